@@ -0,0 +1,509 @@
+/*********************************************************
+ * Copyright (C) 2020 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsCache.c --
+ *
+ *    Implementation of the hgfs LRU cache.
+ *
+ *    Each entry lives both in the hash table, keyed by the local file name,
+ *    and in the LRU list. Lookups move the entry to the front of the list and
+ *    once the cache is full the entry at the back of the list is evicted.
+ *
+ *    Removed entries are collected on a private list while the cache lock is
+ *    held and handed to the LRU callback after the lock has been dropped, so
+ *    that callbacks are free to take other hgfs locks (e.g. the oplock monitor
+ *    lock, which is itself held while HgfsCache_Invalidate is called).
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "vmware.h"
+#include "util.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "mutexRankLib.h"
+#include "hgfsCache.h"
+#include "hgfsServerInt.h"
+
+/* Maximum number of entries kept by one cache. */
+#define HGFS_CACHE_MAX_COUNT     1024
+#define HGFS_CACHE_BUCKETS       1024
+
+typedef struct HgfsCacheEntry {
+   DblLnkLst_Links links;     /* LRU list (or removal list) linkage. */
+   char *key;                 /* Local file name, owned by the entry. */
+   void *data;                /* Caller data, owned by the entry. */
+   VmTimeType expiryMs;       /* Expiry time, 0 means never. */
+} HgfsCacheEntry;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheUnlinkEntry --
+ *
+ *      Remove an entry from the hash table and move it from the LRU list to
+ *      the caller's removal list. The cache lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCacheUnlinkEntry(HgfsCache *cache,              // IN
+                     HgfsCacheEntry *entry,         // IN
+                     DblLnkLst_Links *removedList)  // IN/OUT
+{
+   HashTable_Delete(cache->hashTable, entry->key);
+   DblLnkLst_Unlink1(&entry->links);
+   DblLnkLst_LinkLast(removedList, &entry->links);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheFreeEntries --
+ *
+ *      Free the entries collected on a removal list, invoking the LRU
+ *      callback for each of them first if requested. Must be called
+ *      without the cache lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCacheFreeEntries(HgfsCache *cache,              // IN
+                     DblLnkLst_Links *removedList,  // IN
+                     Bool invokeCallback)           // IN
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, removedList) {
+      HgfsCacheEntry *entry = DblLnkLst_Container(link, HgfsCacheEntry, links);
+
+      DblLnkLst_Unlink1(&entry->links);
+      if (invokeCallback && NULL != cache->callback) {
+         cache->callback(entry->data);
+      }
+      free(entry->data);
+      free(entry->key);
+      free(entry);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheIsUnderPath --
+ *
+ *      Check whether a cache key names the given path or something beneath it.
+ *
+ * Results:
+ *      TRUE if the key is path itself or a descendant of path.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCacheIsUnderPath(const char *key,   // IN
+                     const char *path,  // IN
+                     size_t pathLen)    // IN
+{
+   return strncmp(key, path, pathLen) == 0 &&
+          (key[pathLen] == '\0' || key[pathLen] == DIRSEPC);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Alloc --
+ *
+ *      Create a cache and the corresponding hash table/doubly linked list/lock.
+ *
+ *      If lifetimeMs is not zero entries are only returned for that many
+ *      milliseconds after they were put into the cache. Caches that rely on
+ *      an external change notification (e.g. the oplock monitor) pass zero.
+ *
+ * Results:
+ *      The new cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsCache *
+HgfsCache_Alloc(HgfsCacheRemoveLRUCallback callback, // IN
+                uint32 lifetimeMs)                   // IN
+{
+   HgfsCache *cache = Util_SafeCalloc(1, sizeof *cache);
+
+   cache->hashTable = HashTable_Alloc(HGFS_CACHE_BUCKETS, HASH_STRING_KEY,
+                                      NULL);
+   DblLnkLst_Init(&cache->links);
+   cache->lock = MXUser_CreateExclLock("HgfsCacheLock", RANK_hgfsCacheLock);
+   cache->callback = callback;
+   cache->lifetimeMs = lifetimeMs;
+   return cache;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Destroy --
+ *
+ *      Destroy a cache and the corresponding hash table/doubly linked list/lock.
+ *      The LRU callback is invoked for every entry still in the cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_Destroy(HgfsCache *cache)                    // IN
+{
+   DblLnkLst_Links removedList;
+   DblLnkLst_Links *link, *nextLink;
+
+   if (NULL == cache) {
+      return;
+   }
+
+   DblLnkLst_Init(&removedList);
+   MXUser_AcquireExclLock(cache->lock);
+   DblLnkLst_ForEachSafe(link, nextLink, &cache->links) {
+      HgfsCacheUnlinkEntry(cache,
+                           DblLnkLst_Container(link, HgfsCacheEntry, links),
+                           &removedList);
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removedList, TRUE);
+   HashTable_Free(cache->hashTable);
+   MXUser_DestroyExclLock(cache->lock);
+   free(cache);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Put --
+ *
+ *      Put an entry into a cache. Any previous entry for the key is replaced
+ *      and, if the cache is full, the least recently used entry is evicted.
+ *      The cache takes ownership of data.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The LRU callback is invoked for the replaced/evicted entries.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_Put(HgfsCache *cache,                    // IN
+              const char *key,                     // IN
+              void *data)                          // IN
+{
+   DblLnkLst_Links removedList;
+   HgfsCacheEntry *entry;
+
+   ASSERT(cache);
+   ASSERT(key);
+
+   entry = Util_SafeMalloc(sizeof *entry);
+   DblLnkLst_Init(&entry->links);
+   entry->key = Util_SafeStrdup(key);
+   entry->data = data;
+   entry->expiryMs = cache->lifetimeMs == 0 ?
+                     0 : Hostinfo_SystemTimerMS() + cache->lifetimeMs;
+
+   DblLnkLst_Init(&removedList);
+   MXUser_AcquireExclLock(cache->lock);
+   {
+      HgfsCacheEntry *oldEntry;
+
+      if (HashTable_Lookup(cache->hashTable, key, (void **)&oldEntry)) {
+         HgfsCacheUnlinkEntry(cache, oldEntry, &removedList);
+      }
+   }
+   if (HashTable_GetNumElements(cache->hashTable) >= HGFS_CACHE_MAX_COUNT) {
+      HgfsCacheEntry *lruEntry = DblLnkLst_Container(cache->links.prev,
+                                                     HgfsCacheEntry, links);
+
+      LOG(4, "%s: evicting %s\n", __FUNCTION__, lruEntry->key);
+      HgfsCacheUnlinkEntry(cache, lruEntry, &removedList);
+      cache->stats.evictions++;
+   }
+   HashTable_Insert(cache->hashTable, entry->key, entry);
+   DblLnkLst_LinkFirst(&cache->links, &entry->links);
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removedList, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Get --
+ *
+ *      Get an entry in a cache and mark it as the most recently used one.
+ *
+ *      The first dataSize bytes of the entry data are copied out while the
+ *      cache lock is held, since another thread may replace or remove the
+ *      entry as soon as the lock is dropped.
+ *
+ * Results:
+ *      TRUE if a live entry was found, FALSE otherwise.
+ *
+ * Side effects:
+ *      An expired entry is removed and the LRU callback invoked for it.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_Get(HgfsCache *cache, // IN
+              const char *key,  // IN
+              void *data,       // OUT
+              size_t dataSize)  // IN
+{
+   DblLnkLst_Links removedList;
+   HgfsCacheEntry *entry;
+   Bool found = FALSE;
+
+   ASSERT(cache);
+   ASSERT(key);
+   ASSERT(data);
+
+   DblLnkLst_Init(&removedList);
+   MXUser_AcquireExclLock(cache->lock);
+   if (HashTable_Lookup(cache->hashTable, key, (void **)&entry)) {
+      if (   entry->expiryMs != 0
+          && Hostinfo_SystemTimerMS() >= entry->expiryMs) {
+         HgfsCacheUnlinkEntry(cache, entry, &removedList);
+         cache->stats.expired++;
+      } else {
+         DblLnkLst_Unlink1(&entry->links);
+         DblLnkLst_LinkFirst(&cache->links, &entry->links);
+         memcpy(data, entry->data, dataSize);
+         found = TRUE;
+      }
+   }
+   if (found) {
+      cache->stats.hits++;
+   } else {
+      cache->stats.misses++;
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removedList, TRUE);
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Invalidate --
+ *
+ *      Remove an entry from a cache without invoking the LRU callback.
+ *      This is used when whatever the callback would release is already
+ *      gone, e.g. from the oplock monitor change callback.
+ *
+ * Results:
+ *      TRUE if an entry was removed, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_Invalidate(HgfsCache *cache, // IN
+                     const char *key)  // IN
+{
+   DblLnkLst_Links removedList;
+   HgfsCacheEntry *entry;
+   Bool found;
+
+   ASSERT(cache);
+   ASSERT(key);
+
+   DblLnkLst_Init(&removedList);
+   MXUser_AcquireExclLock(cache->lock);
+   found = HashTable_Lookup(cache->hashTable, key, (void **)&entry);
+   if (found) {
+      HgfsCacheUnlinkEntry(cache, entry, &removedList);
+      cache->stats.invalidations++;
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removedList, FALSE);
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Remove --
+ *
+ *      Remove an entry from a cache and invoke the LRU callback for it.
+ *
+ * Results:
+ *      TRUE if an entry was removed, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_Remove(HgfsCache *cache, // IN
+                 const char *key)  // IN
+{
+   DblLnkLst_Links removedList;
+   HgfsCacheEntry *entry;
+   Bool found;
+
+   ASSERT(cache);
+   ASSERT(key);
+
+   DblLnkLst_Init(&removedList);
+   MXUser_AcquireExclLock(cache->lock);
+   found = HashTable_Lookup(cache->hashTable, key, (void **)&entry);
+   if (found) {
+      HgfsCacheUnlinkEntry(cache, entry, &removedList);
+      cache->stats.invalidations++;
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removedList, TRUE);
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_RemoveTree --
+ *
+ *      Remove the entry for path and the entries for everything beneath it,
+ *      invoking the LRU callback for each of them. Used when a directory is
+ *      renamed or deleted. This walks the whole cache.
+ *
+ * Results:
+ *      The number of entries removed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+HgfsCache_RemoveTree(HgfsCache *cache,  // IN
+                     const char *path)  // IN
+{
+   DblLnkLst_Links removedList;
+   DblLnkLst_Links *link, *nextLink;
+   size_t pathLen;
+   uint32 removed = 0;
+
+   ASSERT(cache);
+   ASSERT(path);
+
+   pathLen = strlen(path);
+   DblLnkLst_Init(&removedList);
+   MXUser_AcquireExclLock(cache->lock);
+   DblLnkLst_ForEachSafe(link, nextLink, &cache->links) {
+      HgfsCacheEntry *entry = DblLnkLst_Container(link, HgfsCacheEntry, links);
+
+      if (HgfsCacheIsUnderPath(entry->key, path, pathLen)) {
+         HgfsCacheUnlinkEntry(cache, entry, &removedList);
+         removed++;
+      }
+   }
+   cache->stats.invalidations += removed;
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removedList, TRUE);
+   return removed;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_GetStats --
+ *
+ *      Return a snapshot of the cache counters.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_GetStats(HgfsCache *cache,       // IN
+                   HgfsCacheStats *stats)  // OUT
+{
+   ASSERT(cache);
+   ASSERT(stats);
+
+   MXUser_AcquireExclLock(cache->lock);
+   *stats = cache->stats;
+   MXUser_ReleaseExclLock(cache->lock);
+}
@@ -21,27 +21,48 @@
  *
  *    A customized LRU cache which is built by combining two data structures:
  *    a doubly linked list and a hash table.
+ *
+ *    The cache owns the data stored in it and frees it when the entry is
+ *    removed. The LRU callback is invoked (without the cache lock held) for
+ *    entries that are evicted, expired, removed or destroyed, but not for
+ *    entries dropped through HgfsCache_Invalidate.
  */
 
 #ifndef _HGFS_CACHE_H_
 #define _HGFS_CACHE_H_
 
+#include "vm_basic_types.h"
 #include "dbllnklst.h"
 #include "userlock.h"
 
 typedef void(*HgfsCacheRemoveLRUCallback)(void *data);
 
+typedef struct HgfsCacheStats {
+   uint64 hits;          /* Lookups that found a live entry. */
+   uint64 misses;        /* Lookups that found nothing or an expired entry. */
+   uint64 expired;       /* Entries dropped because their lifetime ran out. */
+   uint64 evictions;     /* Entries dropped to make room for new ones. */
+   uint64 invalidations; /* Entries dropped by Invalidate/Remove/RemoveTree. */
+} HgfsCacheStats;
+
 typedef struct HgfsCache {
    void *hashTable;
-   DblLnkLst_Links links;
+   DblLnkLst_Links links;             /* LRU list, most recently used first. */
    MXUserExclLock *lock;
    HgfsCacheRemoveLRUCallback callback;
+   uint32 lifetimeMs;                 /* Entry lifetime, 0 means unbounded. */
+   HgfsCacheStats stats;
 } HgfsCache;
 
-HgfsCache *HgfsCache_Alloc(HgfsCacheRemoveLRUCallback callback);
+HgfsCache *HgfsCache_Alloc(HgfsCacheRemoveLRUCallback callback,
+                           uint32 lifetimeMs);
 void HgfsCache_Destroy(HgfsCache *cache);
 void HgfsCache_Put(HgfsCache *cache, const char *key, void *data);
-Bool HgfsCache_Get(HgfsCache *cache, const char *key, void **data);
+Bool HgfsCache_Get(HgfsCache *cache, const char *key, void *data,
+                   size_t dataSize);
 Bool HgfsCache_Invalidate(HgfsCache *cache, const char *key);
+Bool HgfsCache_Remove(HgfsCache *cache, const char *key);
+uint32 HgfsCache_RemoveTree(HgfsCache *cache, const char *path);
+void HgfsCache_GetStats(HgfsCache *cache, HgfsCacheStats *stats);
 
 #endif // ifndef _HGFS_CACHE_H_
@@ -0,0 +1,1818 @@
+/*********************************************************
+ * Copyright (C) 2020 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *	Directory change notification for the HGFS server on Linux, built on
+ *	inotify.
+ *
+ *	Every subscriber owns a set of inotify watches: the watched directory
+ *	and, for recursive subscribers, every directory beneath it. Watches are
+ *	shared between subscribers since inotify hands out one watch descriptor
+ *	per inode. Shares may overlap, so a watch keeps the directory's path and
+ *	the subscribers holding it separately for every share it was added
+ *	through. Recursive subscribers follow directories being created, moved
+ *	in and moved out of the tree.
+ *
+ *	Events are not delivered straight from the inotify read. They are queued
+ *	for HGFS_NOTIFY_COALESCE_MS so that bursts of content changes on the
+ *	same name (e.g. a file being written in many small chunks) collapse into
+ *	a single notification. Namespace events (create, delete, rename) are
+ *	never merged so that their order is preserved. When a subscriber falls
+ *	too far behind, or the kernel queue overflows, its pending events are
+ *	replaced by a single HGFS_NOTIFY_EVENTS_DROPPED notification which tells
+ *	the client to rescan.
+ *
+ *	A single thread reads the inotify descriptor and delivers the events.
+ *	Delivery happens with only the delivery lock held, which is what lets
+ *	subscriber removal wait for any callback that may still be using the
+ *	subscriber's session.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "util.h"
+#include "str.h"
+#include "err.h"
+#include "dbllnklst.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsUtil.h"
+#include "hgfsDirNotify.h"
+#include "hgfsServerInt.h"
+
+/* How long events are held back so that bursts can be coalesced. */
+#define HGFS_NOTIFY_COALESCE_MS          50
+
+/*
+ * Maximum number of undelivered events per subscriber. Past this the
+ * subscriber gets a single "events dropped" notification instead.
+ */
+#define HGFS_NOTIFY_MAX_PENDING          256
+
+#define HGFS_NOTIFY_WATCH_BUCKETS        1024
+
+#define HGFS_NOTIFY_READ_BUFFER_SIZE     (64 * 1024)
+
+/* Events always watched for, needed to keep recursive watches up to date. */
+#define HGFS_NOTIFY_INOTIFY_BASE_MASK \
+   (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+    IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* HGFS events that describe a change of the directory contents. */
+#define HGFS_NOTIFY_NAMESPACE_EVENTS \
+   (HGFS_NOTIFY_CREATE_FILE | HGFS_NOTIFY_CREATE_DIR | \
+    HGFS_NOTIFY_DELETE_FILE | HGFS_NOTIFY_DELETE_DIR | \
+    HGFS_NOTIFY_OLD_FILE_NAME | HGFS_NOTIFY_NEW_FILE_NAME | \
+    HGFS_NOTIFY_OLD_DIR_NAME | HGFS_NOTIFY_NEW_DIR_NAME | \
+    HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_MOVE_SELF | \
+    HGFS_NOTIFY_WATCH_DELETED | HGFS_NOTIFY_EVENTS_DROPPED)
+
+#define WATCH_KEY(_wd)   ((const void *)(uintptr_t)(_wd))
+
+typedef struct HgfsNotifyShare {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle handle;
+   char *path;                  /* Local path of the share root. */
+   char *shareName;
+} HgfsNotifyShare;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;
+   HgfsSubscriberHandle handle;
+   HgfsSharedFolderHandle sharedFolder;
+   char *relPath;               /* Watched directory, relative to the share. */
+   uint32 eventFilter;          /* HGFS_NOTIFY_* events to report. */
+   Bool recursive;
+   struct HgfsSessionInfo *session;
+   int *wds;                    /* Watches held by this subscriber. */
+   uint32 numWds;
+   uint32 maxWds;
+   uint32 numPending;           /* Events queued for delivery. */
+   Bool overflowed;             /* An "events dropped" event is queued. */
+} HgfsNotifySubscriber;
+
+/* A watched directory as seen through one share. */
+typedef struct HgfsNotifyWatchShare {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle sharedFolder;
+   char *relPath;               /* Relative to the share root, "" for the root. */
+   HgfsNotifySubscriber **subscribers; /* Subscribers of the share holding it. */
+   uint32 numSubscribers;
+   uint32 maxSubscribers;
+} HgfsNotifyWatchShare;
+
+typedef struct HgfsNotifyWatch {
+   int wd;
+   DblLnkLst_Links shares;      /* HgfsNotifyWatchShare list. */
+} HgfsNotifyWatch;
+
+typedef struct HgfsNotifyEvent {
+   DblLnkLst_Links links;
+   HgfsNotifySubscriber *subscriber;
+   char *name;                  /* Relative to the share, NULL for overflow. */
+   uint32 mask;
+   VmTimeType dueMs;            /* When the event should be delivered. */
+} HgfsNotifyEvent;
+
+/* An event that has been taken off the queue for delivery. */
+typedef struct HgfsNotifyDelivery {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle sharedFolder;
+   HgfsSubscriberHandle subscriber;
+   struct HgfsSessionInfo *session;
+   char *name;
+   uint32 mask;
+} HgfsNotifyDelivery;
+
+typedef struct HgfsNotifyState {
+   MXUserExclLock *lock;          /* Protects all of the fields below. */
+   MXUserExclLock *deliveryLock;  /* Held while callbacks are invoked. */
+   HgfsServerNotifyCallbacks serverCb;
+   DblLnkLst_Links shares;
+   DblLnkLst_Links subscribers;
+   DblLnkLst_Links pendingEvents; /* Ordered by dueMs. */
+   HashTable *watches;            /* wd -> HgfsNotifyWatch. */
+   HgfsSharedFolderHandle nextShareHandle;
+   HgfsSubscriberHandle nextSubscriberHandle;
+   int inotifyFd;
+   int wakeupPipe[2];
+   pthread_t thread;
+   Bool threadStarted;
+   Bool exiting;
+   Bool suspended;                /* Delivery held back for a server sync. */
+} HgfsNotifyState;
+
+static Bool gHgfsNotifyInited = FALSE;
+static HgfsNotifyState gHgfsNotify;
+
+static void HgfsNotifyAddTree(HgfsNotifySubscriber *subscriber,
+                              HgfsNotifyShare *share,
+                              const char *relPath);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyJoinPath --
+ *
+ *      Join two path components, either of which may be empty.
+ *
+ * Results:
+ *      The allocated path.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyJoinPath(const char *dir,   // IN
+                   const char *name)  // IN
+{
+   if (*dir == '\0') {
+      return Util_SafeStrdup(name);
+   }
+   if (*name == '\0') {
+      return Util_SafeStrdup(dir);
+   }
+   return Str_SafeAsprintf(NULL, "%s%s%s", dir,
+                           dir[strlen(dir) - 1] == DIRSEPC ? "" : DIRSEPS,
+                           name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyIsUnderPath --
+ *
+ *      Check whether a share relative path is dir itself or lies beneath it.
+ *
+ * Results:
+ *      TRUE if path is dir or a descendant of dir.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyIsUnderPath(const char *path,  // IN
+                      const char *dir)   // IN
+{
+   size_t dirLen = strlen(dir);
+
+   if (dirLen == 0) {
+      return TRUE;
+   }
+   return strncmp(path, dir, dirLen) == 0 &&
+          (path[dirLen] == '\0' || path[dirLen] == DIRSEPC);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindShare --
+ *
+ *      Find a shared folder by handle. The state lock must be held.
+ *
+ * Results:
+ *      The share or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyShare *
+HgfsNotifyFindShare(HgfsSharedFolderHandle handle)  // IN
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &gHgfsNotify.shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      if (share->handle == handle) {
+         return share;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFilterToInotify --
+ *
+ *      Convert an HGFS event filter into the inotify events to watch for.
+ *
+ * Results:
+ *      The inotify event mask.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyFilterToInotify(uint32 eventFilter)  // IN
+{
+   uint32 mask = HGFS_NOTIFY_INOTIFY_BASE_MASK;
+
+   if (eventFilter & (HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATIME)) {
+      mask |= IN_ACCESS;
+   }
+   if (eventFilter & (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME |
+                      HGFS_NOTIFY_CHANGE_EA | HGFS_NOTIFY_CHANGE_SECURITY)) {
+      mask |= IN_ATTRIB;
+   }
+   if (eventFilter & (HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME |
+                      HGFS_NOTIFY_MODIFY)) {
+      mask |= IN_MODIFY;
+   }
+   if (eventFilter & HGFS_NOTIFY_OPEN) {
+      mask |= IN_OPEN;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_WRITE) {
+      mask |= IN_CLOSE_WRITE;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_NOWRITE) {
+      mask |= IN_CLOSE_NOWRITE;
+   }
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyInotifyToHgfs --
+ *
+ *      Convert an inotify event mask into HGFS events.
+ *
+ * Results:
+ *      The HGFS event mask.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyInotifyToHgfs(uint32 inotifyMask)  // IN
+{
+   Bool isDir = (inotifyMask & IN_ISDIR) != 0;
+   uint32 mask = 0;
+
+   if (isDir) {
+      /*
+       * Directory reads, including the ones done here to set up recursive
+       * watches, are not interesting and would only flood the subscribers.
+       */
+      inotifyMask &= ~(IN_ACCESS | IN_OPEN | IN_CLOSE_NOWRITE);
+   }
+   if (inotifyMask & IN_ACCESS) {
+      mask |= HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATIME;
+   }
+   if (inotifyMask & IN_ATTRIB) {
+      mask |= HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME |
+              HGFS_NOTIFY_CHANGE_SECURITY;
+   }
+   if (inotifyMask & IN_MODIFY) {
+      mask |= HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME;
+   }
+   if (inotifyMask & IN_OPEN) {
+      mask |= HGFS_NOTIFY_OPEN;
+   }
+   if (inotifyMask & IN_CLOSE_WRITE) {
+      mask |= HGFS_NOTIFY_CLOSE_WRITE;
+   }
+   if (inotifyMask & IN_CLOSE_NOWRITE) {
+      mask |= HGFS_NOTIFY_CLOSE_NOWRITE;
+   }
+   if (inotifyMask & IN_CREATE) {
+      mask |= isDir ? HGFS_NOTIFY_CREATE_DIR : HGFS_NOTIFY_CREATE_FILE;
+   }
+   if (inotifyMask & IN_DELETE) {
+      mask |= isDir ? HGFS_NOTIFY_DELETE_DIR : HGFS_NOTIFY_DELETE_FILE;
+   }
+   if (inotifyMask & IN_MOVED_FROM) {
+      mask |= isDir ? HGFS_NOTIFY_OLD_DIR_NAME : HGFS_NOTIFY_OLD_FILE_NAME;
+   }
+   if (inotifyMask & IN_MOVED_TO) {
+      mask |= isDir ? HGFS_NOTIFY_NEW_DIR_NAME : HGFS_NOTIFY_NEW_FILE_NAME;
+   }
+   if (inotifyMask & IN_DELETE_SELF) {
+      mask |= HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED;
+   }
+   if (inotifyMask & IN_MOVE_SELF) {
+      mask |= HGFS_NOTIFY_MOVE_SELF;
+   }
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWakeThread --
+ *
+ *      Wake up the notification thread so it re-evaluates its state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyWakeThread(void)
+{
+   char c = 0;
+
+   if (write(gHgfsNotify.wakeupPipe[1], &c, sizeof c) < 0 && errno != EAGAIN) {
+      LOG(4, "%s: failed to wake up the thread: %s\n", __FUNCTION__,
+          Err_Errno2String(errno));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindWatchShare --
+ *
+ *      Find the part of a watch that belongs to a shared folder. The state
+ *      lock must be held.
+ *
+ * Results:
+ *      The watch share or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyWatchShare *
+HgfsNotifyFindWatchShare(HgfsNotifyWatch *watch,               // IN
+                         HgfsSharedFolderHandle sharedFolder)  // IN
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &watch->shares) {
+      HgfsNotifyWatchShare *watchShare =
+         DblLnkLst_Container(link, HgfsNotifyWatchShare, links);
+
+      if (watchShare->sharedFolder == sharedFolder) {
+         return watchShare;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeWatchShare --
+ *
+ *      Unlink and free the part of a watch that belongs to a shared folder.
+ *      The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeWatchShare(HgfsNotifyWatchShare *watchShare)  // IN
+{
+   DblLnkLst_Unlink1(&watchShare->links);
+   free(watchShare->subscribers);
+   free(watchShare->relPath);
+   free(watchShare);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeWatch --
+ *
+ *      Remove a watch from the watch table and free it. The inotify watch is
+ *      left alone. The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeWatch(HgfsNotifyWatch *watch)  // IN
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, &watch->shares) {
+      HgfsNotifyFreeWatchShare(DblLnkLst_Container(link, HgfsNotifyWatchShare,
+                                                   links));
+   }
+   HashTable_Delete(gHgfsNotify.watches, WATCH_KEY(watch->wd));
+   free(watch);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAcquireWatch --
+ *
+ *      Add an inotify watch on behalf of a subscriber, sharing the watch
+ *      with other subscribers of the same directory, through the same or
+ *      another share. The state lock must be held.
+ *
+ * Results:
+ *      TRUE if the subscriber holds the watch on return.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAcquireWatch(HgfsNotifySubscriber *subscriber, // IN/OUT
+                       HgfsNotifyShare *share,           // IN
+                       const char *relPath)              // IN
+{
+   HgfsNotifyWatch *watch;
+   HgfsNotifyWatchShare *watchShare;
+   char *fullPath;
+   uint32 i;
+   int wd;
+
+   fullPath = HgfsNotifyJoinPath(share->path, relPath);
+   wd = inotify_add_watch(gHgfsNotify.inotifyFd, fullPath,
+                          HgfsNotifyFilterToInotify(subscriber->eventFilter) |
+                          IN_ONLYDIR | IN_DONT_FOLLOW | IN_MASK_ADD);
+   if (wd < 0) {
+      int error = errno;
+
+      LOG(4, "%s: failed to watch \"%s\": %s\n", __FUNCTION__, fullPath,
+          Err_Errno2String(error));
+      if (ENOSPC == error) {
+         Log("%s: out of inotify watches, fs.inotify.max_user_watches "
+             "may need to be raised\n", __FUNCTION__);
+      }
+      free(fullPath);
+      return FALSE;
+   }
+   free(fullPath);
+
+   for (i = 0; i < subscriber->numWds; i++) {
+      if (subscriber->wds[i] == wd) {
+         return TRUE;
+      }
+   }
+
+   if (!HashTable_Lookup(gHgfsNotify.watches, WATCH_KEY(wd), (void **)&watch)) {
+      watch = Util_SafeMalloc(sizeof *watch);
+      watch->wd = wd;
+      DblLnkLst_Init(&watch->shares);
+      HashTable_Insert(gHgfsNotify.watches, WATCH_KEY(wd), watch);
+   }
+
+   watchShare = HgfsNotifyFindWatchShare(watch, share->handle);
+   if (NULL == watchShare) {
+      watchShare = Util_SafeCalloc(1, sizeof *watchShare);
+      DblLnkLst_Init(&watchShare->links);
+      watchShare->sharedFolder = share->handle;
+      watchShare->relPath = Util_SafeStrdup(relPath);
+      DblLnkLst_LinkLast(&watch->shares, &watchShare->links);
+   } else if (strcmp(watchShare->relPath, relPath) != 0) {
+      /* The directory has been moved since the watch was added. */
+      free(watchShare->relPath);
+      watchShare->relPath = Util_SafeStrdup(relPath);
+   }
+
+   if (watchShare->numSubscribers == watchShare->maxSubscribers) {
+      watchShare->maxSubscribers = watchShare->maxSubscribers == 0 ?
+                                   4 : watchShare->maxSubscribers * 2;
+      watchShare->subscribers =
+         Util_SafeRealloc(watchShare->subscribers,
+                          watchShare->maxSubscribers *
+                          sizeof *watchShare->subscribers);
+   }
+   watchShare->subscribers[watchShare->numSubscribers++] = subscriber;
+
+   if (subscriber->numWds == subscriber->maxWds) {
+      subscriber->maxWds = subscriber->maxWds == 0 ? 8 : subscriber->maxWds * 2;
+      subscriber->wds = Util_SafeRealloc(subscriber->wds,
+                                         subscriber->maxWds *
+                                         sizeof *subscriber->wds);
+   }
+   subscriber->wds[subscriber->numWds++] = wd;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyForgetWatch --
+ *
+ *      Remove a watch from the watch table, and from every subscriber still
+ *      holding it. Used once the kernel has dropped the watch. The state lock
+ *      must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyForgetWatch(int wd)  // IN
+{
+   HgfsNotifyWatch *watch;
+   DblLnkLst_Links *link;
+
+   if (!HashTable_Lookup(gHgfsNotify.watches, WATCH_KEY(wd), (void **)&watch)) {
+      return;
+   }
+
+   DblLnkLst_ForEach(link, &watch->shares) {
+      HgfsNotifyWatchShare *watchShare =
+         DblLnkLst_Container(link, HgfsNotifyWatchShare, links);
+      uint32 j;
+
+      for (j = 0; j < watchShare->numSubscribers; j++) {
+         HgfsNotifySubscriber *subscriber = watchShare->subscribers[j];
+         uint32 i;
+
+         for (i = 0; i < subscriber->numWds; i++) {
+            if (subscriber->wds[i] == wd) {
+               subscriber->wds[i] = subscriber->wds[--subscriber->numWds];
+               break;
+            }
+         }
+      }
+   }
+
+   HgfsNotifyFreeWatch(watch);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReleaseWatch --
+ *
+ *      Drop a subscriber's hold on a watch, removing the inotify watch when
+ *      no subscriber of any share uses it. The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyReleaseWatch(HgfsNotifySubscriber *subscriber, // IN/OUT
+                       uint32 index)                     // IN: into wds
+{
+   HgfsNotifyWatch *watch;
+   HgfsNotifyWatchShare *watchShare;
+   int wd = subscriber->wds[index];
+   uint32 i;
+
+   subscriber->wds[index] = subscriber->wds[--subscriber->numWds];
+
+   if (!HashTable_Lookup(gHgfsNotify.watches, WATCH_KEY(wd), (void **)&watch)) {
+      return;
+   }
+
+   watchShare = HgfsNotifyFindWatchShare(watch, subscriber->sharedFolder);
+   if (NULL != watchShare) {
+      for (i = 0; i < watchShare->numSubscribers; i++) {
+         if (watchShare->subscribers[i] == subscriber) {
+            watchShare->subscribers[i] =
+               watchShare->subscribers[--watchShare->numSubscribers];
+            break;
+         }
+      }
+      if (0 == watchShare->numSubscribers) {
+         HgfsNotifyFreeWatchShare(watchShare);
+      }
+   }
+
+   if (!DblLnkLst_IsLinked(&watch->shares)) {
+      inotify_rm_watch(gHgfsNotify.inotifyFd, wd);
+      HgfsNotifyFreeWatch(watch);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReleaseTree --
+ *
+ *      Drop a subscriber's watches on a directory and everything beneath it.
+ *      The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyReleaseTree(HgfsNotifySubscriber *subscriber, // IN/OUT
+                      const char *relPath)              // IN
+{
+   uint32 i = 0;
+
+   while (i < subscriber->numWds) {
+      HgfsNotifyWatch *watch;
+      HgfsNotifyWatchShare *watchShare = NULL;
+
+      if (HashTable_Lookup(gHgfsNotify.watches,
+                           WATCH_KEY(subscriber->wds[i]), (void **)&watch)) {
+         watchShare = HgfsNotifyFindWatchShare(watch, subscriber->sharedFolder);
+      }
+      if (NULL != watchShare &&
+          HgfsNotifyIsUnderPath(watchShare->relPath, relPath)) {
+         /* The last watch is moved into slot i, so look at it next. */
+         HgfsNotifyReleaseWatch(subscriber, i);
+      } else {
+         i++;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddTree --
+ *
+ *      Watch a directory for a subscriber and, for recursive subscribers,
+ *      every directory beneath it. Symbolic links are not followed. The
+ *      state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyAddTree(HgfsNotifySubscriber *subscriber, // IN/OUT
+                  HgfsNotifyShare *share,           // IN
+                  const char *relPath)              // IN
+{
+   char *fullPath;
+   DIR *dir;
+   struct dirent *entry;
+
+   if (!HgfsNotifyAcquireWatch(subscriber, share, relPath) ||
+       !subscriber->recursive) {
+      return;
+   }
+
+   fullPath = HgfsNotifyJoinPath(share->path, relPath);
+   dir = opendir(fullPath);
+   if (NULL == dir) {
+      LOG(4, "%s: failed to open \"%s\": %s\n", __FUNCTION__, fullPath,
+          Err_Errno2String(errno));
+      free(fullPath);
+      return;
+   }
+
+   while ((entry = readdir(dir)) != NULL) {
+      Bool isDir;
+
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+
+      if (DT_UNKNOWN == entry->d_type) {
+         struct stat st;
+         char *childPath = HgfsNotifyJoinPath(fullPath, entry->d_name);
+
+         isDir = lstat(childPath, &st) == 0 && S_ISDIR(st.st_mode);
+         free(childPath);
+      } else {
+         isDir = DT_DIR == entry->d_type;
+      }
+
+      if (isDir) {
+         char *childRelPath = HgfsNotifyJoinPath(relPath, entry->d_name);
+
+         HgfsNotifyAddTree(subscriber, share, childRelPath);
+         free(childRelPath);
+      }
+   }
+   closedir(dir);
+   free(fullPath);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeEvent --
+ *
+ *      Free a queued event. The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeEvent(HgfsNotifyEvent *event)  // IN
+{
+   DblLnkLst_Unlink1(&event->links);
+   event->subscriber->numPending--;
+   free(event->name);
+   free(event);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyPurgeEvents --
+ *
+ *      Drop all the queued events of a subscriber. The state lock must be
+ *      held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyPurgeEvents(HgfsNotifySubscriber *subscriber)  // IN
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNotify.pendingEvents) {
+      HgfsNotifyEvent *event = DblLnkLst_Container(link, HgfsNotifyEvent, links);
+
+      if (event->subscriber == subscriber) {
+         HgfsNotifyFreeEvent(event);
+      }
+   }
+   ASSERT(subscriber->numPending == 0);
+   subscriber->overflowed = FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueEvent --
+ *
+ *      Queue an event for a subscriber.
+ *
+ *      Content changes are merged into an event already queued for the same
+ *      name. Namespace events always get an event of their own. When the
+ *      subscriber has too many queued events they are all replaced with one
+ *      HGFS_NOTIFY_EVENTS_DROPPED event. The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueEvent(HgfsNotifySubscriber *subscriber, // IN/OUT
+                     const char *name,                 // IN: NULL for overflow
+                     uint32 mask)                      // IN
+{
+   HgfsNotifyEvent *event;
+
+   if (subscriber->overflowed) {
+      /* The client is going to rescan anyway. */
+      return;
+   }
+
+   if (NULL != name && 0 == (mask & HGFS_NOTIFY_NAMESPACE_EVENTS)) {
+      DblLnkLst_Links *link;
+
+      for (link = gHgfsNotify.pendingEvents.prev;
+           link != &gHgfsNotify.pendingEvents;
+           link = link->prev) {
+         event = DblLnkLst_Container(link, HgfsNotifyEvent, links);
+         if (event->subscriber == subscriber &&
+             NULL != event->name && strcmp(event->name, name) == 0) {
+            event->mask |= mask;
+            return;
+         }
+      }
+   }
+
+   if (NULL == name || subscriber->numPending >= HGFS_NOTIFY_MAX_PENDING) {
+      LOG(4, "%s: subscriber %"FMT64"x overflowed\n", __FUNCTION__,
+          subscriber->handle);
+      HgfsNotifyPurgeEvents(subscriber);
+      subscriber->overflowed = TRUE;
+      name = NULL;
+      mask = HGFS_NOTIFY_EVENTS_DROPPED;
+   }
+
+   event = Util_SafeMalloc(sizeof *event);
+   DblLnkLst_Init(&event->links);
+   event->subscriber = subscriber;
+   event->name = NULL == name ? NULL : Util_SafeStrdup(name);
+   event->mask = mask;
+   event->dueMs = Hostinfo_SystemTimerMS() + HGFS_NOTIFY_COALESCE_MS;
+   DblLnkLst_LinkLast(&gHgfsNotify.pendingEvents, &event->links);
+   subscriber->numPending++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDispatchEvent --
+ *
+ *      Dispatch one inotify event to the subscribers of one share holding
+ *      the watch, and keep their recursive watches up to date. The state
+ *      lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDispatchEvent(const struct inotify_event *ievent,      // IN
+                        const HgfsNotifyWatchShare *watchShare)  // IN: a copy
+{
+   HgfsNotifyShare *share;
+   const char *watchPath = watchShare->relPath;
+   char *name;
+   uint32 mask;
+   uint32 i;
+   Bool isSelfEvent;
+
+   share = HgfsNotifyFindShare(watchShare->sharedFolder);
+   if (NULL == share) {
+      return;
+   }
+
+   isSelfEvent = ievent->len == 0 || ievent->name[0] == '\0';
+   name = isSelfEvent ? Util_SafeStrdup(watchPath) :
+                        HgfsNotifyJoinPath(watchPath, ievent->name);
+   mask = HgfsNotifyInotifyToHgfs(ievent->mask);
+
+   for (i = 0; i < watchShare->numSubscribers; i++) {
+      HgfsNotifySubscriber *subscriber = watchShare->subscribers[i];
+      uint32 subscriberMask;
+
+      if (isSelfEvent) {
+         /*
+          * Only report self events for the directory the subscriber asked for,
+          * changes to its subdirectories are reported by their parents.
+          */
+         if (strcmp(watchPath, subscriber->relPath) != 0) {
+            continue;
+         }
+      } else if (strcmp(watchPath, subscriber->relPath) != 0 &&
+                 !(subscriber->recursive &&
+                   HgfsNotifyIsUnderPath(watchPath, subscriber->relPath))) {
+         continue;
+      }
+
+      if (subscriber->recursive && !isSelfEvent &&
+          0 != (ievent->mask & IN_ISDIR)) {
+         if (ievent->mask & (IN_CREATE | IN_MOVED_TO)) {
+            HgfsNotifyAddTree(subscriber, share, name);
+         } else if (ievent->mask & IN_MOVED_FROM) {
+            HgfsNotifyReleaseTree(subscriber, name);
+         }
+      }
+
+      subscriberMask = mask & subscriber->eventFilter;
+      if (0 != subscriberMask) {
+         HgfsNotifyQueueEvent(subscriber, name, subscriberMask);
+      }
+   }
+
+   free(name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyProcessEvent --
+ *
+ *      Dispatch one inotify event to the interested subscribers of every
+ *      share the watched directory is in. The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyProcessEvent(const struct inotify_event *ievent)  // IN
+{
+   HgfsNotifyWatch *watch;
+   HgfsNotifyWatchShare *copies;
+   DblLnkLst_Links *link;
+   uint32 numCopies = 0;
+   uint32 i;
+
+   if (ievent->mask & IN_Q_OVERFLOW) {
+      Log("%s: inotify queue overflow\n", __FUNCTION__);
+      DblLnkLst_ForEach(link, &gHgfsNotify.subscribers) {
+         HgfsNotifyQueueEvent(DblLnkLst_Container(link, HgfsNotifySubscriber,
+                                                  links),
+                              NULL, HGFS_NOTIFY_EVENTS_DROPPED);
+      }
+      return;
+   }
+
+   if (ievent->mask & IN_IGNORED) {
+      /* The kernel dropped the watch (directory deleted or unmounted). */
+      HgfsNotifyForgetWatch(ievent->wd);
+      return;
+   }
+
+   if (!HashTable_Lookup(gHgfsNotify.watches, WATCH_KEY(ievent->wd),
+                         (void **)&watch)) {
+      /* An event for a watch we have already released. */
+      return;
+   }
+
+   /*
+    * Copy the per share paths and subscribers, the watch may change or go
+    * away while updating the recursive watches.
+    */
+   DblLnkLst_ForEach(link, &watch->shares) {
+      numCopies++;
+   }
+   copies = Util_SafeCalloc(numCopies, sizeof *copies);
+   i = 0;
+   DblLnkLst_ForEach(link, &watch->shares) {
+      HgfsNotifyWatchShare *watchShare =
+         DblLnkLst_Container(link, HgfsNotifyWatchShare, links);
+
+      copies[i].sharedFolder = watchShare->sharedFolder;
+      copies[i].relPath = Util_SafeStrdup(watchShare->relPath);
+      copies[i].numSubscribers = watchShare->numSubscribers;
+      copies[i].subscribers =
+         Util_SafeMalloc(watchShare->numSubscribers *
+                         sizeof *watchShare->subscribers);
+      memcpy(copies[i].subscribers, watchShare->subscribers,
+             watchShare->numSubscribers * sizeof *watchShare->subscribers);
+      i++;
+   }
+
+   for (i = 0; i < numCopies; i++) {
+      HgfsNotifyDispatchEvent(ievent, &copies[i]);
+      free(copies[i].subscribers);
+      free(copies[i].relPath);
+   }
+   free(copies);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReadEvents --
+ *
+ *      Read and process everything available on the inotify descriptor.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyReadEvents(char *buffer)  // IN: HGFS_NOTIFY_READ_BUFFER_SIZE bytes
+{
+   for (;;) {
+      ssize_t bytes = read(gHgfsNotify.inotifyFd, buffer,
+                           HGFS_NOTIFY_READ_BUFFER_SIZE);
+      char *p;
+
+      if (bytes <= 0) {
+         if (bytes < 0 && errno != EAGAIN && errno != EINTR) {
+            LOG(4, "%s: read failed: %s\n", __FUNCTION__,
+                Err_Errno2String(errno));
+         }
+         break;
+      }
+
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      for (p = buffer; p < buffer + bytes; ) {
+         const struct inotify_event *ievent = (const struct inotify_event *)p;
+
+         HgfsNotifyProcessEvent(ievent);
+         p += sizeof *ievent + ievent->len;
+      }
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDeliverEvents --
+ *
+ *      Deliver the queued events that are due, unless delivery is suspended.
+ *
+ * Results:
+ *      The poll timeout until the next event is due, -1 if there is none.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsNotifyDeliverEvents(void)
+{
+   DblLnkLst_Links deliveries;
+   DblLnkLst_Links *link, *nextLink;
+   int timeout = -1;
+
+   DblLnkLst_Init(&deliveries);
+
+   MXUser_AcquireExclLock(gHgfsNotify.deliveryLock);
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   if (!gHgfsNotify.suspended) {
+      VmTimeType now = Hostinfo_SystemTimerMS();
+
+      DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNotify.pendingEvents) {
+         HgfsNotifyEvent *event = DblLnkLst_Container(link, HgfsNotifyEvent,
+                                                      links);
+         HgfsNotifySubscriber *subscriber = event->subscriber;
+         HgfsNotifyDelivery *delivery;
+
+         if (event->dueMs > now) {
+            timeout = (int)(event->dueMs - now);
+            break;
+         }
+
+         delivery = Util_SafeMalloc(sizeof *delivery);
+         DblLnkLst_Init(&delivery->links);
+         delivery->sharedFolder = subscriber->sharedFolder;
+         delivery->subscriber = subscriber->handle;
+         delivery->session = subscriber->session;
+         delivery->name = event->name;
+         delivery->mask = event->mask;
+         DblLnkLst_LinkLast(&deliveries, &delivery->links);
+
+         if (event->mask & HGFS_NOTIFY_EVENTS_DROPPED) {
+            subscriber->overflowed = FALSE;
+         }
+         event->name = NULL;
+         HgfsNotifyFreeEvent(event);
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &deliveries) {
+      HgfsNotifyDelivery *delivery = DblLnkLst_Container(link,
+                                                         HgfsNotifyDelivery,
+                                                         links);
+
+      gHgfsNotify.serverCb.eventReceive(delivery->sharedFolder,
+                                        delivery->subscriber,
+                                        delivery->name,
+                                        delivery->mask,
+                                        delivery->session);
+      DblLnkLst_Unlink1(&delivery->links);
+      free(delivery->name);
+      free(delivery);
+   }
+   MXUser_ReleaseExclLock(gHgfsNotify.deliveryLock);
+
+   return timeout;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyThreadMain --
+ *
+ *      Notification thread: waits for inotify events and delivers them.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsNotifyThreadMain(void *unused)  // IN: unused
+{
+   char *buffer = Util_SafeMalloc(HGFS_NOTIFY_READ_BUFFER_SIZE);
+   int timeout = -1;
+
+   for (;;) {
+      struct pollfd fds[2];
+      Bool exiting;
+
+      MXUser_AcquireExclLock(gHgfsNotify.lock);
+      exiting = gHgfsNotify.exiting;
+      MXUser_ReleaseExclLock(gHgfsNotify.lock);
+      if (exiting) {
+         break;
+      }
+
+      fds[0].fd = gHgfsNotify.inotifyFd;
+      fds[0].events = POLLIN;
+      fds[0].revents = 0;
+      fds[1].fd = gHgfsNotify.wakeupPipe[0];
+      fds[1].events = POLLIN;
+      fds[1].revents = 0;
+
+      if (poll(fds, ARRAYSIZE(fds), timeout) < 0 && errno != EINTR) {
+         Log("%s: poll failed: %s\n", __FUNCTION__, Err_Errno2String(errno));
+         break;
+      }
+
+      if (fds[1].revents & POLLIN) {
+         char drain[64];
+
+         while (read(gHgfsNotify.wakeupPipe[0], drain, sizeof drain) > 0) {
+         }
+      }
+      if (fds[0].revents & POLLIN) {
+         HgfsNotifyReadEvents(buffer);
+      }
+      timeout = HgfsNotifyDeliverEvents();
+   }
+
+   free(buffer);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyStartThread --
+ *
+ *      Create the inotify instance and start the notification thread, if
+ *      not done already. The state lock must be held.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyStartThread(void)
+{
+   unsigned int i;
+   int error;
+
+   if (gHgfsNotify.threadStarted) {
+      return TRUE;
+   }
+
+   gHgfsNotify.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (gHgfsNotify.inotifyFd < 0) {
+      Log("%s: inotify_init1 failed: %s\n", __FUNCTION__,
+          Err_Errno2String(errno));
+      return FALSE;
+   }
+
+   if (pipe(gHgfsNotify.wakeupPipe) < 0) {
+      Log("%s: pipe failed: %s\n", __FUNCTION__, Err_Errno2String(errno));
+      goto error;
+   }
+   for (i = 0; i < ARRAYSIZE(gHgfsNotify.wakeupPipe); i++) {
+      fcntl(gHgfsNotify.wakeupPipe[i], F_SETFL, O_NONBLOCK);
+      fcntl(gHgfsNotify.wakeupPipe[i], F_SETFD, FD_CLOEXEC);
+   }
+
+   error = pthread_create(&gHgfsNotify.thread, NULL, HgfsNotifyThreadMain,
+                          NULL);
+   if (0 != error) {
+      Log("%s: failed to create the notification thread: %s\n", __FUNCTION__,
+          Err_Errno2String(error));
+      close(gHgfsNotify.wakeupPipe[0]);
+      close(gHgfsNotify.wakeupPipe[1]);
+      goto error;
+   }
+
+   gHgfsNotify.threadStarted = TRUE;
+   return TRUE;
+
+error:
+   close(gHgfsNotify.inotifyFd);
+   gHgfsNotify.inotifyFd = -1;
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRemoveSubscriberInternal --
+ *
+ *      Unlink a subscriber, release its watches and drop its queued events.
+ *      The state lock must be held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRemoveSubscriberInternal(HgfsNotifySubscriber *subscriber)  // IN
+{
+   LOG(8, "%s: removing subscriber %"FMT64"x\n", __FUNCTION__,
+       subscriber->handle);
+
+   DblLnkLst_Unlink1(&subscriber->links);
+   while (subscriber->numWds > 0) {
+      HgfsNotifyReleaseWatch(subscriber, subscriber->numWds - 1);
+   }
+   HgfsNotifyPurgeEvents(subscriber);
+   free(subscriber->wds);
+   free(subscriber->relPath);
+   free(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialize the notification component. The inotify instance and the
+ *    notification thread are created when the first subscriber is added.
+ *
+ * Results:
+ *    HGFS_STATUS_SUCCESS.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(const HgfsServerNotifyCallbacks *serverCbData) // IN: server callbacks
+{
+   ASSERT(serverCbData);
+   ASSERT(!gHgfsNotifyInited);
+
+   memset(&gHgfsNotify, 0, sizeof gHgfsNotify);
+   gHgfsNotify.lock = MXUser_CreateExclLock("HgfsNotifyLock",
+                                            RANK_hgfsNotifyLock);
+   gHgfsNotify.deliveryLock = MXUser_CreateExclLock("HgfsNotifyDeliveryLock",
+                                                    RANK_hgfsNotifyDeliveryLock);
+   gHgfsNotify.serverCb = *serverCbData;
+   DblLnkLst_Init(&gHgfsNotify.shares);
+   DblLnkLst_Init(&gHgfsNotify.subscribers);
+   DblLnkLst_Init(&gHgfsNotify.pendingEvents);
+   gHgfsNotify.watches = HashTable_Alloc(HGFS_NOTIFY_WATCH_BUCKETS,
+                                         HASH_INT_KEY, NULL);
+   gHgfsNotify.nextShareHandle = 1;
+   gHgfsNotify.nextSubscriberHandle = 1;
+   gHgfsNotify.inotifyFd = -1;
+   gHgfsNotify.wakeupPipe[0] = -1;
+   gHgfsNotify.wakeupPipe[1] = -1;
+
+   gHgfsNotifyInited = TRUE;
+   return HGFS_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Stop the notification thread and free all the notification state.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   if (!gHgfsNotifyInited) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   gHgfsNotify.exiting = TRUE;
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   if (gHgfsNotify.threadStarted) {
+      HgfsNotifyWakeThread();
+      pthread_join(gHgfsNotify.thread, NULL);
+   }
+
+   DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNotify.subscribers) {
+      HgfsNotifyRemoveSubscriberInternal(DblLnkLst_Container(link,
+                                                             HgfsNotifySubscriber,
+                                                             links));
+   }
+   DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNotify.shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      DblLnkLst_Unlink1(&share->links);
+      free(share->path);
+      free(share->shareName);
+      free(share);
+   }
+
+   if (gHgfsNotify.threadStarted) {
+      close(gHgfsNotify.inotifyFd);
+      close(gHgfsNotify.wakeupPipe[0]);
+      close(gHgfsNotify.wakeupPipe[1]);
+   }
+   HashTable_Free(gHgfsNotify.watches);
+   MXUser_DestroyExclLock(gHgfsNotify.deliveryLock);
+   MXUser_DestroyExclLock(gHgfsNotify.lock);
+   gHgfsNotifyInited = FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Resume event delivery once the server has finished synchronizing.
+ *    Subscriber activation is handled internally.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason, // IN: reason
+                    struct HgfsSessionInfo *session) // IN: session
+{
+   if (!gHgfsNotifyInited || HGFS_NOTIFY_REASON_SERVER_SYNC != reason) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   gHgfsNotify.suspended = FALSE;
+   if (gHgfsNotify.threadStarted) {
+      HgfsNotifyWakeThread();
+   }
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Hold back event delivery while the server is synchronizing. Events
+ *    keep being queued, subject to the usual overflow handling.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason, // IN: reason
+                      struct HgfsSessionInfo *session) // IN: session
+{
+   if (!gHgfsNotifyInited || HGFS_NOTIFY_REASON_SERVER_SYNC != reason) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   gHgfsNotify.suspended = TRUE;
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Register a shared folder that subscribers can watch.
+ *
+ * Results:
+ *    The shared folder handle, HGFS_INVALID_FOLDER_HANDLE on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyShare *share;
+   HgfsSharedFolderHandle handle;
+
+   if (!gHgfsNotifyInited || NULL == path || NULL == shareName) {
+      return HGFS_INVALID_FOLDER_HANDLE;
+   }
+
+   share = Util_SafeMalloc(sizeof *share);
+   DblLnkLst_Init(&share->links);
+   share->path = Util_SafeStrdup(path);
+   share->shareName = Util_SafeStrdup(shareName);
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   handle = gHgfsNotify.nextShareHandle++;
+   if (HGFS_INVALID_FOLDER_HANDLE == gHgfsNotify.nextShareHandle) {
+      gHgfsNotify.nextShareHandle = 1;
+   }
+   share->handle = handle;
+   DblLnkLst_LinkLast(&gHgfsNotify.shares, &share->links);
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   LOG(8, "%s: share %s path %s handle %#x\n", __FUNCTION__, shareName, path,
+       handle);
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Start watching a directory of a shared folder for a session.
+ *
+ * Results:
+ *    The subscriber handle, HGFS_INVALID_SUBSCRIBER_HANDLE on failure.
+ *
+ * Side effects:
+ *    Starts the notification thread for the first subscriber.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsNotifySubscriber *subscriber;
+   HgfsSubscriberHandle handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   HgfsNotifyShare *share;
+
+   if (!gHgfsNotifyInited || NULL == path) {
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   /* Paths are relative to the share root. */
+   while (*path == DIRSEPC) {
+      path++;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+
+   share = HgfsNotifyFindShare(sharedFolder);
+   if (NULL == share) {
+      LOG(4, "%s: unknown shared folder %#x\n", __FUNCTION__, sharedFolder);
+      goto exit;
+   }
+
+   if (!HgfsNotifyStartThread()) {
+      goto exit;
+   }
+
+   subscriber = Util_SafeCalloc(1, sizeof *subscriber);
+   DblLnkLst_Init(&subscriber->links);
+   subscriber->sharedFolder = sharedFolder;
+   subscriber->relPath = Util_SafeStrdup(path);
+   subscriber->eventFilter = eventFilter;
+   subscriber->recursive = recursive != 0;
+   subscriber->session = session;
+
+   HgfsNotifyAddTree(subscriber, share, subscriber->relPath);
+   if (0 == subscriber->numWds) {
+      LOG(4, "%s: could not watch \"%s\" in share %s\n", __FUNCTION__, path,
+          share->shareName);
+      free(subscriber->relPath);
+      free(subscriber);
+      goto exit;
+   }
+
+   handle = gHgfsNotify.nextSubscriberHandle++;
+   subscriber->handle = handle;
+   DblLnkLst_LinkLast(&gHgfsNotify.subscribers, &subscriber->links);
+
+   LOG(8, "%s: subscriber %"FMT64"x on \"%s\" share %s, %u watches\n",
+       __FUNCTION__, handle, path, share->shareName, subscriber->numWds);
+
+exit:
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Remove a shared folder and all the subscribers watching it.
+ *
+ * Results:
+ *    TRUE if the shared folder was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   DblLnkLst_Links *link, *nextLink;
+   HgfsNotifyShare *share;
+
+   if (!gHgfsNotifyInited) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   share = HgfsNotifyFindShare(sharedFolder);
+   if (NULL != share) {
+      DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNotify.subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->sharedFolder == sharedFolder) {
+            HgfsNotifyRemoveSubscriberInternal(subscriber);
+         }
+      }
+      DblLnkLst_Unlink1(&share->links);
+      free(share->path);
+      free(share->shareName);
+      free(share);
+   }
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   return NULL != share;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Remove a subscriber.
+ *
+ * Results:
+ *    TRUE if the subscriber was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   DblLnkLst_Links *link;
+   Bool found = FALSE;
+
+   if (!gHgfsNotifyInited) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   DblLnkLst_ForEach(link, &gHgfsNotify.subscribers) {
+      HgfsNotifySubscriber *current =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (current->handle == subscriber) {
+         HgfsNotifyRemoveSubscriberInternal(current);
+         found = TRUE;
+         break;
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Remove all the subscribers of a session. On return no callback for the
+ *    session is running or will be made.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   if (!gHgfsNotifyInited) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsNotify.lock);
+   DblLnkLst_ForEachSafe(link, nextLink, &gHgfsNotify.subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (subscriber->session == session) {
+         HgfsNotifyRemoveSubscriberInternal(subscriber);
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsNotify.lock);
+
+   /* Wait for a delivery that may have picked up an event for the session. */
+   MXUser_AcquireExclLock(gHgfsNotify.deliveryLock);
+   MXUser_ReleaseExclLock(gHgfsNotify.deliveryLock);
+}
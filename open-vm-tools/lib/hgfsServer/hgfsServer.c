@@ -42,12 +42,14 @@
 #include "codeset.h"
 #include "dbllnklst.h"
 #include "file.h"
+#include "hostinfo.h"
 #include "util.h"
 #include "wiper.h"
 #include "hgfsServer.h"
 #include "hgfsServerParameters.h"
 #include "hgfsServerOplock.h"
 #include "hgfsServerOplockMonitor.h"
+#include "hgfsServerStats.h"
 #include "hgfsDirNotify.h"
 #include "hgfsThreadpool.h"
 #include "userlock.h"
@@ -128,6 +130,37 @@
 /* Default maximun number of open nodes that have server locks. */
 #define MAX_LOCKED_FILENODES 10
 
+/*
+ * Number of buckets of the per session handle and file descriptor lookup
+ * tables. The tables chain, so this only needs to be in the ballpark of
+ * the number of handles a busy client keeps open.
+ */
+#define NODE_TABLE_BUCKETS 4096
+
+#define NODE_TABLE_KEY(_x)    ((const void *)(uintptr_t)(_x))
+#define NODE_TABLE_VALUE(_i)  ((void *)(uintptr_t)(_i))
+
+/*
+ * Lifetime of the file attribute cache entries when the oplock monitor is
+ * not available to tell us about changes made behind the server's back.
+ * Changes made through the server drop the entries directly.
+ */
+#define HGFS_CACHE_ENTRY_LIFETIME_MS 1000
+
+/*
+ * Sequential read detection. A handle is treated as sequential after this
+ * many consecutive reads each starting where the previous one ended, and the
+ * data ahead of the reader is then prefetched in a window that grows from
+ * the minimum to the maximum size.
+ */
+#define HGFS_READAHEAD_MIN_SEQUENTIAL  2
+#define HGFS_READAHEAD_MIN_WINDOW      (256 * 1024)
+#define HGFS_READAHEAD_MAX_WINDOW      (8 * 1024 * 1024)
+
+/* Flags for HgfsServerCacheRemoveName. */
+#define HGFS_CACHE_REMOVE_PARENT  (1 << 0)
+#define HGFS_CACHE_REMOVE_TREE    (1 << 1)
+
 
 struct HgfsTransportSessionInfo {
    /* Default session id. */
@@ -175,6 +208,8 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   VmTimeType receiveTime;       /* When the request arrived */
+   VmTimeType startTime;         /* When processing started, 0 if it has not */
 } HgfsInputParam;
 
 /*
@@ -375,6 +410,16 @@ static Bool HgfsPacketSend(HgfsPacket *packet,
                            HgfsSendFlags flags);
 
 static void HgfsCacheRemoveLRUCb(void *data);
+static void HgfsServerDestroyCaches(HgfsSessionInfo *session);
+static Bool HgfsServerCacheMonitorName(HgfsSessionInfo *session,
+                                       char *utf8Name,
+                                       HOM_HANDLE *handle);
+static void HgfsServerCacheRemoveName(HgfsSessionInfo *session,
+                                      const char *utf8Name,
+                                      uint32 flags);
+static void HgfsServerCacheRemoveHandle(HgfsSessionInfo *session,
+                                        HgfsHandle handle,
+                                        uint32 flags);
 
 /*
  * Opcode handlers
@@ -604,25 +649,100 @@ static HgfsFileNode *
 HgfsHandle2FileNode(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
+   void *index;
    HgfsFileNode *fileNode = NULL;
 
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numNodes; i++) {
-      if (session->nodeArray[i].state != FILENODE_STATE_UNUSED &&
-          session->nodeArray[i].handle == handle) {
-         fileNode = &session->nodeArray[i];
-         break;
-      }
+   if (HashTable_Lookup(session->nodeHandleTable, NODE_TABLE_KEY(handle),
+                        &index)) {
+      fileNode = &session->nodeArray[(uintptr_t)index];
+      ASSERT(fileNode->state != FILENODE_STATE_UNUSED);
+      ASSERT(fileNode->handle == handle);
    }
 
    return fileNode;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFileDesc2FileNode --
+ *
+ *    Retrieve the in use file node which owns an open file descriptor.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    The file node if the file descriptor belongs to a node, NULL otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsFileNode *
+HgfsFileDesc2FileNode(fileDesc fd,              // IN: OS handle (file descriptor)
+                      HgfsSessionInfo *session) // IN: Session info
+{
+   void *index;
+   HgfsFileNode *fileNode = NULL;
+
+   ASSERT(session);
+   ASSERT(session->nodeArray);
+
+   if (HashTable_Lookup(session->nodeFileDescTable, NODE_TABLE_KEY(fd),
+                        &index)) {
+      fileNode = &session->nodeArray[(uintptr_t)index];
+      ASSERT(fileNode->state != FILENODE_STATE_UNUSED);
+      ASSERT(fileNode->fileDesc == fd);
+   }
+
+   return fileNode;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeTableRemove --
+ *
+ *    Remove a key from one of the node lookup tables, provided the key
+ *    still maps to the given node. Keys of unused nodes are stale and may
+ *    meanwhile have been reused by another node (e.g. a file descriptor
+ *    that was closed and handed out again), those entries are left alone.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeTableRemove(HashTable *table,             // IN/OUT: lookup table
+                    const void *key,              // IN: handle or fd
+                    HgfsFileNode const *node,     // IN: node owning the key
+                    HgfsSessionInfo *session)     // IN: Session info
+{
+   void *index;
+
+   if (   HashTable_Lookup(table, key, &index)
+       && &session->nodeArray[(uintptr_t)index] == node) {
+      HashTable_Delete(table, key);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -847,7 +967,6 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
                     HgfsSessionInfo *session, // IN: Session info
                     HgfsHandle *handle)       // OUT: Hgfs file handle
 {
-   unsigned int i;
    Bool found = FALSE;
    HgfsFileNode *existingFileNode = NULL;
 
@@ -856,14 +975,11 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
-          (existingFileNode->fileDesc == fd)) {
-         *handle = HgfsFileNode2Handle(existingFileNode);
-         found = TRUE;
-         break;
-      }
+   existingFileNode = HgfsFileDesc2FileNode(fd, session);
+   if (existingFileNode != NULL &&
+       existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) {
+      *handle = HgfsFileNode2Handle(existingFileNode);
+      found = TRUE;
    }
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -1052,7 +1168,8 @@ HgfsHandle2NotifyInfo(HgfsHandle handle,                    // IN: Hgfs file han
       nameSize = existingFileNode->utf8NameLen - existingFileNode->shareInfo.rootDirLen;
       name = Util_SafeMalloc(nameSize + 1);
       *folderHandle = existingFileNode->shareInfo.handle;
-      memcpy(name, existingFileNode->utf8Name, nameSize);
+      memcpy(name, existingFileNode->utf8Name +
+                   existingFileNode->shareInfo.rootDirLen, nameSize);
       name[nameSize] = '\0';
       *fileName = name;
       *fileNameSize = nameSize;
@@ -1176,6 +1293,108 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsHandleUpdateReadahead --
+ *
+ *    Track the read pattern of a handle and work out what to prefetch.
+ *
+ *    After HGFS_READAHEAD_MIN_SEQUENTIAL reads that each start where the
+ *    previous one ended, or straight away for handles opened for sequential
+ *    access, the handle is treated as sequential. Its prefetch window then
+ *    starts at HGFS_READAHEAD_MIN_WINDOW and doubles each time the reader
+ *    consumes half of it, up to HGFS_READAHEAD_MAX_WINDOW. A read elsewhere
+ *    resets the handle to random access.
+ *
+ * Results:
+ *    TRUE on success, FALSE if the handle is not valid. On success
+ *    patternChanged is set if the handle switched between sequential and
+ *    random access, and prefetchSize is non-zero if the range starting at
+ *    prefetchOffset should be prefetched.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsHandleUpdateReadahead(HgfsHandle handle,         // IN: Hgfs file handle
+                          HgfsSessionInfo *session,  // IN: Session info
+                          uint64 offset,             // IN: offset read from
+                          uint32 size,               // IN: bytes read
+                          Bool *patternChanged,      // OUT: sequential changed
+                          Bool *sequential,          // OUT: reads are sequential
+                          uint64 *prefetchOffset,    // OUT: range to prefetch
+                          uint32 *prefetchSize)      // OUT: 0 if none
+{
+   HgfsFileNode *node;
+   Bool wasSequential;
+   Bool success = FALSE;
+
+   *patternChanged = FALSE;
+   *sequential = FALSE;
+   *prefetchOffset = 0;
+   *prefetchSize = 0;
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (node == NULL) {
+      goto exit;
+   }
+
+   wasSequential = node->readaheadWindow != 0;
+
+   if (offset == node->readNextOffset ||
+       (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0) {
+      if (node->readSequentialCount < MAX_UINT32) {
+         node->readSequentialCount++;
+      }
+   } else {
+      node->readSequentialCount = 0;
+      node->readaheadWindow = 0;
+      node->readaheadEnd = 0;
+   }
+   node->readNextOffset = offset + size;
+
+   if (node->readSequentialCount >= HGFS_READAHEAD_MIN_SEQUENTIAL ||
+       (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0) {
+      Bool prefetch = FALSE;
+
+      if (node->readaheadWindow == 0) {
+         node->readaheadWindow = HGFS_READAHEAD_MIN_WINDOW;
+         prefetch = TRUE;
+      } else if (node->readaheadEnd < node->readNextOffset +
+                                      node->readaheadWindow / 2) {
+         /* Half of the prefetched range has been consumed, grow and top up. */
+         node->readaheadWindow = MIN(node->readaheadWindow * 2,
+                                     HGFS_READAHEAD_MAX_WINDOW);
+         prefetch = TRUE;
+      }
+
+      if (prefetch) {
+         uint64 start = MAX(node->readaheadEnd, node->readNextOffset);
+         uint64 end = node->readNextOffset + node->readaheadWindow;
+
+         *prefetchOffset = start;
+         *prefetchSize = (uint32)(end - start);
+         node->readaheadEnd = end;
+      }
+   }
+
+   *sequential = node->readaheadWindow != 0;
+   *patternChanged = wasSequential != *sequential;
+   success = TRUE;
+
+exit:
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   return success;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -1254,8 +1473,12 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
       goto exit;
    }
 
+   HgfsNodeTableRemove(session->nodeFileDescTable,
+                       NODE_TABLE_KEY(node->fileDesc), node, session);
    node->fileDesc = fd;
    node->fileCtx = fileCtx;
+   HashTable_ReplaceOrInsert(session->nodeFileDescTable, NODE_TABLE_KEY(fd),
+                             NODE_TABLE_VALUE(node - session->nodeArray));
    updated = TRUE;
 
 exit:
@@ -1288,7 +1511,6 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
                          HgfsSessionInfo *session,   // IN: Session info
                          HgfsLockType serverLock)    // IN: new oplock
 {
-   unsigned int i;
    HgfsFileNode *existingFileNode = NULL;
    Bool updated = FALSE;
 
@@ -1297,15 +1519,10 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if (existingFileNode->state != FILENODE_STATE_UNUSED) {
-         if (existingFileNode->fileDesc == fd) {
-            existingFileNode->serverLock = serverLock;
-            updated = TRUE;
-            break;
-         }
-      }
+   existingFileNode = HgfsFileDesc2FileNode(fd, session);
+   if (existingFileNode != NULL) {
+      existingFileNode->serverLock = serverLock;
+      updated = TRUE;
    }
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -1629,6 +1846,11 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
    LOG(4, "%s: handle %u, name %s, fileId %"FMT64"u\n", __FUNCTION__,
        HgfsFileNode2Handle(node), node->utf8Name, node->localId.fileId);
 
+   HgfsNodeTableRemove(session->nodeHandleTable,
+                       NODE_TABLE_KEY(node->handle), node, session);
+   HgfsNodeTableRemove(session->nodeFileDescTable,
+                       NODE_TABLE_KEY(node->fileDesc), node, session);
+
    if (node->shareName) {
       free(node->shareName);
       node->shareName = NULL;
@@ -1822,6 +2044,16 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
    newNode->shareInfo.readPermissions = openInfo->shareInfo.readPermissions;
    newNode->shareInfo.writePermissions = openInfo->shareInfo.writePermissions;
    newNode->shareInfo.handle = openInfo->shareInfo.handle;
+   newNode->readNextOffset = 0;
+   newNode->readaheadEnd = 0;
+   newNode->readSequentialCount = 0;
+   newNode->readaheadWindow = 0;
+
+   HashTable_Insert(session->nodeHandleTable, NODE_TABLE_KEY(newNode->handle),
+                    NODE_TABLE_VALUE(newNode - session->nodeArray));
+   HashTable_ReplaceOrInsert(session->nodeFileDescTable,
+                             NODE_TABLE_KEY(newNode->fileDesc),
+                             NODE_TABLE_VALUE(newNode - session->nodeArray));
 
    LOG(4, "%s: got new node, handle %u\n", __FUNCTION__,
        HgfsFileNode2Handle(newNode));
@@ -1957,6 +2189,8 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
        * Instead, we'll just await the lobotomization of the node cache to
        * really fix this.
        */
+      HgfsNodeTableRemove(session->nodeFileDescTable,
+                          NODE_TABLE_KEY(node->fileDesc), node, session);
       if (HgfsPlatformCloseFile(node->fileDesc, node->fileCtx)) {
          LOG(4, "%s: Could not close fd %u\n", __FUNCTION__, node->fileDesc);
 
@@ -2280,6 +2514,9 @@ HgfsGetSearchCopy(HgfsHandle handle,        // IN: Hgfs search handle
 
    ASSERT(copy);
 
+   /* Opened on demand by the platform when entry attributes are read. */
+   copy->dirFd = HGFS_INVALID_FILE_DESC;
+
    MXUser_AcquireExclLock(session->searchArrayLock);
    original = HgfsSearchHandle2Search(handle, session);
    if (original == NULL) {
@@ -2957,6 +3194,7 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
    localParams->op = requestOp;
    localParams->payload = requestOpArgs;
    localParams->payloadSize = requestOpArgsSize;
+   localParams->receiveTime = Hostinfo_SystemTimerNS();
 
    if (NULL != localParams->payload) {
       localParams->payloadOffset = (char *)localParams->payload -
@@ -3263,6 +3501,9 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
    }
 
 exit:
+   HgfsServerStats_EndRequest(input, input->op, status, replySessionId,
+                              input->id, input->requestSize, replySize,
+                              input->receiveTime, input->startTime);
    HgfsServerInputExit(input);
 }
 
@@ -3287,6 +3528,9 @@ static void
 HgfsServerProcessRequest(void *context)
 {
    HgfsInputParam *input = (HgfsInputParam *)context;
+
+   input->startTime = Hostinfo_SystemTimerNS();
+   HgfsServerStats_BeginRequest(input);
    if (!input->request) {
       input->request = HSPU_GetMetaPacket(input->packet,
                                           &input->requestSize,
@@ -3965,6 +4209,7 @@ HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our
    DblLnkLst_Init(&gHgfsSharedFoldersList);
    gHgfsSharedFoldersLock = MXUser_CreateExclLock("sharedFoldersLock",
                                                   RANK_hgfsSharedFolders);
+   HgfsServerStats_Init();
 
    if (!HgfsPlatformInit()) {
       LOG(4, "Could not initialize server platform specific \n");
@@ -4060,6 +4305,7 @@ HgfsServer_ExitState(void)
    }
 
    HgfsPlatformDestroy();
+   HgfsServerStats_Exit();
 
    /*
     * Reset the server manager callbacks.
@@ -4721,6 +4967,10 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                                         sizeof (HgfsFileNode));
    session->numCachedOpenNodes = 0;
    session->numCachedLockedNodes = 0;
+   session->nodeHandleTable = HashTable_Alloc(NODE_TABLE_BUCKETS,
+                                              HASH_INT_KEY, NULL);
+   session->nodeFileDescTable = HashTable_Alloc(NODE_TABLE_BUCKETS,
+                                                HASH_INT_KEY, NULL);
 
    for (i = 0; i < session->numNodes; i++) {
       DblLnkLst_Init(&session->nodeArray[i].links);
@@ -4801,11 +5051,23 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    }
 
    if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
-      /* Allocate symlink check status cache. */
-      session->symlinkCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb);
+      /*
+       * The symlink check guards against escaping the share, so its results
+       * are only cached while the oplock monitor reports every change to
+       * the names involved.
+       */
+      session->symlinkCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb, 0);
 
       /* Allocate file attributes cache. */
-      session->fileAttrCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb);
+      session->fileAttrCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb, 0);
+   } else {
+      /*
+       * Without the monitor attributes still age out after
+       * HGFS_CACHE_ENTRY_LIFETIME_MS. The server drops the entries for
+       * names it modifies itself.
+       */
+      session->fileAttrCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb,
+                                               HGFS_CACHE_ENTRY_LIFETIME_MS);
    }
 
    *sessionData = session;
@@ -4991,6 +5253,10 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    }
    free(session->nodeArray);
    session->nodeArray = NULL;
+   HashTable_Free(session->nodeHandleTable);
+   session->nodeHandleTable = NULL;
+   HashTable_Free(session->nodeFileDescTable);
+   session->nodeFileDescTable = NULL;
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
@@ -5012,6 +5278,8 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
+   HgfsServerDestroyCaches(session);
+
    if (gHgfsThreadpoolActive) {
       HgfsThreadpool_Deactivate();
    }
@@ -5076,6 +5344,34 @@ HgfsServer_SetHandleCounter(uint32 newHandleCounter)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_DumpStats --
+ *
+ *    Report the per-operation request statistics, the busiest shares and
+ *    the slowest requests seen, one line at a time. Used to dump the state
+ *    of the server on request.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_DumpStats(HgfsServerStatsDumpFunc *dumpFn,   // IN: line consumer
+                     void *clientData)                  // IN: for dumpFn
+{
+   ASSERT(dumpFn);
+
+   HgfsServerStats_Dump(dumpFn, clientData, gHgfsThreadpoolActive);
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -5370,8 +5666,15 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
       if (!caches[i]) {
          continue;
       }
+      /*
+       * The keys belong to the cache entries, so copy them before dropping
+       * the lock.
+       */
       MXUser_AcquireExclLock(caches[i]->lock);
       HashTable_KeyArray(caches[i]->hashTable, &keys, &nkeys);
+      for (keyIdx = 0; keyIdx < nkeys; keyIdx++) {
+         keys[keyIdx] = Util_SafeStrdup(keys[keyIdx]);
+      }
       MXUser_ReleaseExclLock(caches[i]->lock);
       for (keyIdx = 0; keyIdx < nkeys; keyIdx++) {
          DblLnkLst_Links *l;
@@ -5387,9 +5690,9 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
 
          if (l == shares) {
             LOG(4, "%s: Remove %s from cache\n", __FUNCTION__, name);
-            HgfsCache_Invalidate(caches[i], name);
-
+            HgfsCache_Remove(caches[i], name);
          }
+         free((void *)name);
       }
       free((void *)keys);
    }
@@ -5640,7 +5943,184 @@ HgfsOplockFileChangeCb(HgfsSessionInfo *session, // IN: Session info
 static void
 HgfsCacheRemoveLRUCb(void *data) // IN
 {
-   HgfsOplockUnmonitorFileChange(((HOM_HANDLE *)data)[0]);
+   HOM_HANDLE handle = ((HOM_HANDLE *)data)[0];
+
+   if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
+      HgfsOplockUnmonitorFileChange(handle);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerDestroyCaches --
+ *
+ *    Log the hit/miss counters of the session caches and destroy them.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerDestroyCaches(HgfsSessionInfo *session) // IN: Session info
+{
+   HgfsCache **caches[] = { &session->symlinkCache, &session->fileAttrCache };
+   const char *names[] = { "symlink", "attr" };
+   int i;
+
+   for (i = 0; i < ARRAYSIZE(caches); i++) {
+      HgfsCacheStats stats;
+
+      if (NULL == *caches[i]) {
+         continue;
+      }
+      HgfsCache_GetStats(*caches[i], &stats);
+      LOG(4, "%s: %s cache hits %"FMT64"u misses %"FMT64"u expired %"FMT64"u "
+          "evictions %"FMT64"u invalidations %"FMT64"u\n", __FUNCTION__,
+          names[i], stats.hits, stats.misses, stats.expired, stats.evictions,
+          stats.invalidations);
+      HgfsCache_Destroy(*caches[i]);
+      *caches[i] = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheMonitorName --
+ *
+ *    Decide whether a lookup result for a name may be cached and, when the
+ *    oplock monitor is enabled, start monitoring the name for changes.
+ *
+ *    Without the oplock monitor the session caches bound the lifetime of
+ *    their entries instead, so no monitor handle is needed.
+ *
+ * Results:
+ *    TRUE if the result may be cached, handle is set for the cache entry.
+ *    FALSE if the name could not be monitored.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsServerCacheMonitorName(HgfsSessionInfo *session, // IN: Session info
+                           char *utf8Name,           // IN: Local name
+                           HOM_HANDLE *handle)       // OUT: Monitor handle
+{
+   if (0 == (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
+      *handle = HGFS_OPLOCK_INVALID_MONITOR_HANDLE;
+      return TRUE;
+   }
+
+   *handle = HgfsOplockMonitorFileChange(utf8Name, session,
+                                         HgfsOplockFileChangeCb,
+                                         Util_SafeStrdup(utf8Name));
+   return *handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheRemoveName --
+ *
+ *    Drop the cached lookup results for a name the server has just modified.
+ *
+ *    HGFS_CACHE_REMOVE_PARENT also drops the parent directory, whose
+ *    attributes change when entries are created, removed or renamed.
+ *    HGFS_CACHE_REMOVE_TREE also drops everything beneath the name, for
+ *    directories that are renamed or removed.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheRemoveName(HgfsSessionInfo *session, // IN: Session info
+                          const char *utf8Name,     // IN: Local name
+                          uint32 flags)             // IN: HGFS_CACHE_REMOVE_*
+{
+   HgfsCache *caches[] = { session->symlinkCache, session->fileAttrCache };
+   char *parentName = NULL;
+   int i;
+
+   if (0 != (flags & HGFS_CACHE_REMOVE_PARENT)) {
+      char *sep;
+
+      parentName = Util_SafeStrdup(utf8Name);
+      sep = strrchr(parentName, DIRSEPC);
+      if (NULL != sep) {
+         *sep = '\0';
+      } else {
+         free(parentName);
+         parentName = NULL;
+      }
+   }
+
+   for (i = 0; i < ARRAYSIZE(caches); i++) {
+      if (NULL == caches[i]) {
+         continue;
+      }
+      if (0 != (flags & HGFS_CACHE_REMOVE_TREE)) {
+         HgfsCache_RemoveTree(caches[i], utf8Name);
+      } else {
+         HgfsCache_Remove(caches[i], utf8Name);
+      }
+      if (NULL != parentName) {
+         HgfsCache_Remove(caches[i], parentName);
+      }
+   }
+   free(parentName);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheRemoveHandle --
+ *
+ *    Same as HgfsServerCacheRemoveName for the name of an open file node.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheRemoveHandle(HgfsSessionInfo *session, // IN: Session info
+                            HgfsHandle handle,        // IN: Hgfs file handle
+                            uint32 flags)             // IN: HGFS_CACHE_REMOVE_*
+{
+   char *utf8Name;
+   size_t utf8NameLen;
+
+   if (NULL == session->symlinkCache && NULL == session->fileAttrCache) {
+      return;
+   }
+
+   if (HgfsHandle2FileName(handle, session, &utf8Name, &utf8NameLen)) {
+      HgfsServerCacheRemoveName(session, utf8Name, flags);
+      free(utf8Name);
+   }
 }
 
 /*
@@ -5727,6 +6207,7 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       LOG(4, "%s: No such share (%s)\n", __FUNCTION__, cpName);
       return nameStatus;
    }
+   HgfsServerStats_NoteShare(cpName, len);
    shareInfo->rootDirLen = strlen(shareInfo->rootDir);
    /*
     * XXX: The handle is now NOT propagated back and held in the policy but only in the
@@ -5912,9 +6393,12 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    /* Check for symlinks if the followSymlinks option is not set. */
    if (!HgfsServerPolicy_IsShareOptionSet(shareOptions,
                                           HGFS_SHARE_FOLLOW_SYMLINKS)) {
+      HgfsSymlinkCacheEntry cached;
+
       if (NULL != session->symlinkCache &&
-          HgfsCache_Get(session->symlinkCache, myBufOut, (void **)&entry)) {
-         nameStatus = entry->nameStatus;
+          HgfsCache_Get(session->symlinkCache, myBufOut, &cached,
+                        sizeof cached)) {
+         nameStatus = cached.nameStatus;
       } else {
          /*
           * Verify that either the path is same as share path or the path until
@@ -5930,11 +6414,9 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
                                                  shareInfo->rootDir,
                                                  shareInfo->rootDirLen);
          if (NULL != session->symlinkCache) {
-            HOM_HANDLE handle =
-               HgfsOplockMonitorFileChange(myBufOut, session,
-                                           HgfsOplockFileChangeCb,
-                                           Util_SafeStrdup(myBufOut));
-            if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
+            HOM_HANDLE handle;
+
+            if (HgfsServerCacheMonitorName(session, myBufOut, &handle)) {
                entry = Util_SafeCalloc(1, sizeof *entry);
                entry->handle = handle;
                entry->nameStatus = nameStatus;
@@ -7065,6 +7547,7 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
       if (HGFS_ERROR_SUCCESS != status) {
          goto exit;
       }
+      HgfsServerCacheRemoveHandle(input->session, writeFile, 0);
    }
 
    if (!HgfsPackWriteReply(input->packet, input->request, input->op,
@@ -7326,6 +7809,11 @@ HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
       localTargetName[trgFileNameLength] = '\0';
 
       status = HgfsPlatformSymlinkCreate(localSymlinkName, localTargetName);
+      if (HGFS_ERROR_SUCCESS == status) {
+         HgfsServerCacheRemoveName(session, localSymlinkName,
+                                   HGFS_CACHE_REMOVE_TREE |
+                                   HGFS_CACHE_REMOVE_PARENT);
+      }
    }
 
    free(localSymlinkName);
@@ -7673,6 +8161,12 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
       if (HGFS_ERROR_SUCCESS == status) {
          /* Update all file nodes that refer to this file to contain the new name. */
          HgfsUpdateNodeNames(utf8OldName, utf8NewName, input->session);
+         HgfsServerCacheRemoveName(input->session, utf8OldName,
+                                   HGFS_CACHE_REMOVE_TREE |
+                                   HGFS_CACHE_REMOVE_PARENT);
+         HgfsServerCacheRemoveName(input->session, utf8NewName,
+                                   HGFS_CACHE_REMOVE_TREE |
+                                   HGFS_CACHE_REMOVE_PARENT);
          if (!HgfsPackRenameReply(input->packet, input->request, input->op,
                                   &replyPayloadSize, input->session)) {
             status = HGFS_ERROR_INTERNAL;
@@ -7754,6 +8248,8 @@ HgfsServerCreateDir(HgfsInputParam *input)  // IN: Input params
       if (shareInfo.writePermissions) {
          status = HgfsPlatformCreateDir(&info, utf8Name);
          if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerCacheRemoveName(input->session, utf8Name,
+                                      HGFS_CACHE_REMOVE_PARENT);
             if (!HgfsPackCreateDirReply(input->packet, input->request, info.requestType,
                                         &replyPayloadSize, input->session)) {
                status = HGFS_ERROR_PROTOCOL;
@@ -7841,6 +8337,10 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
                                &cpNameSize, &hints, &file, &caseFlags)) {
       if (hints & HGFS_DELETE_HINT_USE_FILE_DESC) {
          status = HgfsPlatformDeleteFileByHandle(file, input->session);
+         if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerCacheRemoveHandle(input->session, file,
+                                        HGFS_CACHE_REMOVE_PARENT);
+         }
       } else {
          char *utf8Name = NULL;
          size_t utf8NameLen;
@@ -7872,6 +8372,10 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
             } else {
                LOG(4, "%s: deleting \"%s\"\n", __FUNCTION__, utf8Name);
                status = HgfsPlatformDeleteFileByName(utf8Name);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  HgfsServerCacheRemoveName(input->session, utf8Name,
+                                            HGFS_CACHE_REMOVE_PARENT);
+               }
             }
             free(utf8Name);
          } else {
@@ -7946,6 +8450,10 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
                if (HGFS_ERROR_SUCCESS != status) {
                   LOG(4, "%s: error deleting directory %d: %d\n", __FUNCTION__,
                      file, status);
+               } else {
+                  HgfsServerCacheRemoveHandle(input->session, file,
+                                              HGFS_CACHE_REMOVE_TREE |
+                                              HGFS_CACHE_REMOVE_PARENT);
                }
             }
          } else {
@@ -7979,6 +8487,11 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
             } else {
                LOG(4, "%s: removing \"%s\"\n", __FUNCTION__, utf8Name);
                status = HgfsPlatformDeleteDirByName(utf8Name);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  HgfsServerCacheRemoveName(input->session, utf8Name,
+                                            HGFS_CACHE_REMOVE_TREE |
+                                            HGFS_CACHE_REMOVE_PARENT);
+               }
             }
             free(utf8Name);
          } else {
@@ -8410,6 +8923,7 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
    size_t replyPayloadSize = 0;
    HgfsSessionInfo *session;
    HgfsFileAttrCacheEntry *entry;
+   HgfsFileAttrCacheEntry cached;
 
    HGFS_ASSERT_INPUT(input);
 
@@ -8428,28 +8942,19 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
 
          if (found && NULL != session->fileAttrCache &&
              HgfsCache_Get(session->fileAttrCache, node.utf8Name,
-                           (void **)&entry)) {
-            attr = entry->attr;
+                           &cached, sizeof cached)) {
+            attr = cached.attr;
             status = HGFS_ERROR_SUCCESS;
          } else {
             targetNameLen = 0;
             status = HgfsPlatformGetFd(file, session, FALSE, &fd);
             if (HGFS_ERROR_SUCCESS == status) {
+               /*
+                * Not cached: the attributes of an open file describe what
+                * its name resolved to, which for a symlink is not what a
+                * lookup by name must return.
+                */
                status = HgfsPlatformGetattrFromFd(fd, session, &attr);
-               if (found && HGFS_ERROR_SUCCESS == status &&
-                   NULL != session->fileAttrCache) {
-                  HOM_HANDLE handle =
-                     HgfsOplockMonitorFileChange(node.utf8Name, session,
-                                                 HgfsOplockFileChangeCb,
-                                                 Util_SafeStrdup(node.utf8Name));
-                  if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
-                     entry = Util_SafeCalloc(1, sizeof *entry);
-                     entry->handle = handle;
-                     entry->attr = attr;
-                     HgfsCache_Put(session->fileAttrCache, node.utf8Name,
-                                   entry);
-                  }
-               }
             } else {
                LOG(4, "%s: Could not get file descriptor\n", __FUNCTION__);
             }
@@ -8483,8 +8988,8 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
 
             if (NULL != session->fileAttrCache &&
                 HgfsCache_Get(session->fileAttrCache, localName,
-                              (void **)&entry)) {
-               attr = entry->attr;
+                              &cached, sizeof cached)) {
+               attr = cached.attr;
                status = HGFS_ERROR_SUCCESS;
             } else {
                /* Get the config options. */
@@ -8494,13 +8999,17 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
                   status = HgfsPlatformGetattrFromName(localName, configOptions,
                                                        (char *)cpName, &attr,
                                                        &targetName);
+                  /*
+                   * The cache keeps only the attributes, so symlinks, whose
+                   * reply also carries the target name, are never cached.
+                   */
                   if (HGFS_ERROR_SUCCESS == status &&
+                      attr.type != HGFS_FILE_TYPE_SYMLINK &&
                       NULL != session->fileAttrCache) {
-                     HOM_HANDLE handle =
-                        HgfsOplockMonitorFileChange(localName, session,
-                                                    HgfsOplockFileChangeCb,
-                                                    Util_SafeStrdup(localName));
-                     if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
+                     HOM_HANDLE handle;
+
+                     if (HgfsServerCacheMonitorName(session, localName,
+                                                    &handle)) {
                         entry = Util_SafeCalloc(1, sizeof *entry);
                         entry->handle = handle;
                         entry->attr = attr;
@@ -8604,6 +9113,9 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                                                   &attr,
                                                   hints,
                                                   useHostTime);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  HgfsServerCacheRemoveHandle(input->session, file, 0);
+               }
             } else {
                status = HGFS_ERROR_ACCESS_DENIED;
             }
@@ -8652,6 +9164,9 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                                                     configOptions,
                                                     hints,
                                                     useHostTime);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  HgfsServerCacheRemoveName(input->session, utf8Name, 0);
+               }
             }
             free(utf8Name);
          } else {
@@ -8852,6 +9367,13 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
             if (status == HGFS_ERROR_SUCCESS) {
                ASSERT(newHandle >= 0);
 
+               /* Opens that may create or truncate the file modify it. */
+               if (   0 != (openInfo.mask & HGFS_OPEN_VALID_FLAGS)
+                   && HGFS_OPEN != openInfo.flags) {
+                  HgfsServerCacheRemoveName(input->session, openInfo.utf8Name,
+                                            HGFS_CACHE_REMOVE_PARENT);
+               }
+
                /*
                 * Open succeeded, so make new node and return its handle. If we fail,
                 * it's almost certainly an internal server error.
@@ -9173,6 +9695,48 @@ HgfsDoSearchRead(HgfsHandle hgfsSearchHandle,     // IN: ID for search data
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSearchReadMaxReplySize --
+ *
+ *    Determines the largest search read reply, excluding the reply header,
+ *    that can be returned for the request. This is bounded by the large
+ *    packet size, the session's negotiated packet size and any reply
+ *    buffer already provided by the transport.
+ *
+ * Results:
+ *    Size in bytes available for the search read reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+HgfsServerSearchReadMaxReplySize(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsPacket *packet = input->packet;
+   size_t maxReplySize = HGFS_LARGE_PACKET_MAX;
+
+   if (0 != (input->session->flags & HGFS_SESSION_MAXPACKETSIZE_VALID) &&
+       0 != input->session->maxPacketSize) {
+      maxReplySize = MIN(maxReplySize, input->session->maxPacketSize);
+   }
+
+   /* See HSPU_GetReplyPacket for the buffers the reply may be placed in. */
+   if (NULL != packet->replyPacket) {
+      maxReplySize = MIN(maxReplySize, packet->replyPacketSize);
+   } else if (NULL != packet->metaPacket) {
+      maxReplySize = MIN(maxReplySize, packet->metaPacketSize);
+   }
+
+   /* Allow for the largest reply header. */
+   return maxReplySize - MIN(maxReplySize, sizeof (HgfsHeader));
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -9210,9 +9774,10 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
 
    /*
     * For search read V4 we use the whole packet buffer available to pack
-    * as many replies as can fit into that size. For all previous versions
-    * only one record is going to be returned, so we allow the old packet
-    * max for the reply.
+    * as many replies as can fit into that size. V3 requests asking for
+    * multiple entries get an inline payload as large as the reply packet
+    * allows. For all other requests only one record is going to be
+    * returned, so we allow the old packet max for the reply.
     */
    if (HgfsUnpackSearchReadRequest(input->payload, input->payloadSize, input->op,
                                    &info, &baseReplySize, &inlineDataSize,
@@ -9221,6 +9786,16 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
       LOG(4, "%s: read search #%u, offset %u\n", __FUNCTION__,
           hgfsSearchHandle, info.startIndex);
 
+      if (0 != inlineDataSize &&
+          0 == (info.flags & HGFS_SEARCH_READ_SINGLE_ENTRY)) {
+         size_t maxReplySize = HgfsServerSearchReadMaxReplySize(input);
+
+         if (maxReplySize > baseReplySize + inlineDataSize) {
+            inlineDataSize = maxReplySize - baseReplySize;
+            info.payloadSize = inlineDataSize;
+         }
+      }
+
       info.reply = HgfsAllocInitReply(input->packet, input->request,
                                       baseReplySize + inlineDataSize,
                                       input->session);
@@ -9298,6 +9873,9 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
                }
             }
 
+            if (HGFS_INVALID_FILE_DESC != search.dirFd) {
+               HgfsPlatformCloseFile(search.dirFd, NULL);
+            }
             free(search.utf8Dir);
             free(search.utf8ShareName);
 
@@ -9410,12 +9988,7 @@ HgfsServerDestroySession(HgfsInputParam *input)  // IN: Input params
       transportSession->defaultSessionId = HGFS_INVALID_SESSION_ID;
    }
 
-   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
-      HgfsCache_Destroy(session->symlinkCache);
-      session->symlinkCache = NULL;
-      HgfsCache_Destroy(session->fileAttrCache);
-      session->fileAttrCache = NULL;
-   }
+   HgfsServerDestroyCaches(session);
 
    /*
     * Remove the session from the list. By doing that, the refcount of
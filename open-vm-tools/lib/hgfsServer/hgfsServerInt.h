@@ -26,13 +26,16 @@ struct DirectoryEntry;
 
 #ifndef _WIN32
    typedef int fileDesc;
+#  define HGFS_INVALID_FILE_DESC (-1)
 #else
 #  include <windows.h>
    typedef HANDLE fileDesc;
+#  define HGFS_INVALID_FILE_DESC INVALID_HANDLE_VALUE
 #endif
 
 #include "dbllnklst.h"
 #include "cpName.h"     // for HgfsNameStatus
+#include "hashTable.h"
 #include "hgfsCache.h"
 #include "hgfsProto.h"
 #include "hgfsServer.h" // for the server public types
@@ -236,6 +239,12 @@ typedef struct HgfsFileNode {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /* Read access pattern, see HgfsHandleUpdateReadahead. */
+   uint64 readNextOffset;      /* Offset following the last read. */
+   uint64 readaheadEnd;        /* End of the range already prefetched. */
+   uint32 readSequentialCount; /* Consecutive sequential reads. */
+   uint32 readaheadWindow;     /* Prefetch window, 0 when not sequential. */
 } HgfsFileNode;
 
 
@@ -292,6 +301,13 @@ typedef struct HgfsSearch {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /*
+    * Open directory used by the platform to query the attributes of the
+    * entries of a search copy, relative to the directory rather than by
+    * full path. Only valid for the duration of a single request.
+    */
+   fileDesc dirFd;
 } HgfsSearch;
 
 /* HgfsSearch flags. */
@@ -349,8 +365,8 @@ typedef struct HgfsSessionInfo {
    /*
     ** START NODE ARRAY **************************************************
     *
-    * Lock for the following 6 fields: the node array,
-    * counters and lists for this session.
+    * Lock for the following 8 fields: the node array,
+    * counters, lists and lookup tables for this session.
     */
    MXUserExclLock *nodeArrayLock;
 
@@ -360,6 +376,12 @@ typedef struct HgfsSessionInfo {
    /* Number of nodes in the nodeArray. */
    uint32 numNodes;
 
+   /* Maps the handle of each in use node to its nodeArray index. */
+   HashTable *nodeHandleTable;
+
+   /* Maps the open file descriptor of each in use node to its index. */
+   HashTable *nodeFileDescTable;
+
    /* Free list of file nodes. LIFO to be cache-friendly. */
    DblLnkLst_Links nodeFreeList;
 
@@ -719,6 +741,16 @@ HgfsGetNodeCopy(HgfsHandle handle,        // IN: Hgfs file handle
                 Bool copyName,            // IN: Should we copy the name?
                 HgfsFileNode *copy);      // IN/OUT: Copy of the node
 
+Bool
+HgfsHandleUpdateReadahead(HgfsHandle handle,         // IN: Hgfs file handle
+                          HgfsSessionInfo *session,  // IN: Session info
+                          uint64 offset,             // IN: offset read from
+                          uint32 size,               // IN: bytes read
+                          Bool *patternChanged,      // OUT: sequential changed
+                          Bool *sequential,          // OUT: reads are sequential
+                          uint64 *prefetchOffset,    // OUT: range to prefetch
+                          uint32 *prefetchSize);     // OUT: 0 if none
+
 Bool
 HgfsHandleIsSequentialOpen(HgfsHandle handle,        // IN:  Hgfs file handle
                            HgfsSessionInfo *session, // IN: session info
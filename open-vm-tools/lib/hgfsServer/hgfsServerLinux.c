@@ -67,7 +67,11 @@
 #include "su.h"
 #include "codeset.h"
 #include "unicodeOperations.h"
+#include "unicodeTransforms.h"
 #include "userlock.h"
+#include "hashTable.h"
+#include "dbllnklst.h"
+#include "mutexRankLib.h"
 
 #if defined(__linux__) && !defined(SYS_getdents64)
 /* For DT_UNKNOWN */
@@ -317,6 +321,40 @@ static const int HgfsServerOpenMode[] = {
    O_RDWR,
 };
 
+/*
+ * Case insensitive lookups resolve each path component through an index of
+ * the case folded names of its parent directory, built on the first lookup
+ * in that directory. An index is only trusted while the directory's mtime and
+ * ctime are unchanged, and is not built for directories modified in the last
+ * HGFS_CASE_INDEX_RACY_SECS seconds since a change within the same mtime
+ * tick would go unnoticed. The indexes are kept in LRU order and bounded both
+ * in number and in the total names held.
+ */
+#define HGFS_CASE_INDEX_BUCKETS     256
+#define HGFS_CASE_INDEX_MAX_DIRS    256
+#define HGFS_CASE_INDEX_MAX_NAMES   (256 * 1024)
+#define HGFS_CASE_INDEX_RACY_SECS   2
+
+typedef struct HgfsCaseIndexDir {
+   DblLnkLst_Links links;       /* LRU list, most recently used first. */
+   char *dirPath;
+   dev_t dev;
+   ino_t ino;
+   time_t mtime;
+   time_t ctime;
+   HashTable *names;            /* Folded name -> name on disk. */
+   uint32 numNames;
+} HgfsCaseIndexDir;
+
+typedef struct HgfsCaseIndex {
+   MXUserExclLock *lock;
+   HashTable *dirs;             /* Directory path -> HgfsCaseIndexDir. */
+   DblLnkLst_Links lruList;
+   uint32 numNames;             /* Names held by all the indexes. */
+} HgfsCaseIndex;
+
+static HgfsCaseIndex gHgfsCaseIndex;
+
 /* Local functions. */
 static HgfsInternalStatus HgfsGetattrResolveAlias(char const *fileName,
                                                   char **targetName);
@@ -339,6 +377,8 @@ static void HgfsGetSequentialOnlyFlagFromName(const char *fileName,
 static void HgfsGetSequentialOnlyFlagFromFd(int fd,
                                             HgfsFileAttrInfo *attr);
 
+static void HgfsCaseIndexRemoveDir(HgfsCaseIndexDir *dir);
+
 static int HgfsConvertComponentCase(char *currentComponent,
                                     const char *dirPath,
                                     const char **convertedComponent,
@@ -559,6 +599,12 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsPlatformInit(void)
 {
+   gHgfsCaseIndex.lock = MXUser_CreateExclLock("HgfsCaseIndexLock",
+                                               RANK_hgfsCaseIndexLock);
+   gHgfsCaseIndex.dirs = HashTable_Alloc(HGFS_CASE_INDEX_BUCKETS,
+                                         HASH_STRING_KEY, NULL);
+   DblLnkLst_Init(&gHgfsCaseIndex.lruList);
+   gHgfsCaseIndex.numNames = 0;
    return TRUE;
 }
 
@@ -582,6 +628,14 @@ HgfsPlatformInit(void)
 void
 HgfsPlatformDestroy(void)
 {
+   while (DblLnkLst_IsLinked(&gHgfsCaseIndex.lruList)) {
+      HgfsCaseIndexRemoveDir(DblLnkLst_Container(gHgfsCaseIndex.lruList.next,
+                                                 HgfsCaseIndexDir, links));
+   }
+   HashTable_Free(gHgfsCaseIndex.dirs);
+   gHgfsCaseIndex.dirs = NULL;
+   MXUser_DestroyExclLock(gHgfsCaseIndex.lock);
+   gHgfsCaseIndex.lock = NULL;
 }
 
 
@@ -1405,6 +1459,259 @@ HgfsGetHiddenAttr(char const *fileName,         // IN:  Input filename
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexRemoveDir --
+ *
+ *    Remove a directory index and free it. The case index lock must be held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseIndexRemoveDir(HgfsCaseIndexDir *dir)  // IN
+{
+   DblLnkLst_Unlink1(&dir->links);
+   HashTable_Delete(gHgfsCaseIndex.dirs, dir->dirPath);
+   gHgfsCaseIndex.numNames -= dir->numNames;
+   HashTable_Free(dir->names);
+   free(dir->dirPath);
+   free(dir);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexFold --
+ *
+ *    Case fold a directory entry name the same way Unicode_CompareIgnoreCase
+ *    compares names.
+ *
+ * Results:
+ *    The allocated folded name, or NULL if the name is not valid in the
+ *    default encoding.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsCaseIndexFold(const char *name)  // IN
+{
+   char *nameU;
+   char *folded;
+
+   if (!Unicode_IsBufferValid(name, strlen(name), STRING_ENCODING_DEFAULT)) {
+      return NULL;
+   }
+
+   nameU = Unicode_Alloc(name, STRING_ENCODING_DEFAULT);
+   folded = Unicode_FoldCase(nameU);
+   free(nameU);
+   return folded;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexBuild --
+ *
+ *    Read a directory and build the index of its case folded names. When
+ *    several names fold to the same key the first one read wins, which is
+ *    the one the directory scan would have returned.
+ *
+ * Results:
+ *    The index, or NULL if the directory could not be read or changed while
+ *    being read.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsCaseIndexDir *
+HgfsCaseIndexBuild(const char *dirPath,        // IN
+                   const struct stat *dirStat) // IN: taken before the read
+{
+   HgfsCaseIndexDir *dir;
+   DIR *dirStream;
+   struct dirent *dirent;
+   struct stat afterStat;
+   char **names = NULL;
+   uint32 numNames = 0;
+   uint32 maxNames = 0;
+   uint32 numBuckets;
+   uint32 i;
+
+   dirStream = Posix_OpenDir(dirPath);
+   if (NULL == dirStream) {
+      return NULL;
+   }
+
+   while ((dirent = readdir(dirStream)) != NULL) {
+      if (numNames == maxNames) {
+         maxNames = maxNames == 0 ? 64 : maxNames * 2;
+         names = Util_SafeRealloc(names, maxNames * sizeof *names);
+      }
+      names[numNames++] = Util_SafeStrdup(dirent->d_name);
+   }
+   closedir(dirStream);
+
+   dir = NULL;
+   if (Posix_Stat(dirPath, &afterStat) != 0 ||
+       afterStat.st_mtime != dirStat->st_mtime ||
+       afterStat.st_ctime != dirStat->st_ctime ||
+       afterStat.st_ino != dirStat->st_ino) {
+      LOG(4, "%s: %s changed while being indexed\n", __FUNCTION__, dirPath);
+      goto exit;
+   }
+
+   for (numBuckets = 16; numBuckets < numNames && numBuckets < 64 * 1024;
+        numBuckets <<= 1) {
+   }
+
+   dir = Util_SafeCalloc(1, sizeof *dir);
+   DblLnkLst_Init(&dir->links);
+   dir->dirPath = Util_SafeStrdup(dirPath);
+   dir->dev = dirStat->st_dev;
+   dir->ino = dirStat->st_ino;
+   dir->mtime = dirStat->st_mtime;
+   dir->ctime = dirStat->st_ctime;
+   dir->names = HashTable_Alloc(numBuckets,
+                                HASH_STRING_KEY | HASH_FLAG_COPYKEY, free);
+
+   for (i = 0; i < numNames; i++) {
+      char *folded = HgfsCaseIndexFold(names[i]);
+
+      if (NULL == folded) {
+         /* Names that are not valid unicode never match, as in the scan. */
+         continue;
+      }
+      if (HashTable_Insert(dir->names, folded, names[i])) {
+         names[i] = NULL;
+         dir->numNames++;
+      }
+      free(folded);
+   }
+
+exit:
+   for (i = 0; i < numNames; i++) {
+      free(names[i]);
+   }
+   free(names);
+   return dir;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexLookup --
+ *
+ *    Look a component up in the case folded name index of its parent
+ *    directory, building the index if there is no valid one.
+ *
+ * Results:
+ *    TRUE if the index answered the lookup, with the name on disk returned
+ *    in match or NULL if the directory has no such entry.
+ *    FALSE if no index could be used, the caller must scan the directory.
+ *
+ * Side effects:
+ *    On success, allocated memory may be returned in match.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCaseIndexLookup(const char *component, // IN: valid UTF-8
+                    const char *dirPath,   // IN
+                    char **match)          // OUT
+{
+   HgfsCaseIndexDir *dir;
+   HgfsCaseIndexDir *newDir;
+   struct stat dirStat;
+   char *folded;
+   char *name;
+   Bool found = FALSE;
+
+   *match = NULL;
+
+   if (NULL == gHgfsCaseIndex.lock ||
+       Posix_Stat(dirPath, &dirStat) != 0 ||
+       !S_ISDIR(dirStat.st_mode)) {
+      return FALSE;
+   }
+
+   folded = Unicode_FoldCase(component);
+
+   MXUser_AcquireExclLock(gHgfsCaseIndex.lock);
+   if (HashTable_Lookup(gHgfsCaseIndex.dirs, dirPath, (void **)&dir)) {
+      if (dir->dev == dirStat.st_dev && dir->ino == dirStat.st_ino &&
+          dir->mtime == dirStat.st_mtime && dir->ctime == dirStat.st_ctime) {
+         if (HashTable_Lookup(dir->names, folded, (void **)&name)) {
+            *match = Util_SafeStrdup(name);
+         }
+         DblLnkLst_Unlink1(&dir->links);
+         DblLnkLst_LinkFirst(&gHgfsCaseIndex.lruList, &dir->links);
+         found = TRUE;
+      } else {
+         HgfsCaseIndexRemoveDir(dir);
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsCaseIndex.lock);
+
+   if (found ||
+       MAX(dirStat.st_mtime, dirStat.st_ctime) + HGFS_CASE_INDEX_RACY_SECS >=
+       time(NULL)) {
+      goto exit;
+   }
+
+   newDir = HgfsCaseIndexBuild(dirPath, &dirStat);
+   if (NULL == newDir) {
+      goto exit;
+   }
+
+   if (HashTable_Lookup(newDir->names, folded, (void **)&name)) {
+      *match = Util_SafeStrdup(name);
+   }
+   found = TRUE;
+
+   MXUser_AcquireExclLock(gHgfsCaseIndex.lock);
+   if (HashTable_Lookup(gHgfsCaseIndex.dirs, dirPath, (void **)&dir)) {
+      /* Another lookup indexed the directory meanwhile, keep the newest. */
+      HgfsCaseIndexRemoveDir(dir);
+   }
+   HashTable_Insert(gHgfsCaseIndex.dirs, newDir->dirPath, newDir);
+   DblLnkLst_LinkFirst(&gHgfsCaseIndex.lruList, &newDir->links);
+   gHgfsCaseIndex.numNames += newDir->numNames;
+
+   while (HashTable_GetNumElements(gHgfsCaseIndex.dirs) >
+          HGFS_CASE_INDEX_MAX_DIRS ||
+          (gHgfsCaseIndex.numNames > HGFS_CASE_INDEX_MAX_NAMES &&
+           gHgfsCaseIndex.lruList.prev != &newDir->links)) {
+      HgfsCaseIndexRemoveDir(DblLnkLst_Container(gHgfsCaseIndex.lruList.prev,
+                                                 HgfsCaseIndexDir, links));
+   }
+   MXUser_ReleaseExclLock(gHgfsCaseIndex.lock);
+
+exit:
+   free(folded);
+   return found;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1448,13 +1755,6 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
    ASSERT(convertedComponent);
    ASSERT(convertedComponentSize);
 
-   /* Open the specified directory. */
-   dir = Posix_OpenDir(dirPath);
-   if (!dir) {
-      ret = errno;
-      goto exit;
-   }
-
    /*
     * Unicode_CompareIgnoreCase crashes with invalid unicode strings,
     * validate it before passing it to Unicode_* functions.
@@ -1465,6 +1765,24 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
       goto exit;
    }
 
+   if (HgfsCaseIndexLookup(currentComponent, dirPath, &myConvertedComponent)) {
+      if (NULL == myConvertedComponent) {
+         ret = ENOENT;
+      } else {
+         ret = 0;
+         *convertedComponentSize = strlen(myConvertedComponent) + 1;
+         *convertedComponent = myConvertedComponent;
+      }
+      goto exit;
+   }
+
+   /* No usable index, open the specified directory and scan it. */
+   dir = Posix_OpenDir(dirPath);
+   if (!dir) {
+      ret = errno;
+      goto exit;
+   }
+
    /*
     * Read all of the directory entries. For each one, convert the name
     * to lower case and then compare it to the lower case component.
@@ -3548,6 +3866,121 @@ out:
 }
 
 
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGetattrFromDirFd --
+ *
+ *    Gets the attributes of a directory entry relative to the search
+ *    directory, opening the directory on first use. This returns the same
+ *    attributes as HgfsPlatformGetattrFromName for a directory entry, but
+ *    each lookup resolves only the entry name instead of the whole path, and
+ *    only special files are opened to probe for the sequential only flag
+ *    (regular files, directories and symlinks never have it).
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    The search directory may be opened, it is closed with the search copy.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsGetattrFromDirFd(HgfsSearch *search,             // IN/OUT: search copy
+                     const char *fullName,           // IN: full name of the entry
+                     const char *entryName,          // IN: entry name
+                     HgfsShareOptions configOptions, // IN: share config options
+                     HgfsFileAttrInfo *attr)         // OUT: entry attributes
+{
+   HgfsInternalStatus status = 0;
+   struct stat stats;
+   uint64 creationTime;
+   Bool followSymlinks;
+   char *localName;
+
+   followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+
+   if (search->dirFd < 0) {
+      /* Same flags as HgfsPlatformScandir used to list the directory. */
+      search->dirFd = Posix_Open(search->utf8Dir,
+                                 O_NONBLOCK | O_RDONLY | O_DIRECTORY |
+                                 (followSymlinks ? 0 : O_NOFOLLOW));
+      if (search->dirFd < 0) {
+         status = errno;
+         LOG(4, "%s: error opening \"%s\": %s\n", __FUNCTION__,
+             search->utf8Dir, Err_Errno2String(status));
+         return status;
+      }
+   }
+
+   /* Names are UTF8, convert them as the Posix_ wrappers would. */
+   localName = Unicode_GetAllocBytes(entryName, STRING_ENCODING_DEFAULT);
+   if (localName == NULL) {
+      return UNICODE_CONVERSION_ERRNO;
+   }
+
+   if (fstatat(search->dirFd, localName, &stats,
+               followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW) < 0) {
+      status = errno;
+      LOG(4, "%s: error stating \"%s\": %s\n", __FUNCTION__, fullName,
+          Err_Errno2String(status));
+      goto exit;
+   }
+   creationTime = HgfsGetCreationTime(&stats);
+
+   if (S_ISDIR(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_DIRECTORY;
+   } else if (S_ISLNK(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_SYMLINK;
+   } else {
+      attr->type = HGFS_FILE_TYPE_REGULAR;
+   }
+
+   HgfsStatToFileAttr(&stats, &creationTime, attr);
+   HgfsGetHiddenAttr(fullName, attr);
+
+   if (!S_ISREG(stats.st_mode) &&
+       !S_ISDIR(stats.st_mode) &&
+       !S_ISLNK(stats.st_mode)) {
+      HgfsGetSequentialOnlyFlagFromName(fullName, followSymlinks, attr);
+   }
+
+   /* Get effective permissions if we can, as HgfsEffectivePermissions does. */
+   if (!S_ISLNK(stats.st_mode)) {
+      HgfsOpenMode shareMode;
+      HgfsNameStatus nameStatus;
+
+      nameStatus = HgfsServerPolicy_GetShareMode(search->utf8ShareName,
+                                                 search->utf8ShareNameLen,
+                                                 &shareMode);
+      if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
+         attr->effectivePerms = 0;
+         if (faccessat(search->dirFd, localName, R_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_READ;
+         }
+         if (faccessat(search->dirFd, localName, X_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_EXEC;
+         }
+         if (shareMode != HGFS_OPEN_MODE_READ_ONLY &&
+             faccessat(search->dirFd, localName, W_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_WRITE;
+         }
+         attr->mask |= HGFS_ATTR_VALID_EFFECTIVE_PERMS;
+      }
+   }
+
+exit:
+   free(localName);
+   return status;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -3625,9 +4058,14 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
                    "to avoid oplock break deadlock\n", __FUNCTION__);
                status = HgfsPlatformGetattrFromFd(fileDesc, session, entryAttr);
             } else {
+#if defined(__linux__)
+               status = HgfsGetattrFromDirFd(search, fullName, dirEntry->d_name,
+                                             configOptions, entryAttr);
+#else
                status = HgfsPlatformGetattrFromName(fullName, configOptions,
                                                     search->utf8ShareName,
                                                     entryAttr, NULL);
+#endif
             }
 
             if (HGFS_ERROR_SUCCESS != status) {
@@ -3779,6 +4217,7 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
    int result;
    DirectoryEntry **myDents = NULL;
    int myNumDents = 0;
+   int myMaxDents = 0;
    HgfsInternalStatus status = 0;
 
    /*
@@ -3845,13 +4284,21 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
          /* This dent had better fit in the actual space we've got left. */
          ASSERT(newDent->d_reclen <= result - offset);
 
-         /* Add another dent pointer to the dents array. */
-         newDents = realloc(myDents, sizeof *myDents * (myNumDents + 1));
-         if (newDents == NULL) {
-            status = ENOMEM;
-            goto exit;
+         /*
+          * Add another dent pointer to the dents array, growing it
+          * geometrically so that large directories are not quadratic.
+          */
+         if (myNumDents == myMaxDents) {
+            int newMaxDents = MAX(2 * myMaxDents, 64);
+
+            newDents = realloc(myDents, sizeof *myDents * newMaxDents);
+            if (newDents == NULL) {
+               status = ENOMEM;
+               goto exit;
+            }
+            myDents = newDents;
+            myMaxDents = newMaxDents;
          }
-         myDents = newDents;
 
          /*
           * Allocate the new dent and set it up. We do a straight memcpy of
@@ -4137,6 +4584,66 @@ exit:
  */
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsReadahead --
+ *
+ *    Feed a completed read to the handle's access pattern detection and
+ *    advise the kernel accordingly: sequential handles get the kernel's
+ *    aggressive readahead and have the data ahead of the reader prefetched
+ *    into the page cache, so that it is ready when the next requests arrive.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May start asynchronous reads of the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsReadahead(fileDesc file,               // IN: file descriptor
+              HgfsHandle handle,           // IN: Hgfs file handle
+              HgfsSessionInfo *session,    // IN: session info
+              uint64 offset,               // IN: offset read from
+              uint32 size)                 // IN: bytes read
+{
+#if defined(POSIX_FADV_WILLNEED)
+   Bool patternChanged;
+   Bool sequential;
+   uint64 prefetchOffset;
+   uint32 prefetchSize;
+   int error;
+
+   if (!HgfsHandleUpdateReadahead(handle, session, offset, size,
+                                  &patternChanged, &sequential,
+                                  &prefetchOffset, &prefetchSize)) {
+      return;
+   }
+
+   if (patternChanged) {
+      LOG(4, "%s: fh %u is now %s\n", __FUNCTION__, file,
+          sequential ? "sequential" : "random");
+      posix_fadvise(file, 0, 0,
+                    sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+   }
+
+   if (prefetchSize != 0) {
+      LOG(10, "%s: fh %u prefetch %"FMT64"u + %u\n", __FUNCTION__, file,
+          prefetchOffset, prefetchSize);
+      error = posix_fadvise(file, prefetchOffset, prefetchSize,
+                            POSIX_FADV_WILLNEED);
+      if (error != 0) {
+         LOG(4, "%s: prefetch failed: %s\n", __FUNCTION__,
+             Err_Errno2String(error));
+      }
+   }
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4231,6 +4738,7 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
    } else {
       LOG(4, "%s: read %d bytes\n", __FUNCTION__, error);
       *actualSize = error;
+      HgfsReadahead(file, handle, session, offset, *actualSize);
    }
 
    return status;
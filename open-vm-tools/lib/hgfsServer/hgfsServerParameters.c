@@ -2893,8 +2893,8 @@ HgfsPackSearchReadReplyHeaderV3(HgfsSearchReadInfo *info,     // IN: reply info
                                 HgfsReplySearchReadV3 *reply, // OUT: payload
                                 size_t *headerSize)           // OUT: size written
 {
-   ASSERT(info->numberRecordsWritten <= 1 &&
-          0 != (info->flags & HGFS_SEARCH_READ_SINGLE_ENTRY));
+   ASSERT(info->numberRecordsWritten <= 1 ||
+          0 == (info->flags & HGFS_SEARCH_READ_SINGLE_ENTRY));
    reply->count = info->numberRecordsWritten;
    reply->reserved = 0;
    /*
@@ -2916,7 +2916,7 @@ HgfsPackSearchReadReplyHeaderV3(HgfsSearchReadInfo *info,     // IN: reply info
  *    None.
  *
  * Side effects:
- *    None
+ *    The last record, if any, is linked to the new record.
  *
  *-----------------------------------------------------------------------------
  */
@@ -2925,8 +2925,13 @@ static void
 HgfsPackSearchReadReplyRecordV3(HgfsFileAttrInfo *attr,       // IN: attr stucture
                                 const char *utf8Name,         // IN: file name
                                 uint32 utf8NameLen,           // IN: file name length
+                                HgfsDirEntry *lastDirent,     // IN/OUT: last packed dirent
                                 HgfsDirEntry *replyDirent)    // OUT: reply buffer for dirent
 {
+   if (NULL != lastDirent) {
+      lastDirent->nextEntry = (uint32)((char*)replyDirent - (char*)lastDirent);
+   }
+
    replyDirent->fileName.length = (uint32)utf8NameLen;
    replyDirent->fileName.flags = 0;
    replyDirent->fileName.fid = 0;
@@ -3162,7 +3167,13 @@ HgfsUnpackSearchReadRequest(const void *packet,           // IN: request packet
 
       *hgfsSearchHandle = request->search;
       *startIndex = request->offset;
-      *flags = HGFS_SEARCH_READ_SINGLE_ENTRY;
+      /*
+       * Clients that can walk the nextEntry chain ask for multiple entries,
+       * the caller then grows the payload to what the reply packet allows.
+       */
+      if (0 == (request->flags & HGFS_SEARCH_READ_FLAG_MULTIPLE_REPLY)) {
+         *flags = HGFS_SEARCH_READ_SINGLE_ENTRY;
+      }
       *mask = (HGFS_SEARCH_READ_FILE_NODE_TYPE |
                HGFS_SEARCH_READ_NAME |
                HGFS_SEARCH_READ_FILE_SIZE |
@@ -3271,6 +3282,7 @@ HgfsPackSearchReadReplyRecord(HgfsOp requestType,           // IN: search read r
 
    case HGFS_OP_SEARCH_READ_V3: {
       HgfsDirEntry *replyCurrentEntry = currentSearchReadRecord;
+      HgfsDirEntry *replyLastEntry = lastSearchReadRecord;
 
       /*
        * Previous shipping tools expect to account for a whole reply,
@@ -3288,6 +3300,7 @@ HgfsPackSearchReadReplyRecord(HgfsOp requestType,           // IN: search read r
       HgfsPackSearchReadReplyRecordV3(&entry->attr,
                                       entry->name,
                                       entry->nameLength,
+                                      replyLastEntry,
                                       replyCurrentEntry);
       break;
    }
@@ -0,0 +1,755 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerStats.c --
+ *
+ *      Per-operation request statistics of the HGFS server.
+ *
+ *      Every request is timestamped when it is received, when a thread
+ *      starts processing it and when its reply is sent. The time between
+ *      the first two is queue wait (non-zero only for requests handed to
+ *      the threadpool, and so only reported while the pool is active), the
+ *      time between the last two is service time.
+ *      Per opcode we keep counts, request and reply bytes and log2
+ *      histograms of both times, all updated with atomics only.
+ *
+ *      Requests naming a file also note the share the name resolved to, on
+ *      the thread processing them, so service time can be broken down by
+ *      share as well. Requests working on an open handle are not
+ *      attributed to a share.
+ *
+ *      The slowest requests seen are kept as samples. Only a request
+ *      slower than the fastest sample takes the lock to replace it.
+ *
+ *      Everything is dumped through HgfsServer_DumpStats, which the tools
+ *      plugin calls when vmtoolsd is asked to dump its state.
+ */
+
+#include <string.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "str.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+#include "vm_atomic.h"
+#include "vm_basic_asm.h"
+#include "hgfsServerStats.h"
+
+ /*
+  * Local data
+  */
+
+/*
+ * Histogram bucket i counts requests taking [2^i, 2^(i+1)) microseconds,
+ * the first bucket also takes anything faster, the last anything slower.
+ */
+#define HGFS_STATS_BUCKETS 24
+
+/* Number of slowest requests kept. */
+#define HGFS_STATS_SLOW_SAMPLES 8
+
+/* Number of shares tracked, and the length share names are cut to. */
+#define HGFS_STATS_SHARES 32
+#define HGFS_STATS_SHARE_NAME_MAX 64
+
+typedef struct {
+   Atomic_uint64 count;
+   Atomic_uint64 errors;
+   Atomic_uint64 requestBytes;
+   Atomic_uint64 replyBytes;
+   Atomic_uint64 queueUs;
+   Atomic_uint64 serviceUs;
+   Atomic_uint64 maxServiceUs;
+   Atomic_uint64 queueHist[HGFS_STATS_BUCKETS];
+   Atomic_uint64 serviceHist[HGFS_STATS_BUCKETS];
+} HgfsServerOpStats;
+
+typedef struct {
+   HgfsOp op;
+   HgfsInternalStatus status;
+   uint64 sessionId;
+   uint32 requestId;
+   size_t requestSize;
+   size_t replySize;
+   uint64 queueUs;
+   uint64 serviceUs;
+   char share[HGFS_STATS_SHARE_NAME_MAX];
+} HgfsServerStatsSample;
+
+typedef struct {
+   char name[HGFS_STATS_SHARE_NAME_MAX];
+   Atomic_uint64 count;
+   Atomic_uint64 errors;
+   Atomic_uint64 serviceUs;
+   Atomic_uint64 maxServiceUs;
+} HgfsServerShareStats;
+
+static const char *gHgfsOpNames[] = {
+   "OPEN",
+   "READ",
+   "WRITE",
+   "CLOSE",
+   "SEARCH_OPEN",
+   "SEARCH_READ",
+   "SEARCH_CLOSE",
+   "GETATTR",
+   "SETATTR",
+   "CREATE_DIR",
+   "DELETE_FILE",
+   "DELETE_DIR",
+   "RENAME",
+   "QUERY_VOLUME_INFO",
+   "OPEN_V2",
+   "GETATTR_V2",
+   "SETATTR_V2",
+   "SEARCH_READ_V2",
+   "CREATE_SYMLINK",
+   "SERVER_LOCK_CHANGE",
+   "CREATE_DIR_V2",
+   "DELETE_FILE_V2",
+   "DELETE_DIR_V2",
+   "RENAME_V2",
+   "OPEN_V3",
+   "READ_V3",
+   "WRITE_V3",
+   "CLOSE_V3",
+   "SEARCH_OPEN_V3",
+   "SEARCH_READ_V3",
+   "SEARCH_CLOSE_V3",
+   "GETATTR_V3",
+   "SETATTR_V3",
+   "CREATE_DIR_V3",
+   "DELETE_FILE_V3",
+   "DELETE_DIR_V3",
+   "RENAME_V3",
+   "QUERY_VOLUME_INFO_V3",
+   "CREATE_SYMLINK_V3",
+   "SERVER_LOCK_CHANGE_V3",
+   "WRITE_WIN32_STREAM_V3",
+   "CREATE_SESSION_V4",
+   "DESTROY_SESSION_V4",
+   "READ_FAST_V4",
+   "WRITE_FAST_V4",
+   "SET_WATCH_V4",
+   "REMOVE_WATCH_V4",
+   "NOTIFY_V4",
+   "SEARCH_READ_V4",
+   "OPEN_V4",
+   "ENUMERATE_STREAMS_V4",
+   "GETATTR_V4",
+   "SETATTR_V4",
+   "DELETE_V4",
+   "LINKMOVE_V4",
+   "FSCTL_V4",
+   "ACCESS_CHECK_V4",
+   "FSYNC_V4",
+   "QUERY_VOLUME_INFO_V4",
+   "OPLOCK_ACQUIRE_V4",
+   "OPLOCK_BREAK_V4",
+   "LOCK_BYTE_RANGE_V4",
+   "UNLOCK_BYTE_RANGE_V4",
+   "QUERY_EAS_V4",
+   "SET_EAS_V4",
+};
+
+static HgfsServerOpStats gHgfsOpStats[HGFS_OP_MAX];
+
+/* Shares seen so far, entries below gHgfsShareCount never change names. */
+static HgfsServerShareStats gHgfsShareStats[HGFS_STATS_SHARES];
+static Atomic_uint32 gHgfsShareCount;
+
+/* Slowest requests, and the service time a request must beat to get in. */
+static HgfsServerStatsSample gHgfsSlowSamples[HGFS_STATS_SLOW_SAMPLES];
+static uint32 gHgfsSlowSampleCount;
+static Atomic_uint64 gHgfsSlowThresholdUs;
+
+/* Protects the samples and adding shares. */
+static MXUserExclLock *gHgfsStatsLock;
+
+/* Request being processed by this thread and the share it resolved to. */
+static __thread const void *gHgfsStatsRequest;
+static __thread char gHgfsStatsShare[HGFS_STATS_SHARE_NAME_MAX];
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Init --
+ *
+ *      Set up the lock protecting the slowest request samples.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Init(void)
+{
+   ASSERT_ON_COMPILE(ARRAYSIZE(gHgfsOpNames) == HGFS_OP_MAX);
+
+   if (NULL == gHgfsStatsLock) {
+      gHgfsStatsLock = MXUser_CreateExclLock("hgfsStatsLock",
+                                             RANK_hgfsStatsLock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Exit --
+ *
+ *      Tear down the statistics lock. The statistics themselves are kept.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Exit(void)
+{
+   if (NULL != gHgfsStatsLock) {
+      MXUser_DestroyExclLock(gHgfsStatsLock);
+      gHgfsStatsLock = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_BeginRequest --
+ *
+ *      Note that the calling thread starts processing a request.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_BeginRequest(const void *request)   // IN: request context
+{
+   gHgfsStatsRequest = request;
+   gHgfsStatsShare[0] = '\0';
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_NoteShare --
+ *
+ *      Note the share the request being processed by the calling thread
+ *      resolved a name to.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_NoteShare(const char *shareName,   // IN: share name
+                          size_t shareNameLen)     // IN: its length
+{
+   size_t len = MIN(shareNameLen, sizeof gHgfsStatsShare - 1);
+
+   if (NULL == gHgfsStatsRequest) {
+      return;
+   }
+   memcpy(gHgfsStatsShare, shareName, len);
+   gHgfsStatsShare[len] = '\0';
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsBucket --
+ *
+ *      Histogram bucket for a duration.
+ *
+ * Results:
+ *      Bucket index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsServerStatsBucket(uint64 us)   // IN: duration in microseconds
+{
+   int bit = mssb64_0(us);
+
+   if (bit < 0) {
+      return 0;
+   }
+   return MIN((uint32)bit, HGFS_STATS_BUCKETS - 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsUpdateMax --
+ *
+ *      Raise an atomic maximum.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsUpdateMax(Atomic_uint64 *maxVar,   // IN/OUT: maximum
+                         uint64 value)            // IN: new value
+{
+   uint64 cur = Atomic_Read64(maxVar);
+
+   while (value > cur) {
+      uint64 prev = Atomic_ReadIfEqualWrite64(maxVar, cur, value);
+
+      if (prev == cur) {
+         break;
+      }
+      cur = prev;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsGetShare --
+ *
+ *      Find the statistics of a share, adding them if this is the first
+ *      request seen for it.
+ *
+ * Results:
+ *      The share statistics, NULL if the table is full.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsServerShareStats *
+HgfsServerStatsGetShare(const char *name)   // IN: share name
+{
+   HgfsServerShareStats *share = NULL;
+   uint32 count = Atomic_Read32(&gHgfsShareCount);
+   uint32 i;
+
+   for (i = 0; i < count; i++) {
+      if (strcmp(gHgfsShareStats[i].name, name) == 0) {
+         return &gHgfsShareStats[i];
+      }
+   }
+
+   if (NULL == gHgfsStatsLock) {
+      return NULL;
+   }
+
+   MXUser_AcquireExclLock(gHgfsStatsLock);
+   count = Atomic_Read32(&gHgfsShareCount);
+   for (; i < count; i++) {
+      if (strcmp(gHgfsShareStats[i].name, name) == 0) {
+         share = &gHgfsShareStats[i];
+         break;
+      }
+   }
+   if (NULL == share && count < HGFS_STATS_SHARES) {
+      share = &gHgfsShareStats[count];
+      Str_Strcpy(share->name, name, sizeof share->name);
+      /* Publishes the name. */
+      Atomic_Inc32(&gHgfsShareCount);
+   }
+   MXUser_ReleaseExclLock(gHgfsStatsLock);
+
+   return share;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsAddSample --
+ *
+ *      Keep a request among the slowest samples if it is slow enough.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsAddSample(const HgfsServerStatsSample *sample)  // IN: request
+{
+   uint32 slot;
+   uint32 i;
+
+   if (NULL == gHgfsStatsLock ||
+       sample->serviceUs <= Atomic_Read64(&gHgfsSlowThresholdUs)) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsStatsLock);
+   if (gHgfsSlowSampleCount < HGFS_STATS_SLOW_SAMPLES) {
+      slot = gHgfsSlowSampleCount++;
+   } else {
+      slot = 0;
+      for (i = 1; i < HGFS_STATS_SLOW_SAMPLES; i++) {
+         if (gHgfsSlowSamples[i].serviceUs < gHgfsSlowSamples[slot].serviceUs) {
+            slot = i;
+         }
+      }
+      if (sample->serviceUs <= gHgfsSlowSamples[slot].serviceUs) {
+         slot = HGFS_STATS_SLOW_SAMPLES;
+      }
+   }
+
+   if (slot < HGFS_STATS_SLOW_SAMPLES) {
+      gHgfsSlowSamples[slot] = *sample;
+      if (gHgfsSlowSampleCount == HGFS_STATS_SLOW_SAMPLES) {
+         uint64 threshold = gHgfsSlowSamples[0].serviceUs;
+
+         for (i = 1; i < HGFS_STATS_SLOW_SAMPLES; i++) {
+            threshold = MIN(threshold, gHgfsSlowSamples[i].serviceUs);
+         }
+         Atomic_Write64(&gHgfsSlowThresholdUs, threshold);
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsStatsLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_EndRequest --
+ *
+ *      Account a request whose reply is being sent.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_EndRequest(const void *request,         // IN: request context
+                           HgfsOp op,                   // IN: opcode
+                           HgfsInternalStatus status,   // IN: reply status
+                           uint64 sessionId,            // IN: session
+                           uint32 requestId,            // IN: request id
+                           size_t requestSize,          // IN: request bytes
+                           size_t replySize,            // IN: reply bytes
+                           VmTimeType receiveTime,      // IN: received, ns
+                           VmTimeType startTime)        // IN: started, ns
+{
+   VmTimeType now = Hostinfo_SystemTimerNS();
+   HgfsServerStatsSample sample;
+   Bool failed = HGFS_ERROR_SUCCESS != status;
+
+   if (0 == startTime) {
+      /* Rejected before it was processed. */
+      startTime = now;
+   }
+
+   sample.op = op;
+   sample.status = status;
+   sample.sessionId = sessionId;
+   sample.requestId = requestId;
+   sample.requestSize = requestSize;
+   sample.replySize = replySize;
+   sample.queueUs = startTime > receiveTime ?
+                    (startTime - receiveTime) / 1000 : 0;
+   sample.serviceUs = now > startTime ? (now - startTime) / 1000 : 0;
+   sample.share[0] = '\0';
+   if (gHgfsStatsRequest == request) {
+      Str_Strcpy(sample.share, gHgfsStatsShare, sizeof sample.share);
+      gHgfsStatsRequest = NULL;
+   }
+
+   if (op < HGFS_OP_MAX) {
+      HgfsServerOpStats *stats = &gHgfsOpStats[op];
+
+      Atomic_Inc64(&stats->count);
+      if (failed) {
+         Atomic_Inc64(&stats->errors);
+      }
+      Atomic_Add64(&stats->requestBytes, requestSize);
+      Atomic_Add64(&stats->replyBytes, replySize);
+      Atomic_Add64(&stats->queueUs, sample.queueUs);
+      Atomic_Add64(&stats->serviceUs, sample.serviceUs);
+      Atomic_Inc64(&stats->queueHist[HgfsServerStatsBucket(sample.queueUs)]);
+      Atomic_Inc64(&stats->serviceHist[HgfsServerStatsBucket(sample.serviceUs)]);
+      HgfsServerStatsUpdateMax(&stats->maxServiceUs, sample.serviceUs);
+   }
+
+   if ('\0' != sample.share[0]) {
+      HgfsServerShareStats *share = HgfsServerStatsGetShare(sample.share);
+
+      if (NULL != share) {
+         Atomic_Inc64(&share->count);
+         if (failed) {
+            Atomic_Inc64(&share->errors);
+         }
+         Atomic_Add64(&share->serviceUs, sample.serviceUs);
+         HgfsServerStatsUpdateMax(&share->maxServiceUs, sample.serviceUs);
+      }
+   }
+
+   HgfsServerStatsAddSample(&sample);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsOpName --
+ *
+ *      Printable name of an opcode.
+ *
+ * Results:
+ *      The name, "?" for unknown opcodes.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+HgfsServerStatsOpName(HgfsOp op)   // IN: opcode
+{
+   return op < HGFS_OP_MAX ? gHgfsOpNames[op] : "?";
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsFormatHist --
+ *
+ *      Format the non-empty buckets of a histogram as "<bound:count ...".
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerStatsFormatHist(Atomic_uint64 *hist,   // IN: histogram
+                          char *buf,             // OUT: formatted buckets
+                          size_t bufSize)        // IN: size of buf
+{
+   size_t used = 0;
+   uint32 i;
+
+   buf[0] = '\0';
+   for (i = 0; i < HGFS_STATS_BUCKETS && used < bufSize; i++) {
+      uint64 count = Atomic_Read64(&hist[i]);
+      int len;
+
+      if (0 == count) {
+         continue;
+      }
+      len = Str_Snprintf(buf + used, bufSize - used, " %s%"FMT64"u:%"FMT64"u",
+                         i == HGFS_STATS_BUCKETS - 1 ? ">=" : "<",
+                         CONST64U(1) << (i == HGFS_STATS_BUCKETS - 1 ? i : i + 1),
+                         count);
+      if (len < 0) {
+         break;
+      }
+      used += len;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Dump --
+ *
+ *      Report the statistics one line at a time. Counters keep changing
+ *      while they are read, so figures of a busy server can be off from
+ *      each other by a few requests. Queue wait is left out unless the
+ *      threadpool is active, as it is always zero otherwise.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Dump(HgfsServerStatsDumpFunc *dumpFn,   // IN: line consumer
+                     void *clientData,                  // IN: for dumpFn
+                     Bool threadpoolActive)             // IN: queue wait kept
+{
+   HgfsServerStatsSample samples[HGFS_STATS_SLOW_SAMPLES];
+   uint32 numSamples = 0;
+   char line[512];
+   char hist[384];
+   uint32 count;
+   uint32 i;
+
+   dumpFn(clientData, "HGFS server requests (times in microseconds):");
+   for (i = 0; i < HGFS_OP_MAX; i++) {
+      HgfsServerOpStats *stats = &gHgfsOpStats[i];
+      uint64 n = Atomic_Read64(&stats->count);
+
+      if (0 == n) {
+         continue;
+      }
+      if (threadpoolActive) {
+         Str_Snprintf(line, sizeof line,
+                      "  %-22s count %"FMT64"u errors %"FMT64"u "
+                      "bytes in %"FMT64"u out %"FMT64"u "
+                      "avg queue %"FMT64"u service %"FMT64"u max %"FMT64"u",
+                      HgfsServerStatsOpName(i), n,
+                      Atomic_Read64(&stats->errors),
+                      Atomic_Read64(&stats->requestBytes),
+                      Atomic_Read64(&stats->replyBytes),
+                      Atomic_Read64(&stats->queueUs) / n,
+                      Atomic_Read64(&stats->serviceUs) / n,
+                      Atomic_Read64(&stats->maxServiceUs));
+      } else {
+         Str_Snprintf(line, sizeof line,
+                      "  %-22s count %"FMT64"u errors %"FMT64"u "
+                      "bytes in %"FMT64"u out %"FMT64"u "
+                      "avg service %"FMT64"u max %"FMT64"u",
+                      HgfsServerStatsOpName(i), n,
+                      Atomic_Read64(&stats->errors),
+                      Atomic_Read64(&stats->requestBytes),
+                      Atomic_Read64(&stats->replyBytes),
+                      Atomic_Read64(&stats->serviceUs) / n,
+                      Atomic_Read64(&stats->maxServiceUs));
+      }
+      dumpFn(clientData, line);
+
+      if (threadpoolActive) {
+         HgfsServerStatsFormatHist(stats->queueHist, hist, sizeof hist);
+         Str_Snprintf(line, sizeof line, "    queue  %s", hist);
+         dumpFn(clientData, line);
+      }
+      HgfsServerStatsFormatHist(stats->serviceHist, hist, sizeof hist);
+      Str_Snprintf(line, sizeof line, "    service%s", hist);
+      dumpFn(clientData, line);
+   }
+
+   count = Atomic_Read32(&gHgfsShareCount);
+   if (count > 0) {
+      dumpFn(clientData, "HGFS server requests by share:");
+   }
+   for (i = 0; i < count; i++) {
+      HgfsServerShareStats *share = &gHgfsShareStats[i];
+      uint64 n = Atomic_Read64(&share->count);
+
+      Str_Snprintf(line, sizeof line,
+                   "  %-22s count %"FMT64"u errors %"FMT64"u "
+                   "avg service %"FMT64"u max %"FMT64"u",
+                   share->name, n, Atomic_Read64(&share->errors),
+                   n == 0 ? 0 : Atomic_Read64(&share->serviceUs) / n,
+                   Atomic_Read64(&share->maxServiceUs));
+      dumpFn(clientData, line);
+   }
+
+   if (NULL != gHgfsStatsLock) {
+      MXUser_AcquireExclLock(gHgfsStatsLock);
+      numSamples = gHgfsSlowSampleCount;
+      memcpy(samples, gHgfsSlowSamples, numSamples * sizeof samples[0]);
+      MXUser_ReleaseExclLock(gHgfsStatsLock);
+   }
+
+   /* Slowest first. */
+   for (i = 1; i < numSamples; i++) {
+      HgfsServerStatsSample tmp = samples[i];
+      uint32 j = i;
+
+      for (; j > 0 && samples[j - 1].serviceUs < tmp.serviceUs; j--) {
+         samples[j] = samples[j - 1];
+      }
+      samples[j] = tmp;
+   }
+
+   if (numSamples > 0) {
+      dumpFn(clientData, "HGFS server slowest requests:");
+   }
+   for (i = 0; i < numSamples; i++) {
+      HgfsServerStatsSample *sample = &samples[i];
+      char queue[32] = "";
+
+      if (threadpoolActive) {
+         Str_Snprintf(queue, sizeof queue, " queue %"FMT64"u",
+                      sample->queueUs);
+      }
+      Str_Snprintf(line, sizeof line,
+                   "  %-22s service %"FMT64"u%s status %d "
+                   "share %s session %#"FMT64"x id %u "
+                   "bytes in %"FMTSZ"u out %"FMTSZ"u",
+                   HgfsServerStatsOpName(sample->op), sample->serviceUs,
+                   queue, (int)sample->status,
+                   '\0' != sample->share[0] ? sample->share : "-",
+                   sample->sessionId, sample->requestId,
+                   sample->requestSize, sample->replySize);
+      dumpFn(clientData, line);
+   }
+}
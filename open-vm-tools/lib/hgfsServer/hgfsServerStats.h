@@ -0,0 +1,62 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerStats.h --
+ *
+ *	Per-operation request statistics of the HGFS server.
+ */
+
+#ifndef _HGFS_SERVER_STATS_H_
+#define _HGFS_SERVER_STATS_H_
+
+#include "vm_basic_types.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsUtil.h"
+
+
+/*
+ * Global functions
+ */
+
+void
+HgfsServerStats_Init(void);
+void
+HgfsServerStats_Exit(void);
+void
+HgfsServerStats_BeginRequest(const void *request);
+void
+HgfsServerStats_NoteShare(const char *shareName,
+                          size_t shareNameLen);
+void
+HgfsServerStats_EndRequest(const void *request,
+                           HgfsOp op,
+                           HgfsInternalStatus status,
+                           uint64 sessionId,
+                           uint32 requestId,
+                           size_t requestSize,
+                           size_t replySize,
+                           VmTimeType receiveTime,
+                           VmTimeType startTime);
+void
+HgfsServerStats_Dump(HgfsServerStatsDumpFunc *dumpFn,
+                     void *clientData,
+                     Bool threadpoolActive);
+
+#endif // ifndef _HGFS_SERVER_STATS_H_
@@ -218,6 +218,38 @@ HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData)  // IN:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerManager_DumpStats --
+ *
+ *    Reports the HGFS server request statistics through dumpFn.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerManager_DumpStats(HgfsServerMgrData *mgrData,          // IN: RpcIn channel
+                            HgfsServerManagerDumpFunc *dumpFn,   // IN: line consumer
+                            void *clientData)                    // IN: for dumpFn
+{
+   ASSERT(mgrData);
+   ASSERT(dumpFn);
+
+   if (NULL == mgrData->connection) {
+      dumpFn(clientData, "HGFS server is not registered.");
+      return;
+   }
+   HgfsServer_DumpStats(dumpFn, clientData);
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
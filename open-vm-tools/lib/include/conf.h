@@ -206,6 +206,32 @@
  */
 #define CONFNAME_SERVICEDISCOVERY_DISABLED "disabled"
 
+/**
+ * Defines the configuration to collect the listening process, connection
+ * and performance data in process rather than with the scripts. The
+ * scripts are still used when the data can't be collected natively.
+ *
+ * @note Illegal values result in a @c g_warning and fallback to the default
+ * value.
+ *
+ * @param boolean Set to TRUE to use the native collectors.
+ *                Set to FALSE to always run the scripts.
+ */
+#define CONFNAME_SERVICEDISCOVERY_NATIVE_COLLECTORS "native-collectors"
+
+/**
+ * Defines the configuration to skip publishing a key to the gdp daemon when
+ * its data has not changed since the last cycle. Unchanged data is still
+ * published periodically.
+ *
+ * @note Illegal values result in a @c g_warning and fallback to the default
+ * value.
+ *
+ * @param boolean Set to TRUE to publish changed data only.
+ *                Set to FALSE to publish all data every cycle.
+ */
+#define CONFNAME_SERVICEDISCOVERY_PUBLISH_CHANGES_ONLY "publish-changes-only"
+
 /*
  * END ServiceDiscovery goodies.
  ******************************************************************************
@@ -993,11 +993,21 @@ typedef struct HgfsRequestSearchReadV2 {
 typedef struct HgfsRequestSearchReadV3 {
    HgfsHandle search;    /* Opaque search ID used by the server */
    uint32 offset;        /* The first result is offset 0 */
-   uint32 flags;         /* Reserved for reading multiple directory entries. */
+   uint32 flags;         /* See HGFS_SEARCH_READ_FLAG_* below. */
    uint64 reserved;      /* Reserved for future use */
 } HgfsRequestSearchReadV3;
 #pragma pack(pop)
 
+/*
+ * HgfsRequestSearchReadV3 flags.
+ *
+ * HGFS_SEARCH_READ_FLAG_MULTIPLE_REPLY asks the server to return as many
+ * directory entries as fit in a reply of up to HGFS_LARGE_PACKET_MAX bytes,
+ * chained through HgfsDirEntry.nextEntry. Servers which predate the flag
+ * ignore it and return a single entry, which clients handle already.
+ */
+#define HGFS_SEARCH_READ_FLAG_MULTIPLE_REPLY (1 << 0)
+
 
 /* Deprecated */
 
@@ -223,6 +223,11 @@ Bool HgfsServer_ShareAccessCheck(HgfsOpenMode accessMode,
 uint32 HgfsServer_GetHandleCounter(void);
 void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
+/* Receives the request statistics one line (without newline) at a time. */
+typedef void HgfsServerStatsDumpFunc(void *clientData, const char *line);
+
+void HgfsServer_DumpStats(HgfsServerStatsDumpFunc *dumpFn, void *clientData);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
@@ -65,6 +65,13 @@ Bool HgfsServerManager_ProcessPacket(HgfsServerMgrData *mgrData,
                                      char *packetOut,
                                      size_t *packetOutSize);
 uint32 HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData);
+
+/* Same as HgfsServerStatsDumpFunc, receives one line at a time. */
+typedef void HgfsServerManagerDumpFunc(void *clientData, const char *line);
+
+void HgfsServerManager_DumpStats(HgfsServerMgrData *mgrData,
+                                 HgfsServerManagerDumpFunc *dumpFn,
+                                 void *clientData);
 #endif
 
 #if defined(__cplusplus)
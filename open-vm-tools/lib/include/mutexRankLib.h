@@ -58,6 +58,7 @@ extern "C" {
  * hgfs locks
  */
 #define RANK_hgfsSessionArrayLock    (RANK_libLockBase + 0x4010)
+#define RANK_hgfsNotifyDeliveryLock  (RANK_libLockBase + 0x4020)
 #define RANK_hgfsSharedFolders       (RANK_libLockBase + 0x4030)
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
@@ -65,6 +66,9 @@ extern "C" {
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
 #define RANK_hgfsActivateLock        (RANK_libLockBase + 0x4080)
 #define RANK_hgfsThreadpoolLock      (RANK_libLockBase + 0x4090)
+#define RANK_hgfsCacheLock           (RANK_libLockBase + 0x40A0)
+#define RANK_hgfsCaseIndexLock       (RANK_libLockBase + 0x40B0)
+#define RANK_hgfsStatsLock           (RANK_libLockBase + 0x40C0)
 
 #define RANK_nfcLibAioCtxLock        (RANK_libLockBase + 0x4300)
 
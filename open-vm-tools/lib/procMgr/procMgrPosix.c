@@ -81,6 +81,10 @@
 #include "codeset.h"
 #include "unicode.h"
 #include "logToHost.h"
+#if defined(__linux__)
+#include "hashTable.h"
+#include "userlock.h"
+#endif
 
 #ifdef USERWORLD
 #include <vm_basic_types.h>
@@ -225,6 +229,374 @@ done:
 }
 
 
+/*
+ * The Linux process list is kept between calls to ProcMgr_ListProcesses.
+ * A listing then only reads /proc/<pid>/stat and stats /proc/<pid> for
+ * processes already seen; cmdline, exe and status are read again only
+ * for pids that show up with a new start time or command name, i.e.
+ * new, recycled or exec'd processes. Processes are re-read until they
+ * have been running for PROCMGR_CACHE_SETTLE_TIME seconds, to pick up
+ * daemons that rewrite their command line shortly after they start.
+ */
+
+#define PROCMGR_CACHE_BUCKETS      4096   // power of 2, the table doesn't grow
+#define PROCMGR_CACHE_SETTLE_TIME  5      // seconds
+#define PROCMGR_OWNER_CACHE_TIME   60     // seconds
+#define PROCMGR_COMM_MAX           64
+
+typedef struct ProcMgrCacheEntry {
+   unsigned long long relativeStartTime;
+   char comm[PROCMGR_COMM_MAX];
+   Bool settled;
+   char *cmdName;
+   char *cmdAbsPath;
+   char *cmdLine;
+} ProcMgrCacheEntry;
+
+static HashTable *procCache;       // pid -> ProcMgrCacheEntry
+static uid_t procCacheEuid;
+static DIR *procDir;
+static HashTable *ownerCache;      // uid -> owner name
+static time_t ownerCacheTime;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrCacheEntryFree --
+ *
+ *      Frees a process cache entry.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrCacheEntryFree(void *clientData)  // IN:
+{
+   ProcMgrCacheEntry *entry = clientData;
+
+   free(entry->cmdName);
+   free(entry->cmdAbsPath);
+   free(entry->cmdLine);
+   free(entry);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadStat --
+ *
+ *      Reads the command name and start time of a process from
+ *      /proc/<pid>/stat, without allocating.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the process is gone or can't be read.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrReadStat(int procFd,                              // IN: /proc
+                const char *pidName,                     // IN:
+                char comm[PROCMGR_COMM_MAX],             // OUT:
+                unsigned long long *relativeStartTime)   // OUT:
+{
+   char path[64];
+   char buf[1024];
+   char *commBegin;
+   char *commEnd;
+   ssize_t numRead;
+   int fd;
+
+   Str_Snprintf(path, sizeof path, "%s/stat", pidName);
+   fd = openat(procFd, path, O_RDONLY | O_CLOEXEC);
+   if (-1 == fd) {
+      return FALSE;
+   }
+   numRead = read(fd, buf, sizeof buf - 1);
+   close(fd);
+   if (0 >= numRead) {
+      return FALSE;
+   }
+   buf[numRead] = '\0';
+
+   /*
+    * "123 (bash) S [...]". The name may itself contain ')', so look for
+    * the last one.
+    */
+   commBegin = strchr(buf, '(');
+   commEnd = strrchr(buf, ')');
+   if (NULL == commBegin || NULL == commEnd || commEnd < commBegin) {
+      return FALSE;
+   }
+   commBegin++;
+   Str_Strncpy(comm, PROCMGR_COMM_MAX, commBegin,
+               MIN(commEnd - commBegin, PROCMGR_COMM_MAX - 1));
+
+   /*
+    * Skip state through itrealvalue; starttime is the 22nd field.
+    */
+   return 1 == sscanf(commEnd + 1, " %*c %*d %*d %*d %*d %*d "
+                      "%*u %*u %*u %*u %*u %*u %*u %*d %*d "
+                      "%*d %*d %*d %*d %llu",
+                      relativeStartTime);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadCmdInfo --
+ *
+ *      Reads the command name, executable path and command line of a
+ *      process into a cache entry.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the command line can't be read. Maybe
+ *      we don't have enough permission.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrReadCmdInfo(int procFd,                 // IN: /proc
+                   const char *pidName,        // IN:
+                   ProcMgrCacheEntry *entry)   // IN/OUT:
+{
+   char cmdFilePath[64];
+   char exeRealPath[1024];
+   char *cmdLineTemp = NULL;
+   int numRead;
+   int cmdFd;
+   int exeLen;
+   int replaceLoop;
+   Bool cmdNameLookup = TRUE;
+
+   Str_Snprintf(cmdFilePath, sizeof cmdFilePath, "%s/cmdline", pidName);
+   cmdFd = openat(procFd, cmdFilePath, O_RDONLY | O_CLOEXEC);
+   if (-1 == cmdFd) {
+      /*
+       * We may not be able to open the file due to the security reason.
+       * In that case, just ignore and continue.
+       */
+      return FALSE;
+   }
+
+   /*
+    * Read in the command and its arguments.  Arguments are separated
+    * by \0, which we convert to ' '.  Then we add a NULL terminator
+    * at the end.  Example: "perl -cw try.pl" is read in as
+    * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
+    * It would have been nice to preserve the NUL character so it is easy
+    * to determine what the command line arguments are without
+    * using a quote and space parsing heuristic.  But we do this
+    * to have parity with how Windows reports the command line.
+    * In the future, we could keep the NUL version around and pass it
+    * back to the client for easier parsing when retrieving individual
+    * command line parameters is needed.
+    */
+   numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
+   close(cmdFd);
+
+   if (numRead < 0) {
+      return FALSE;
+   }
+
+   Str_Snprintf(cmdFilePath, sizeof cmdFilePath, "%s/exe", pidName);
+   exeLen = readlinkat(procFd, cmdFilePath, exeRealPath,
+                       sizeof exeRealPath - 1);
+   if (exeLen != -1) {
+      exeRealPath[exeLen] = '\0';
+      entry->cmdAbsPath = Unicode_Alloc(exeRealPath, STRING_ENCODING_DEFAULT);
+   }
+
+   if (numRead > 0) {
+      for (replaceLoop = 0 ; replaceLoop < numRead ; replaceLoop++) {
+         if ('\0' == cmdLineTemp[replaceLoop] ||
+             replaceLoop == numRead - 1) {
+            if (cmdNameLookup) {
+               /*
+                * Store the command name.
+                * Find the last path separator, to get the cmd name.
+                * If no separator is found, then use the whole name.
+                * This needs to be done only if there is an absolute
+                * path for the binary. Else, the parsing may result
+                * in incorrect results. Following are few examples:
+                *
+                *   sshd: root@pts/1
+                *   gdm-session-worker [pam/gdm-autologin]
+                *
+                */
+               char *cmdNameBegin = strrchr(cmdLineTemp, '/');
+               if (NULL != cmdNameBegin && cmdLineTemp[0] == '/') {
+                  /*
+                   * Skip over the last separator.
+                   */
+                  cmdNameBegin++;
+               } else {
+                  cmdNameBegin = cmdLineTemp;
+               }
+               entry->cmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
+               if (entry->cmdAbsPath == NULL &&
+                   cmdLineTemp[0] == '/') {
+                  entry->cmdAbsPath =
+                     Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+               }
+               cmdNameLookup = FALSE;
+            }
+
+            /*
+             * In /proc/{PID}/cmdline file, the command and the
+             * arguments are separated by '\0'. We need to replace
+             * only the intermediate '\0' with ' ' and not the trailing
+             * NUL characer.
+             */
+            if (replaceLoop < (numRead - 1)) {
+               cmdLineTemp[replaceLoop] = ' ';
+            }
+         }
+      }
+   } else {
+      /*
+       * Some procs don't have a command line text, so read a name from
+       * the 'status' file (should be the first line). If unable to get a name,
+       * the process is still real, so it should be included in the list, just
+       * without a name.
+       */
+      numRead = 0;
+
+      Str_Snprintf(cmdFilePath, sizeof cmdFilePath, "%s/status", pidName);
+      cmdFd = openat(procFd, cmdFilePath, O_RDONLY | O_CLOEXEC);
+      if (cmdFd != -1) {
+         numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
+         close(cmdFd);
+      }
+      if (numRead > 0) {
+         /*
+          * Extract the part with just the name, by reading until the first
+          * space, then reading the next non-space word after that, and
+          * ignoring everything else. The format looks like this:
+          *     "^Name:[ \t]*(.*)$"
+          * for example:
+          *     "Name:    nfsd"
+          */
+         const char *nameStart;
+         char *copyItr;
+
+         /* Skip non-whitespace. */
+         for (nameStart = cmdLineTemp; *nameStart &&
+                                       *nameStart != ' ' &&
+                                       *nameStart != '\t' &&
+                                       *nameStart != '\n'; ++nameStart);
+         /* Skip whitespace. */
+         for (;*nameStart &&
+               (*nameStart == ' ' ||
+                *nameStart == '\t' ||
+                *nameStart == '\n'); ++nameStart);
+         /* Copy the name to the start of the string and null term it. */
+         for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
+            *(copyItr++) = *(nameStart++);
+         }
+         *copyItr = '\0';
+         /*
+          * Store the command name.
+          */
+         entry->cmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+         if (entry->cmdAbsPath == NULL &&
+             cmdLineTemp[0] == '/') {
+            entry->cmdAbsPath = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+         }
+      }
+   }
+
+   if (cmdLineTemp) {
+      int i;
+
+      /*
+       * Chop off the trailing whitespace characters.
+       */
+      for (i = strlen(cmdLineTemp) - 1 ;
+           i >= 0 && cmdLineTemp[i] == ' ' ;
+           i--) {
+         cmdLineTemp[i] = '\0';
+      }
+
+      entry->cmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+   } else {
+      entry->cmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+   }
+
+   free(cmdLineTemp);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrOwnerName --
+ *
+ *      Maps a uid to a user name. Names are cached for
+ *      PROCMGR_OWNER_CACHE_TIME seconds, since most processes belong
+ *      to a handful of users and the lookup may go to NSS.
+ *
+ * Results:
+ *      The user name, or the uid as a string if it has no name. Owned
+ *      by the cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+ProcMgrOwnerName(uid_t uid)  // IN:
+{
+   const void *key = (const void *)(uintptr_t) uid;
+   time_t now = time(NULL);
+   char *name;
+
+   if (NULL == ownerCache) {
+      ownerCache = HashTable_Alloc(64, HASH_INT_KEY, free);
+      ownerCacheTime = now;
+   } else if (now - ownerCacheTime >= PROCMGR_OWNER_CACHE_TIME ||
+              now < ownerCacheTime) {
+      HashTable_Clear(ownerCache);
+      ownerCacheTime = now;
+   }
+
+   if (!HashTable_Lookup(ownerCache, key, (void **) &name)) {
+      char buffer[BUFSIZ];
+      struct passwd pw;
+      struct passwd *ppw = NULL;
+
+      if (0 == getpwuid_r(uid, &pw, buffer, sizeof buffer, &ppw) &&
+          NULL != ppw) {
+         name = Unicode_Alloc(ppw->pw_name, STRING_ENCODING_DEFAULT);
+      } else {
+         name = Str_SafeAsprintf(NULL, "%d", (int) uid);
+      }
+      HashTable_Insert(ownerCache, key, name);
+   }
+
+   return name;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -240,63 +612,64 @@ done:
  *
  * Side effects:
  *
+ *      Updates the process cache.
+ *
  *----------------------------------------------------------------------
  */
 
 ProcMgrProcInfoArray *
 ProcMgr_ListProcesses(void)
 {
+   static Atomic_Ptr lckStorage;
+   MXUserExclLock *lck;
    ProcMgrProcInfoArray *procList = NULL;
    ProcMgrProcInfo procInfo;
    Bool failed = TRUE;
-   DIR *dir;
+   Bool outOfMemory = FALSE;
    struct dirent *ent;
    static time_t hostStartTime = 0;
    static unsigned long long hertz = 100;
-   int numberFound;
+   HashTable *oldCache;
+   HashTable *newCache;
+   time_t now;
+   int procFd;
 
    procList = Util_SafeCalloc(1, sizeof *procList);
    ProcMgrProcInfoArray_Init(procList, 0);
-   procInfo.procCmdName = NULL;
-   procInfo.procCmdAbsPath = NULL;
-   procInfo.procCmdLine = NULL;
-   procInfo.procOwner = NULL;
+
+   lck = MXUser_CreateSingletonExclLock(&lckStorage, "procMgrListLock",
+                                        RANK_LEAF);
+   MXUser_AcquireExclLock(lck);
 
    /*
     * Figure out when the system started.  We need this number to
     * compute process start times, which are relative to this number.
-    * We grab the first float in /proc/uptime, convert it to an integer,
-    * and then subtract that from the current time.  That leaves us
-    * with the seconds since epoch that the system booted up.
+    * We grab the whole seconds of the first number in /proc/uptime and
+    * subtract that from the current time.  That leaves us with the
+    * seconds since epoch that the system booted up.
     */
    if (0 == hostStartTime) {
-      FILE *uptimeFile = fopen("/proc/uptime", "r");
-      if (NULL != uptimeFile) {
-         double secondsSinceBoot;
-         char *realLocale;
-         char *savedLocale;
+      int uptimeFd = open("/proc/uptime", O_RDONLY | O_CLOEXEC);
+      if (-1 != uptimeFd) {
+         char uptime[64];
+         ssize_t numRead = read(uptimeFd, uptime, sizeof uptime - 1);
 
          /*
-          * Set the locale such that floats are delimited with ".".
+          * Figure out system boot time in absolute terms.  Parsing the
+          * integer part by hand avoids depending on the locale's decimal
+          * separator.
           */
-         realLocale = setlocale(LC_NUMERIC, NULL);
-         /*
-          * On Linux, the returned locale can point to static data,
-          * so make a copy.
-          */
-         savedLocale = Util_SafeStrdup(realLocale);
-         setlocale(LC_NUMERIC, "C");
-         numberFound = fscanf(uptimeFile, "%lf", &secondsSinceBoot);
-         setlocale(LC_NUMERIC, savedLocale);
-         free(savedLocale);
+         if (numRead > 0) {
+            char *end;
+            unsigned long long secondsSinceBoot;
 
-         /*
-          * Figure out system boot time in absolute terms.
-          */
-         if (numberFound) {
-            hostStartTime = time(NULL) - (time_t) secondsSinceBoot;
+            uptime[numRead] = '\0';
+            secondsSinceBoot = strtoull(uptime, &end, 10);
+            if (end != uptime) {
+               hostStartTime = time(NULL) - (time_t) secondsSinceBoot;
+            }
          }
-         fclose(uptimeFile);
+         close(uptimeFd);
       }
 
       /*
@@ -316,29 +689,49 @@ ProcMgr_ListProcesses(void)
 
    /*
     * Scan /proc for any directory that is all numbers.
-    * That represents a process id.
+    * That represents a process id.  /proc stays open between calls and
+    * the per-process files are opened relative to it.
     */
-   dir = opendir("/proc");
-   if (NULL == dir) {
+   if (NULL == procDir) {
+      int fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+      if (-1 != fd) {
+         procDir = fdopendir(fd);
+         if (NULL == procDir) {
+            close(fd);
+         }
+      }
+   } else {
+      rewinddir(procDir);
+   }
+   if (NULL == procDir) {
       Warning("ProcMgr_ListProcesses unable to open /proc\n");
       goto quit;
    }
+   procFd = dirfd(procDir);
 
-   while ((ent = readdir(dir))) {
+   /*
+    * What a process' files reveal depends on who is asking; don't hand
+    * out what was read on behalf of another user.
+    */
+   if (NULL != procCache && procCacheEuid != geteuid()) {
+      HashTable_Free(procCache);
+      procCache = NULL;
+   }
+   procCacheEuid = geteuid();
+   oldCache = procCache;
+   newCache = HashTable_Alloc(PROCMGR_CACHE_BUCKETS, HASH_INT_KEY,
+                              ProcMgrCacheEntryFree);
+   procCache = newCache;
+   now = time(NULL);
+
+   while ((ent = readdir(procDir))) {
       struct stat fileStat;
-      char cmdFilePath[1024];
-      int statResult;
-      int numRead = 0;   /* number of bytes that read() actually read */
-      int cmdFd;
-      int replaceLoop;
-      struct passwd *pwd;
-      char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
+      char comm[PROCMGR_COMM_MAX];
       unsigned long long relativeStartTime;
-      char *stringBegin;
-      Bool cmdNameLookup = TRUE;
+      ProcMgrCacheEntry *entry = NULL;
+      const void *key;
+      pid_t pid;
 
       /*
        * We only care about dirs that look like processes.
@@ -347,273 +740,58 @@ ProcMgr_ListProcesses(void)
          continue;
       }
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         continue;
-      }
-
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         /*
-          * We may not be able to open the file due to the security reason.
-          * In that case, just ignore and continue.
-          */
-         continue;
-      }
-
       /*
-       * Read in the command and its arguments.  Arguments are separated
-       * by \0, which we convert to ' '.  Then we add a NULL terminator
-       * at the end.  Example: "perl -cw try.pl" is read in as
-       * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
-       * It would have been nice to preserve the NUL character so it is easy
-       * to determine what the command line arguments are without
-       * using a quote and space parsing heuristic.  But we do this
-       * to have parity with how Windows reports the command line.
-       * In the future, we could keep the NUL version around and pass it
-       * back to the client for easier parsing when retrieving individual
-       * command line parameters is needed.
+       * Figure out the process start time.  Together with the command
+       * name, it tells whether this is still the process we cached.
        */
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-      close(cmdFd);
-
-      if (numRead < 0) {
+      if (!ProcMgrReadStat(procFd, ent->d_name, comm, &relativeStartTime)) {
          continue;
       }
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/exe",
-                   ent->d_name) != -1) {
-         int exeLen;
-         char exeRealPath[1024];
-
-         /*
-          * This readlink() call on the "exe" file of the current /proc
-          * entry is not intended as a check on the subsequent open() of
-          * the "status" file of that entry, hence no time-of-check to
-          * time-of-use issue.
-          */
-         /* coverity[fs_check_call] */
-         exeLen = readlink(cmdFilePath, exeRealPath, sizeof exeRealPath -1);
-         if (exeLen != -1) {
-            exeRealPath[exeLen] = '\0';
-            procInfo.procCmdAbsPath =
-               Unicode_Alloc(exeRealPath, STRING_ENCODING_DEFAULT);
-         }
-      }
-
-      if (numRead > 0) {
-         for (replaceLoop = 0 ; replaceLoop < numRead ; replaceLoop++) {
-            if ('\0' == cmdLineTemp[replaceLoop] ||
-                replaceLoop == numRead - 1) {
-               if (cmdNameLookup) {
-                  /*
-                   * Store the command name.
-                   * Find the last path separator, to get the cmd name.
-                   * If no separator is found, then use the whole name.
-                   * This needs to be done only if there is an absolute
-                   * path for the binary. Else, the parsing may result
-                   * in incorrect results. Following are few examples:
-                   *
-                   *   sshd: root@pts/1
-                   *   gdm-session-worker [pam/gdm-autologin]
-                   *
-                   */
-                  char *cmdNameBegin = strrchr(cmdLineTemp, '/');
-                  if (NULL != cmdNameBegin && cmdLineTemp[0] == '/') {
-                     /*
-                      * Skip over the last separator.
-                      */
-                     cmdNameBegin++;
-                  } else {
-                     cmdNameBegin = cmdLineTemp;
-                  }
-                  procInfo.procCmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
-                  if (procInfo.procCmdAbsPath == NULL &&
-                      cmdLineTemp[0] == '/') {
-                     procInfo.procCmdAbsPath =
-                        Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-                  }
-                  cmdNameLookup = FALSE;
-               }
-
-               /*
-                * In /proc/{PID}/cmdline file, the command and the
-                * arguments are separated by '\0'. We need to replace
-                * only the intermediate '\0' with ' ' and not the trailing
-                * NUL characer.
-                */
-               if (replaceLoop < (numRead - 1)) {
-                  cmdLineTemp[replaceLoop] = ' ';
-               }
-            }
-         }
-      } else {
-         /*
-          * Some procs don't have a command line text, so read a name from
-          * the 'status' file (should be the first line). If unable to get a name,
-          * the process is still real, so it should be included in the list, just
-          * without a name.
-          */
-         cmdFd = -1;
-         numRead = 0;
-
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
-         }
-         if (cmdFd != -1) {
-            numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-            close(cmdFd);
-         }
-         if (numRead > 0) {
-            /*
-             * Extract the part with just the name, by reading until the first
-             * space, then reading the next non-space word after that, and
-             * ignoring everything else. The format looks like this:
-             *     "^Name:[ \t]*(.*)$"
-             * for example:
-             *     "Name:    nfsd"
-             */
-            const char *nameStart;
-            char *copyItr;
-
-            /* Skip non-whitespace. */
-            for (nameStart = cmdLineTemp; *nameStart &&
-                                          *nameStart != ' ' &&
-                                          *nameStart != '\t' &&
-                                          *nameStart != '\n'; ++nameStart);
-            /* Skip whitespace. */
-            for (;*nameStart &&
-                  (*nameStart == ' ' ||
-                   *nameStart == '\t' ||
-                   *nameStart == '\n'); ++nameStart);
-            /* Copy the name to the start of the string and null term it. */
-            for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
-               *(copyItr++) = *(nameStart++);
-            }
-            *copyItr = '\0';
-            /*
-             * Store the command name.
-             */
-            procInfo.procCmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-            if (procInfo.procCmdAbsPath == NULL &&
-                cmdLineTemp[0] == '/') {
-               procInfo.procCmdAbsPath = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-            }
-         }
-      }
-
       /*
-       * Get the inode information for this process.  This gives us
-       * the process owner.
+       * stat() /proc/<pid> to get the owner.  If we can't stat(), ignore
+       * and continue.  Maybe we don't have enough permission.
        */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
+      if (0 != fstatat(procFd, ent->d_name, &fileStat, 0)) {
+         continue;
       }
 
-      /*
-       * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
-       * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
-       *
-       * This stat() call on the current /proc entry is not intended
-       * as a check on the open() near the top of the while loop which
-       * is on the cmdline file of the next entry in /proc, hence no
-       * time-of-check to time-of-use issue.
-       */
-      /* coverity[fs_check_call] */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
-      }
+      pid = (pid_t) atoi(ent->d_name);
+      key = (const void *)(uintptr_t) pid;
 
-      /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
-       */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
-         goto next_entry;
+      if (NULL != oldCache &&
+          HashTable_LookupAndDelete(oldCache, key, (void **) &entry) &&
+          (!entry->settled ||
+           entry->relativeStartTime != relativeStartTime ||
+           strcmp(entry->comm, comm) != 0)) {
+         ProcMgrCacheEntryFree(entry);
+         entry = NULL;
       }
 
-      /*
-       * Store the command line string pointer in dynbuf.
-       */
-      if (cmdLineTemp) {
-         int i;
-
-         /*
-          * Chop off the trailing whitespace characters.
-          */
-         for (i = strlen(cmdLineTemp) - 1 ;
-              i >= 0 && cmdLineTemp[i] == ' ' ;
-              i--) {
-            cmdLineTemp[i] = '\0';
+      if (NULL == entry) {
+         entry = Util_SafeCalloc(1, sizeof *entry);
+         if (!ProcMgrReadCmdInfo(procFd, ent->d_name, entry)) {
+            ProcMgrCacheEntryFree(entry);
+            continue;
          }
+         entry->relativeStartTime = relativeStartTime;
+         Str_Strcpy(entry->comm, comm, sizeof entry->comm);
+         entry->settled = now - (time_t) (hostStartTime +
+                                          relativeStartTime / hertz) >=
+                          PROCMGR_CACHE_SETTLE_TIME;
+      }
 
-         procInfo.procCmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-      } else {
-         procInfo.procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+      if (!HashTable_Insert(newCache, key, entry)) {
+         /* The same pid twice in one readdir pass; keep the first. */
+         ProcMgrCacheEntryFree(entry);
+         continue;
       }
 
-      /*
-       * Store the pid in dynbuf.
-       */
-      procInfo.procId = (pid_t) atoi(ent->d_name);
-
-      /*
-       * Store the owner of the process.
-       */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      procInfo.procId = pid;
+      procInfo.procCmdName = Util_SafeStrdup(entry->cmdName);
+      procInfo.procCmdAbsPath = Util_SafeStrdup(entry->cmdAbsPath);
+      procInfo.procCmdLine = Util_SafeStrdup(entry->cmdLine);
+      procInfo.procOwner = Util_SafeStrdup(ProcMgrOwnerName(fileStat.st_uid));
 
       /*
        * Store the time that the process started.
@@ -626,36 +804,28 @@ ProcMgr_ListProcesses(void)
       if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
          Warning("%s: failed to expand DynArray - out of memory\n",
                  __FUNCTION__);
-         free(cmdLineTemp);
-         free(cmdStatTemp);
-         goto quit;
+         free(procInfo.procCmdName);
+         free(procInfo.procCmdAbsPath);
+         free(procInfo.procCmdLine);
+         free(procInfo.procOwner);
+         outOfMemory = TRUE;
+         break;
       }
-      procInfo.procCmdName = NULL;
-      procInfo.procCmdAbsPath = NULL;
-      procInfo.procCmdLine = NULL;
-      procInfo.procOwner = NULL;
-
-next_entry:
-      free(procInfo.procCmdName);
-      procInfo.procCmdName = NULL;
-      free(procInfo.procCmdAbsPath);
-      procInfo.procCmdAbsPath = NULL;
-
-      free(cmdLineTemp);
-      free(cmdStatTemp);
    } // while readdir
 
-   if (0 < ProcMgrProcInfoArray_Count(procList)) {
+   /*
+    * Whatever is left in the old table has exited.
+    */
+   if (NULL != oldCache) {
+      HashTable_Free(oldCache);
+   }
+
+   if (!outOfMemory && 0 < ProcMgrProcInfoArray_Count(procList)) {
       failed = FALSE;
    }
 
 quit:
-   closedir(dir);
-
-   free(procInfo.procCmdName);
-   free(procInfo.procCmdAbsPath);
-   free(procInfo.procCmdLine);
-   free(procInfo.procOwner);
+   MXUser_ReleaseExclLock(lck);
 
    if (failed) {
       ProcMgr_FreeProcList(procList);
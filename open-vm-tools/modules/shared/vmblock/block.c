@@ -84,13 +84,51 @@ typedef struct BlockInfo {
    char filename[OS_PATH_MAX];
 } BlockInfo;
 
+/*
+ * Blocks are hashed on their filename, so that the lookup done for every
+ * access to the vmblock namespace (every getattr and readlink for
+ * vmblock-fuse) does not compare the name against every block in place.
+ * Must be a power of 2.
+ */
+#define BLOCK_HASH_BUCKETS 256
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
+static DblLnkLst_Links blockedFiles[BLOCK_HASH_BUCKETS];
 static os_rwlock_t blockedFilesLock;
 static os_kmem_cache_t *blockInfoCache;
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockHashBucket --
+ *
+ *    Finds the hash chain blocks on the provided filename are kept on
+ *    (FNV-1a hash of the name).
+ *
+ * Results:
+ *    Head of the hash chain.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+BlockHashBucket(const char *filename)  // IN: file to find the chain for
+{
+   const unsigned char *p = (const unsigned char *)filename;
+   unsigned int hash = 2166136261U;
+
+   while (*p != '\0') {
+      hash ^= *p++;
+      hash *= 16777619U;
+   }
+
+   return &blockedFiles[hash & (BLOCK_HASH_BUCKETS - 1)];
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -110,6 +148,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -120,7 +160,9 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_Init(&blockedFiles[i]);
+   }
    os_rwlock_init(&blockedFilesLock);
 
    return 0;
@@ -146,8 +188,14 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+#ifdef VMX86_DEBUG
+   unsigned int i;
+
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockedFiles[i]));
+   }
+#endif
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
 
    os_rwlock_destroy(&blockedFilesLock);
    os_kmem_cache_destroy(blockInfoCache);
@@ -328,7 +376,7 @@ GetBlock(const char *filename,          // IN: file to find block for
    ASSERT(os_rwlock_held(&blockedFilesLock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   DblLnkLst_ForEach(curr, BlockHashBucket(filename)) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
       if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
@@ -422,7 +470,7 @@ BlockAddFileBlock(const char *filename,           // IN: name of file to block
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(BlockHashBucket(filename), &block->links);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
@@ -498,20 +546,23 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
    os_write_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         BlockDoRemoveBlock(currBlock);
+            BlockDoRemoveBlock(currBlock);
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            /*
+             * We count only entries removed from the -list-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
       }
    }
 
@@ -689,13 +740,16 @@ BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
    int count = 0;
+   unsigned int i;
 
    os_read_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_ForEach(curr, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
    }
 
    os_read_unlock(&blockedFilesLock);
@@ -91,5 +91,22 @@ GuestInfo_FreeDiskInfo(GuestDiskInfoInt *di);
 void
 GuestInfo_StatProviderShutdown(void);
 
+#if defined(__linux__)
+typedef void (*GuestInfoNicChangedFunc)(ToolsAppCtx *ctx);
+
+Bool
+GuestInfo_NicMonStart(ToolsAppCtx *ctx,
+                      GuestInfoNicChangedFunc changed);
+
+void
+GuestInfo_NicMonStop(void);
+
+Bool
+GuestInfo_NicMonActive(void);
+
+Bool
+GuestInfo_NicMonResolverChanged(void);
+#endif
+
 #endif /* _GUESTINFOINT_H_ */
 
@@ -85,6 +85,23 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
  */
 #define GUESTINFO_STATS_INTERVAL 20
 
+/**
+ * While network configuration changes are watched, the NIC info is gathered
+ * after a change or when the resolver configuration files changed, which
+ * is checked on every poll. In case a change went unnoticed it is gathered
+ * at least every GUESTINFO_NIC_REFRESH_POLLS guestInfo polls.
+ */
+#define GUESTINFO_NIC_REFRESH_POLLS 10
+
+/**
+ * Delay in ms between a network configuration change and gathering the NIC
+ * info, letting related changes (address, then routes) settle. Gathers
+ * triggered by changes are also at least a guestInfo poll interval apart,
+ * so that constantly changing interfaces (e.g. containers starting and
+ * stopping) cost no more than polling does.
+ */
+#define GUESTINFO_NIC_CHANGE_DELAY 1000
+
 #define GUESTINFO_DEFAULT_DELIMITER ' '
 
 /**
@@ -160,6 +177,21 @@ static GSource *gatherInfoTimeoutSource = NULL;
  */
 static GSource *gatherStatsTimeoutSource = NULL;
 
+/**
+ * Timeout source gathering the NIC info after a network configuration change.
+ */
+static GSource *gatherNicInfoTimeoutSource = NULL;
+
+/*
+ * Whether the NIC info may have changed since it was last sent to the vmx,
+ * and the number of guestInfo polls since it was last gathered.
+ */
+static Bool gNicInfoDirty = TRUE;
+static guint gNicInfoSkippedPolls = 0;
+
+/* Monotonic time in us the NIC info was last gathered at, 0 for never. */
+static gint64 gNicInfoLastGather = 0;
+
 /* Local cache of the guest information that was last sent to vmx. */
 static GuestInfoCache gInfoCache;
 
@@ -187,6 +219,7 @@ static Bool SetGuestInfo(ToolsAppCtx *ctx,
 static void SendUptime(ToolsAppCtx *ctx);
 static Bool DiskInfoChanged(const GuestDiskInfoInt *diskInfo);
 static void GuestInfoClearCache(void);
+static void GuestInfoGatherNicInfo(ToolsAppCtx *ctx);
 static GuestNicList *NicInfoV3ToV2(const NicInfoV3 *infoV3);
 static void TweakGatherLoops(ToolsAppCtx *ctx,
                              gboolean enable);
@@ -536,16 +569,9 @@ GuestInfoGather(gpointer data)
    gboolean disableQueryDiskInfo;
    GuestDiskInfoInt *diskInfo = NULL;
 #endif
-   NicInfoV3 *nicInfo = NULL;
    ToolsAppCtx *ctx = data;
-   Bool primaryChanged;
-   Bool lowPriorityChanged;
-   int maxIPv4RoutesToGather;
-   int maxIPv6RoutesToGather;
    gchar *osNameOverride;
    gchar *osNameFullOverride;
-   Bool maxNicsError = FALSE;
-   static uint32 logThrottleCount = 0;
 
    g_debug("Entered guest info gather.\n");
 
@@ -719,7 +745,60 @@ GuestInfoGather(gpointer data)
       g_warning("Failed to update INFO_DNS_NAME.\n");
    }
 
-   /* Get NIC information. */
+   /*
+    * Get NIC information, unless it cannot have changed since the last
+    * gather. Changes are only watched on Linux; elsewhere it is gathered
+    * on every poll.
+    */
+   if (gNicInfoDirty || gInfoCache.nicInfo == NULL ||
+#if defined(__linux__)
+       !GuestInfo_NicMonActive() ||
+       GuestInfo_NicMonResolverChanged() ||
+#else
+       TRUE ||
+#endif
+       ++gNicInfoSkippedPolls >= GUESTINFO_NIC_REFRESH_POLLS) {
+      GuestInfoGatherNicInfo(ctx);
+   } else {
+      g_debug("NIC info not changed since the last gather.\n");
+   }
+
+   /* Send the uptime to the VMX so that it can detect soft resets. */
+   SendUptime(ctx);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoGatherNicInfo --
+ *
+ * Collects the NIC info and updates the VMX if it has changed.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoGatherNicInfo(ToolsAppCtx *ctx)
+{
+   NicInfoV3 *nicInfo = NULL;
+   Bool primaryChanged;
+   Bool lowPriorityChanged;
+   int maxIPv4RoutesToGather;
+   int maxIPv6RoutesToGather;
+   Bool maxNicsError = FALSE;
+   static uint32 logThrottleCount = 0;
+
+   /*
+    * Clear the dirty flag first; a change reported while gathering has to
+    * be gathered again.
+    */
+   gNicInfoDirty = FALSE;
+   gNicInfoSkippedPolls = 0;
+   gNicInfoLastGather = g_get_monotonic_time();
 
    primaryChanged = GuestInfoResetNicPrimaryList(ctx);
    lowPriorityChanged = GuestInfoResetNicLowPriorityList(ctx);
@@ -762,6 +841,7 @@ GuestInfoGather(gpointer data)
                              maxIPv6RoutesToGather,
                              &nicInfo, &maxNicsError)) {
       g_warning("Failed to get NIC info.\n");
+      gNicInfoDirty = TRUE;
       /*
        * Return an empty NIC info.
        */
@@ -792,15 +872,74 @@ GuestInfoGather(gpointer data)
    } else {
       g_warning("Failed to update INFO_IPADDRESS.\n");
       GuestInfo_FreeNicInfo(nicInfo);
+      gNicInfoDirty = TRUE;
    }
+}
 
-   /* Send the uptime to the VMX so that it can detect soft resets. */
-   SendUptime(ctx);
 
-   return TRUE;
+#if defined(__linux__)
+/*
+ ******************************************************************************
+ * GuestInfoGatherNicInfoCb --
+ *
+ * Gathers the NIC info after a network configuration change.
+ *
+ * @param[in]  data     The application context.
+ *
+ * @return FALSE to destroy the timeout source.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestInfoGatherNicInfoCb(gpointer data)
+{
+   gatherNicInfoTimeoutSource = NULL;
+
+   if (gNicInfoDirty) {
+      GuestInfoGatherNicInfo(data);
+   }
+
+   return FALSE;
 }
 
 
+/*
+ ******************************************************************************
+ * GuestInfoNicChanged --
+ *
+ * Called when the network configuration of the guest changed. Marks the NIC
+ * info dirty and schedules gathering it, unless the gather loop is stopped.
+ * The gather is held back until a poll interval has passed since the last
+ * one.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestInfoNicChanged(ToolsAppCtx *ctx)
+{
+   gint64 delay = GUESTINFO_NIC_CHANGE_DELAY;
+
+   gNicInfoDirty = TRUE;
+
+   if (gatherNicInfoTimeoutSource == NULL && gatherInfoTimeoutSource != NULL) {
+      if (gNicInfoLastGather != 0) {
+         gint64 sinceLast = (g_get_monotonic_time() - gNicInfoLastGather) / 1000;
+
+         delay = MAX(delay, guestInfoPollInterval - sinceLast);
+      }
+      gatherNicInfoTimeoutSource = g_timeout_source_new((guint) delay);
+      VMTOOLSAPP_ATTACH_SOURCE(ctx, gatherNicInfoTimeoutSource,
+                               GuestInfoGatherNicInfoCb, ctx, NULL);
+      g_source_unref(gatherNicInfoTimeoutSource);
+   }
+}
+#endif
+
+
 /*
  ******************************************************************************
  * GuestInfoConvertNicInfoToNicInfoV1 --                                 */ /**
@@ -2099,6 +2238,25 @@ TweakGatherLoops(ToolsAppCtx *ctx,
                    GuestInfoGather,
                    &guestInfoPollInterval,
                    &gatherInfoTimeoutSource);
+
+   /*
+    * Watch for network configuration changes while the GuestInfo gather
+    * loop runs. Changes are not tracked while it is stopped.
+    */
+   if (gatherInfoTimeoutSource != NULL) {
+#if defined(__linux__)
+      GuestInfo_NicMonStart(ctx, GuestInfoNicChanged);
+#endif
+   } else {
+#if defined(__linux__)
+      GuestInfo_NicMonStop();
+#endif
+      if (gatherNicInfoTimeoutSource != NULL) {
+         g_source_destroy(gatherNicInfoTimeoutSource);
+         gatherNicInfoTimeoutSource = NULL;
+      }
+      gNicInfoDirty = TRUE;
+   }
 }
 
 
@@ -2153,6 +2311,9 @@ GuestInfoServerConfReload(gpointer src,
                           ToolsAppCtx *ctx,
                           gpointer data)
 {
+   /* The NIC lists and route limits may have changed. */
+   gNicInfoDirty = TRUE;
+
    TweakGatherLoops(ctx, TRUE);
 }
 
@@ -2214,6 +2375,15 @@ GuestInfoServerShutdown(gpointer src,
       gatherStatsTimeoutSource = NULL;
    }
 
+   if (gatherNicInfoTimeoutSource != NULL) {
+      g_source_destroy(gatherNicInfoTimeoutSource);
+      gatherNicInfoTimeoutSource = NULL;
+   }
+
+#if defined(__linux__)
+   GuestInfo_NicMonStop();
+#endif
+
 #if defined(__linux__) || defined(USERWORLD) || defined(_WIN32)
    GuestInfo_StatProviderShutdown();
 #endif
@@ -2250,6 +2420,8 @@ GuestInfoServerReset(gpointer src,
 
    /* Reset detailed guest OS data sending */
    gSendDetailedGosData = TRUE;
+
+   gNicInfoDirty = TRUE;
 }
 
 
@@ -0,0 +1,315 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * nicMonLinux.c --
+ *
+ *      Watches rtnetlink for changes to the network interfaces, their
+ *      addresses and the routing tables, so that the NIC info only needs
+ *      to be gathered again when it may have changed. The resolver
+ *      configuration has no such notification; its files are checked for
+ *      changes instead.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "vmware.h"
+#include "guestInfoInt.h"
+
+#define NICMON_GROUPS (RTMGRP_LINK |        \
+                       RTMGRP_IPV4_IFADDR | \
+                       RTMGRP_IPV6_IFADDR | \
+                       RTMGRP_IPV4_ROUTE |  \
+                       RTMGRP_IPV6_ROUTE)
+
+static int gNicMonFd = -1;
+static GSource *gNicMonSource = NULL;
+static GuestInfoNicChangedFunc gNicMonChanged = NULL;
+
+/*
+ * Files the resolver configuration is read from, see RecordResolverNS(),
+ * and what they looked like when last checked.
+ */
+static const char *gNicMonResolvFiles[] = {
+   "/etc/resolv.conf",
+   "/run/systemd/resolve/resolv.conf",
+};
+static struct stat gNicMonResolvStat[ARRAYSIZE(gNicMonResolvFiles)];
+
+
+/*
+ ******************************************************************************
+ * NicMonClose --
+ *
+ * Stops watching and closes the netlink socket.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicMonClose(void)
+{
+   if (gNicMonSource != NULL) {
+      g_source_destroy(gNicMonSource);
+      g_source_unref(gNicMonSource);
+      gNicMonSource = NULL;
+   }
+
+   if (gNicMonFd >= 0) {
+      close(gNicMonFd);
+      gNicMonFd = -1;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NicMonDispatch --
+ *
+ * Reads all pending rtnetlink notifications and reports a change if any of
+ * them is about a link, an address or a route.
+ *
+ * @param[in]  chn      Channel of the netlink socket (unused).
+ * @param[in]  cond     Condition satisfied (unused).
+ * @param[in]  data     The application context.
+ *
+ * @return TRUE to keep watching, FALSE if the socket failed.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+NicMonDispatch(GIOChannel *chn,
+               GIOCondition cond,
+               gpointer data)
+{
+   ToolsAppCtx *ctx = data;
+   Bool changed = FALSE;
+   Bool failed = FALSE;
+   union {
+      struct nlmsghdr hdr;
+      char buf[8192];
+   } msg;
+
+   for (;;) {
+      struct sockaddr_nl from;
+      socklen_t fromLen = sizeof from;
+      struct nlmsghdr *nlh;
+      ssize_t len;
+
+      len = recvfrom(gNicMonFd, &msg, sizeof msg, 0,
+                     (struct sockaddr *) &from, &fromLen);
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         if (errno == ENOBUFS) {
+            /* Notifications were dropped; assume the worst. */
+            g_debug("%s: Netlink receive buffer overrun.\n", __FUNCTION__);
+            changed = TRUE;
+            continue;
+         }
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            g_warning("%s: Failed to read netlink socket, error=%d.\n",
+                      __FUNCTION__, errno);
+            failed = TRUE;
+         }
+         break;
+      }
+
+      /* Only the kernel is trusted to report changes. */
+      if (from.nl_pid != 0) {
+         continue;
+      }
+
+      for (nlh = &msg.hdr; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+         switch (nlh->nlmsg_type) {
+         case RTM_NEWLINK:
+         case RTM_DELLINK:
+         case RTM_NEWADDR:
+         case RTM_DELADDR:
+         case RTM_NEWROUTE:
+         case RTM_DELROUTE:
+            changed = TRUE;
+            break;
+         default:
+            break;
+         }
+      }
+   }
+
+   if (failed) {
+      /*
+       * Returning FALSE destroys the source; drop our reference and the
+       * socket without destroying it again.
+       */
+      g_source_unref(gNicMonSource);
+      gNicMonSource = NULL;
+      close(gNicMonFd);
+      gNicMonFd = -1;
+      changed = TRUE;
+   }
+
+   if (changed) {
+      g_debug("%s: Network configuration changed.\n", __FUNCTION__);
+      gNicMonChanged(ctx);
+   }
+
+   return !failed;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonStart --
+ *
+ * Starts watching for network configuration changes, unless already
+ * watching.
+ *
+ * @param[in]  ctx        The application context.
+ * @param[in]  changed    Called from the main loop after a change.
+ *
+ * @return TRUE if changes are being watched.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_NicMonStart(ToolsAppCtx *ctx,
+                      GuestInfoNicChangedFunc changed)
+{
+   struct sockaddr_nl addr;
+   GIOChannel *chn;
+
+   if (gNicMonSource != NULL) {
+      return TRUE;
+   }
+
+   gNicMonFd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      NETLINK_ROUTE);
+   if (gNicMonFd < 0) {
+      g_warning("%s: Failed to create netlink socket, error=%d.\n",
+                __FUNCTION__, errno);
+      return FALSE;
+   }
+
+   memset(&addr, 0, sizeof addr);
+   addr.nl_family = AF_NETLINK;
+   addr.nl_groups = NICMON_GROUPS;
+   if (bind(gNicMonFd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+      g_warning("%s: Failed to bind netlink socket, error=%d.\n",
+                __FUNCTION__, errno);
+      NicMonClose();
+      return FALSE;
+   }
+
+   gNicMonChanged = changed;
+   GuestInfo_NicMonResolverChanged();
+
+   chn = g_io_channel_unix_new(gNicMonFd);
+   gNicMonSource = g_io_create_watch(chn, G_IO_IN | G_IO_ERR | G_IO_HUP);
+   g_io_channel_unref(chn);   // Ownership transferred to the source.
+
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, gNicMonSource, NicMonDispatch, ctx, NULL);
+
+   g_debug("%s: Watching for network configuration changes.\n",
+           __FUNCTION__);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonStop --
+ *
+ * Stops watching for network configuration changes.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_NicMonStop(void)
+{
+   NicMonClose();
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonActive --
+ *
+ * Tells whether network configuration changes are being watched.
+ *
+ * @return TRUE if watching.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_NicMonActive(void)
+{
+   return gNicMonSource != NULL;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_NicMonResolverChanged --
+ *
+ * Checks whether the resolver configuration files were modified, replaced or
+ * removed since the last check. This is only a few stat() calls, so it can
+ * be done on every guestInfo poll.
+ *
+ * @return TRUE if the resolver configuration may have changed.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfo_NicMonResolverChanged(void)
+{
+   Bool changed = FALSE;
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(gNicMonResolvFiles); i++) {
+      struct stat st;
+      struct stat *last = &gNicMonResolvStat[i];
+
+      /* Follows the link, a replaced target has a new inode. */
+      if (stat(gNicMonResolvFiles[i], &st) != 0) {
+         memset(&st, 0, sizeof st);
+      }
+      if (st.st_dev != last->st_dev ||
+          st.st_ino != last->st_ino ||
+          st.st_size != last->st_size ||
+          st.st_mtim.tv_sec != last->st_mtim.tv_sec ||
+          st.st_mtim.tv_nsec != last->st_mtim.tv_nsec) {
+         *last = st;
+         changed = TRUE;
+      }
+   }
+
+   return changed;
+}
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <locale.h>
 #include <string.h>
@@ -42,8 +43,8 @@
 #include "conf.h"
 
 #define GUEST_INFO_PREALLOC_SIZE 4096
+#define GUEST_INFO_PROC_BUF_SIZE 4096  // Close to length of /proc/stat intr line
 #define INT_AS_HASHKEY(x) ((const void *)(uintptr_t)(x))
-#define KEY_FORMAT  "%s|%s"
 
 #define STAT_FILE        "/proc/stat"
 #define VMSTAT_FILE      "/proc/vmstat"
@@ -55,6 +56,49 @@
 
 #define SYSFS_BLOCK_FOLDER  "/sys/block"
 
+/*
+ * The /proc files read for every sample. They are opened once and re-read
+ * from offset 0 with pread, which has the kernel regenerate their contents.
+ */
+typedef enum {
+   PROC_FILE_MEMINFO,
+   PROC_FILE_VMSTAT,
+   PROC_FILE_STAT,
+   PROC_FILE_ZONEINFO,
+   PROC_FILE_UPTIME,
+   PROC_FILE_DISKSTATS,
+   PROC_FILE_SWAPPINESS,
+   PROC_FILE_MAX
+} GuestInfoProcFileID;
+
+typedef struct {
+   const char  *pathName;
+   int          fd;
+} GuestInfoProcFile;
+
+static GuestInfoProcFile gProcFiles[PROC_FILE_MAX] = {
+   { MEMINFO_FILE,    -1 },
+   { VMSTAT_FILE,     -1 },
+   { STAT_FILE,       -1 },
+   { ZONEINFO_FILE,   -1 },
+   { UPTIME_FILE,     -1 },
+   { DISKSTATS_FILE,  -1 },
+   { SWAPPINESS_FILE, -1 },
+};
+
+/*
+ * Line reader over a /proc file. Lines are returned in place, in buf.
+ */
+typedef struct {
+   GuestInfoProcFileID  id;
+   off_t                offset;    // File offset of the next read
+   size_t               start;     // Start of the next line in buf
+   size_t               len;       // Bytes of file data in buf
+   Bool                 eof;
+   Bool                 skipLine;  // Dropping the rest of a long line
+   char                 buf[GUEST_INFO_PROC_BUF_SIZE];
+} GuestInfoProcReader;
+
 /*
  * For now, all data collection is of uint64 values. Rates are always returned
  * as a double, derived from the uint64 data.
@@ -152,11 +196,18 @@ typedef struct {
    GuestInfoQuery  *query;
 } GuestInfoStat;
 
+/*
+ * The stats collected from one /proc file, indexed by field name.
+ */
 typedef struct {
    HashTable       *exactMatches;
 
    uint32           numRegExps;
    GuestInfoStat  **regExps;
+} GuestInfoFieldIndex;
+
+typedef struct {
+   GuestInfoFieldIndex  fields[PROC_FILE_MAX];
 
    uint32           numStats;
    GuestInfoStat   *stats;
@@ -169,6 +220,7 @@ typedef struct {
 
 static GuestInfoCollector *gCurrentCollector = NULL;
 static GuestInfoCollector *gPreviousCollector = NULL;
+static locale_t gCLocale = (locale_t)0;
 
 static void
 GuestInfoDeriveMemNeeded(GuestInfoCollector *collector);
@@ -240,6 +292,241 @@ GuestInfoIsBlockDevice(const char *name)  // IN:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoProcFileByPath --
+ *
+ *      Look up a /proc file by path name.
+ *
+ * Results:
+ *      The file's ID, -1 if it is not a known file.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GuestInfoProcFileByPath(const char *pathName)  // IN:
+{
+   int i;
+
+   for (i = 0; i < PROC_FILE_MAX; i++) {
+      if (strcmp(gProcFiles[i].pathName, pathName) == 0) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoProcClose --
+ *
+ *      Close a /proc file.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The file is opened again when next read.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoProcClose(GuestInfoProcFileID id)  // IN:
+{
+   if (gProcFiles[id].fd >= 0) {
+      close(gProcFiles[id].fd);
+      gProcFiles[id].fd = -1;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoProcOpen --
+ *
+ *      Start reading a /proc file from its beginning. The file is only
+ *      opened the first time it is read.
+ *
+ * Results:
+ *      TRUE   Success! reader is ready for GuestInfoProcNextLine
+ *      FALSE  Failure!
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoProcOpen(GuestInfoProcFileID id,        // IN:
+                  GuestInfoProcReader *reader)   // OUT:
+{
+   GuestInfoProcFile *file = &gProcFiles[id];
+
+   if (file->fd < 0) {
+      file->fd = Posix_Open(file->pathName, O_RDONLY | O_CLOEXEC);
+      if (file->fd < 0) {
+         g_warning("%s: Failed to open %s, error=%d.\n",
+                   __FUNCTION__, file->pathName, errno);
+         return FALSE;
+      }
+   }
+
+   reader->id = id;
+   reader->offset = 0;
+   reader->start = 0;
+   reader->len = 0;
+   reader->eof = FALSE;
+   reader->skipLine = FALSE;
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoProcNextLine --
+ *
+ *      Get the next line of a /proc file, without its newline.
+ *
+ *      Lines longer than the reader buffer are cut short; only fields
+ *      at the beginning of a line are of interest.
+ *
+ * Results:
+ *      The line, valid until the next call. NULL at end of file or on
+ *      read error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+GuestInfoProcNextLine(GuestInfoProcReader *reader)  // IN/OUT:
+{
+   for (;;) {
+      char *line = reader->buf + reader->start;
+      size_t avail = reader->len - reader->start;
+      char *eol = memchr(line, '\n', avail);
+      ssize_t bytesRead;
+
+      if (eol != NULL) {
+         Bool skipLine = reader->skipLine;
+
+         *eol = '\0';
+         reader->start += eol - line + 1;
+         reader->skipLine = FALSE;
+         if (!skipLine) {
+            return line;
+         }
+         continue;
+      }
+
+      if (reader->eof) {
+         reader->start = reader->len;
+         if (avail == 0 || reader->skipLine) {
+            return NULL;
+         }
+         line[avail] = '\0';
+         return line;
+      }
+
+      if (reader->skipLine) {
+         avail = 0;
+      } else if (avail == sizeof reader->buf - 1) {
+         line[avail] = '\0';
+         reader->start = 0;
+         reader->len = 0;
+         reader->skipLine = TRUE;
+         return line;
+      }
+
+      memmove(reader->buf, line, avail);
+      reader->start = 0;
+      reader->len = avail;
+
+      bytesRead = pread(gProcFiles[reader->id].fd,
+                        reader->buf + reader->len,
+                        sizeof reader->buf - 1 - reader->len,
+                        reader->offset);
+      if (bytesRead < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         g_warning("%s: Failed to read %s, error=%d.\n",
+                   __FUNCTION__, gProcFiles[reader->id].pathName, errno);
+         GuestInfoProcClose(reader->id);
+         reader->start = reader->len = 0;
+         reader->eof = TRUE;
+         return NULL;
+      }
+
+      if (bytesRead == 0) {
+         reader->eof = TRUE;
+      }
+      reader->offset += bytesRead;
+      reader->len += bytesRead;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoParseUint64 --
+ *
+ *      Parse the unsigned decimal number at the start of a string.
+ *      Values too large for a uint64 saturate.
+ *
+ * Results:
+ *      TRUE   Success! *value is populated
+ *      FALSE  The string does not start with a digit
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+GuestInfoParseUint64(const char *str,  // IN:
+                     uint64 *value)    // OUT:
+{
+   uint64 result = 0;
+
+   if (*str < '0' || *str > '9') {
+      return FALSE;
+   }
+
+   do {
+      unsigned int digit = *str - '0';
+
+      if (result > (MAX_UINT64 - digit) / 10) {
+         result = MAX_UINT64;
+      } else {
+         result = result * 10 + digit;
+      }
+      str++;
+   } while (*str >= '0' && *str <= '9');
+
+   *value = result;
+
+   return TRUE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -260,17 +547,16 @@ GuestInfoIsBlockDevice(const char *name)  // IN:
 static Bool
 GuestInfoGetUpTime(double *now)  // OUT:
 {
-   char line[512];
+   GuestInfoProcReader reader;
+   char *line;
    Bool result = FALSE;
-   FILE *fp = Posix_Fopen(UPTIME_FILE, "r");
 
-   if (fp == NULL) {
-      g_warning("%s: Failed to open %s, error=%d.\n",
-                __FUNCTION__, UPTIME_FILE, errno);
+   if (!GuestInfoProcOpen(PROC_FILE_UPTIME, &reader)) {
       return result;
    }
 
-   if (fgets(line, sizeof line, fp) == line) {
+   line = GuestInfoProcNextLine(&reader);
+   if (line != NULL) {
       int assignedCount;
       double idle;
 
@@ -283,8 +569,6 @@ GuestInfoGetUpTime(double *now)  // OUT:
       }
    }
 
-   fclose(fp);
-
    return result;
 }
 
@@ -396,30 +680,25 @@ GuestInfoStoreStatByID(GuestStatToolsID reportID,      // IN:
  */
 
 static void
-GuestInfoCollectStat(const char *pathName,           // IN:
-                     GuestInfoCollector *collector,  // IN/OUT:
-                     const char *fieldName,          // IN:
-                     uint64 value)                   // IN:
+GuestInfoCollectStat(GuestInfoFieldIndex *index,  // IN/OUT: stats of the file
+                     const char *fieldName,       // IN:
+                     uint64 value)                // IN:
 {
    GuestInfoStat *stat = NULL;
-   char *key = Str_SafeAsprintf(NULL, KEY_FORMAT, pathName, fieldName);
 
-   if (!HashTable_Lookup(collector->exactMatches, key, (void **) &stat)) {
+   if (!HashTable_Lookup(index->exactMatches, fieldName, (void **) &stat)) {
       uint32 i;
 
-      for (i = 0; i < collector->numRegExps; i++) {
-         GuestInfoStat *thisOne = collector->regExps[i];
+      for (i = 0; i < index->numRegExps; i++) {
+         GuestInfoStat *thisOne = index->regExps[i];
 
-         if (strcmp(pathName, thisOne->query->sourceFile) == 0 &&
-             StrUtil_StartsWith(fieldName, thisOne->query->locatorString)) {
+         if (StrUtil_StartsWith(fieldName, thisOne->query->locatorString)) {
             stat = thisOne;
             break;
          }
       }
    }
 
-   free(key);
-
    if (stat != NULL) {
       GuestInfoStoreStat(stat, value);
    }
@@ -448,25 +727,18 @@ GuestInfoCollectStat(const char *pathName,           // IN:
  */
 
 static Bool
-GuestInfoProcData(const char *pathName,           // IN: path name
+GuestInfoProcData(GuestInfoProcFileID id,         // IN: file to read
                   char fieldSeparator,            // IN/OPT:
                   GuestInfoCollector *collector)  // IN/OUT:
 {
-   char line[4096];  // Close to length of /proc/stat intr line
-   FILE *fp = Posix_Fopen(pathName, "r");
+   GuestInfoProcReader reader;
+   char *line;
 
-   if (fp == NULL) {
-      g_warning("%s: Failed to open %s, error=%d.\n",
-                __FUNCTION__, pathName, errno);
+   if (!GuestInfoProcOpen(id, &reader)) {
       return FALSE;
    }
 
-   /*
-    * If a line inside the file is longer than what the buffer can hold,
-    * fgets still succeeds, the next fgets call continues at the previously
-    * stopped location in the line.
-    */
-   while (fgets(line, sizeof line, fp) == line) {
+   while ((line = GuestInfoProcNextLine(&reader)) != NULL) {
       uint64 value = 0;
       char *savedPtr = NULL;
       char *fieldName = strtok_r(line, " \t", &savedPtr);
@@ -490,15 +762,13 @@ GuestInfoProcData(const char *pathName,           // IN: path name
       }
 
       if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
+          !GuestInfoParseUint64(fieldData, &value)) {
          continue;
       }
 
-      GuestInfoCollectStat(pathName, collector, fieldName, value);
+      GuestInfoCollectStat(&collector->fields[id], fieldName, value);
    }
 
-   fclose(fp);
-
    return TRUE;
 }
 
@@ -526,9 +796,10 @@ static Bool
 GuestInfoProcSimpleValue(GuestStatToolsID reportID,      // IN:
                          GuestInfoCollector *collector)  // IN/OUT:
 {
-   char line[512];
+   GuestInfoProcReader reader;
+   char *line;
    uint64 value;
-   FILE *fp;
+   int id;
    Bool success = FALSE;
    GuestInfoStat *stat = NULL;
 
@@ -543,17 +814,17 @@ GuestInfoProcSimpleValue(GuestStatToolsID reportID,      // IN:
    ASSERT(stat->query->sourceFile);
 
    /* coverity[var_deref_op] */
-   fp = Posix_Fopen(stat->query->sourceFile, "r");
-   if (fp == NULL) {
-      g_warning("%s: Failed to open %s, error=%d.\n",
-                __FUNCTION__, stat->query->sourceFile, errno);
+   id = GuestInfoProcFileByPath(stat->query->sourceFile);
+   ASSERT(id >= 0);
 
+   if (!GuestInfoProcOpen(id, &reader)) {
       return success;
    }
 
-   if (fgets(line, sizeof line, fp) == line) {
+   line = GuestInfoProcNextLine(&reader);
+   if (line != NULL) {
       value = 0;
-      if (sscanf(line, "%"FMT64"u", &value) == 1) {
+      if (GuestInfoParseUint64(line, &value)) {
          stat->err = 0;
          stat->count = 1;
          stat->value = value;
@@ -562,8 +833,6 @@ GuestInfoProcSimpleValue(GuestStatToolsID reportID,      // IN:
       }
    }
 
-   fclose(fp);
-
    return success;
 }
 #endif
@@ -722,12 +991,10 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
    uint64 inflightIOsSum;
    Bool setStats; // Only when no disk device change in between
 
-   char line[512];
-   FILE *fp = Posix_Fopen(DISKSTATS_FILE, "r");
+   GuestInfoProcReader reader;
+   char *line;
 
-   if (fp == NULL) {
-      g_warning("%s: Failed to open %s, error=%d.\n",
-                __FUNCTION__, DISKSTATS_FILE, errno);
+   if (!GuestInfoProcOpen(PROC_FILE_DISKSTATS, &reader)) {
       return FALSE;
    }
 
@@ -736,7 +1003,7 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
    inflightIOsSum = 0;
    setStats = (gDiskStatsList != NULL) ? TRUE : FALSE;
 
-   while (fgets(line, sizeof line, fp) == line) {
+   while ((line = GuestInfoProcNextLine(&reader)) != NULL) {
       /*
        * Linux kernel diskstats_show format string:
        * "%4d %7d %s %lu %lu %lu %u %lu %lu %lu %u %u %u %u\n"
@@ -762,7 +1029,15 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
                              &writeIOs,
                              &inflightIOs, &weightedTime);
       if (assignedCount != 5 ||
-          (readIOs == 0 && writeIOs == 0) ||
+          (readIOs == 0 && writeIOs == 0)) {
+         continue;
+      }
+
+      /*
+       * Disks already in the list were checked when they were added.
+       */
+      if ((*listItem == NULL ||
+           strcmp((*listItem)->diskName, diskName) != 0) &&
           !GuestInfoIsBlockDevice(diskName)) {
          continue;
       }
@@ -794,8 +1069,6 @@ GuestInfoProcDiskStatsData(GuestInfoCollector *collector)  // IN/OUT:
       listItem = &((*listItem)->next);
    }
 
-   fclose(fp);
-
    if (listItem == &gDiskStatsList // No qualified disk device found
        || *listItem != NULL) {     // Disk hot unplug at the end of the list
       GuestInfoDeleteDiskStatsList(*listItem);
@@ -861,10 +1134,10 @@ GuestInfoCollect(GuestInfoCollector *collector)  // IN/OUT:
    }
 
    /* Collect new values */
-   GuestInfoProcData(MEMINFO_FILE, ':', collector);
-   GuestInfoProcData(VMSTAT_FILE, '\0', collector);
-   GuestInfoProcData(STAT_FILE, '\0', collector);
-   GuestInfoProcData(ZONEINFO_FILE, '\0', collector);
+   GuestInfoProcData(PROC_FILE_MEMINFO, ':', collector);
+   GuestInfoProcData(PROC_FILE_VMSTAT, '\0', collector);
+   GuestInfoProcData(PROC_FILE_STAT, '\0', collector);
+   GuestInfoProcData(PROC_FILE_ZONEINFO, '\0', collector);
 #if PUBLISH_EXPERIMENTAL_STATS
    GuestInfoProcSimpleValue(GuestStatID_Linux_Swappiness, collector);
    GuestInfoDeriveSwapData(collector);
@@ -1422,9 +1695,13 @@ static void
 GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
 {
    if (collector != NULL) {
-      HashTable_Free(collector->exactMatches);
+      uint32 i;
+
+      for (i = 0; i < ARRAYSIZE(collector->fields); i++) {
+         HashTable_Free(collector->fields[i].exactMatches);
+         free(collector->fields[i].regExps);
+      }
       HashTable_Free(collector->reportMap);
-      free(collector->regExps);
       free(collector->stats);
       free(collector);
    }
@@ -1453,7 +1730,6 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
                             uint32 numQueries)        // IN:
 {
    uint32 i;
-   uint32 regExp = 0;
    GuestInfoCollector *collector = Util_SafeCalloc(1, sizeof *collector);
 
    if (collector == NULL) {
@@ -1462,32 +1738,47 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
 
    collector->reportMap = HashTable_Alloc(256, HASH_INT_KEY, NULL);
 
-   collector->exactMatches = HashTable_Alloc(256,
-                                           HASH_STRING_KEY | HASH_FLAG_COPYKEY,
-                                             NULL);
+   /*
+    * The field names are the locator strings of the static query table,
+    * so they need not be copied.
+    */
+   for (i = 0; i < ARRAYSIZE(collector->fields); i++) {
+      collector->fields[i].exactMatches = HashTable_Alloc(64, HASH_STRING_KEY,
+                                                          NULL);
+   }
 
-   collector->numRegExps = 0;
    for (i = 0; i < numQueries; i++) {
       if (queries[i].isRegExp) {
-         collector->numRegExps++;
+         int id = GuestInfoProcFileByPath(queries[i].sourceFile);
+
+         ASSERT(id >= 0);
+         collector->fields[id].numRegExps++;
       }
    }
 
    collector->numStats = numQueries;
    collector->stats = Util_SafeCalloc(numQueries, sizeof *collector->stats);
-   collector->regExps = Util_SafeCalloc(collector->numRegExps,
-                                        sizeof(GuestInfoStat *));
 
-   if ((collector->exactMatches == NULL) ||
-       (collector->reportMap == NULL) ||
-       ((collector->numRegExps != 0) && (collector->regExps == NULL)) ||
+   for (i = 0; i < ARRAYSIZE(collector->fields); i++) {
+      GuestInfoFieldIndex *index = &collector->fields[i];
+
+      if (index->exactMatches == NULL) {
+         GuestInfoDestroyCollector(collector);
+         return NULL;
+      }
+      if (index->numRegExps != 0) {
+         index->regExps = Util_SafeCalloc(index->numRegExps,
+                                          sizeof(GuestInfoStat *));
+         index->numRegExps = 0;
+      }
+   }
+
+   if ((collector->reportMap == NULL) ||
        ((collector->numStats != 0) && (collector->stats == NULL))) {
       GuestInfoDestroyCollector(collector);
       return NULL;
    }
 
-   regExp = 0;
-
    for (i = 0; i < numQueries; i++) {
       GuestInfoQuery *query = &queries[i];
       GuestInfoStat *stat = &collector->stats[i];
@@ -1496,18 +1787,20 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
 
       stat->query = query;
 
-      if (query->isRegExp) {
-         ASSERT(query->sourceFile);
-         ASSERT(query->locatorString);
+      if (query->sourceFile != NULL && query->locatorString != NULL) {
+         int id = GuestInfoProcFileByPath(query->sourceFile);
+         GuestInfoFieldIndex *index;
 
-         collector->regExps[regExp++] = stat;
-      } else {
-         if (query->sourceFile != NULL && query->locatorString != NULL) {
-            char *key = Str_SafeAsprintf(NULL, KEY_FORMAT, query->sourceFile,
-                                         query->locatorString);
-            HashTable_Insert(collector->exactMatches, key, stat);
-            free(key);
+         ASSERT(id >= 0);
+         index = &collector->fields[id];
+
+         if (query->isRegExp) {
+            index->regExps[index->numRegExps++] = stat;
+         } else {
+            HashTable_Insert(index->exactMatches, query->locatorString, stat);
          }
+      } else {
+         ASSERT(!query->isRegExp);
       }
 
       /* The report lookup */
@@ -1540,7 +1833,6 @@ Bool
 GuestInfoTakeSample(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
 {
    GuestInfoCollector *temp;
-   locale_t newLoc;
    locale_t prevLoc;
 
    ASSERT(statBuf && DynBuf_GetSize(statBuf) == 0);
@@ -1583,13 +1875,17 @@ GuestInfoTakeSample(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
     * and "C" locale.
     *
     * Restore the current thread to its previous locale once done with the
-    * stats collection and encoding.
+    * stats collection and encoding. The "C" locale is kept for the next
+    * sample.
     */
-   newLoc = newlocale(LC_ALL_MASK, "C", (locale_t)0);
-   if (newLoc != (locale_t)0) {
-      prevLoc = uselocale(newLoc);
-   } else {
-      g_warning("%s: newlocale failed, error=%d.\n", __FUNCTION__, errno);
+   if (gCLocale == (locale_t)0) {
+      gCLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+      if (gCLocale == (locale_t)0) {
+         g_warning("%s: newlocale failed, error=%d.\n", __FUNCTION__, errno);
+      }
+   }
+   if (gCLocale != (locale_t)0) {
+      prevLoc = uselocale(gCLocale);
    }
 
    /* Collect the current data */
@@ -1598,10 +1894,9 @@ GuestInfoTakeSample(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
    /* Encode the captured data */
    GuestInfoEncodeStats(gCurrentCollector, gPreviousCollector, statBuf);
 
-   if (newLoc != (locale_t)0) {
+   if (gCLocale != (locale_t)0) {
       /* Restore thread previous locale */
       uselocale(prevLoc);
-      freelocale(newLoc);
    }
 
    /* Switch the collections for next time. */
@@ -1664,7 +1959,6 @@ GuestInfo_StatProviderPoll(gpointer data)
  * GuestInfo_StatProviderShutdown --
  *
  *      Clean up the resource acquired by perfMonLinux.
- *      Nothing to do at the moment.
  *
  * Results:
  *      None.
@@ -1678,6 +1972,17 @@ GuestInfo_StatProviderPoll(gpointer data)
 void
 GuestInfo_StatProviderShutdown(void)
 {
+   int i;
+
+   for (i = 0; i < PROC_FILE_MAX; i++) {
+      GuestInfoProcClose(i);
+   }
+
+   if (gCLocale != (locale_t)0) {
+      freelocale(gCLocale);
+      gCLocale = (locale_t)0;
+   }
+
    GuestInfoDeleteDiskStatsList(gDiskStatsList);
    gDiskStatsList = NULL;
 
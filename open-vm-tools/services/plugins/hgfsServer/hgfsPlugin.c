@@ -91,6 +91,38 @@ HgfsServerShutdown(gpointer src,
 }
 
 
+/**
+ * Writes one line of the HGFS server statistics to the state log.
+ * @param[in]  clientData  Unused.
+ * @param[in]  line        The line, without newline.
+ */
+
+static void
+HgfsServerDumpStatsLine(void *clientData,
+                        const char *line)
+{
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "%s\n", line);
+}
+
+
+/**
+ * Logs the HGFS server request statistics when the service dumps its state.
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      Unused.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+static void
+HgfsServerDumpState(gpointer src,
+                    ToolsAppCtx *ctx,
+                    ToolsPluginData *plugin)
+{
+   HgfsServerMgrData *mgrData = plugin->_private;
+
+   HgfsServerManager_DumpStats(mgrData, HgfsServerDumpStatsLine, NULL);
+}
+
+
 /**
  * Handles hgfs requests.
  *
@@ -1137,7 +1169,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
-         { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData }
+         { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData },
+         { TOOLS_CORE_SIG_DUMP_STATE, HgfsServerDumpState, &regData }
       };
       ToolsAppReg regs[] = {
          { TOOLS_APP_GUESTRPC, VMTools_WrapArray(rpcs, sizeof *rpcs, ARRAYSIZE(rpcs)) },
@@ -94,6 +94,18 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
  */
 #define SERVICE_DISCOVERY_CONF_DEFAULT_DISABLED_VALUE FALSE
 
+/*
+ * Default value for CONFNAME_SERVICEDISCOVERY_NATIVE_COLLECTORS setting in
+ * tools configuration file.
+ */
+#define SERVICE_DISCOVERY_CONF_DEFAULT_NATIVE_COLLECTORS TRUE
+
+/*
+ * Default value for CONFNAME_SERVICEDISCOVERY_PUBLISH_CHANGES_ONLY setting in
+ * tools configuration file.
+ */
+#define SERVICE_DISCOVERY_CONF_DEFAULT_PUBLISH_CHANGES_ONLY FALSE
+
 /*
  * Polling interval of service discovery plugin in milliseconds
  */
@@ -152,6 +164,13 @@ static Bool isGDPDebug = FALSE;
  */
 #define SERVICE_DISCOVERY_DELETE_CHUNK_SIZE 25
 
+/*
+ * With publish-changes-only, unchanged data is still published every
+ * SERVICE_DISCOVERY_FULL_PUBLISH_CYCLES cycles so that a consumer that
+ * missed an update catches up.
+ */
+#define SERVICE_DISCOVERY_FULL_PUBLISH_CYCLES 12
+
 /*
  * GdpError message table.
  */
@@ -166,6 +185,19 @@ typedef struct {
    gchar *val;
 } KeyNameValue;
 
+/*
+ * What was last published for a key. Namespace DB chunks whose content
+ * hasn't changed are not written again, as long as the chunk count read
+ * back from Namespace DB shows that it still holds what we wrote.
+ */
+typedef struct {
+   gint64 ndbWriteTime;   // Timestamp of the chunk count, 0 if unknown
+   GArray *ndbHashes;     // Hash of each chunk in Namespace DB
+   Bool ndbInPlace;       // Chunks were kept by this cycle's cleanup
+   Bool gdpHashValid;
+   guint64 gdpHash;       // Hash of the data last published to gdp daemon
+} KeyPublishState;
+
 static KeyNameValue gKeyScripts[] = {
    { SERVICE_DISCOVERY_KEY_PROCESSES, SERVICE_DISCOVERY_SCRIPT_PROCESSES },
    { SERVICE_DISCOVERY_KEY_CONNECTIONS,
@@ -197,6 +229,9 @@ static Bool isNDBWriteReady = TRUE;
 
 static Bool gSkipThisTask = FALSE; // Skip this task on some gdp errors.
 
+static GHashTable *gPublishStates = NULL; // Key name -> KeyPublishState
+static Bool gPublishChangesOnly = SERVICE_DISCOVERY_CONF_DEFAULT_PUBLISH_CHANGES_ONLY;
+
 /*
  *****************************************************************************
  * GetGuestTimeInMillis --
@@ -246,6 +281,88 @@ GetGDPPollInterval(ToolsAppCtx *ctx)
 }
 #endif
 
+/*
+ *****************************************************************************
+ * HashData --
+ *
+ * Computes the 64-bit FNV-1a hash of a buffer.
+ *
+ * @param[in] data        Data
+ * @param[in] len         Data length
+ *
+ * @retval The hash.
+ *
+ *****************************************************************************
+ */
+
+static guint64
+HashData(const char *data,
+         size_t len)
+{
+   guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      hash ^= (guchar) data[i];
+      hash *= G_GUINT64_CONSTANT(1099511628211);
+   }
+
+   return hash;
+}
+
+/*
+ *****************************************************************************
+ * FreePublishState --
+ *
+ * Frees the publish state of a key.
+ *
+ * @param[in] data        KeyPublishState
+ *
+ *****************************************************************************
+ */
+
+static void
+FreePublishState(gpointer data)
+{
+   KeyPublishState *state = data;
+
+   g_array_free(state->ndbHashes, TRUE);
+   g_free(state);
+}
+
+/*
+ *****************************************************************************
+ * GetPublishState --
+ *
+ * Looks up the publish state of a key, creating it on first use.
+ *
+ * @param[in] key         Key name
+ *
+ * @retval The key's publish state.
+ *
+ *****************************************************************************
+ */
+
+static KeyPublishState *
+GetPublishState(const char *key)
+{
+   KeyPublishState *state;
+
+   if (gPublishStates == NULL) {
+      gPublishStates = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, FreePublishState);
+   }
+
+   state = g_hash_table_lookup(gPublishStates, key);
+   if (state == NULL) {
+      state = g_new0(KeyPublishState, 1);
+      state->ndbHashes = g_array_new(FALSE, FALSE, sizeof(guint64));
+      g_hash_table_insert(gPublishStates, g_strdup(key), state);
+   }
+
+   return state;
+}
+
 /*
  *****************************************************************************
  * SendRpcMessage --
@@ -683,52 +800,69 @@ out:
 
 /*
  *****************************************************************************
- * SendScriptOutput --
+ * PublishData --
+ *
+ * Sends the data gathered for a key to host-side gdp daemon and/or
+ * namespace DB.
  *
- * Reads script child process stdout stream, sends output to
- * host-side gdp daemon and/or namespace DB.
+ * Data are cut into chunks with chunk size of 16K for namespace DB and 48K
+ * for gdp daemon. If there are multiple chunks of data, each chunk is sent
+ * to gdp daemon/namespace db separately with its chunk number in the topic.
  *
- * Stream output data are cut into chunks with chunk size of 16K for namespace
- * DB and 48K for gdp daemon. If there are multiple chunks of data, each chunk
- * is sent to gdp daemon/namespace db separately with its chunk number in the
- * topic.
+ * With publish-changes-only, Namespace DB chunks that are unchanged since
+ * the previous cycle and were kept by CleanupNamespaceDB are not written
+ * again, and data identical to what was last published to gdp daemon is
+ * not sent again except every SERVICE_DISCOVERY_FULL_PUBLISH_CYCLES cycles.
+ * Otherwise every chunk is rewritten, refreshing its timestamp.
  *
  * @param[in] ctx             The application context
- * @param[in] key             Script name
- * @param[in] childStdout     Stream to read child process stdout
+ * @param[in] key             Key name
+ * @param[in] data            Data
+ * @param[in] len             Data length
  *
- * @retval TRUE  Successfully sent output.
+ * @retval TRUE  Successfully sent data.
  * @retval FALSE Otherwise.
  *
  *****************************************************************************
  */
 
 Bool
-SendScriptOutput(ToolsAppCtx *ctx,
-                 const char *key,
-                 FILE* childStdout)
+PublishData(ToolsAppCtx *ctx,
+            const char *key,
+            const char *data,
+            size_t len)
 {
    Bool status = TRUE;
    Bool gdp_status = TRUE;
+   Bool gdpPublish = isGDPWriteReady;
+   KeyPublishState *state = GetPublishState(key);
+   guint64 hash = HashData(data, len);
+   guint oldChunks = state->ndbHashes->len;
    int i = 0;
    size_t totalReadBytes = 0;
    gint64 createTime = g_get_real_time();
    size_t ndbBufSize = SERVICE_DISCOVERY_VALUE_MAX_SIZE * sizeof(char);
+
+   if (gdpPublish && gPublishChangesOnly && state->gdpHashValid &&
+       state->gdpHash == hash &&
+       cycle % SERVICE_DISCOVERY_FULL_PUBLISH_CYCLES != 0) {
+      g_debug("%s: %s unchanged, not publishing to GDP\n", __FUNCTION__, key);
+      gdpPublish = FALSE;
+   }
+
    for (;;) {
-      size_t readBytes;
-      char buf[GDP_USER_DATA_LEN];
-      Bool eof = FALSE;
-      readBytes = fread_safe(buf, sizeof(buf), childStdout, &eof);
+      size_t readBytes = MIN(len - totalReadBytes, GDP_USER_DATA_LEN);
+      const char *buf = data + totalReadBytes;
 
       totalReadBytes += readBytes;
       g_debug("%s: DB readBytes = %"FMTSZ"u\n", __FUNCTION__,
               readBytes);
-      if (isGDPWriteReady && gdp_status && readBytes > 0) {
+      if (gdpPublish && gdp_status && readBytes > 0) {
          g_debug("%s:%s Write to GDP readBytes = %"FMTSZ"u\n",
                  __FUNCTION__, key, readBytes);
          gchar* topic;
 
-         if (eof || readBytes < sizeof(buf)) {
+         if (totalReadBytes == len) {
             topic = g_strdup_printf(SERVICE_DISCOVERY_TOPIC_PREFIX ".%s.%"FMTSZ
                                     "u.%"FMTSZ"u", key, cycle, totalReadBytes);
          } else {
@@ -750,6 +884,16 @@ SendScriptOutput(ToolsAppCtx *ctx,
                ndbReadBytes = ndbBufSize;
             }
             if (status && ndbReadBytes > 0) {
+               guint64 chunkHash = HashData(buf + j, ndbReadBytes);
+
+               if (state->ndbInPlace && i < oldChunks &&
+                   g_array_index(state->ndbHashes, guint64, i) == chunkHash) {
+                  g_debug("%s:%s Chunk %d unchanged in Namespace DB\n",
+                          __FUNCTION__, key, i + 1);
+                  i++;
+                  continue;
+               }
+
                g_debug("%s:%s Write to Namespace DB readBytes = %"FMTSZ"u\n",
                        __FUNCTION__, key, ndbReadBytes);
 
@@ -757,35 +901,116 @@ SendScriptOutput(ToolsAppCtx *ctx,
                status = WriteData(ctx, msg, buf + j, ndbReadBytes);
                if (!status) {
                    g_warning("%s: Failed to store data\n", __FUNCTION__);
+               } else if (i <= state->ndbHashes->len) {
+                  g_array_index(state->ndbHashes, guint64, i - 1) = chunkHash;
+               } else {
+                  g_array_append_val(state->ndbHashes, chunkHash);
                }
                g_free(msg);
             }
          }
       }
 
-      /*
-       * Exit the loop only after childStdout is not readable any more.
-       * Otherwise, the child process may be blocked in writing its stdout
-       * and hang.
-       */
-      if (eof || readBytes < sizeof(buf)) {
+      if (totalReadBytes == len) {
          break;
       }
+   }
+
+   if (gdpPublish) {
+      state->gdpHashValid = gdp_status;
+      state->gdpHash = hash;
+   }
 
+   if (isNDBWriteReady && status && state->ndbInPlace && i < oldChunks) {
+      /*
+       * The data shrank; remove the chunks past its end.
+       */
+      GPtrArray *keys = g_ptr_array_new_with_free_func(g_free);
+      int j;
+
+      for (j = i + 1; j <= oldChunks; j++) {
+         g_ptr_array_add(keys, g_strdup_printf("%s-%d", key, j));
+         if (keys->len >= SERVICE_DISCOVERY_DELETE_CHUNK_SIZE ||
+             j == oldChunks) {
+            status = DeleteData(ctx, keys) && status;
+            g_ptr_array_set_size(keys, 0);
+         }
+      }
+      g_ptr_array_free(keys, TRUE);
    }
 
    if (isNDBWriteReady && status) {
       gchar *chunkCount = g_strdup_printf("%d", i);
+      g_array_set_size(state->ndbHashes, i);
       status = WriteData(ctx, key, chunkCount, strlen(chunkCount));
       if (status) {
          g_debug("%s: Written key %s chunks %s\n", __FUNCTION__, key, chunkCount);
+         state->ndbWriteTime = gLastWriteTime;
       }
       g_free(chunkCount);
    }
+   if (isNDBWriteReady && !status) {
+      /*
+       * Namespace DB content is unknown, have the next cleanup remove it.
+       */
+      state->ndbWriteTime = 0;
+   }
 
    return status && gdp_status;
 }
 
+/*
+ *****************************************************************************
+ * SendScriptOutput --
+ *
+ * Reads script child process stdout stream to its end and publishes the
+ * output with PublishData.
+ *
+ * @param[in] ctx             The application context
+ * @param[in] key             Script name
+ * @param[in] childStdout     Stream to read child process stdout
+ *
+ * @retval TRUE  Successfully sent output.
+ * @retval FALSE Otherwise.
+ *
+ *****************************************************************************
+ */
+
+Bool
+SendScriptOutput(ToolsAppCtx *ctx,
+                 const char *key,
+                 FILE* childStdout)
+{
+   Bool status;
+   DynBuf out;
+
+   DynBuf_Init(&out);
+
+   /*
+    * Exit the loop only after childStdout is not readable any more.
+    * Otherwise, the child process may be blocked in writing its stdout
+    * and hang.
+    */
+   for (;;) {
+      size_t readBytes;
+      char buf[GDP_USER_DATA_LEN];
+      Bool eof = FALSE;
+      readBytes = fread_safe(buf, sizeof(buf), childStdout, &eof);
+
+      if (readBytes > 0 && !DynBuf_Append(&out, buf, readBytes)) {
+         g_warning("%s: Failed to buffer output of %s\n", __FUNCTION__, key);
+      }
+      if (eof || readBytes < sizeof(buf)) {
+         break;
+      }
+   }
+
+   status = PublishData(ctx, key, DynBuf_Get(&out), DynBuf_GetSize(&out));
+
+   DynBuf_Destroy(&out);
+   return status;
+}
+
 /*
  *****************************************************************************
  * DeleteDataAndFree --
@@ -820,6 +1045,10 @@ DeleteDataAndFree(ToolsAppCtx *ctx,
  *
  * Deletes all the chunks written to the Namespace DB in previous cycle.
  *
+ * With publish-changes-only, chunks of a key whose chunk count still
+ * carries the timestamp and count written in the previous cycle are kept,
+ * so that PublishData only has to rewrite the chunks that changed.
+ *
  * @param[in] ctx       Application context.
  *
  *****************************************************************************
@@ -838,20 +1067,39 @@ CleanupNamespaceDB(ToolsAppCtx *ctx) {
       char *value = NULL;
       size_t len = 0;
       KeyNameValue tmp = g_array_index(gFullPaths, KeyNameValue, i);
+      KeyPublishState *state = GetPublishState(tmp.keyName);
+
+      state->ndbInPlace = FALSE;
+
       /*
-       * Read count of chunks, ignore timestamp, iterate over chunks
-       * and remove them.
+       * Read count of chunks, iterate over chunks and remove them.
        */
       if (ReadData(ctx, tmp.keyName, &value, &len) && len > 1) {
          char *token = NULL;
+         char *timeStamp;
          g_debug("%s: Read %s from Namespace DB\n", __FUNCTION__, value);
 
+         timeStamp = strtok(value, ",");
+         token = timeStamp != NULL ? strtok(NULL, ",") : NULL;
+         if (gPublishChangesOnly &&
+             token != NULL && state->ndbWriteTime != 0 &&
+             g_ascii_strtoll(timeStamp, NULL, 10) == state->ndbWriteTime &&
+             g_ascii_strtoll(token, NULL, 10) == state->ndbHashes->len) {
+            g_debug("%s: Keeping %d chunks of %s\n", __FUNCTION__,
+                    state->ndbHashes->len, tmp.keyName);
+            state->ndbInPlace = TRUE;
+            free(value);
+            continue;
+         }
+         state->ndbWriteTime = 0;
+         g_array_set_size(state->ndbHashes, 0);
+
          g_ptr_array_add(keys, g_strdup(tmp.keyName));
          if (keys->len >= SERVICE_DISCOVERY_DELETE_CHUNK_SIZE) {
             DeleteDataAndFree(ctx, keys);
          }
 
-         if (NULL == strtok(value, ",")) {
+         if (NULL == timeStamp) {
             g_warning("%s: Malformed data for %s in Namespace DB",
                       __FUNCTION__, tmp.keyName);
             if (value) {
@@ -860,7 +1108,6 @@ CleanupNamespaceDB(ToolsAppCtx *ctx) {
             }
             continue;
          }
-         token = strtok(NULL, ",");
          if (token != NULL) {
             int count = (int) g_ascii_strtoll(token, NULL, 10);
             int j;
@@ -879,6 +1126,8 @@ CleanupNamespaceDB(ToolsAppCtx *ctx) {
       } else {
          g_warning("%s: Key %s not found in Namespace DB\n", __FUNCTION__,
                    tmp.keyName);
+         state->ndbWriteTime = 0;
+         g_array_set_size(state->ndbHashes, 0);
       }
       if (value) {
          free(value);
@@ -892,6 +1141,49 @@ CleanupNamespaceDB(ToolsAppCtx *ctx) {
 }
 
 
+/*
+ *****************************************************************************
+ * ExecuteCollector --
+ *
+ * Gathers the data of one key and sends it to Namespace DB and/or host-side
+ * gdp daemon, natively when possible and with the key's script otherwise.
+ *
+ * @param[in] ctx             The application context
+ * @param[in] key             Key name
+ * @param[in] script          Script producing the data for the key
+ * @param[in] useNative       Whether native collectors may be used
+ *
+ * @retval TRUE  Successfully gathered and sent data.
+ * @retval FALSE Otherwise.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+ExecuteCollector(ToolsAppCtx *ctx,
+                 const char *key,
+                 const char *script,
+                 Bool useNative)
+{
+#if defined(__linux__)
+   if (useNative) {
+      Bool status;
+      GString *out = g_string_new(NULL);
+
+      if (CollectNativeData(key, out)) {
+         g_debug("%s: Collected %s natively\n", __FUNCTION__, key);
+         status = PublishData(ctx, key, out->str, out->len);
+         g_string_free(out, TRUE);
+         return status;
+      }
+      g_string_free(out, TRUE);
+   }
+#endif
+
+   return ExecuteScript(ctx, key, script);
+}
+
+
 /*
  *****************************************************************************
  * ServiceDiscoveryTask --
@@ -910,6 +1202,7 @@ ServiceDiscoveryTask(ToolsAppCtx *ctx,
 {
    int i;
    Bool status = FALSE;
+   Bool useNative;
    Atomic_WriteBool(&gTaskSubmitted, TRUE);
    if (isGDPWriteReady) {
       gSkipThisTask = FALSE;
@@ -943,13 +1236,24 @@ ServiceDiscoveryTask(ToolsAppCtx *ctx,
       CleanupNamespaceDB(ctx);
    }
 
+   useNative =
+      VMTools_ConfigGetBoolean(ctx->config,
+                               CONFGROUPNAME_SERVICEDISCOVERY,
+                               CONFNAME_SERVICEDISCOVERY_NATIVE_COLLECTORS,
+                               SERVICE_DISCOVERY_CONF_DEFAULT_NATIVE_COLLECTORS);
+   gPublishChangesOnly =
+      VMTools_ConfigGetBoolean(ctx->config,
+                               CONFGROUPNAME_SERVICEDISCOVERY,
+                               CONFNAME_SERVICEDISCOVERY_PUBLISH_CHANGES_ONLY,
+                               SERVICE_DISCOVERY_CONF_DEFAULT_PUBLISH_CHANGES_ONLY);
+
    readBytesPerCycle = 0;
    cycle++;
    for (i = 0; i < gFullPaths->len; i++) {
       KeyNameValue tmp = g_array_index(gFullPaths, KeyNameValue, i);
-      if (!ExecuteScript(ctx, tmp.keyName, tmp.val)) {
-         g_debug("%s: ExecuteScript failed for script %s\n",
-                __FUNCTION__, tmp.val);
+      if (!ExecuteCollector(ctx, tmp.keyName, tmp.val, useNative)) {
+         g_debug("%s: ExecuteCollector failed for %s\n",
+                __FUNCTION__, tmp.keyName);
          if (isGDPWriteReady && gSkipThisTask && !isNDBWriteReady) {
             break;
          }
@@ -1223,6 +1527,11 @@ ServiceDiscoveryServerShutdown(gpointer src,
       }
       g_array_free(gFullPaths, TRUE);
    }
+
+   if (gPublishStates != NULL) {
+      g_hash_table_destroy(gPublishStates);
+      gPublishStates = NULL;
+   }
 }
 
 
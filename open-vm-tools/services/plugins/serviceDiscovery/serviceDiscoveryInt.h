@@ -55,6 +55,11 @@ Bool SendData(ToolsAppCtx *ctx,
               const char *data,
               const int len);
 
+Bool PublishData(ToolsAppCtx *ctx,
+                 const char *key,
+                 const char *data,
+                 size_t len);
+
 Bool SendScriptOutput(ToolsAppCtx *ctx,
                       const char *key,
                       FILE *childStdout);
@@ -63,4 +68,9 @@ Bool ExecuteScript(ToolsAppCtx *ctx,
                    const char *key,
                    const char *script);
 
+#if defined(__linux__)
+Bool CollectNativeData(const char *key,
+                       GString *out);
+#endif
+
 #endif /* _SERVICEDISCOVERYINT_H_ */
@@ -0,0 +1,1276 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * serviceDiscoveryNative.c --
+ *
+ * In-process collectors for the listening process, connection and
+ * performance metrics data. They read /proc and sock_diag directly and
+ * produce the same output as get-listening-process-info.sh,
+ * get-connection-info.sh and get-listening-process-perf-metrics.sh,
+ * without forking ss, ps, awk and friends on every poll.
+ */
+
+#ifndef __linux__
+#   error This file should not be compiled.
+#endif
+
+#include "serviceDiscoveryInt.h"
+#include "vm_basic_defs.h"
+#include "vmware/guestrpc/serviceDiscovery.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+/*
+ * Seconds between the two CPU and IO samples of the performance metrics,
+ * as in get-listening-process-perf-metrics.sh.
+ */
+#define SD_PERF_SAMPLE_INTERVAL 1
+
+/*
+ * TCP states, see include/net/tcp_states.h. UDP sockets are either
+ * TCP_ESTABLISHED (connected) or TCP_CLOSE.
+ */
+#define SD_TCP_CLOSE   7
+#define SD_TCP_LISTEN 10
+
+/*
+ * State names as printed by ss, indexed by TCP state.
+ */
+static const char *sdStateNames[] = {
+   "UNKNOWN",
+   "ESTAB",
+   "SYN-SENT",
+   "SYN-RECV",
+   "FIN-WAIT-1",
+   "FIN-WAIT-2",
+   "TIME-WAIT",
+   "UNCONN",
+   "CLOSE-WAIT",
+   "LAST-ACK",
+   "LISTEN",
+   "CLOSING",
+};
+
+typedef struct {
+   int pid;
+   int fd;
+} SdSocketOwner;
+
+typedef struct {
+   const char *netid;
+   int family;
+   guint state;
+   guint txQueue;
+   guint rxQueue;
+   guint8 localAddr[16];
+   guint localPort;
+   guint8 peerAddr[16];
+   guint peerPort;
+   guint64 inode;
+   Bool v6only;
+   GArray *owners;            // SdSocketOwner
+} SdSocket;
+
+typedef struct {
+   GPtrArray *sockets;        // SdSocket *, in ss order
+   GHashTable *inodes;        // inode -> SdSocket *
+   GHashTable *comms;         // pid -> command name
+   GHashTable *listening;     // set of pids owning a listening socket
+} SdSnapshot;
+
+typedef struct {
+   int pid;
+   int ppid;
+   guint64 cpuTicks;          // utime + stime + cutime + cstime
+} SdProcStat;
+
+/*
+ * Socket tables read for a snapshot, in the order ss -antup lists them.
+ * The /proc/net files are only read when sock_diag is not available.
+ */
+static const struct {
+   const char *path;
+   const char *netid;
+   int family;
+   int protocol;
+} sdSocketTables[] = {
+   { "/proc/net/udp",  "udp", AF_INET,  IPPROTO_UDP },
+   { "/proc/net/udp6", "udp", AF_INET6, IPPROTO_UDP },
+   { "/proc/net/tcp",  "tcp", AF_INET,  IPPROTO_TCP },
+   { "/proc/net/tcp6", "tcp", AF_INET6, IPPROTO_TCP },
+};
+
+
+/*
+ *****************************************************************************
+ * SdIsPid --
+ *
+ * Checks whether a /proc entry name is a process id.
+ *
+ * @param[in] name        Directory entry name.
+ *
+ * @retval TRUE  name is all digits.
+ * @retval FALSE Otherwise.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+SdIsPid(const char *name)
+{
+   return *name != '\0' && strspn(name, "0123456789") == strlen(name);
+}
+
+
+/*
+ *****************************************************************************
+ * SdReadProcFile --
+ *
+ * Reads a small file under /proc/<pid> into a caller supplied buffer.
+ *
+ * @param[in]  pid        Process id.
+ * @param[in]  name       File name relative to /proc/<pid>.
+ * @param[out] buf        Output buffer, NUL terminated.
+ * @param[in]  size       Size of buf.
+ *
+ * @return Number of bytes read, -1 on error.
+ *
+ *****************************************************************************
+ */
+
+static ssize_t
+SdReadProcFile(int pid,
+               const char *name,
+               char *buf,
+               size_t size)
+{
+   char path[64];
+   ssize_t len;
+   int fd;
+
+   g_snprintf(path, sizeof path, "/proc/%d/%s", pid, name);
+   fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd == -1) {
+      return -1;
+   }
+   len = read(fd, buf, size - 1);
+   close(fd);
+   if (len < 0) {
+      return -1;
+   }
+   buf[len] = '\0';
+   return len;
+}
+
+
+/*
+ *****************************************************************************
+ * SdGetComm --
+ *
+ * Returns the command name of a process, caching it in the snapshot.
+ *
+ * @param[in] snap        Snapshot.
+ * @param[in] pid         Process id.
+ *
+ * @return Command name, owned by the snapshot. Empty if the process is gone.
+ *
+ *****************************************************************************
+ */
+
+static const char *
+SdGetComm(SdSnapshot *snap,
+          int pid)
+{
+   char *comm = g_hash_table_lookup(snap->comms, GINT_TO_POINTER(pid));
+
+   if (comm == NULL) {
+      char buf[64];
+      ssize_t len = SdReadProcFile(pid, "comm", buf, sizeof buf);
+
+      if (len > 0 && buf[len - 1] == '\n') {
+         buf[len - 1] = '\0';
+      } else if (len < 0) {
+         buf[0] = '\0';
+      }
+      comm = g_strdup(buf);
+      g_hash_table_insert(snap->comms, GINT_TO_POINTER(pid), comm);
+   }
+   return comm;
+}
+
+
+/*
+ *****************************************************************************
+ * SdParseAddress --
+ *
+ * Converts an address as printed in /proc/net/{tcp,udp}{,6}: the words of
+ * the address in host byte order, each as 8 hex digits.
+ *
+ * @param[in]  hex        Address text.
+ * @param[in]  family     AF_INET or AF_INET6.
+ * @param[out] addr       Address in network byte order.
+ *
+ * @retval TRUE  Successfully parsed.
+ * @retval FALSE Malformed address.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+SdParseAddress(const char *hex,
+               int family,
+               guint8 addr[16])
+{
+   size_t words = family == AF_INET ? 1 : 4;
+   size_t i;
+
+   if (strlen(hex) != words * 8) {
+      return FALSE;
+   }
+   for (i = 0; i < words; i++) {
+      char word[9];
+      guint32 val;
+
+      memcpy(word, hex + i * 8, 8);
+      word[8] = '\0';
+      val = (guint32) strtoul(word, NULL, 16);
+      memcpy(addr + i * 4, &val, sizeof val);
+   }
+   return TRUE;
+}
+
+
+/*
+ *****************************************************************************
+ * SdAddSocket --
+ *
+ * Adds a socket to the snapshot. Sockets without an inode (e.g. TIME-WAIT)
+ * can't belong to a process and are skipped.
+ *
+ * @param[in] snap        Snapshot.
+ * @param[in] sock        Socket, without owners.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdAddSocket(SdSnapshot *snap,
+            const SdSocket *sock)
+{
+   SdSocket *newSock;
+
+   if (sock->inode == 0 ||
+       g_hash_table_lookup(snap->inodes, &sock->inode) != NULL) {
+      return;
+   }
+
+   newSock = g_new(SdSocket, 1);
+   *newSock = *sock;
+   newSock->owners = g_array_new(FALSE, FALSE, sizeof(SdSocketOwner));
+   g_ptr_array_add(snap->sockets, newSock);
+   g_hash_table_insert(snap->inodes, &newSock->inode, newSock);
+}
+
+
+/*
+ *****************************************************************************
+ * SdReadSockDiag --
+ *
+ * Adds the sockets of one protocol and family to the snapshot, dumped by
+ * the kernel over sock_diag netlink. Unlike the /proc/net files this
+ * reports the backlog of listening sockets, which ss shows as Send-Q.
+ *
+ * @param[in] snap        Snapshot.
+ * @param[in] netid       Protocol name as printed by ss.
+ * @param[in] family      Address family.
+ * @param[in] protocol    IPPROTO_TCP or IPPROTO_UDP.
+ *
+ * @retval TRUE  The dump completed.
+ * @retval FALSE sock_diag is not available.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+SdReadSockDiag(SdSnapshot *snap,
+               const char *netid,
+               int family,
+               int protocol)
+{
+   struct {
+      struct nlmsghdr nlh;
+      struct inet_diag_req_v2 req;
+   } request;
+   struct sockaddr_nl kernel = { 0 };
+   guint32 buf[8192];
+   Bool done = FALSE;
+   Bool status = FALSE;
+   int fd;
+
+   fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+   if (fd == -1) {
+      g_debug("%s: Failed to open sock_diag socket, errno=%d\n",
+              __FUNCTION__, errno);
+      return FALSE;
+   }
+
+   memset(&request, 0, sizeof request);
+   request.nlh.nlmsg_len = sizeof request;
+   request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+   request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+   request.req.sdiag_family = family;
+   request.req.sdiag_protocol = protocol;
+   request.req.idiag_states = ~0U;
+   kernel.nl_family = AF_NETLINK;
+
+   if (sendto(fd, &request, sizeof request, 0,
+              (struct sockaddr *) &kernel, sizeof kernel) < 0) {
+      g_debug("%s: sock_diag request failed, errno=%d\n", __FUNCTION__, errno);
+      goto out;
+   }
+
+   while (!done) {
+      struct nlmsghdr *nlh;
+      ssize_t len = recv(fd, buf, sizeof buf, 0);
+
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         g_debug("%s: sock_diag recv failed, errno=%d\n", __FUNCTION__, errno);
+         goto out;
+      }
+
+      for (nlh = (struct nlmsghdr *) buf;
+           NLMSG_OK(nlh, len);
+           nlh = NLMSG_NEXT(nlh, len)) {
+         struct inet_diag_msg *msg;
+         SdSocket sock = { 0 };
+
+         if (nlh->nlmsg_type == NLMSG_DONE) {
+            done = TRUE;
+            break;
+         }
+         if (nlh->nlmsg_type == NLMSG_ERROR) {
+            g_debug("%s: sock_diag dump failed for family %d protocol %d\n",
+                    __FUNCTION__, family, protocol);
+            goto out;
+         }
+         if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+             nlh->nlmsg_len < NLMSG_LENGTH(sizeof *msg)) {
+            continue;
+         }
+
+         msg = NLMSG_DATA(nlh);
+         if (msg->idiag_family == AF_INET6) {
+            struct rtattr *attr = (struct rtattr *) (msg + 1);
+            int attrLen = nlh->nlmsg_len - NLMSG_LENGTH(sizeof *msg);
+
+            for (; RTA_OK(attr, attrLen); attr = RTA_NEXT(attr, attrLen)) {
+               if (attr->rta_type == INET_DIAG_SKV6ONLY &&
+                   RTA_PAYLOAD(attr) >= 1) {
+                  sock.v6only = *(guint8 *) RTA_DATA(attr);
+               }
+            }
+         }
+         sock.netid = netid;
+         sock.family = msg->idiag_family;
+         sock.state = msg->idiag_state;
+         sock.rxQueue = msg->idiag_rqueue;
+         sock.txQueue = msg->idiag_wqueue;
+         memcpy(sock.localAddr, msg->id.idiag_src, sizeof sock.localAddr);
+         memcpy(sock.peerAddr, msg->id.idiag_dst, sizeof sock.peerAddr);
+         sock.localPort = ntohs(msg->id.idiag_sport);
+         sock.peerPort = ntohs(msg->id.idiag_dport);
+         sock.inode = msg->idiag_inode;
+         SdAddSocket(snap, &sock);
+      }
+   }
+   status = TRUE;
+
+out:
+   close(fd);
+   return status;
+}
+
+
+/*
+ *****************************************************************************
+ * SdReadNetFile --
+ *
+ * Adds the sockets listed in one /proc/net file to the snapshot.
+ *
+ * @param[in] snap        Snapshot.
+ * @param[in] path        File to read.
+ * @param[in] netid       Protocol name as printed by ss.
+ * @param[in] family      Address family of the file.
+ *
+ * @retval TRUE  The file was read.
+ * @retval FALSE The file could not be opened.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+SdReadNetFile(SdSnapshot *snap,
+              const char *path,
+              const char *netid,
+              int family)
+{
+   char line[512];
+   FILE *f = fopen(path, "r");
+
+   if (f == NULL) {
+      g_debug("%s: Failed to open %s, errno=%d\n", __FUNCTION__, path, errno);
+      return FALSE;
+   }
+
+   /* Skip the header. */
+   if (fgets(line, sizeof line, f) != NULL) {
+      while (fgets(line, sizeof line, f) != NULL) {
+         SdSocket sock = { 0 };
+         char local[33];
+         char peer[33];
+
+         /*
+          * sl local_address rem_address st tx_queue:rx_queue tr:tm->when
+          * retrnsmt uid timeout inode ...
+          */
+         if (sscanf(line, " %*u: %32[0-9A-Fa-f]:%x %32[0-9A-Fa-f]:%x %x "
+                    "%x:%x %*x:%*x %*x %*u %*u %" G_GUINT64_FORMAT,
+                    local, &sock.localPort, peer, &sock.peerPort,
+                    &sock.state, &sock.txQueue, &sock.rxQueue,
+                    &sock.inode) != 8 ||
+             !SdParseAddress(local, family, sock.localAddr) ||
+             !SdParseAddress(peer, family, sock.peerAddr)) {
+            continue;
+         }
+
+         sock.netid = netid;
+         sock.family = family;
+         SdAddSocket(snap, &sock);
+      }
+   }
+
+   fclose(f);
+   return TRUE;
+}
+
+
+/*
+ *****************************************************************************
+ * SdFindOwners --
+ *
+ * Walks /proc/<pid>/fd of every process to map the sockets in the snapshot
+ * to the processes that hold them, as ss -p does, and records the owners
+ * of listening sockets (ss -l: TCP LISTEN and unconnected UDP).
+ *
+ * @param[in] snap        Snapshot.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdFindOwners(SdSnapshot *snap)
+{
+   DIR *proc = opendir("/proc");
+   struct dirent *ent;
+
+   if (proc == NULL) {
+      g_warning("%s: Failed to open /proc, errno=%d\n", __FUNCTION__, errno);
+      return;
+   }
+
+   while ((ent = readdir(proc)) != NULL) {
+      char path[64];
+      DIR *fds;
+      struct dirent *fdEnt;
+      int fdDir;
+      int pid;
+
+      if (!SdIsPid(ent->d_name)) {
+         continue;
+      }
+      pid = atoi(ent->d_name);
+
+      g_snprintf(path, sizeof path, "%s/fd", ent->d_name);
+      fdDir = openat(dirfd(proc), path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fdDir == -1) {
+         continue;
+      }
+      fds = fdopendir(fdDir);
+      if (fds == NULL) {
+         close(fdDir);
+         continue;
+      }
+
+      while ((fdEnt = readdir(fds)) != NULL) {
+         char link[64];
+         ssize_t len;
+         guint64 inode;
+         SdSocket *sock;
+         SdSocketOwner owner;
+
+         if (!SdIsPid(fdEnt->d_name)) {
+            continue;
+         }
+         len = readlinkat(fdDir, fdEnt->d_name, link, sizeof link - 1);
+         if (len <= 0) {
+            continue;
+         }
+         link[len] = '\0';
+         if (strncmp(link, "socket:[", 8) != 0) {
+            continue;
+         }
+         inode = g_ascii_strtoull(link + 8, NULL, 10);
+         sock = g_hash_table_lookup(snap->inodes, &inode);
+         if (sock == NULL) {
+            continue;
+         }
+
+         owner.pid = pid;
+         owner.fd = atoi(fdEnt->d_name);
+         /* ss lists the last process found first. */
+         g_array_prepend_val(sock->owners, owner);
+         if (sock->state == (strcmp(sock->netid, "tcp") == 0 ?
+                             SD_TCP_LISTEN : SD_TCP_CLOSE)) {
+            g_hash_table_insert(snap->listening, GINT_TO_POINTER(pid),
+                                GINT_TO_POINTER(pid));
+         }
+      }
+      closedir(fds);
+   }
+
+   closedir(proc);
+}
+
+
+/*
+ *****************************************************************************
+ * SdFreeSocket --
+ *
+ * Frees a socket of a snapshot.
+ *
+ * @param[in] data        SdSocket.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdFreeSocket(gpointer data)
+{
+   SdSocket *sock = data;
+
+   g_array_free(sock->owners, TRUE);
+   g_free(sock);
+}
+
+
+/*
+ *****************************************************************************
+ * SdSnapshotInit --
+ *
+ * Takes a snapshot of the TCP and UDP sockets and of their owners.
+ *
+ * @param[out] snap       Snapshot, to be released with SdSnapshotDestroy.
+ *
+ * @retval TRUE  Successfully read the socket tables.
+ * @retval FALSE None of the socket tables could be read.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+SdSnapshotInit(SdSnapshot *snap)
+{
+   Bool found = FALSE;
+   int i;
+
+   snap->sockets = g_ptr_array_new_with_free_func(SdFreeSocket);
+   snap->inodes = g_hash_table_new(g_int64_hash, g_int64_equal);
+   snap->comms = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                       NULL, g_free);
+   snap->listening = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+   for (i = 0; i < ARRAYSIZE(sdSocketTables); i++) {
+      if (SdReadSockDiag(snap, sdSocketTables[i].netid,
+                         sdSocketTables[i].family,
+                         sdSocketTables[i].protocol) ||
+          SdReadNetFile(snap, sdSocketTables[i].path,
+                        sdSocketTables[i].netid,
+                        sdSocketTables[i].family)) {
+         found = TRUE;
+      }
+   }
+   if (found) {
+      SdFindOwners(snap);
+   }
+   return found;
+}
+
+
+/*
+ *****************************************************************************
+ * SdSnapshotDestroy --
+ *
+ * Releases a snapshot.
+ *
+ * @param[in] snap        Snapshot.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdSnapshotDestroy(SdSnapshot *snap)
+{
+   g_hash_table_destroy(snap->listening);
+   g_hash_table_destroy(snap->comms);
+   g_hash_table_destroy(snap->inodes);
+   g_ptr_array_free(snap->sockets, TRUE);
+}
+
+
+/*
+ *****************************************************************************
+ * SdComparePids --
+ *
+ * Numeric comparison of two pids, for sorting.
+ *
+ *****************************************************************************
+ */
+
+static gint
+SdComparePids(gconstpointer a,
+              gconstpointer b)
+{
+   int pidA = *(const int *) a;
+   int pidB = *(const int *) b;
+
+   return pidA < pidB ? -1 : pidA > pidB;
+}
+
+
+/*
+ *****************************************************************************
+ * SdCompareAsStrings --
+ *
+ * Compares two pids as strings, the order "sort -u" puts them in.
+ *
+ *****************************************************************************
+ */
+
+static gint
+SdCompareAsStrings(gconstpointer a,
+                   gconstpointer b)
+{
+   char pidA[16];
+   char pidB[16];
+
+   g_snprintf(pidA, sizeof pidA, "%d", *(const int *) a);
+   g_snprintf(pidB, sizeof pidB, "%d", *(const int *) b);
+   return strcmp(pidA, pidB);
+}
+
+
+/*
+ *****************************************************************************
+ * SdListeningPids --
+ *
+ * Returns the pids owning a listening socket.
+ *
+ * @param[in] snap        Snapshot.
+ * @param[in] compare     Sort order.
+ *
+ * @return Sorted array of pids, free with g_array_free.
+ *
+ *****************************************************************************
+ */
+
+static GArray *
+SdListeningPids(SdSnapshot *snap,
+                GCompareFunc compare)
+{
+   GArray *pids = g_array_new(FALSE, FALSE, sizeof(int));
+   GHashTableIter iter;
+   gpointer key;
+
+   g_hash_table_iter_init(&iter, snap->listening);
+   while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      int pid = GPOINTER_TO_INT(key);
+      g_array_append_val(pids, pid);
+   }
+   g_array_sort(pids, compare);
+   return pids;
+}
+
+
+/*
+ *****************************************************************************
+ * SdAppendAddress --
+ *
+ * Appends an address and port the way ss prints them. The IPv6 wildcard
+ * of a socket that also accepts IPv4 is printed as "*".
+ *
+ * @param[out] out        Output.
+ * @param[in]  sock       Socket.
+ * @param[in]  addr       Address in network byte order.
+ * @param[in]  port       Port, 0 for any.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdAppendAddress(GString *out,
+                const SdSocket *sock,
+                const guint8 addr[16],
+                guint port)
+{
+   static const guint8 any[16] = { 0 };
+   char text[INET6_ADDRSTRLEN];
+
+   if (sock->family == AF_INET6 && !sock->v6only &&
+       memcmp(addr, any, sizeof any) == 0) {
+      g_string_append_c(out, '*');
+   } else if (inet_ntop(sock->family, addr, text, sizeof text) == NULL) {
+      g_string_append_c(out, '?');
+   } else if (sock->family == AF_INET6) {
+      g_string_append_printf(out, "[%s]", text);
+   } else {
+      g_string_append(out, text);
+   }
+   if (port == 0) {
+      g_string_append(out, ":*");
+   } else {
+      g_string_append_printf(out, ":%u", port);
+   }
+}
+
+
+/*
+ *****************************************************************************
+ * SdCollectConnections --
+ *
+ * Equivalent of get-connection-info.sh: the ss -antup lines of every
+ * socket held by a process that is listening on some port.
+ *
+ * @param[in]  snap       Snapshot.
+ * @param[out] out        Output.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdCollectConnections(SdSnapshot *snap,
+                     GString *out)
+{
+   int i;
+
+   for (i = 0; i < snap->sockets->len; i++) {
+      SdSocket *sock = g_ptr_array_index(snap->sockets, i);
+      Bool selected = FALSE;
+      int j;
+
+      for (j = 0; j < sock->owners->len && !selected; j++) {
+         SdSocketOwner *owner = &g_array_index(sock->owners, SdSocketOwner, j);
+         selected = g_hash_table_contains(snap->listening,
+                                          GINT_TO_POINTER(owner->pid));
+      }
+      if (!selected) {
+         continue;
+      }
+
+      g_string_append_printf(out, "%-5s %-10s %-6u %-6u ", sock->netid,
+                             sock->state < ARRAYSIZE(sdStateNames) ?
+                                sdStateNames[sock->state] : "UNKNOWN",
+                             sock->rxQueue, sock->txQueue);
+      SdAppendAddress(out, sock, sock->localAddr, sock->localPort);
+      g_string_append_c(out, ' ');
+      SdAppendAddress(out, sock, sock->peerAddr, sock->peerPort);
+      g_string_append(out, " users:(");
+      for (j = 0; j < sock->owners->len; j++) {
+         SdSocketOwner *owner = &g_array_index(sock->owners, SdSocketOwner, j);
+         g_string_append_printf(out, "%s(\"%s\",pid=%d,fd=%d)",
+                                j > 0 ? "," : "",
+                                SdGetComm(snap, owner->pid),
+                                owner->pid, owner->fd);
+      }
+      g_string_append(out, ")\n");
+   }
+}
+
+
+/*
+ *****************************************************************************
+ * SdCollectProcesses --
+ *
+ * Equivalent of get-listening-process-info.sh: pid, parent pid, command
+ * name and command line of every listening process, as printed by
+ * ps -o pid=,ppid=,comm=,command=.
+ *
+ * @param[in]  snap       Snapshot.
+ * @param[out] out        Output.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdCollectProcesses(SdSnapshot *snap,
+                   GString *out)
+{
+   GArray *pids = SdListeningPids(snap, SdComparePids);
+   int i;
+
+   for (i = 0; i < pids->len; i++) {
+      int pid = g_array_index(pids, int, i);
+      const char *comm;
+      char *cmdLine = NULL;
+      gsize cmdLen = 0;
+      char stat[1024];
+      char path[64];
+      char *statEnd;
+      int ppid;
+
+      if (SdReadProcFile(pid, "stat", stat, sizeof stat) <= 0 ||
+          (statEnd = strrchr(stat, ')')) == NULL ||
+          sscanf(statEnd + 1, " %*c %d", &ppid) != 1) {
+         continue;
+      }
+      comm = SdGetComm(snap, pid);
+
+      g_string_append_printf(out, "%5d %5d %-15s ", pid, ppid, comm);
+
+      g_snprintf(path, sizeof path, "/proc/%d/cmdline", pid);
+      if (g_file_get_contents(path, &cmdLine, &cmdLen, NULL) && cmdLen > 0) {
+         gsize j;
+
+         /*
+          * Arguments are separated by NULs; like ps, print them and any
+          * other control characters as spaces.
+          */
+         for (j = 0; j < cmdLen - 1; j++) {
+            if ((guchar) cmdLine[j] < ' ' || cmdLine[j] == '\x7f') {
+               cmdLine[j] = ' ';
+            }
+         }
+         g_string_append(out, cmdLine);
+      } else {
+         g_string_append_printf(out, "[%s]", comm);
+      }
+      g_string_append_c(out, '\n');
+      g_free(cmdLine);
+   }
+
+   g_array_free(pids, TRUE);
+}
+
+
+/*
+ *****************************************************************************
+ * SdReadProcStats --
+ *
+ * Reads the parent and the CPU time of every process.
+ *
+ * @return Array of SdProcStat sorted by pid, free with g_array_free.
+ *
+ *****************************************************************************
+ */
+
+static GArray *
+SdReadProcStats(void)
+{
+   GArray *stats = g_array_new(FALSE, FALSE, sizeof(SdProcStat));
+   DIR *proc = opendir("/proc");
+   struct dirent *ent;
+
+   if (proc == NULL) {
+      g_warning("%s: Failed to open /proc, errno=%d\n", __FUNCTION__, errno);
+      return stats;
+   }
+
+   while ((ent = readdir(proc)) != NULL) {
+      SdProcStat stat;
+      char buf[1024];
+      char *statEnd;
+      guint64 utime, stime, cutime, cstime;
+
+      if (!SdIsPid(ent->d_name)) {
+         continue;
+      }
+      stat.pid = atoi(ent->d_name);
+
+      /*
+       * "pid (comm) state ppid pgrp session tty_nr tpgid flags minflt
+       * cminflt majflt cmajflt utime stime cutime cstime ..."
+       */
+      if (SdReadProcFile(stat.pid, "stat", buf, sizeof buf) <= 0 ||
+          (statEnd = strrchr(buf, ')')) == NULL ||
+          sscanf(statEnd + 1, " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                 "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+                 " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                 &stat.ppid, &utime, &stime, &cutime, &cstime) != 5) {
+         continue;
+      }
+      stat.cpuTicks = utime + stime + cutime + cstime;
+      g_array_append_val(stats, stat);
+   }
+
+   closedir(proc);
+   g_array_sort(stats, SdComparePids);
+   return stats;
+}
+
+
+/*
+ *****************************************************************************
+ * SdFindProcStat --
+ *
+ * Looks up a process in the array returned by SdReadProcStats.
+ *
+ * @return The process' entry, NULL if it is gone.
+ *
+ *****************************************************************************
+ */
+
+static const SdProcStat *
+SdFindProcStat(GArray *stats,
+               int pid)
+{
+   return bsearch(&pid, stats->data, stats->len, sizeof(SdProcStat),
+                  SdComparePids);
+}
+
+
+/*
+ *****************************************************************************
+ * SdAppendNumber --
+ *
+ * Appends a number the way awk prints it: integers as such, everything
+ * else with "%.6g", independent of the locale.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdAppendNumber(GString *out,
+               double value)
+{
+   if (value == (double) (gint64) value) {
+      g_string_append_printf(out, "%" G_GINT64_FORMAT, (gint64) value);
+   } else {
+      char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+      g_string_append(out, g_ascii_formatd(buf, sizeof buf, "%.6g", value));
+   }
+}
+
+
+/*
+ *****************************************************************************
+ * SdAppendCpu --
+ *
+ * Appends the "CPU:" line for one listening process, computed over the
+ * process and its children exactly like calculateCpuTimeForProcess.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdAppendCpu(GString *out,
+            GArray *stats,
+            int pid,
+            long clockTicks,
+            long numCpus)
+{
+   const SdProcStat *stat = SdFindProcStat(stats, pid);
+   double cpuUsage;
+   int i;
+
+   cpuUsage = (((stat != NULL ? stat->cpuTicks : 0) /
+                (double) (SD_PERF_SAMPLE_INTERVAL * clockTicks) * 100) /
+               numCpus);
+   for (i = 0; i < stats->len; i++) {
+      stat = &g_array_index(stats, SdProcStat, i);
+      if (stat->ppid == pid) {
+         cpuUsage = (((cpuUsage + stat->cpuTicks) /
+                      (double) (SD_PERF_SAMPLE_INTERVAL * clockTicks) * 100) /
+                     numCpus);
+      }
+   }
+
+   g_string_append_printf(out, "CPU: %d ", pid);
+   SdAppendNumber(out, cpuUsage);
+   g_string_append_c(out, '\n');
+}
+
+
+/*
+ *****************************************************************************
+ * SdSumField --
+ *
+ * Sums a "name: value" field of a /proc/<pid> file over a process and its
+ * children, like the scripts' awk '/^name:/{A+=$2}'.
+ *
+ * @param[in]  stats      Process table.
+ * @param[in]  pid        Process id.
+ * @param[in]  file       File name relative to /proc/<pid>.
+ * @param[in]  field      Field name, including the colon.
+ * @param[out] sum        Sum of the field.
+ *
+ * @retval TRUE  The field was found at least once.
+ * @retval FALSE Otherwise, the script would print nothing.
+ *
+ *****************************************************************************
+ */
+
+static Bool
+SdSumField(GArray *stats,
+           int pid,
+           const char *file,
+           const char *field,
+           guint64 *sum)
+{
+   size_t fieldLen = strlen(field);
+   Bool found = FALSE;
+   int i;
+
+   *sum = 0;
+   for (i = -1; i < (int) stats->len; i++) {
+      char path[64];
+      gchar *contents;
+      const char *line;
+      int curPid;
+
+      if (i == -1) {
+         curPid = pid;
+      } else if (g_array_index(stats, SdProcStat, i).ppid == pid) {
+         curPid = g_array_index(stats, SdProcStat, i).pid;
+      } else {
+         continue;
+      }
+
+      g_snprintf(path, sizeof path, "/proc/%d/%s", curPid, file);
+      if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+         continue;
+      }
+      for (line = contents; line != NULL && *line != '\0'; ) {
+         const char *next = strchr(line, '\n');
+
+         if (strncmp(line, field, fieldLen) == 0) {
+            *sum += g_ascii_strtoull(line + fieldLen, NULL, 10);
+            found = TRUE;
+         }
+         line = next != NULL ? next + 1 : NULL;
+      }
+      g_free(contents);
+   }
+   return found;
+}
+
+
+/*
+ *****************************************************************************
+ * SdAppendIo --
+ *
+ * Appends the "IO:" line for one listening process, summed over the
+ * process and its children.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdAppendIo(GString *out,
+           GArray *stats,
+           int pid)
+{
+   guint64 readBytes;
+   guint64 writeBytes;
+
+   g_string_append_printf(out, "IO: %d", pid);
+   if (SdSumField(stats, pid, "io", "read_bytes:", &readBytes)) {
+      g_string_append_printf(out, " %" G_GUINT64_FORMAT, readBytes);
+   }
+   if (SdSumField(stats, pid, "io", "write_bytes:", &writeBytes)) {
+      g_string_append_printf(out, " %" G_GUINT64_FORMAT, writeBytes);
+   }
+   g_string_append_c(out, '\n');
+}
+
+
+/*
+ *****************************************************************************
+ * SdAppendMem --
+ *
+ * Appends the "MEM:" line for one listening process: the proportional set
+ * size in kB of the process and its children. smaps_rollup carries the
+ * totals of smaps; smaps is only read on kernels without it.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdAppendMem(GString *out,
+            GArray *stats,
+            int pid)
+{
+   static int hasRollup = -1;
+   guint64 pss;
+
+   if (hasRollup == -1) {
+      hasRollup = access("/proc/self/smaps_rollup", R_OK) == 0;
+   }
+
+   g_string_append_printf(out, "MEM: %d", pid);
+   if (SdSumField(stats, pid, hasRollup ? "smaps_rollup" : "smaps", "Pss:",
+                  &pss)) {
+      g_string_append_printf(out, " %" G_GUINT64_FORMAT, pss);
+   }
+   g_string_append_c(out, '\n');
+}
+
+
+/*
+ *****************************************************************************
+ * SdCollectPerfMetrics --
+ *
+ * Equivalent of get-listening-process-perf-metrics.sh: two CPU and IO
+ * samples SD_PERF_SAMPLE_INTERVAL seconds apart, then memory, for every
+ * listening process.
+ *
+ * @param[in]  snap       Snapshot.
+ * @param[out] out        Output.
+ *
+ *****************************************************************************
+ */
+
+static void
+SdCollectPerfMetrics(SdSnapshot *snap,
+                     GString *out)
+{
+   GArray *pids = SdListeningPids(snap, SdCompareAsStrings);
+   long clockTicks = sysconf(_SC_CLK_TCK);
+   long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+   GArray *stats;
+   int sample;
+   int i;
+
+   if (pids->len == 0) {
+      g_string_append(out, "No process id has been provided.\n");
+      goto out;
+   }
+   if (clockTicks <= 0) {
+      g_string_append(out, "Failed to get conf variable CLK_TCK\n");
+      goto out;
+   }
+   if (numCpus <= 0) {
+      g_string_append(out, "Failed to get conf variable _NPROCESSORS_ONLN\n");
+      goto out;
+   }
+
+   g_string_append(out, "#PIDs: -");
+   for (i = 0; i < pids->len; i++) {
+      g_string_append_printf(out, " %d", g_array_index(pids, int, i));
+   }
+   g_string_append_c(out, '\n');
+
+   /*
+    * CPU and IO are sampled twice so that the consumer can compute rates.
+    */
+   stats = NULL;
+   for (sample = 0; sample < 2; sample++) {
+      if (sample > 0) {
+         g_array_free(stats, TRUE);
+         g_usleep(SD_PERF_SAMPLE_INTERVAL * G_USEC_PER_SEC);
+      }
+      stats = SdReadProcStats();
+      for (i = 0; i < pids->len; i++) {
+         SdAppendCpu(out, stats, g_array_index(pids, int, i), clockTicks,
+                     numCpus);
+      }
+      for (i = 0; i < pids->len; i++) {
+         SdAppendIo(out, stats, g_array_index(pids, int, i));
+      }
+   }
+   for (i = 0; i < pids->len; i++) {
+      SdAppendMem(out, stats, g_array_index(pids, int, i));
+   }
+   g_array_free(stats, TRUE);
+
+out:
+   g_array_free(pids, TRUE);
+}
+
+
+/*
+ *****************************************************************************
+ * CollectNativeData --
+ *
+ * Produces the data of a service discovery key in process, when there is
+ * a native collector for it.
+ *
+ * @param[in]  key        Service discovery key.
+ * @param[out] out        Collected data, same format as the key's script.
+ *
+ * @retval TRUE  Data collected.
+ * @retval FALSE No native collector for the key, or /proc could not be
+ *               read; the caller should run the script instead.
+ *
+ *****************************************************************************
+ */
+
+Bool
+CollectNativeData(const char *key,
+                  GString *out)
+{
+   SdSnapshot snap;
+   Bool status;
+
+   if (strcmp(key, SERVICE_DISCOVERY_KEY_PROCESSES) != 0 &&
+       strcmp(key, SERVICE_DISCOVERY_KEY_CONNECTIONS) != 0 &&
+       strcmp(key, SERVICE_DISCOVERY_KEY_PERFORMANCE_METRICS) != 0) {
+      return FALSE;
+   }
+
+   status = SdSnapshotInit(&snap);
+   if (status) {
+      if (strcmp(key, SERVICE_DISCOVERY_KEY_PROCESSES) == 0) {
+         SdCollectProcesses(&snap, out);
+      } else if (strcmp(key, SERVICE_DISCOVERY_KEY_CONNECTIONS) == 0) {
+         SdCollectConnections(&snap, out);
+      } else {
+         SdCollectPerfMetrics(&snap, out);
+      }
+   } else {
+      g_info("%s: Unable to read socket tables, falling back to script\n",
+             __FUNCTION__);
+   }
+   SdSnapshotDestroy(&snap);
+
+   return status;
+}
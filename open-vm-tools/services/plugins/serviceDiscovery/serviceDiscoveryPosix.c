@@ -170,3 +170,4 @@ out:
    g_free(command);
    return status;
 }
+
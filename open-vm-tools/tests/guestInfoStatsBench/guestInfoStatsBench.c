@@ -0,0 +1,145 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * guestInfoStatsBench.c --
+ *
+ *   Benchmark for the Linux guest stats collector of the guestInfo plugin.
+ *   Links the collector (perfMonLinux.c) and polls it the way the plugin's
+ *   stats timer does, without sending the samples to the host:
+ *
+ *   vmware-guestinfo-stats-bench [samples]
+ *
+ *   Reports the number of samples taken per second and the size of the
+ *   encoded stats.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "vmware.h"
+#include "dynbuf.h"
+#include "guestInfoInt.h"
+
+#define DEFAULT_SAMPLES 10000
+
+static unsigned int numReports = 0;
+static size_t reportSize = 0;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    Current time in seconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * GuestInfo_ServerReportStats --
+ *
+ *    Stands in for the plugin's function sending a sample to the host.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    Counts the sample.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+GuestInfo_ServerReportStats(ToolsAppCtx *ctx,  // IN
+                            DynBuf *stats)     // IN
+{
+   numReports++;
+   reportSize = DynBuf_GetSize(stats);
+   return TRUE;
+}
+
+
+int
+main(int argc,        // IN
+     char *argv[])    // IN
+{
+   unsigned int numSamples = DEFAULT_SAMPLES;
+   ToolsAppCtx ctx = { 0 };
+   unsigned int i;
+   double start;
+   double seconds;
+
+   if (argc > 1) {
+      numSamples = strtoul(argv[1], NULL, 0);
+   }
+   if (numSamples == 0) {
+      fprintf(stderr, "Usage: %s [samples]\n", argv[0]);
+      return 1;
+   }
+
+   ctx.config = g_key_file_new();
+
+   /* The first sample opens the /proc files and sets up the collectors. */
+   start = Now();
+   GuestInfo_StatProviderPoll(&ctx);
+   printf("%-20s %10.1f us\n", "first sample", (Now() - start) * 1e6);
+
+   numReports = 0;
+   start = Now();
+   for (i = 0; i < numSamples; i++) {
+      GuestInfo_StatProviderPoll(&ctx);
+   }
+   seconds = Now() - start;
+
+   if (numReports != numSamples) {
+      fprintf(stderr, "%u of %u samples failed\n",
+              numSamples - numReports, numSamples);
+      return 1;
+   }
+
+   printf("%-20s %10u\n", "samples", numSamples);
+   printf("%-20s %10.1f\n", "samples/second", numSamples / seconds);
+   printf("%-20s %10.1f us\n", "time/sample", seconds * 1e6 / numSamples);
+   printf("%-20s %10"FMTSZ"u bytes\n", "sample size", reportSize);
+
+   GuestInfo_StatProviderShutdown();
+   g_key_file_free(ctx.config);
+
+   return 0;
+}
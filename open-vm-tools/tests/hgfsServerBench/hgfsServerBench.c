@@ -0,0 +1,1127 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerBench.c --
+ *
+ *   Microbenchmarks for the HGFS server. Requests are packed in the V3
+ *   wire format and handed to the server through the synchronous guest
+ *   channel (HgfsServerManager_ProcessPacket), which feeds them to
+ *   HgfsServerSessionReceive as a transport would, so no hypervisor or
+ *   kernel client is involved. Paths are resolved through the guest "root"
+ *   share, i.e. the scratch directory is used as is; put it on tmpfs to
+ *   measure the server rather than the disk.
+ *
+ *   Each scenario reports throughput and, for scenarios timing individual
+ *   requests, the latency distribution.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServerManager.h"
+#include "hgfsServerPolicy.h"
+#include "str.h"
+#include "util.h"
+
+#define BENCH_DEFAULT_DIR         "/tmp"
+#define BENCH_DEFAULT_HANDLES     10000
+#define BENCH_DEFAULT_ITERATIONS  100000
+#define BENCH_DEFAULT_FILES       1000
+#define BENCH_DEFAULT_FILE_MB     64
+#define BENCH_DEFAULT_BLOCK_SIZE  (64 * 1024)
+#define BENCH_READ_SIZE           512
+
+/* Largest write payload fitting in a request packet. */
+#define BENCH_MAX_BLOCK_SIZE \
+   MIN(HGFS_LARGE_IO_MAX, \
+       HGFS_LARGE_PACKET_MAX - sizeof(HgfsRequest) - sizeof(HgfsRequestWriteV3))
+
+typedef struct BenchState {
+   HgfsServerMgrData mgrData;
+   char *scratchDir;              /* Directory holding the benchmark files. */
+   uint32 numHandles;             /* Handles kept open by the scenarios. */
+   uint32 iterations;             /* Timed operations per scenario. */
+   uint32 numFiles;               /* Files in the enumerated directory. */
+   uint64 fileSize;               /* Size of the sequential I/O file. */
+   uint32 blockSize;              /* Sequential I/O request size. */
+   char *request;                 /* Request packet buffer. */
+   char *reply;                   /* Reply packet buffer. */
+   size_t replySize;              /* Size of the last reply. */
+   uint32 nextId;                 /* Request id counter. */
+} BenchState;
+
+typedef struct BenchScenario {
+   const char *name;
+   const char *description;
+   Bool (*run)(BenchState *state);
+} BenchScenario;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowUS --
+ *
+ *   Monotonic time stamp.
+ *
+ * Results:
+ *   Time in microseconds.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowUS(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchNowNS --
+ *
+ *   Monotonic time stamp, for timing individual requests.
+ *
+ * Results:
+ *   Time in nanoseconds.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+BenchNowNS(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReport --
+ *
+ *   Prints the result of a timed loop.
+ *
+ * Results:
+ *   None.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchReport(const char *what,      // IN: measured operation
+            uint64 count,          // IN: number of operations
+            uint64 elapsedUS,      // IN: total time
+            uint64 bytes)          // IN: payload bytes moved, may be 0
+{
+   double seconds = elapsedUS / 1e6;
+
+   printf("  %-28s %10"FMT64"u ops %10.3f s %12.0f ops/s %9.2f us/op",
+          what, count, seconds, seconds > 0 ? count / seconds : 0.0,
+          count > 0 ? (double)elapsedUS / count : 0.0);
+   if (bytes != 0) {
+      printf(" %9.1f MiB/s", seconds > 0 ? bytes / seconds / (1 << 20) : 0.0);
+   }
+   printf("\n");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCompareSamples --
+ *
+ *   qsort comparator for latency samples.
+ *
+ * Results:
+ *   <0, 0 or >0 as for strcmp.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BenchCompareSamples(const void *a,   // IN
+                    const void *b)   // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReportLatency --
+ *
+ *   Prints the distribution of per operation latencies of a timed loop.
+ *
+ * Results:
+ *   None.
+ *
+ * Side effects:
+ *   Sorts samples.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchReportLatency(uint64 *samples,   // IN/OUT: latencies in nanoseconds
+                   uint32 count)      // IN: number of samples
+{
+   if (count == 0) {
+      return;
+   }
+
+   qsort(samples, count, sizeof *samples, BenchCompareSamples);
+   printf("  %-28s p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f us\n",
+          "",
+          samples[count / 2] / 1e3,
+          samples[(uint64)count * 90 / 100] / 1e3,
+          samples[(uint64)count * 99 / 100] / 1e3,
+          samples[(uint64)count * 999 / 1000] / 1e3,
+          samples[count - 1] / 1e3);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSend --
+ *
+ *   Hands the V3 request in state->request to the server and checks the
+ *   reply status.
+ *
+ * Results:
+ *   Pointer to the reply payload on success, NULL on failure.
+ *
+ * Side effects:
+ *   state->reply and state->replySize are updated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+BenchSend(BenchState *state,   // IN/OUT: benchmark state
+          HgfsOp op,           // IN: operation
+          size_t payloadSize)  // IN: size of the request payload
+{
+   HgfsRequest *header = (HgfsRequest *)state->request;
+   HgfsReply *reply = (HgfsReply *)state->reply;
+
+   header->id = state->nextId++;
+   header->op = op;
+
+   state->replySize = HGFS_LARGE_PACKET_MAX;
+   if (!HgfsServerManager_ProcessPacket(&state->mgrData,
+                                        state->request,
+                                        sizeof *header + payloadSize,
+                                        state->reply,
+                                        &state->replySize)) {
+      fprintf(stderr, "op %d: failed to process packet\n", op);
+      return NULL;
+   }
+
+   if (state->replySize < sizeof *reply || reply->status != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "op %d: failed with status %d\n", op,
+              state->replySize < sizeof *reply ? -1 : (int)reply->status);
+      return NULL;
+   }
+
+   return HGFS_REP_GET_PAYLOAD_V3(reply);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchPackName --
+ *
+ *   Converts an absolute local path into a cross platform name relative to
+ *   the guest root share.
+ *
+ * Results:
+ *   None.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchPackName(HgfsFileNameV3 *fileName,   // OUT: packed name
+              const char *path)           // IN: absolute local path
+{
+   size_t len;
+   char *p;
+
+   ASSERT(path[0] == '/');
+
+   len = Str_Snprintf(fileName->name, HGFS_PACKET_MAX, "%s%s",
+                      HGFS_SERVER_POLICY_ROOT_SHARE_NAME, path);
+   for (p = fileName->name; *p != '\0'; p++) {
+      if (*p == '/') {
+         *p = '\0';
+      }
+   }
+
+   fileName->length = len;
+   fileName->flags = 0;
+   fileName->caseType = HGFS_FILE_NAME_DEFAULT_CASE;
+   fileName->fid = HGFS_INVALID_HANDLE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchOpen --
+ *
+ *   Opens (creating if needed) a file through the server.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchOpen(BenchState *state,    // IN/OUT: benchmark state
+          const char *path,     // IN: absolute local path
+          HgfsHandle *handle)   // OUT: server handle
+{
+   HgfsRequestOpenV3 *request;
+   HgfsReplyOpenV3 *reply;
+
+   request = (HgfsRequestOpenV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_OWNER_PERMS | HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = HGFS_OPEN_MODE_READ_WRITE;
+   request->flags = HGFS_OPEN_CREATE;
+   request->ownerPerms = HGFS_PERM_READ | HGFS_PERM_WRITE;
+   BenchPackName(&request->fileName, path);
+
+   reply = BenchSend(state, HGFS_OP_OPEN_V3,
+                     sizeof *request + request->fileName.length);
+   if (reply == NULL) {
+      return FALSE;
+   }
+   *handle = reply->file;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRead --
+ *
+ *   Reads from an open handle through the server.
+ *
+ * Results:
+ *   Number of bytes read, -1 on failure.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int64
+BenchRead(BenchState *state,    // IN/OUT: benchmark state
+          HgfsHandle handle,    // IN: server handle
+          uint64 offset,        // IN: file offset
+          uint32 size)          // IN: bytes to read
+{
+   HgfsRequestReadV3 *request;
+   HgfsReplyReadV3 *reply;
+
+   request = (HgfsRequestReadV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+   request->offset = offset;
+   request->requiredSize = size;
+
+   reply = BenchSend(state, HGFS_OP_READ_V3, sizeof *request);
+   return reply == NULL ? -1 : reply->actualSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchClose --
+ *
+ *   Closes a handle through the server.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchClose(BenchState *state,    // IN/OUT: benchmark state
+           HgfsHandle handle)    // IN: server handle
+{
+   HgfsRequestCloseV3 *request;
+
+   request = (HgfsRequestCloseV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+
+   return BenchSend(state, HGFS_OP_CLOSE_V3, sizeof *request) != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchWrite --
+ *
+ *   Writes the reply buffer contents to an open handle through the server.
+ *
+ * Results:
+ *   Number of bytes written, -1 on failure.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int64
+BenchWrite(BenchState *state,    // IN/OUT: benchmark state
+           HgfsHandle handle,    // IN: server handle
+           uint64 offset,        // IN: file offset
+           uint32 size)          // IN: bytes to write
+{
+   HgfsRequestWriteV3 *request;
+   HgfsReplyWriteV3 *reply;
+
+   ASSERT(size <= BENCH_MAX_BLOCK_SIZE);
+
+   request = (HgfsRequestWriteV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(request, 0, sizeof *request);
+   request->file = handle;
+   request->offset = offset;
+   request->requiredSize = size;
+
+   /*
+    * The payload is left as is: the server does not look at it and filling
+    * it would be measured as well.
+    */
+   reply = BenchSend(state, HGFS_OP_WRITE_V3, sizeof *request - 1 + size);
+   return reply == NULL ? -1 : reply->actualSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchGetattr --
+ *
+ *   Gets the attributes of a file by name through the server.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchGetattr(BenchState *state,    // IN/OUT: benchmark state
+             const char *path)     // IN: absolute local path
+{
+   HgfsRequestGetattrV3 *request;
+
+   request = (HgfsRequestGetattrV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(request, 0, sizeof *request);
+   BenchPackName(&request->fileName, path);
+
+   return BenchSend(state, HGFS_OP_GETATTR_V3,
+                    sizeof *request + request->fileName.length) != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchEnumerate --
+ *
+ *   Lists a directory through the server, the way clients do: search open,
+ *   search reads until no entry is returned, search close. Reads ask for
+ *   as many entries per reply as fit.
+ *
+ * Results:
+ *   Number of entries returned, -1 on failure.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int64
+BenchEnumerate(BenchState *state,    // IN/OUT: benchmark state
+               const char *path)     // IN: absolute local path of directory
+{
+   HgfsRequestSearchOpenV3 *openRequest;
+   HgfsReplySearchOpenV3 *openReply;
+   HgfsRequestSearchReadV3 *readRequest;
+   HgfsReplySearchReadV3 *readReply;
+   HgfsRequestSearchCloseV3 *closeRequest;
+   HgfsHandle search;
+   uint32 offset = 0;
+   Bool success = TRUE;
+
+   openRequest =
+      (HgfsRequestSearchOpenV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(openRequest, 0, sizeof *openRequest);
+   BenchPackName(&openRequest->dirName, path);
+
+   openReply = BenchSend(state, HGFS_OP_SEARCH_OPEN_V3,
+                         sizeof *openRequest + openRequest->dirName.length);
+   if (openReply == NULL) {
+      return -1;
+   }
+   search = openReply->search;
+
+   for (;;) {
+      readRequest =
+         (HgfsRequestSearchReadV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+      memset(readRequest, 0, sizeof *readRequest);
+      readRequest->search = search;
+      readRequest->offset = offset;
+      readRequest->flags = HGFS_SEARCH_READ_FLAG_MULTIPLE_REPLY;
+
+      readReply = BenchSend(state, HGFS_OP_SEARCH_READ_V3, sizeof *readRequest);
+      if (readReply == NULL) {
+         success = FALSE;
+         break;
+      }
+
+      /* A single empty entry is how the end of the directory is reported. */
+      if (readReply->count == 0 ||
+          ((HgfsDirEntry *)readReply->payload)->fileName.length == 0) {
+         break;
+      }
+      offset += readReply->count;
+   }
+
+   closeRequest =
+      (HgfsRequestSearchCloseV3 *)HGFS_REQ_GET_PAYLOAD_V3(state->request);
+   memset(closeRequest, 0, sizeof *closeRequest);
+   closeRequest->search = search;
+   if (BenchSend(state, HGFS_OP_SEARCH_CLOSE_V3, sizeof *closeRequest) == NULL) {
+      success = FALSE;
+   }
+
+   return success ? offset : -1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchMakeFiles --
+ *
+ *   Creates a directory with numFiles empty files in the scratch directory.
+ *   Done locally, it is not part of what is measured.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   Creates the directory and files; BenchRemoveFiles removes them.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchMakeFiles(BenchState *state,   // IN: benchmark state
+               char *dir,           // OUT: directory path
+               size_t dirSize)      // IN: size of dir
+{
+   char path[PATH_MAX];
+   uint32 i;
+
+   Str_Snprintf(dir, dirSize, "%s/hgfsbench-files", state->scratchDir);
+   if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+      fprintf(stderr, "cannot create %s\n", dir);
+      return FALSE;
+   }
+
+   for (i = 0; i < state->numFiles; i++) {
+      int fd;
+
+      Str_Snprintf(path, sizeof path, "%s/file%06u", dir, i);
+      fd = open(path, O_CREAT | O_WRONLY, 0600);
+      if (fd < 0) {
+         fprintf(stderr, "cannot create %s\n", path);
+         return FALSE;
+      }
+      close(fd);
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRemoveFiles --
+ *
+ *   Removes what BenchMakeFiles created.
+ *
+ * Results:
+ *   None.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRemoveFiles(BenchState *state,   // IN: benchmark state
+                 const char *dir)     // IN: directory path
+{
+   char path[PATH_MAX];
+   uint32 i;
+
+   for (i = 0; i < state->numFiles; i++) {
+      Str_Snprintf(path, sizeof path, "%s/file%06u", dir, i);
+      unlink(path);
+   }
+   rmdir(dir);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchHandles --
+ *
+ *   Opens numHandles handles and measures the cost of reads while they are
+ *   all open: repeatedly on one hot handle, which isolates the per request
+ *   handle lookup, and round robin over all of them.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   Creates and removes files in the scratch directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchHandles(BenchState *state)  // IN/OUT: benchmark state
+{
+   char path[PATH_MAX];
+   HgfsHandle *handles;
+   uint32 numOpen = 0;
+   uint64 start;
+   uint32 i;
+   Bool success = FALSE;
+   int fd;
+
+   /* All the handles refer to the same small file. */
+   Str_Snprintf(path, sizeof path, "%s/hgfsbench-handles", state->scratchDir);
+   fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+   if (fd < 0 || ftruncate(fd, BENCH_READ_SIZE) != 0) {
+      fprintf(stderr, "cannot create %s\n", path);
+      goto exit;
+   }
+
+   handles = Util_SafeCalloc(state->numHandles, sizeof *handles);
+
+   start = BenchNowUS();
+   for (numOpen = 0; numOpen < state->numHandles; numOpen++) {
+      if (!BenchOpen(state, path, &handles[numOpen])) {
+         goto close;
+      }
+   }
+   BenchReport("open", numOpen, BenchNowUS() - start, 0);
+
+   start = BenchNowUS();
+   for (i = 0; i < state->iterations; i++) {
+      if (BenchRead(state, handles[numOpen - 1], 0, BENCH_READ_SIZE) < 0) {
+         goto close;
+      }
+   }
+   BenchReport("read (hot handle)", i, BenchNowUS() - start,
+               (uint64)i * BENCH_READ_SIZE);
+
+   start = BenchNowUS();
+   for (i = 0; i < state->iterations; i++) {
+      if (BenchRead(state, handles[i % numOpen], 0, BENCH_READ_SIZE) < 0) {
+         goto close;
+      }
+   }
+   BenchReport("read (round robin)", i, BenchNowUS() - start,
+               (uint64)i * BENCH_READ_SIZE);
+   success = TRUE;
+
+close:
+   start = BenchNowUS();
+   for (i = 0; i < numOpen; i++) {
+      BenchClose(state, handles[i]);
+   }
+   BenchReport("close", numOpen, BenchNowUS() - start, 0);
+   free(handles);
+
+exit:
+   if (fd >= 0) {
+      close(fd);
+   }
+   unlink(path);
+   return success;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchChurn --
+ *
+ *   Opens and closes files of a directory one after the other, like a build
+ *   or a file manager does, so that handles do not accumulate.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   Creates and removes files in the scratch directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchChurn(BenchState *state)  // IN/OUT: benchmark state
+{
+   char dir[PATH_MAX];
+   char path[PATH_MAX];
+   uint64 *samples;
+   uint64 start;
+   uint32 i;
+   Bool success = FALSE;
+
+   samples = Util_SafeCalloc(state->iterations, sizeof *samples);
+   if (!BenchMakeFiles(state, dir, sizeof dir)) {
+      goto exit;
+   }
+
+   start = BenchNowUS();
+   for (i = 0; i < state->iterations; i++) {
+      HgfsHandle handle;
+      uint64 opStart = BenchNowNS();
+
+      Str_Snprintf(path, sizeof path, "%s/file%06u", dir, i % state->numFiles);
+      if (!BenchOpen(state, path, &handle) || !BenchClose(state, handle)) {
+         goto exit;
+      }
+      samples[i] = BenchNowNS() - opStart;
+   }
+   BenchReport("open + close", i, BenchNowUS() - start, 0);
+   BenchReportLatency(samples, i);
+   success = TRUE;
+
+exit:
+   BenchRemoveFiles(state, dir);
+   free(samples);
+   return success;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchGetattrStorm --
+ *
+ *   Gets the attributes of the files of a directory by name, over and over,
+ *   like ls -l, stat heavy build tools or the kernel client revalidating
+ *   its caches do.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   Creates and removes files in the scratch directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchGetattrStorm(BenchState *state)  // IN/OUT: benchmark state
+{
+   char dir[PATH_MAX];
+   char path[PATH_MAX];
+   uint64 *samples;
+   uint64 start;
+   uint32 i;
+   Bool success = FALSE;
+
+   samples = Util_SafeCalloc(state->iterations, sizeof *samples);
+   if (!BenchMakeFiles(state, dir, sizeof dir)) {
+      goto exit;
+   }
+
+   start = BenchNowUS();
+   for (i = 0; i < state->iterations; i++) {
+      uint64 opStart = BenchNowNS();
+
+      Str_Snprintf(path, sizeof path, "%s/file%06u", dir, i % state->numFiles);
+      if (!BenchGetattr(state, path)) {
+         goto exit;
+      }
+      samples[i] = BenchNowNS() - opStart;
+   }
+   BenchReport("getattr", i, BenchNowUS() - start, 0);
+   BenchReportLatency(samples, i);
+   success = TRUE;
+
+exit:
+   BenchRemoveFiles(state, dir);
+   free(samples);
+   return success;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchSequential --
+ *
+ *   Writes a file of fileSize bytes sequentially in blockSize requests,
+ *   then reads it back the same way.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   Creates and removes a file in the scratch directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchSequential(BenchState *state)  // IN/OUT: benchmark state
+{
+   char path[PATH_MAX];
+   uint32 numBlocks = state->fileSize / state->blockSize;
+   uint64 *samples;
+   HgfsHandle handle;
+   uint64 bytes;
+   uint64 start;
+   uint32 i;
+   Bool success = FALSE;
+   int fd;
+
+   Str_Snprintf(path, sizeof path, "%s/hgfsbench-sequential",
+                state->scratchDir);
+   fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+   if (fd < 0) {
+      fprintf(stderr, "cannot create %s\n", path);
+      return FALSE;
+   }
+   close(fd);
+
+   samples = Util_SafeCalloc(numBlocks, sizeof *samples);
+   if (!BenchOpen(state, path, &handle)) {
+      goto exit;
+   }
+
+   bytes = 0;
+   start = BenchNowUS();
+   for (i = 0; i < numBlocks; i++) {
+      uint64 opStart = BenchNowNS();
+      int64 written = BenchWrite(state, handle, bytes, state->blockSize);
+
+      if (written <= 0) {
+         goto close;
+      }
+      samples[i] = BenchNowNS() - opStart;
+      bytes += written;
+   }
+   BenchReport("sequential write", i, BenchNowUS() - start, bytes);
+   BenchReportLatency(samples, i);
+
+   bytes = 0;
+   start = BenchNowUS();
+   for (i = 0; i < numBlocks; i++) {
+      uint64 opStart = BenchNowNS();
+      int64 nread = BenchRead(state, handle, bytes, state->blockSize);
+
+      if (nread <= 0) {
+         goto close;
+      }
+      samples[i] = BenchNowNS() - opStart;
+      bytes += nread;
+   }
+   BenchReport("sequential read", i, BenchNowUS() - start, bytes);
+   BenchReportLatency(samples, i);
+   success = TRUE;
+
+close:
+   BenchClose(state, handle);
+exit:
+   free(samples);
+   unlink(path);
+   return success;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchReaddir --
+ *
+ *   Lists a directory of numFiles files repeatedly, until about iterations
+ *   entries have been returned.
+ *
+ * Results:
+ *   TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *   Creates and removes files in the scratch directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchReaddir(BenchState *state)  // IN/OUT: benchmark state
+{
+   char dir[PATH_MAX];
+   uint32 numLists = MAX(1, state->iterations / state->numFiles);
+   uint64 *samples;
+   uint64 entries = 0;
+   uint64 start;
+   uint32 i;
+   Bool success = FALSE;
+
+   samples = Util_SafeCalloc(numLists, sizeof *samples);
+   if (!BenchMakeFiles(state, dir, sizeof dir)) {
+      goto exit;
+   }
+
+   start = BenchNowUS();
+   for (i = 0; i < numLists; i++) {
+      uint64 opStart = BenchNowNS();
+      int64 count = BenchEnumerate(state, dir);
+
+      if (count < state->numFiles) {
+         fprintf(stderr, "listed %"FMT64"d entries of %u\n", count,
+                 state->numFiles);
+         goto exit;
+      }
+      samples[i] = BenchNowNS() - opStart;
+      entries += count;
+   }
+   BenchReport("directory listing", i, BenchNowUS() - start, 0);
+   BenchReportLatency(samples, i);
+   BenchReport("directory entries", entries, BenchNowUS() - start, 0);
+   success = TRUE;
+
+exit:
+   BenchRemoveFiles(state, dir);
+   free(samples);
+   return success;
+}
+
+
+static const BenchScenario gScenarios[] = {
+   { "handles", "reads with many open handles", BenchHandles },
+   { "churn", "open/close churn over a directory", BenchChurn },
+   { "getattr", "getattr by name over a directory", BenchGetattrStorm },
+   { "sequential", "large sequential write and read", BenchSequential },
+   { "readdir", "directory enumeration", BenchReaddir },
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Usage --
+ *
+ *   Prints the command line help.
+ *
+ * Results:
+ *   None.
+ *
+ * Side effects:
+ *   None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Usage(const char *progName)  // IN
+{
+   size_t i;
+
+   fprintf(stderr,
+           "Usage: %s [-d dir] [-n handles] [-i iterations] [-f files]\n"
+           "          [-s megabytes] [-b bytes] [scenario...]\n"
+           "  -d dir         scratch directory, preferably on tmpfs (%s)\n"
+           "  -n handles     number of open handles (%u)\n"
+           "  -i iterations  timed operations per scenario (%u)\n"
+           "  -f files       files in the test directory (%u)\n"
+           "  -s megabytes   size of the sequential I/O file (%u)\n"
+           "  -b bytes       sequential I/O request size, at most %u (%u)\n"
+           "Scenarios (all by default):\n",
+           progName, BENCH_DEFAULT_DIR, BENCH_DEFAULT_HANDLES,
+           BENCH_DEFAULT_ITERATIONS, BENCH_DEFAULT_FILES,
+           BENCH_DEFAULT_FILE_MB, (unsigned)BENCH_MAX_BLOCK_SIZE,
+           BENCH_DEFAULT_BLOCK_SIZE);
+   for (i = 0; i < ARRAYSIZE(gScenarios); i++) {
+      fprintf(stderr, "  %-14s %s\n", gScenarios[i].name,
+              gScenarios[i].description);
+   }
+}
+
+
+int
+main(int argc,      // IN
+     char **argv)   // IN
+{
+   BenchState state;
+   Bool success = TRUE;
+   size_t i;
+   int opt;
+
+   memset(&state, 0, sizeof state);
+   state.scratchDir = BENCH_DEFAULT_DIR;
+   state.numHandles = BENCH_DEFAULT_HANDLES;
+   state.iterations = BENCH_DEFAULT_ITERATIONS;
+   state.numFiles = BENCH_DEFAULT_FILES;
+   state.fileSize = (uint64)BENCH_DEFAULT_FILE_MB << 20;
+   state.blockSize = BENCH_DEFAULT_BLOCK_SIZE;
+
+   while ((opt = getopt(argc, argv, "d:n:i:f:s:b:h")) != -1) {
+      switch (opt) {
+      case 'd':
+         state.scratchDir = optarg;
+         break;
+      case 'n':
+         state.numHandles = strtoul(optarg, NULL, 0);
+         break;
+      case 'i':
+         state.iterations = strtoul(optarg, NULL, 0);
+         break;
+      case 'f':
+         state.numFiles = strtoul(optarg, NULL, 0);
+         break;
+      case 's':
+         state.fileSize = (uint64)strtoul(optarg, NULL, 0) << 20;
+         break;
+      case 'b':
+         state.blockSize = strtoul(optarg, NULL, 0);
+         break;
+      default:
+         Usage(argv[0]);
+         return opt == 'h' ? 0 : 1;
+      }
+   }
+
+   if (state.scratchDir[0] != '/' || state.numHandles == 0 ||
+       state.numFiles == 0 || state.blockSize == 0 ||
+       state.blockSize > BENCH_MAX_BLOCK_SIZE ||
+       state.fileSize < state.blockSize) {
+      Usage(argv[0]);
+      return 1;
+   }
+
+   state.request = Util_SafeCalloc(1, HGFS_LARGE_PACKET_MAX);
+   state.reply = Util_SafeMalloc(HGFS_LARGE_PACKET_MAX);
+
+   HgfsServerManager_DataInit(&state.mgrData, "hgfsServerBench", NULL, NULL);
+   if (!HgfsServerManager_Register(&state.mgrData)) {
+      fprintf(stderr, "cannot register with the HGFS server\n");
+      return 1;
+   }
+
+   for (i = 0; i < ARRAYSIZE(gScenarios); i++) {
+      int j;
+
+      for (j = optind; j < argc; j++) {
+         if (strcmp(argv[j], gScenarios[i].name) == 0) {
+            break;
+         }
+      }
+      if (optind < argc && j == argc) {
+         continue;
+      }
+
+      printf("%s: %s\n", gScenarios[i].name, gScenarios[i].description);
+      if (!gScenarios[i].run(&state)) {
+         fprintf(stderr, "%s: failed\n", gScenarios[i].name);
+         success = FALSE;
+      }
+   }
+
+   HgfsServerManager_Unregister(&state.mgrData);
+   free(state.request);
+   free(state.reply);
+
+   return success ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vmblockbench.c --
+ *
+ *   Benchmark for the block list shared by the vmblock drivers. Links the
+ *   block code built for vmblock-fuse and drives it directly, without a
+ *   mounted file system, with thousands of blocks in place:
+ *
+ *   vmware-testvmblock-bench [blocks [lookups [threads]]]
+ *
+ *   Reports the cost of adding blocks, of looking up files that are
+ *   blocked and files that are not (what every getattr and readlink in
+ *   vmblock-fuse does), and of removing blocks.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "os.h"
+#include "block.h"
+
+#define DEFAULT_BLOCKS     4096
+#define DEFAULT_LOOKUPS    1000000
+#define DEFAULT_THREADS    4
+#define BLOCKED_FMT        "/tmp/VMwareDnD/%08x/file-%u.txt"
+#define UNBLOCKED_FMT      "/home/user/Documents/file-%u.txt"
+
+int LOGLEVEL_THRESHOLD = 0;
+
+static unsigned int numBlocks = DEFAULT_BLOCKS;
+static unsigned int numLookups = DEFAULT_LOOKUPS;
+static os_blocker_id_t blocker = (os_blocker_id_t)"vmblockbench";
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    Current time in seconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Report --
+ *
+ *    Prints the cost of one benchmark step.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Report(const char *what,    // IN: step name
+       unsigned int ops,    // IN: operations done
+       double seconds)      // IN: time taken
+{
+   printf("%-28s %10u ops %10.1f ns/op\n", what, ops, seconds * 1e9 / ops);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockedName --
+ *
+ *    Builds the name of the i-th blocked file.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+BlockedName(char *buf,        // OUT: file name
+            size_t size,      // IN: size of buf
+            unsigned int i)   // IN: block number
+{
+   snprintf(buf, size, BLOCKED_FMT, i * 2654435761U, i);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * LookupThread --
+ *
+ *    Looks up files that are not blocked, as vmblock-fuse does for every
+ *    getattr and readlink while blocks are in place.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+LookupThread(void *arg)  // IN: thread number
+{
+   unsigned int id = (unsigned int)(uintptr_t)arg;
+   char name[OS_PATH_MAX];
+   unsigned int i;
+
+   for (i = 0; i < numLookups; i++) {
+      snprintf(name, sizeof name, UNBLOCKED_FMT, (i + id) % 1024);
+      if (BlockWaitOnFile(name, NULL) != 0) {
+         fprintf(stderr, "Lookup of %s failed\n", name);
+         exit(1);
+      }
+   }
+   return NULL;
+}
+
+
+int
+main(int argc,        // IN
+     char *argv[])    // IN
+{
+   unsigned int numThreads = DEFAULT_THREADS;
+   pthread_t *threads;
+   char name[OS_PATH_MAX];
+   unsigned int i;
+   double start;
+
+   if (argc > 1) {
+      numBlocks = strtoul(argv[1], NULL, 0);
+   }
+   if (argc > 2) {
+      numLookups = strtoul(argv[2], NULL, 0);
+   }
+   if (argc > 3) {
+      numThreads = strtoul(argv[3], NULL, 0);
+   }
+   if (numBlocks == 0 || numLookups == 0 || numThreads == 0) {
+      fprintf(stderr, "Usage: %s [blocks [lookups [threads]]]\n", argv[0]);
+      return 1;
+   }
+
+   if (BlockInit() != 0) {
+      fprintf(stderr, "BlockInit failed\n");
+      return 1;
+   }
+
+   start = Now();
+   for (i = 0; i < numBlocks; i++) {
+      BlockedName(name, sizeof name, i);
+      if (BlockAddFileBlock(name, blocker) != 0) {
+         fprintf(stderr, "Adding block on %s failed\n", name);
+         return 1;
+      }
+   }
+   Report("add block", numBlocks, Now() - start);
+
+   /* A second block on the same file is refused after finding the first. */
+   start = Now();
+   for (i = 0; i < numLookups; i++) {
+      BlockedName(name, sizeof name, i % numBlocks);
+      if (BlockAddFileBlock(name, blocker) != OS_EEXIST) {
+         fprintf(stderr, "Block on %s was not found\n", name);
+         return 1;
+      }
+   }
+   Report("lookup, blocked", numLookups, Now() - start);
+
+   start = Now();
+   LookupThread((void *)0);
+   Report("lookup, not blocked", numLookups, Now() - start);
+
+   threads = calloc(numThreads, sizeof *threads);
+   if (threads == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      return 1;
+   }
+   start = Now();
+   for (i = 0; i < numThreads; i++) {
+      pthread_create(&threads[i], NULL, LookupThread, (void *)(uintptr_t)i);
+   }
+   for (i = 0; i < numThreads; i++) {
+      pthread_join(threads[i], NULL);
+   }
+   snprintf(name, sizeof name, "lookup, not blocked, %ux", numThreads);
+   Report(name, numLookups * numThreads, Now() - start);
+   free(threads);
+
+   start = Now();
+   for (i = 0; i < numBlocks / 2; i++) {
+      BlockedName(name, sizeof name, i);
+      if (BlockRemoveFileBlock(name, blocker) != 0) {
+         fprintf(stderr, "Removing block on %s failed\n", name);
+         return 1;
+      }
+   }
+   Report("remove block", numBlocks / 2, Now() - start);
+
+   start = Now();
+   i = BlockRemoveAllBlocks(blocker);
+   Report("remove all blocks", i, Now() - start);
+   if (i != numBlocks - numBlocks / 2) {
+      fprintf(stderr, "Removed %u blocks, expected %u\n", i,
+              numBlocks - numBlocks / 2);
+      return 1;
+   }
+
+   BlockCleanup();
+   return 0;
+}
@@ -0,0 +1,230 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * cachetest.c --
+ *
+ *   Tests for the negative entries of the vmhgfs-fuse attribute cache.
+ *   Links the cache code built for vmhgfs-fuse and drives it directly,
+ *   without a mounted file system, the way the lookup, create and rename
+ *   paths of the driver do. Exits with a non-zero status on failure.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "module.h"
+#include "cache.h"
+
+int LOGLEVEL_THRESHOLD = 0;
+
+static HgfsFuseState testState;
+HgfsFuseState *gState = &testState;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                     \
+   do {                                                                 \
+      if (!(cond)) {                                                    \
+         fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                 __FILE__, __LINE__, #cond);                            \
+         failures++;                                                    \
+      }                                                                 \
+   } while (0)
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Probe --
+ *
+ *    Records path as missing the way a lookup does after the server
+ *    answered it does not exist.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Probe(const char *path)  // IN
+{
+   HgfsSetNegativeCache(path, HgfsGetNegativeCacheGen(path));
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * IsNegative --
+ *
+ *    Checks whether the cache answers a lookup of path with ENOENT.
+ *
+ * Results:
+ *    TRUE if it does.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+IsNegative(const char *path)  // IN
+{
+   HgfsAttrInfo attr = { 0 };
+
+   return HgfsGetAttrCache(path, &attr) == -ENOENT;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestCreate --
+ *
+ *    A name created in a directory replaces its negative entry, also when
+ *    the create races with the lookup that found it missing.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestCreate(void)
+{
+   uint32 gen;
+
+   Probe("/create/x");
+   CHECK(IsNegative("/create/x"));
+   HgfsInvalidateNegativeCache("/create/y");
+   CHECK(!IsNegative("/create/x"));
+
+   gen = HgfsGetNegativeCacheGen("/create/x");
+   HgfsInvalidateNegativeCache("/create/x");
+   HgfsSetNegativeCache("/create/x", gen);
+   CHECK(!IsNegative("/create/x"));
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestRenameDirectory --
+ *
+ *    Renaming a directory over a probed path makes its whole subtree
+ *    appear, so negative entries at any depth below the new name must go.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestRenameDirectory(void)
+{
+   HgfsAttrInfo dir = { 0 };
+
+   Probe("/a/d/x");
+   Probe("/a/d/sub/y");
+   CHECK(IsNegative("/a/d/x"));
+   CHECK(IsNegative("/a/d/sub/y"));
+
+   dir.type = HGFS_FILE_TYPE_DIRECTORY;
+   HgfsSetAttrCache("/a/e", &dir);
+
+   /* What HgfsRename does once "/a/e" was renamed to "/a/d". */
+   HgfsInvalidateNegativeCache("/a/d");
+   HgfsInvalidateNegativeCacheRename("/a/e");
+
+   CHECK(!IsNegative("/a/d/x"));
+   CHECK(!IsNegative("/a/d/sub/y"));
+
+   /* Same when the old name was not in the cache. */
+   Probe("/b/d/x");
+   HgfsInvalidateNegativeCache("/b/d");
+   HgfsInvalidateNegativeCacheRename("/b/e");
+   CHECK(!IsNegative("/b/d/x"));
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestRenameFile --
+ *
+ *    Renaming a file known to the cache only affects the directory it
+ *    was renamed into.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestRenameFile(void)
+{
+   HgfsAttrInfo file = { 0 };
+
+   Probe("/c/d/x");
+   Probe("/other/x");
+
+   file.type = HGFS_FILE_TYPE_REGULAR;
+   HgfsSetAttrCache("/c/f.tmp", &file);
+
+   HgfsInvalidateNegativeCache("/c/d/f");
+   HgfsInvalidateNegativeCacheRename("/c/f.tmp");
+
+   CHECK(!IsNegative("/c/d/x"));
+   CHECK(IsNegative("/other/x"));
+}
+
+
+int
+main(void)
+{
+   HgfsInitCache();
+
+   TestCreate();
+   TestRenameDirectory();
+   TestRenameFile();
+
+   if (failures != 0) {
+      fprintf(stderr, "%d check(s) failed\n", failures);
+      return EXIT_FAILURE;
+   }
+   printf("All tests passed\n");
+   return EXIT_SUCCESS;
+}
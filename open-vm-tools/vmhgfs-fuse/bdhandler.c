@@ -34,8 +34,6 @@
 #include "transport.h"
 #include "vm_assert.h"
 
-static HgfsTransportChannel bdChannel;
-
 
 /*
  *-----------------------------------------------------------------------------
@@ -207,7 +205,7 @@ HgfsBdChannelSend(HgfsTransportChannel *channel, // IN: Channel
  *     None
  *
  * Side effects:
- *     None
+ *     The channel is freed.
  *
  *----------------------------------------------------------------------
  */
@@ -219,6 +217,8 @@ HgfsBdChannelExit(HgfsTransportChannel *channel)  // IN
    HgfsBdChannelCloseInt(channel);
    channel->status = HGFS_CHANNEL_UNINITIALIZED;
    pthread_mutex_unlock(&channel->connLock);
+   pthread_mutex_destroy(&channel->connLock);
+   free(channel);
 }
 
 
@@ -227,10 +227,13 @@ HgfsBdChannelExit(HgfsTransportChannel *channel)  // IN
  *
  * HgfsBdChannelInit --
  *
- *     Initialize backdoor channel.
+ *     Initialize a backdoor channel. Each channel has an RPCI channel of
+ *     its own, so several of them can have a request outstanding at once.
+ *     They all reach the same server connection on the host, hence share
+ *     the HGFS session.
  *
  * Results:
- *     Always return pointer to back door channel.
+ *     Pointer to the new back door channel, NULL if out of memory.
  *
  * Side effects:
  *     None
@@ -241,14 +244,20 @@ HgfsBdChannelExit(HgfsTransportChannel *channel)  // IN
 HgfsTransportChannel*
 HgfsBdChannelInit(void)
 {
-   bdChannel.name = "backdoor";
-   bdChannel.ops.open = HgfsBdChannelOpen;
-   bdChannel.ops.close = HgfsBdChannelClose;
-   bdChannel.ops.send = HgfsBdChannelSend;
-   bdChannel.ops.recv = NULL;
-   bdChannel.ops.exit = HgfsBdChannelExit;
-   bdChannel.priv = NULL;
-   pthread_mutex_init(&bdChannel.connLock, NULL);
-   bdChannel.status = HGFS_CHANNEL_NOTCONNECTED;
-   return &bdChannel;
+   HgfsTransportChannel *bdChannel = malloc(sizeof *bdChannel);
+
+   if (bdChannel == NULL) {
+      LOG(4, ("Can't allocate memory.\n"));
+      return NULL;
+   }
+   bdChannel->name = "backdoor";
+   bdChannel->ops.open = HgfsBdChannelOpen;
+   bdChannel->ops.close = HgfsBdChannelClose;
+   bdChannel->ops.send = HgfsBdChannelSend;
+   bdChannel->ops.recv = NULL;
+   bdChannel->ops.exit = HgfsBdChannelExit;
+   bdChannel->priv = NULL;
+   pthread_mutex_init(&bdChannel->connLock, NULL);
+   bdChannel->status = HGFS_CHANNEL_NOTCONNECTED;
+   return bdChannel;
 }
@@ -20,11 +20,29 @@
  * cache.c --
  *
  * Module-specific components of the vmhgfs driver.
+ *
+ * The attribute cache is a hash table split into shards, each with its own
+ * lock, hash chains and LRU list, so that getattr-heavy workloads running on
+ * many FUSE threads rarely contend with each other. Entries expire after the
+ * attribute timeout and each shard evicts its least recently used entries
+ * once it holds more than its share of HASH_THRESHOLD_SIZE.
+ *
+ * The same table also remembers paths the server reported as missing, so
+ * that repeated probes of nonexistent files (include and PATH searches)
+ * do not each cost a round trip. These negative entries live for a much
+ * shorter time, only a few of them are kept per shard, and they are
+ * dropped whenever something is created in or renamed into their
+ * directory. To make the last cheap, each directory hashes to a
+ * generation counter that creating a name bumps; an entry is only valid
+ * while the generation it was looked up under is current. Lookups take
+ * the generation before asking the server, so a create racing with a
+ * miss cannot leave a stale entry behind. Renaming a directory makes a
+ * whole subtree appear at once, so it bumps a global generation that
+ * every entry also depends on.
  */
+#include <ctype.h>
 #include "module.h"
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-#include <glib.h>
-#endif
+#include "vm_atomic.h"
 
 /*
  * We make the default attribute cache timeout 1 second which is the same
@@ -35,7 +53,21 @@
 #define CACHE_PURGE_TIME 10
 #define CACHE_PURGE_SLEEP_TIME 30
 #define HASH_THRESHOLD_SIZE (2046 * 4)
-#define HASH_PURGE_SIZE (HASH_THRESHOLD_SIZE / 2)
+
+/* Number of shards and hash chains per shard, both powers of 2. */
+#define HGFS_ATTR_CACHE_SHARDS 16
+#define HGFS_ATTR_CACHE_BUCKETS 512
+#define HGFS_ATTR_CACHE_SHARD_MAX (HASH_THRESHOLD_SIZE / HGFS_ATTR_CACHE_SHARDS)
+
+/* Age of an entry in seconds. */
+#define HGFS_ATTR_CACHE_AGE(entry) \
+   ((HGFS_GET_TIME(time(NULL)) - (entry)->changeTime) / 10000000)
+
+/* Negative entries: lifetime in seconds, per shard limit, generations. */
+#define HGFS_NEG_CACHE_TIMEOUT 1
+#define HGFS_NEG_CACHE_SHARD_MAX 64
+#define HGFS_NEG_CACHE_DIR_GENS 1024
+
 #include "cache.h"
 
 /*
@@ -43,65 +75,73 @@
  */
 
 typedef struct HgfsAttrCache {
-   HgfsAttrInfo attr; /* Attribute of a file or directory */
-   uint64 changeTime; /* time the attribute was last updated */
-   struct list_head list; /* used in linked list implementation */
-   char path[0];      /* path of the file corresponding the the attr */
+   HgfsAttrInfo attr;         /* Attribute of a file or directory */
+   uint64 changeTime;         /* time the attribute was last updated */
+   uint32 hash;               /* hash of the path */
+   Bool negative;             /* the path does not exist, attr is unused */
+   uint32 dirGen;             /* generation of a negative entry */
+   struct list_head hashList; /* hash chain of the entry */
+   struct list_head lruList;  /* shard LRU list, most recently used first */
+   char path[0];              /* path of the file corresponding the the attr */
 } HgfsAttrCache;
 
+/*
+ * HgfsAttrCacheShard, a lock protected part of the attribute cache
+ */
 
-/* Head of the list */
-struct HgfsAttrCache attrList;
+typedef struct HgfsAttrCacheShard {
+   pthread_mutex_t lock;
+   uint32 numEntries;
+   uint32 numNegative;
+   struct list_head lru;
+   struct list_head buckets[HGFS_ATTR_CACHE_BUCKETS];
+} HgfsAttrCacheShard;
 
-/*Lock for accessing the attribute cache*/
-static pthread_mutex_t HgfsAttrCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static HgfsAttrCacheShard attrCache[HGFS_ATTR_CACHE_SHARDS];
 
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-static void HgfsInvalidateParentsChildren(const char* parent);
-#endif
+static Atomic_uint32 negDirGen[HGFS_NEG_CACHE_DIR_GENS];
+static Atomic_uint32 negTreeGen;
+static Atomic_uint64 negCacheHits;
 
-/*
- * Lists are used to manage attribute cache in Solaris and FreeBSD,
- * HashTables are used in Linux. HashTables perform better and hence
- * once newer version of glib with hash tables are packaged for Solaris
- * and FreeBSD, this section will go away.
- */
-
-#if defined(__FreeBSD__) || defined(__SOLARIS__)
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInitCache
+ * HgfsAttrCacheHash
  *
- *    Initializes the list attrList to cache attributes.
+ *    Hashes a path (FNV-1a).
  *
  * Results:
- *    None
+ *    The hash of the path.
  *
  * Side effects:
  *    None
  *
  *----------------------------------------------------------------------
- *
  */
 
-void
-HgfsInitCache()
+static uint32
+HgfsAttrCacheHash(const char *path) //IN: Path of file or directory
 {
-   INIT_LIST_HEAD(&attrList.list);
+   uint32 hash = 2166136261U;
+
+   while (*path != '\0') {
+      hash ^= (unsigned char)*path++;
+      hash *= 16777619U;
+   }
+   return hash;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetAttrCache
+ * HgfsAttrCacheGetShard
  *
- *    Retrieves the attr from the list for a given path.
+ *    Gets the shard holding a hash.
  *
  * Results:
- *    0 on success else -1 on error
+ *    The shard.
  *
  * Side effects:
  *    None
@@ -109,47 +149,48 @@ HgfsInitCache()
  *----------------------------------------------------------------------
  */
 
-int
-HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static inline HgfsAttrCacheShard *
+HgfsAttrCacheGetShard(uint32 hash) //IN: Path hash
 {
-   HgfsAttrCache *tmp;
-   int res = -1;
-   int diff;
-
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry(tmp, &attrList.list, list) {
-      LOG(4, ("tmp->path = %d\n", tmp->path));
-      if (strcmp(path, tmp->path) == 0) {
-         LOG(4, ("cache hit. path = %s\n", tmp->path));
+   return &attrCache[hash & (HGFS_ATTR_CACHE_SHARDS - 1)];
+}
 
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
 
-         LOG(4, ("time since last updated is %d seconds\n", diff));
-         if (diff <= CACHE_TIMEOUT) {
-            *attr = tmp->attr;
-            res = 0;
-         }
-         break;
-      }
-   }
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheGetBucket
+ *
+ *    Gets the hash chain of a hash within its shard.
+ *
+ * Results:
+ *    The hash chain head.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+static inline struct list_head *
+HgfsAttrCacheGetBucket(HgfsAttrCacheShard *shard, //IN: Shard of the hash
+                       uint32 hash)               //IN: Path hash
+{
+   /* The low bits select the shard, use the next ones for the chain. */
+   return &shard->buckets[(hash / HGFS_ATTR_CACHE_SHARDS) &
+                          (HGFS_ATTR_CACHE_BUCKETS - 1)];
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsSetAttrCache
+ * HgfsAttrCacheLookup
  *
- *    Updates the list with the given (key, attr)pair.
+ *    Finds the entry for a path in a shard. The shard lock must be held.
  *
  * Results:
- *    0 on success else negative value on error
+ *    The entry or NULL if not found.
  *
  * Side effects:
  *    None
@@ -157,49 +198,30 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *----------------------------------------------------------------------
  */
 
-int
-HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static HgfsAttrCache *
+HgfsAttrCacheLookup(HgfsAttrCacheShard *shard, //IN: Shard of the path
+                    const char *path,          //IN: Path of file or directory
+                    uint32 hash)               //IN: Path hash
 {
    HgfsAttrCache *tmp;
-   int res = 0;
-
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   struct list_head *bucket = HgfsAttrCacheGetBucket(shard, hash);
 
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         tmp->attr = *attr;
-         tmp->changeTime = HGFS_GET_TIME(time(NULL));
-         LOG(4, ("cache entry updated. path = %s\n", tmp->path));
-         goto out;
+   list_for_each_entry(tmp, bucket, hashList) {
+      if (tmp->hash == hash && strcmp(path, tmp->path) == 0) {
+         return tmp;
       }
    }
-
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
-      goto out;
-   }
-   INIT_LIST_HEAD(&tmp->list);
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-   list_add(&tmp->list, &attrList.list);
-   LOG(4, ("cache entry added. path = %s\n", tmp->path));
-
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+   return NULL;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateAttrCache
+ * HgfsAttrCacheRemove
  *
- *    Invalidate the attribute list entry for a given path.
+ *    Removes an entry from its shard and frees it. The shard lock must be
+ *    held.
  *
  * Results:
  *    None
@@ -210,35 +232,31 @@ out:
  *----------------------------------------------------------------------
  */
 
-void
-HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+static void
+HgfsAttrCacheRemove(HgfsAttrCacheShard *shard, //IN: Shard of the entry
+                    HgfsAttrCache *entry)      //IN: Entry to remove
 {
-   HgfsAttrCache *tmp;
-
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         list_del(&tmp->list);
-         free(tmp);
-         break;
-      }
+   list_del(&entry->hashList);
+   list_del(&entry->lruList);
+   shard->numEntries--;
+   if (entry->negative) {
+      shard->numNegative--;
    }
-
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   free(entry);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache:
+ * HgfsNegCacheDirGen
  *
- *    This routine is called by an independent thread to purge the cache,
- *    deletion is based on time of last update.
+ *    Gets the generation counter of the directory containing path. The
+ *    directory name is hashed without regard to case, as the host file
+ *    system may not be case sensitive either.
  *
  * Results:
- *    None
+ *    The generation counter.
  *
  * Side effects:
  *    None
@@ -246,49 +264,61 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused) //IN: Thread argument
+static Atomic_uint32 *
+HgfsNegCacheDirGen(const char *path) //IN: Path of file or directory
 {
-   HgfsAttrCache *tmp;
-   HgfsAttrCache *prev;
-   int diff;
+   const char *end = strrchr(path, '/');
+   uint32 hash = 2166136261U;
 
-   while (1)
-   {
-      sleep(CACHE_PURGE_SLEEP_TIME);
-
-      pthread_mutex_lock(&HgfsAttrCacheLock);
-
-      list_for_each_entry_safe (tmp, prev, &attrList.list, list) {
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-         if (diff > CACHE_PURGE_TIME) {
-            list_del (&tmp->list);
-            free (tmp);
-         }
-      }
-
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+   if (end == NULL) {
+      end = path;
    }
-   return 0;
+   while (path < end) {
+      hash ^= (unsigned char)tolower((unsigned char)*path++);
+      hash *= 16777619U;
+   }
+   return &negDirGen[hash & (HGFS_NEG_CACHE_DIR_GENS - 1)];
 }
 
-#else
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsNegCacheGen
+ *
+ *    Gets the generation a negative entry for path depends on: the sum of
+ *    its directory generation and the global one. Both only ever grow, so
+ *    bumping either changes the sum.
+ *
+ * Results:
+ *    The generation.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNegCacheGen(const char *path) //IN: Path of file or directory
+{
+   return Atomic_Read32(&negTreeGen) + Atomic_Read32(HgfsNegCacheDirGen(path));
+}
 
-GHashTable *g_hash_table;
 
 /*
  *----------------------------------------------------------------------
  *
  * HgfsInitCache
  *
- *    Creates a hash table with string as a key.
+ *    Initializes the attribute cache shards.
  *
  * Results:
  *    None
  *
  * Side effects:
  *    None
+ *
  *----------------------------------------------------------------------
  *
  */
@@ -296,7 +326,20 @@ GHashTable *g_hash_table;
 void
 HgfsInitCache()
 {
-   g_hash_table = g_hash_table_new(g_str_hash, g_str_equal);
+   int i;
+   int j;
+
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &attrCache[i];
+
+      pthread_mutex_init(&shard->lock, NULL);
+      shard->numEntries = 0;
+      shard->numNegative = 0;
+      INIT_LIST_HEAD(&shard->lru);
+      for (j = 0; j < HGFS_ATTR_CACHE_BUCKETS; j++) {
+         INIT_LIST_HEAD(&shard->buckets[j]);
+      }
+   }
 }
 
 
@@ -305,13 +348,14 @@ HgfsInitCache()
  *
  * HgfsGetAttrCache
  *
- *    Retrieves the attr from the HashTable for a given path.
+ *    Retrieves the attr from the cache for a given path.
  *
  * Results:
- *    0 on success else -1 on error
+ *    0 on success, -ENOENT if the path is known not to exist, else -1.
  *
  * Side effects:
- *    None
+ *    An expired entry is removed, a valid one becomes the most
+ *    recently used of its shard.
  *
  *----------------------------------------------------------------------
  */
@@ -321,25 +365,41 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
                  HgfsAttrInfo *attr) //IN: Attribute for a given path
 {
    HgfsAttrCache *tmp;
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
    int res = -1;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
-      int diff;
+      int64 diff = HGFS_ATTR_CACHE_AGE(tmp);
 
       LOG(4, ("cache hit. path = %s\n", tmp->path));
-
-      diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-      LOG(4, ("time since last updated is %d seconds\n", diff));
-      if ( diff <= CACHE_TIMEOUT ) {
+      LOG(4, ("time since last updated is %"FMT64"d seconds\n", diff));
+      if (tmp->negative) {
+         if (diff <= HGFS_NEG_CACHE_TIMEOUT &&
+             tmp->dirGen == HgfsNegCacheGen(path)) {
+            list_move(&tmp->lruList, &shard->lru);
+            Atomic_Inc64(&negCacheHits);
+            res = -ENOENT;
+         } else {
+            HgfsAttrCacheRemove(shard, tmp);
+         }
+      } else if (diff <= CACHE_TIMEOUT) {
          *attr = tmp->attr;
+         list_move(&tmp->lruList, &shard->lru);
          res = 0;
+      } else {
+         HgfsAttrCacheRemove(shard, tmp);
       }
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
+
+   HgfsStatsCount(res == 0 ? HGFS_STAT_CACHE_HIT :
+                  res == -ENOENT ? HGFS_STAT_CACHE_NEGATIVE_HIT :
+                                   HGFS_STAT_CACHE_MISS);
    return res;
 }
 
@@ -349,13 +409,14 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *
  * HgfsSetAttrCache
  *
- *    Updates the HashTable with the given (key, attr) pair.
+ *    Updates the cache with the given (key, attr) pair.
  *
  * Results:
  *    0 on success else negative value on error
  *
  * Side effects:
- *    None
+ *    The least recently used entry of the shard is evicted when the shard
+ *    is full.
  *
  *----------------------------------------------------------------------
  */
@@ -365,31 +426,51 @@ HgfsSetAttrCache(const char* path,         //IN: Path of file or directory
                  HgfsAttrInfo *attr)       //IN: Attribute for a given path
 {
    HgfsAttrCache *tmp;
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
+   size_t pathLen = strlen(path);
    int res = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
+      if (tmp->negative) {
+         tmp->negative = FALSE;
+         shard->numNegative--;
+      }
       tmp->attr = *attr;
       tmp->changeTime = HGFS_GET_TIME(time(NULL));
+      list_move(&tmp->lruList, &shard->lru);
+      LOG(4, ("cache entry updated. path = %s\n", tmp->path));
       goto out;
    }
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
+   tmp = malloc(sizeof(HgfsAttrCache) + pathLen + 1);
    if (tmp == NULL) {
       res = -ENOMEM;
       goto out;
    }
 
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
+   memcpy(tmp->path, path, pathLen + 1);
    tmp->attr = *attr;
    tmp->changeTime = HGFS_GET_TIME(time(NULL));
+   tmp->hash = hash;
+   tmp->negative = FALSE;
+   list_add(&tmp->hashList, HgfsAttrCacheGetBucket(shard, hash));
+   list_add(&tmp->lruList, &shard->lru);
+   shard->numEntries++;
+   LOG(4, ("cache entry added. path = %s\n", tmp->path));
 
-   g_hash_table_insert(g_hash_table, (gpointer)tmp->path, (gpointer)tmp);
+   while (shard->numEntries > HGFS_ATTR_CACHE_SHARD_MAX) {
+      HgfsAttrCache *lru = list_entry(shard->lru.prev, HgfsAttrCache, lruList);
+
+      LOG(10, ("cache entry evicted. path = %s\n", lru->path));
+      HgfsAttrCacheRemove(shard, lru);
+   }
 
 out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
    return res;
 }
 
@@ -397,12 +478,13 @@ out:
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateAttrCache
+ * HgfsGetNegativeCacheGen
  *
- *    Invalidate the HashTable entry for a path.
+ *    Gets the generation to pass to HgfsSetNegativeCache for path. Must be
+ *    called before the server is asked about path.
  *
  * Results:
- *    None
+ *    The current generation of the directory of path.
  *
  * Side effects:
  *    None
@@ -410,20 +492,181 @@ out:
  *----------------------------------------------------------------------
  */
 
+uint32
+HgfsGetNegativeCacheGen(const char* path)  //IN: Path of file or directory
+{
+   return HgfsNegCacheGen(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetNegativeCache
+ *
+ *    Remembers that the server reported path as missing, unless a name
+ *    was created in its directory since gen was taken.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The oldest negative entry of the shard is evicted when the shard
+ *    holds too many.
+ *
+ *----------------------------------------------------------------------
+ */
+
 void
-HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+HgfsSetNegativeCache(const char* path,  //IN: Path of file or directory
+                     uint32 gen)        //IN: From HgfsGetNegativeCacheGen
 {
    HgfsAttrCache *tmp;
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
+   size_t pathLen = strlen(path);
+
+   pthread_mutex_lock(&shard->lock);
+
+   /* Checked under the lock so that a racing create wins. */
+   if (gen != HgfsNegCacheGen(path)) {
+      goto out;
+   }
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
    if (tmp != NULL) {
-      tmp->changeTime = 0;
-      if (tmp->attr.type == HGFS_FILE_TYPE_DIRECTORY) {
-         HgfsInvalidateParentsChildren(tmp->path);
+      HgfsAttrCacheRemove(shard, tmp);
+   }
+
+   tmp = malloc(sizeof(HgfsAttrCache) + pathLen + 1);
+   if (tmp == NULL) {
+      goto out;
+   }
+
+   memcpy(tmp->path, path, pathLen + 1);
+   memset(&tmp->attr, 0, sizeof tmp->attr);
+   tmp->changeTime = HGFS_GET_TIME(time(NULL));
+   tmp->hash = hash;
+   tmp->negative = TRUE;
+   tmp->dirGen = gen;
+   list_add(&tmp->hashList, HgfsAttrCacheGetBucket(shard, hash));
+   list_add(&tmp->lruList, &shard->lru);
+   shard->numEntries++;
+   shard->numNegative++;
+   LOG(4, ("negative cache entry added. path = %s\n", tmp->path));
+
+   if (shard->numNegative > HGFS_NEG_CACHE_SHARD_MAX) {
+      struct list_head *cur;
+
+      list_for_each_prev(cur, &shard->lru) {
+         HgfsAttrCache *lru = list_entry(cur, HgfsAttrCache, lruList);
+
+         if (lru->negative) {
+            LOG(10, ("negative cache entry evicted. path = %s\n", lru->path));
+            HgfsAttrCacheRemove(shard, lru);
+            break;
+         }
       }
    }
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+
+   while (shard->numEntries > HGFS_ATTR_CACHE_SHARD_MAX) {
+      HgfsAttrCache *lru = list_entry(shard->lru.prev, HgfsAttrCache, lruList);
+
+      LOG(10, ("cache entry evicted. path = %s\n", lru->path));
+      HgfsAttrCacheRemove(shard, lru);
+   }
+
+out:
+   pthread_mutex_unlock(&shard->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateNegativeCache
+ *
+ *    Called after a name was created in, or renamed into, the directory of
+ *    path. Drops the negative entries of that directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Negative entries of other directories sharing the generation counter
+ *    are dropped as well.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateNegativeCache(const char* path)  //IN: Path of the new name
+{
+   Atomic_Inc32(HgfsNegCacheDirGen(path));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateNegativeCacheRename
+ *
+ *    Called after from was renamed. Unless from is known to be a regular
+ *    file or a link, a directory may now have replaced any path below the
+ *    new name, so every negative entry is dropped.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Negative entries outside the new name are dropped as well.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateNegativeCacheRename(const char* from)  //IN: Old name
+{
+   HgfsAttrCache *tmp;
+   uint32 hash = HgfsAttrCacheHash(from);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
+   Bool isDirectory = TRUE;
+
+   pthread_mutex_lock(&shard->lock);
+   tmp = HgfsAttrCacheLookup(shard, from, hash);
+   if (tmp != NULL && !tmp->negative) {
+      isDirectory = tmp->attr.type == HGFS_FILE_TYPE_DIRECTORY;
+   }
+   pthread_mutex_unlock(&shard->lock);
+
+   if (isDirectory) {
+      LOG(4, ("Invalidating negative cache after rename of %s\n", from));
+      Atomic_Inc32(&negTreeGen);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetNegativeCacheHits
+ *
+ *    Gets the number of lookups answered by negative entries, each of
+ *    which saved a round trip to the server.
+ *
+ * Results:
+ *    The number of hits.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+uint64
+HgfsGetNegativeCacheHits(void)
+{
+   return Atomic_Read64(&negCacheHits);
 }
 
 
@@ -434,7 +677,8 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  *
  *    This routine is called by the general function to invalidate a cache
  *    entry. If the entry is a directory this function is called to invalidate
- *    any cached children.
+ *    any cached children. Shards are visited one at a time, and no shard
+ *    lock may be held by the caller.
  *
  * Results:
  *    None
@@ -448,22 +692,65 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 static void
 HgfsInvalidateParentsChildren(const char* parent)      //IN: parent
 {
-   gpointer key, value;
-   GHashTableIter iter;
    size_t parentLen = Str_Strlen(parent, PATH_MAX);
+   int i;
 
    LOG(4, ("Invalidating cache children for parent = %s\n",
            parent));
 
-   g_hash_table_iter_init(&iter, g_hash_table);
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &attrCache[i];
+      HgfsAttrCache *child;
+      HgfsAttrCache *next;
+
+      pthread_mutex_lock(&shard->lock);
+      list_for_each_entry_safe(child, next, &shard->lru, lruList) {
+         if (Str_Strncasecmp(parent, child->path, parentLen) == 0 &&
+             child->path[parentLen] == '/') {
+            LOG(10, ("Invalidating cache child = %s\n", child->path));
+            HgfsAttrCacheRemove(shard, child);
+         }
+      }
+      pthread_mutex_unlock(&shard->lock);
+   }
+}
+
 
-   while (g_hash_table_iter_next(&iter, &key, &value)) {
-      HgfsAttrCache *child = (HgfsAttrCache *)value;
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateAttrCache
+ *
+ *    Invalidate the cache entry for a path, and those of its children if
+ *    it is a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-      if (Str_Strncasecmp(parent, child->path, parentLen) == 0) {
-         LOG(10, ("Invalidating cache child = %s\n", child->path));
-         child->changeTime = 0;
-      }
+void
+HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+{
+   HgfsAttrCache *tmp;
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
+   Bool isDirectory = FALSE;
+
+   pthread_mutex_lock(&shard->lock);
+   tmp = HgfsAttrCacheLookup(shard, path, hash);
+   if (tmp != NULL) {
+      isDirectory = tmp->attr.type == HGFS_FILE_TYPE_DIRECTORY;
+      HgfsAttrCacheRemove(shard, tmp);
+   }
+   pthread_mutex_unlock(&shard->lock);
+
+   if (isDirectory) {
+      HgfsInvalidateParentsChildren(path);
    }
 }
 
@@ -474,8 +761,8 @@ HgfsInvalidateParentsChildren(const char* parent)      //IN: parent
  * HgfsPurgeCache
  *
  *    This routine is called by an independent thread to purge the cache,
- *    for performance reasons, the deletion is done in random based
- *    on the order of iteration.
+ *    deletion is based on time of last update. Shards are purged one at a
+ *    time so lookups in the other shards are not held up.
  *
  * Results:
  *    None
@@ -489,25 +776,24 @@ HgfsInvalidateParentsChildren(const char* parent)      //IN: parent
 void*
 HgfsPurgeCache(void* unused)      //IN: Thread argument
 {
-   gpointer key, value;
-   GHashTableIter iter;
-
    while (1) {
+      int i;
+
       sleep(CACHE_PURGE_SLEEP_TIME);
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+      for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+         HgfsAttrCacheShard *shard = &attrCache[i];
+         HgfsAttrCache *tmp;
+         HgfsAttrCache *next;
 
-      if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
-         g_hash_table_iter_init(&iter, g_hash_table);
-         while (g_hash_table_iter_next(&iter, &key, &value) &&
-               (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
-            g_hash_table_iter_remove(&iter);
-            free(value);
+         pthread_mutex_lock(&shard->lock);
+         list_for_each_entry_safe(tmp, next, &shard->lru, lruList) {
+            if (HGFS_ATTR_CACHE_AGE(tmp) > CACHE_PURGE_TIME) {
+               HgfsAttrCacheRemove(shard, tmp);
+            }
          }
+         pthread_mutex_unlock(&shard->lock);
       }
-
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
    }
    return 0;
 }
-#endif
@@ -30,5 +30,10 @@ int HgfsSetAttrCache(const char* path, HgfsAttrInfo *attr);
 void HgfsInitCache();
 void* HgfsPurgeCache(void*);
 void HgfsInvalidateAttrCache(const char* path);
+uint32 HgfsGetNegativeCacheGen(const char* path);
+void HgfsSetNegativeCache(const char* path, uint32 gen);
+void HgfsInvalidateNegativeCache(const char* path);
+void HgfsInvalidateNegativeCacheRename(const char* from);
+uint64 HgfsGetNegativeCacheHits(void);
 
 #endif
@@ -76,6 +76,12 @@ const struct fuse_opt vmhgfsOpts[] = {
      VMHGFS_OPT("--loglevel %i",    logLevel, 4),
      VMHGFS_OPT("-l %i",            logLevel, 4),
 #endif
+     VMHGFS_OPT("max_inflight=%u",  maxInflight, 0),
+     VMHGFS_OPT("channels=%u",      numChannels, 0),
+     VMHGFS_OPT("lowlevel",         lowLevel, TRUE),
+     VMHGFS_OPT("writeback",        writeBack, TRUE),
+     VMHGFS_OPT("stats",            stats, TRUE),
+     VMHGFS_OPT("stats_file=%s",    statsFile, 0),
      /* We will change the default value, unless it is specified explicitly. */
 #if FUSE_MAJOR_VERSION != 3
      FUSE_OPT_KEY("big_writes",     KEY_BIG_WRITES),
@@ -124,12 +130,24 @@ Usage(char *prog_name)  // IN
            "                           1 - system OS version is not supported for HGFS FUSE\n"
            "                           2 - system needs FUSE packages for HGFS FUSE\n"
            "\n"
-#ifdef VMX86_DEVEL
            "vmhgfs options:\n"
+           "    -o max_inflight=NUM    read or write requests a single large I/O\n"
+           "                           keeps outstanding (1-%u, default %u)\n"
+           "    -o channels=NUM        host channels to spread requests over\n"
+           "                           (1-%u, default %u)\n"
+           "    -o lowlevel            use the inode based FUSE low-level API\n"
+           "    -o writeback           buffer and coalesce small sequential writes\n"
+           "    -o stats               collect per-operation latency statistics,\n"
+           "                           reported on SIGUSR1 and at unmount\n"
+           "    -o stats_file=PATH     append statistics reports to PATH instead\n"
+           "                           of stderr (implies stats)\n"
+#ifdef VMX86_DEVEL
            "    -l   --loglevel NUM    set loglevel=NUM only available in debug build.\n"
-           "\n"
 #endif
-           , prog_name, prog_name, prog_name);
+           "\n"
+           , prog_name, prog_name, prog_name,
+           HGFS_MAX_INFLIGHT_LIMIT, HGFS_MAX_INFLIGHT_DEFAULT,
+           HGFS_CHANNELS_LIMIT, HGFS_CHANNELS_DEFAULT);
 }
 
 #define LIB_MODULEPATH         "/lib/modules"
@@ -520,6 +538,12 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #else
    config.addBigWrites = TRUE;
 #endif
+   config.maxInflight = HGFS_MAX_INFLIGHT_DEFAULT;
+   config.numChannels = HGFS_CHANNELS_DEFAULT;
+   config.lowLevel = FALSE;
+   config.writeBack = FALSE;
+   config.stats = FALSE;
+   config.statsFile = NULL;
 
    res = fuse_opt_parse(outargs, &config, vmhgfsOpts, vmhgfsOptProc);
    if (res != 0) {
@@ -529,6 +553,22 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #ifdef VMX86_DEVEL
    LOGLEVEL_THRESHOLD = config.logLevel;
 #endif
+   if (config.maxInflight == 0) {
+      config.maxInflight = 1;
+   } else if (config.maxInflight > HGFS_MAX_INFLIGHT_LIMIT) {
+      config.maxInflight = HGFS_MAX_INFLIGHT_LIMIT;
+   }
+   gState->maxInflight = config.maxInflight;
+   if (config.numChannels == 0) {
+      config.numChannels = 1;
+   } else if (config.numChannels > HGFS_CHANNELS_LIMIT) {
+      config.numChannels = HGFS_CHANNELS_LIMIT;
+   }
+   gState->numChannels = config.numChannels;
+   gState->lowLevel = config.lowLevel;
+   gState->writeBack = config.writeBack;
+   gState->stats = config.stats || config.statsFile != NULL;
+   gState->statsFile = config.statsFile;
    /* Default option changes for vmhgfs fuse client. */
    if (config.addBigWrites) {
       res = fuse_opt_add_arg(outargs, "-obig_writes");
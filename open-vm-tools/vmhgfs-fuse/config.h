@@ -26,12 +26,32 @@
 
 #define HOSTNAME_PREFIX ".host:"
 
+/*
+ * Number of read or write chunk requests a single large I/O may have
+ * outstanding at once (mount option max_inflight=N).
+ */
+#define HGFS_MAX_INFLIGHT_DEFAULT 4
+#define HGFS_MAX_INFLIGHT_LIMIT   16
+
+/*
+ * Number of transport channels requests are spread over (mount option
+ * channels=N). Channels beyond the first are only opened when needed.
+ */
+#define HGFS_CHANNELS_DEFAULT 4
+#define HGFS_CHANNELS_LIMIT   8
+
 struct vmhgfsConfig {
 #ifdef VMX86_DEVEL
    int logLevel;
 #endif
    int addBigWrites;
    int addAllowOther;
+   unsigned int maxInflight;
+   unsigned int numChannels;
+   int lowLevel;
+   int writeBack;
+   int stats;
+   char *statsFile;
 };
 
 int vmhgfsOptProc(void *data, const char *arg,
@@ -22,6 +22,7 @@
  * File operations for the hgfs driver.
  */
 #include "module.h"
+#include "cache.h"
 
 
 #define HGFS_CREATE_DIR_MASK (HGFS_CREATE_DIR_VALID_FILE_NAME | \
@@ -213,6 +214,43 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetDirEntryAttrCache --
+ *
+ *    Adds the attributes of a directory entry to the attribute cache.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsSetDirEntryAttrCache(const char *path,    // IN: Path of the directory
+                         const char *name,    // IN: Entry name
+                         HgfsAttrInfo *attr)  // IN: Entry attributes
+{
+   size_t pathLen = strlen(path);
+   Bool addSeparator = pathLen == 0 || path[pathLen - 1] != '/';
+   char *entryPath;
+
+   entryPath = Str_Asprintf(NULL, "%s%s%s", path, addSeparator ? "/" : "",
+                            name);
+   if (entryPath == NULL) {
+      LOG(4, ("Out of memory caching attributes of %s\n", name));
+      return;
+   }
+
+   HgfsSetAttrCache(entryPath, attr);
+   free(entryPath);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -226,17 +264,26 @@ out:
  *    server, while for V3 we may have multiple directory entries. The
  *    number of entries can be read from the reply packet.
  *
+ *    V3 entries carry the same attributes as a V3 getattr reply, so the
+ *    attributes of regular files and directories are added to the attribute
+ *    cache, saving a getattr round trip per entry for "ls -l" and friends.
+ *
+ *    Every entry, its name and the offset of the next entry are checked
+ *    against the size of the reply before they are used.
+ *
  * Results:
- *    0 on success, anything else on failure.
+ *    0 on success, -EPROTO if an entry does not fit in the reply, anything
+ *    else on other failures.
  *
  * Side effects:
- *    None
+ *    The attribute cache may be updated.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
+HgfsReadDirFromReply(const char *path,  // IN: Path of the directory
+                     uint32 *f_pos,     // IN/OUT: Offset
                      void *vfsDirent,   // OUT: Buffer to copy dentries into
                      fuse_fill_dir_t filldir, // IN:  Filler function
                      HgfsReq *req,      // IN:  The request containing reply
@@ -244,9 +291,12 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
                      Bool *done)        // OUT: Set true when there are no
                                         //      more entries
 {
-   uint32 replyCount;
+   uint64 replyCount;
    HgfsAttrInfo attr;
    HgfsDirEntry *hgfsDirent = NULL; /* Only for V3. */
+   char *replyStart = HGFS_REQ_PAYLOAD(req);
+   size_t replySize = req->payloadSize;
+   size_t entryOffset = 0;          /* Only for V3. */
    char *escName;                   /* Buffer for escaped version of name */
    size_t escNameLength = NAME_MAX + 1;
    int result = 0;
@@ -263,8 +313,14 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
    if (opUsed == HGFS_OP_SEARCH_READ_V3) {
       HgfsReplySearchReadV3 *replyV3 = HgfsGetReplyPayload(req);
 
+      entryOffset = replyV3->payload - replyStart;
+      if (entryOffset > replySize) {
+         LOG(4, ("Search read reply too short, %"FMTSZ"u bytes.\n",
+                 replySize));
+         result = -EPROTO;
+         goto out;
+      }
       replyCount = replyV3->count;
-      hgfsDirent = (HgfsDirEntry *)replyV3->payload;
       if (replyCount == 0) {
          /* We're at the end of the directory. */
          *done = TRUE;
@@ -272,7 +328,7 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       }
    }
 
-   LOG(8, ("Reply counter %u, opUsed %d\n", replyCount, opUsed));
+   LOG(8, ("Reply counter %"FMT64"u, opUsed %d\n", replyCount, opUsed));
    while (replyCount-- > 0) {
       void *rawAttr;
       char *fileName;
@@ -283,13 +339,40 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
 
       switch(opUsed) {
       case HGFS_OP_SEARCH_READ_V3: {
+         if (replySize - entryOffset < offsetof(HgfsDirEntry, fileName.name)) {
+            LOG(4, ("Directory entry at %"FMTSZ"u past the reply end.\n",
+                    entryOffset));
+            result = -EPROTO;
+            goto out;
+         }
+         hgfsDirent = (HgfsDirEntry *)(replyStart + entryOffset);
          rawAttr =  &hgfsDirent->attr;
          fileName = hgfsDirent->fileName.name;
          fileNameLength = hgfsDirent->fileName.length;
+
+         /*
+          * Move on to the next entry now, so that skipped entries do not
+          * leave us parsing this one again.
+          */
+         if (replyCount > 0) {
+            if (hgfsDirent->nextEntry == 0 ||
+                hgfsDirent->nextEntry > replySize - entryOffset) {
+               LOG(4, ("Bad next directory entry offset %u.\n",
+                       hgfsDirent->nextEntry));
+               result = -EPROTO;
+               goto out;
+            }
+            entryOffset += hgfsDirent->nextEntry;
+         }
          break;
       }
       case HGFS_OP_SEARCH_READ_V2: {
          HgfsReplySearchReadV2 *replyV2;
+
+         if (replySize < offsetof(HgfsReplySearchReadV2, fileName.name)) {
+            result = -EPROTO;
+            goto out;
+         }
          replyV2 = (HgfsReplySearchReadV2 *)(HGFS_REQ_PAYLOAD(req));
          rawAttr = &replyV2->attr;
          fileName = replyV2->fileName.name;
@@ -298,6 +381,11 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       }
       case HGFS_OP_SEARCH_READ: {
          HgfsReplySearchRead *replyV1;
+
+         if (replySize < offsetof(HgfsReplySearchRead, fileName.name)) {
+            result = -EPROTO;
+            goto out;
+         }
          replyV1 = (HgfsReplySearchRead *)(HGFS_REQ_PAYLOAD(req));
          rawAttr = &replyV1->attr;
          fileName = replyV1->fileName.name;
@@ -310,6 +398,14 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
          goto out;
       }
 
+      /* The name must lie within the reply. */
+      if (fileNameLength > replySize - (fileName - replyStart)) {
+         LOG(4, ("Directory entry name of %u bytes past the reply end.\n",
+                 fileNameLength));
+         result = -EPROTO;
+         goto out;
+      }
+
       /* Make sure name length is legal. */
       if (fileNameLength > NAME_MAX) {
          /*
@@ -324,6 +420,7 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
          *done = TRUE;
          goto out;
       }
+      memset(&attr, 0, sizeof attr);
       result = HgfsUnpackCommonAttr(rawAttr, opUsed, &attr);
       if (result != 0) {
          goto out;
@@ -419,13 +516,17 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       }
       (*f_pos)++;
 
-      /* For V3, there may be remaining entries to process. */
-      if (opUsed == HGFS_OP_SEARCH_READ_V3) {
-         if (hgfsDirent->nextEntry > 0) {
-            ASSERT(replyCount > 0);
-         }
-         hgfsDirent = (HgfsDirEntry *)((unsigned long)hgfsDirent +
-                                       hgfsDirent->nextEntry);
+      /*
+       * The server only reports the type of entries it failed to stat,
+       * those are left for getattr to report properly.
+       */
+      if (opUsed == HGFS_OP_SEARCH_READ_V3 &&
+          (attr.mask & HGFS_ATTR_VALID_SIZE) != 0 &&
+          (attr.type == HGFS_FILE_TYPE_REGULAR ||
+           attr.type == HGFS_FILE_TYPE_DIRECTORY) &&
+          strcmp(escName, ".") != 0 &&
+          strcmp(escName, "..") != 0) {
+         HgfsSetDirEntryAttrCache(path, escName, &attr);
       }
    }
 
@@ -470,7 +571,7 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
       request->search = searchHandle;
       request->offset = offset;
       request->reserved = 0;
-      request->flags = 0 /* HGFS_SEARCH_READ_FLAG_MULTIPLE_REPLY */;
+      request->flags = HGFS_SEARCH_READ_FLAG_MULTIPLE_REPLY;
       req->payloadSize = sizeof(*request) + HgfsGetRequestHeaderSize();
 
    } else {
@@ -553,7 +654,8 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
  */
 
 int
-HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
+HgfsReaddir(const char *path,         // IN:  Path of the directory
+            HgfsHandle handle,        // IN:  Directory handle to read from
             void *dirent,             // OUT: Buffer to copy dentries into
             fuse_fill_dir_t filldir)  // IN:  Filler function
 {
@@ -581,8 +683,8 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
          break;
       }
 
-      result = HgfsReadDirFromReply(&f_pos, dirent, filldir, request, opUsed,
-                                    &done);
+      result = HgfsReadDirFromReply(path, &f_pos, dirent, filldir, request,
+                                    opUsed, &done);
 
       LOG(4, ("f_pos = %d\n", f_pos));
       if (result == -ENAMETOOLONG) {
@@ -604,6 +706,83 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirClose --
+ *
+ *    Close a search handle opened by HgfsDirOpen.
+ *
+ * Results:
+ *    Returns zero on success, or an error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsDirClose(HgfsHandle handle)  // IN: Search handle to close
+{
+   HgfsReq *req;
+   HgfsOp opUsed;
+   HgfsStatus replyStatus;
+   int result;
+
+   LOG(6, ("Entry(handle = %u)\n", handle));
+
+   req = HgfsGetNewSmallRequest(0);
+   if (!req) {
+      LOG(4, ("Out of memory while getting new request\n"));
+      return -ENOMEM;
+   }
+
+retry:
+   opUsed = hgfsVersionSearchClose;
+   if (opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+      HgfsRequestSearchCloseV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->search = handle;
+      requestV3->reserved = 0;
+      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+
+   } else {
+      HgfsRequestSearchClose *request;
+
+      request = (HgfsRequestSearchClose *)(HGFS_REQ_PAYLOAD(req));
+      request->search = handle;
+      req->payloadSize = sizeof *request;
+   }
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+
+   /* Send the request and process the reply. */
+   result = HgfsSendRequest(req);
+   if (result == 0) {
+      /* Get the reply. */
+      replyStatus = HgfsGetReplyStatus(req);
+      result = HgfsStatusConvertToLinux(replyStatus);
+
+      if (result == -EPROTO && opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+         /* Retry with older version(s). Set globally. */
+         LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+         hgfsVersionSearchClose = HGFS_OP_SEARCH_CLOSE;
+         goto retry;
+      } else if (result != 0) {
+         LOG(4, ("Failed. handle = %u\n", handle));
+      }
+   } else {
+      LOG(4, ("Send failed. error: %d\n", result));
+   }
+
+   HgfsFreeRequest(req);
+   LOG(6, ("Exit(%d)\n", result));
+   return result;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -808,6 +987,8 @@ retry:
    }
 
 out:
+   /* Even a failed request may have created the directory. */
+   HgfsInvalidateNegativeCache(path);
    HgfsFreeRequest(req);
    return result;
 }
@@ -849,7 +1030,9 @@ HgfsDelete(const char* path,       // IN: Path to file
       goto out;
    }
 
-   req = HgfsGetNewRequest();
+   HgfsWriteBackFlushPath(path);
+
+   req = HgfsGetNewSmallRequest(strlen(path));
    if (!req) {
       LOG(4, ("Out of memory while getting new request.\n"));
       result = -ENOMEM;
@@ -29,13 +29,88 @@
 #include "hgfsUtil.h"
 #include "fsutil.h"
 #include "file.h"
+#include "cache.h"
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 
+/*
+ * Reads and writes larger than one request are split into chunks. When the
+ * mount allows more than one request in flight, the chunks are handed to a
+ * small pool of I/O threads so that several of them are outstanding on the
+ * transport at once. The calling thread runs chunks as well, so a request
+ * never waits behind a busy pool.
+ */
+typedef struct HgfsIoBatch {
+   pthread_cond_t done;
+   uint32 pending;                /* Chunks not yet completed. */
+} HgfsIoBatch;
+
+typedef struct HgfsIoChunk {
+   struct list_head list;         /* Link in gHgfsIoQueue while queued. */
+   HgfsIoBatch *batch;
+   HgfsHandle handle;
+   Bool isWrite;
+   char *buf;
+   size_t count;
+   loff_t offset;
+   int result;
+} HgfsIoChunk;
+
+static pthread_mutex_t gHgfsIoLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gHgfsIoQueueCond = PTHREAD_COND_INITIALIZER;
+static struct list_head gHgfsIoQueue = LIST_HEAD_INIT(gHgfsIoQueue);
+static uint32 gHgfsIoThreads = 0;
+
+/*
+ * With the writeback mount option, small writes are collected in a buffer
+ * per open handle and sent as one write request once the buffer holds
+ * HgfsMaxIOSize bytes, or when the handle is flushed, synced or released,
+ * or when the buffer has been dirty for HGFS_WB_MAX_AGE seconds. Only
+ * writes that continue where the buffered data ends are coalesced; any
+ * other write flushes the buffer first. Buffers of a path are also flushed
+ * before it is opened, renamed, deleted or has its attributes read or set,
+ * so that the host sees the data in order, and a rename moves the buffers
+ * of the renamed path and of everything beneath it to the new name. A
+ * failed flush that no caller was waiting on is reported by the next
+ * write, flush or release of the handle.
+ */
+#define HGFS_WB_MAX_AGE 1
+
+typedef struct HgfsWbBuffer {
+   struct list_head list;         /* Link in gHgfsWbList. */
+   uint32 refCount;               /* Protected by gHgfsWbLock. */
+   pthread_mutex_t lock;          /* Serializes appends and flushes. */
+   HgfsHandle handle;
+   char *path;                    /* Protected by gHgfsWbLock. */
+   char *data;
+   size_t size;                   /* Capacity of data. */
+   size_t len;                    /* Bytes buffered. */
+   loff_t offset;                 /* File offset of data[0]. */
+   Bool dirty;                    /* Protected by gHgfsWbLock. */
+   time_t dirtyTime;              /* Protected by gHgfsWbLock. */
+   int error;                     /* Deferred flush error. */
+} HgfsWbBuffer;
+
+static pthread_mutex_t gHgfsWbLock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head gHgfsWbList = LIST_HEAD_INIT(gHgfsWbList);
+static uint32 gHgfsWbCount = 0;
+static Bool gHgfsWbThreadStarted = FALSE;
 
 
 static int
 HgfsGetOpenFlags(uint32 flags);
+static int
+HgfsDoWrite(HgfsHandle handle, const char *buf, size_t count, loff_t offset);
+static void
+HgfsWbFlushMatching(const char *path);
+static int
+HgfsWbFlush(HgfsHandle handle, Bool report);
+static void *
+HgfsWbThread(void *data);
+static int
+HgfsWriteBackRelease(HgfsHandle handle);
+static void
+HgfsWbRename(const char *from, const char *to);
 
 
 /*
@@ -400,6 +475,8 @@ HgfsOpenInt(const char *path,           //IN: Path to a file
 
    LOG(4, ("Entry(%s)\n", path));
 
+   HgfsWriteBackFlushPath(path);
+
    req = HgfsGetNewRequest();
    if (!req) {
       LOG(4, ("Out of memory while getting new request.\n"));
@@ -468,6 +545,10 @@ retry:
       LOG(4, ("Unknown error: %d\n", result));
    }
 out:
+   if ((fi->flags & O_CREAT) != 0 || mask == HGFS_FILE_CREATE_MASK) {
+      /* Even a failed request may have created the file. */
+      HgfsInvalidateNegativeCache(path);
+   }
    HgfsFreeRequest(req);
    LOG(4, ("Exit(0x%"FMT64"x -> %d)\n",fi->fh, result));
    return result;
@@ -687,6 +768,271 @@ HgfsMaxIOSize(void)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsIoChunkRun --
+ *
+ *    Send the read or write request for one chunk and mark it complete
+ *    in its batch. Wakes the batch owner when this was the last chunk.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Acquires and releases gHgfsIoLock.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsIoChunkRun(HgfsIoChunk *chunk)  // IN/OUT: Chunk to issue
+{
+   HgfsIoBatch *batch = chunk->batch;
+
+   LOG(4, ("Issue Do%s(0x%x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+           chunk->isWrite ? "Write" : "Read", chunk->handle, chunk->count,
+           chunk->offset));
+   if (chunk->isWrite) {
+      chunk->result = HgfsDoWrite(chunk->handle, chunk->buf, chunk->count,
+                                  chunk->offset);
+   } else {
+      chunk->result = HgfsDoRead(chunk->handle, chunk->buf, chunk->count,
+                                 chunk->offset);
+   }
+
+   pthread_mutex_lock(&gHgfsIoLock);
+   ASSERT(batch->pending > 0);
+   if (--batch->pending == 0) {
+      pthread_cond_signal(&batch->done);
+   }
+   pthread_mutex_unlock(&gHgfsIoLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsIoThread --
+ *
+ *    I/O pool thread body. Takes chunks off the shared queue and issues
+ *    them for as long as the process lives.
+ *
+ * Results:
+ *    Never returns.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+HgfsIoThread(void *data)  // IN: Unused
+{
+   pthread_mutex_lock(&gHgfsIoLock);
+   for (;;) {
+      HgfsIoChunk *chunk;
+
+      while (list_empty(&gHgfsIoQueue)) {
+         pthread_cond_wait(&gHgfsIoQueueCond, &gHgfsIoLock);
+      }
+      chunk = list_entry(gHgfsIoQueue.next, HgfsIoChunk, list);
+      list_del_init(&chunk->list);
+      pthread_mutex_unlock(&gHgfsIoLock);
+
+      HgfsIoChunkRun(chunk);
+
+      pthread_mutex_lock(&gHgfsIoLock);
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsIoStartThreads --
+ *
+ *    Grow the I/O pool to the requested number of threads. Called with
+ *    gHgfsIoLock held.
+ *
+ * Results:
+ *    The number of pool threads running.
+ *
+ * Side effects:
+ *    May create detached threads.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+HgfsIoStartThreads(uint32 wanted)  // IN: Desired pool size
+{
+   while (gHgfsIoThreads < wanted) {
+      pthread_t thread;
+      pthread_attr_t attr;
+      int res;
+
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+      res = pthread_create(&thread, &attr, HgfsIoThread, NULL);
+      pthread_attr_destroy(&attr);
+      if (res != 0) {
+         LOG(4, ("Failed to create I/O thread: %d\n", res));
+         break;
+      }
+      gHgfsIoThreads++;
+   }
+   return gHgfsIoThreads;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsIoPipelined --
+ *
+ *    Issue a large read or write as maxIOSize chunks with up to
+ *    gState->maxInflight of them outstanding. The transfer covers the
+ *    chunks up to the first short or failed one. After a short but not
+ *    empty chunk the rest of the range is issued sequentially right
+ *    behind it, as the sequential loops in HgfsRead and HgfsWrite do.
+ *
+ *    Unlike those loops, chunks past a failed or short one have already
+ *    been sent. For a read this only costs the wasted requests. For a
+ *    write, data past a failed chunk may have reached the file even
+ *    though the error is returned.
+ *
+ * Results:
+ *    Bytes transferred, or a negative error. A read reports the bytes
+ *    read before the first error, a write the error itself. Returns
+ *    -ENOSYS if the I/O could not be pipelined and the caller should
+ *    issue it serially.
+ *
+ * Side effects:
+ *    For a read, the part of the buffer past the bytes read is zeroed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+HgfsIoPipelined(HgfsHandle handle,  // IN: Handle for the file
+                Bool isWrite,       // IN: Write if TRUE, read if FALSE
+                char *buf,          // IN/OUT: Data buffer
+                size_t count,       // IN: Number of bytes
+                loff_t offset,      // IN: Starting file offset
+                uint32 maxIOSize)   // IN: Maximum bytes per request
+{
+   HgfsIoBatch batch;
+   HgfsIoChunk *chunks;
+   uint32 numChunks = (count + maxIOSize - 1) / maxIOSize;
+   uint32 i;
+   ssize_t result = 0;
+
+   ASSERT(numChunks > 1);
+
+   chunks = malloc(numChunks * sizeof *chunks);
+   if (chunks == NULL) {
+      return -ENOSYS;
+   }
+
+   pthread_cond_init(&batch.done, NULL);
+   batch.pending = numChunks;
+
+   pthread_mutex_lock(&gHgfsIoLock);
+   if (HgfsIoStartThreads(gState->maxInflight - 1) == 0) {
+      pthread_mutex_unlock(&gHgfsIoLock);
+      pthread_cond_destroy(&batch.done);
+      free(chunks);
+      return -ENOSYS;
+   }
+   for (i = 0; i < numChunks; i++) {
+      HgfsIoChunk *chunk = &chunks[i];
+
+      chunk->batch = &batch;
+      chunk->handle = handle;
+      chunk->isWrite = isWrite;
+      chunk->buf = buf + (size_t)i * maxIOSize;
+      chunk->offset = offset + (loff_t)i * maxIOSize;
+      chunk->count = MIN(count - (size_t)i * maxIOSize, maxIOSize);
+      chunk->result = 0;
+      list_add_tail(&chunk->list, &gHgfsIoQueue);
+   }
+   pthread_cond_broadcast(&gHgfsIoQueueCond);
+
+   /* Run whatever chunks of ours the pool has not picked up yet. */
+   for (i = 0; i < numChunks; i++) {
+      if (!list_empty(&chunks[i].list)) {
+         list_del_init(&chunks[i].list);
+         pthread_mutex_unlock(&gHgfsIoLock);
+         HgfsIoChunkRun(&chunks[i]);
+         pthread_mutex_lock(&gHgfsIoLock);
+      }
+   }
+   while (batch.pending > 0) {
+      pthread_cond_wait(&batch.done, &gHgfsIoLock);
+   }
+   pthread_mutex_unlock(&gHgfsIoLock);
+   pthread_cond_destroy(&batch.done);
+
+   for (i = 0; i < numChunks; i++) {
+      if (chunks[i].result < 0) {
+         LOG(4, ("Error: chunk %u of %u -> %d\n", i, numChunks,
+                 chunks[i].result));
+         /* Reads report what was read before the error, writes the error. */
+         if (isWrite) {
+            result = chunks[i].result;
+            goto out;
+         }
+         break;
+      }
+      result += chunks[i].result;
+      if ((size_t)chunks[i].result < chunks[i].count) {
+         break;
+      }
+   }
+
+   /* Carry on behind a short chunk until the end or an empty transfer. */
+   if (i < numChunks && chunks[i].result > 0) {
+      while ((size_t)result < count) {
+         size_t nextCount = MIN(count - (size_t)result, maxIOSize);
+         int res;
+
+         if (isWrite) {
+            res = HgfsDoWrite(handle, buf + result, nextCount,
+                              offset + result);
+         } else {
+            res = HgfsDoRead(handle, buf + result, nextCount,
+                             offset + result);
+         }
+         if (res < 0) {
+            LOG(4, ("Error: 0x%"FMTSZ"x bytes Do%s -> %d\n", result,
+                    isWrite ? "Write" : "Read", res));
+            if (isWrite) {
+               result = res;
+               goto out;
+            }
+            break;
+         }
+         if (res == 0) {
+            break;
+         }
+         result += res;
+      }
+   }
+
+   if (!isWrite) {
+      memset(buf + result, 0, count - result);
+   }
+
+out:
+   free(chunks);
+   return result;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -705,7 +1051,8 @@ HgfsMaxIOSize(void)
  */
 
 ssize_t
-HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
+HgfsRead(const char *path,           // IN:  Path of the file or NULL
+         struct fuse_file_info *fi,  // IN:  File info struct
          char  *buf,                 // OUT: User buffer to copy data into
          size_t count,               // IN:  Number of bytes to read
          loff_t offset)              // IN:  Offset at which to read
@@ -719,9 +1066,25 @@ HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
    ASSERT(NULL != fi);
    ASSERT(NULL != buf);
 
+   /* Reads must see what was written, whichever handle wrote it. */
+   if (path != NULL) {
+      HgfsWriteBackFlushPath(path);
+   } else {
+      HgfsWbFlush(fi->fh, FALSE);
+   }
+
    LOG(4, ("Entry(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
            fi->fh, count, offset));
 
+   if (count > maxIOSize && gState->maxInflight > 1) {
+      ssize_t bytesRead = HgfsIoPipelined(fi->fh, FALSE, buf, count, offset,
+                                          maxIOSize);
+      if (bytesRead != -ENOSYS) {
+         LOG(4, ("Exit(%"FMTSZ"d)\n", bytesRead));
+         return bytesRead;
+      }
+   }
+
     do {
       nextCount = (remainingCount > maxIOSize) ? maxIOSize : remainingCount;
       LOG(4, ("Issue DoRead(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
@@ -908,6 +1271,15 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
    LOG(6, ("Entry(0x%"FMT64"x off bytes 0x%"FMTSZ"x @ 0x%"FMT64"x)\n",
            fi->fh, count, offset));
 
+   if (count > maxIOSize && gState->maxInflight > 1) {
+      bytesWritten = HgfsIoPipelined(fi->fh, TRUE, (char *)buf, count, offset,
+                                     maxIOSize);
+      if (bytesWritten != -ENOSYS) {
+         goto out;
+      }
+      bytesWritten = 0;
+   }
+
    do {
       nextCount = (remainingCount > maxIOSize) ? maxIOSize : remainingCount;
       LOG(4, ("Issue DoWrite(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
@@ -934,6 +1306,537 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbGet --
+ *
+ *    Look up the write-back buffer of a handle, optionally creating it.
+ *
+ * Results:
+ *    The buffer with a reference held, or NULL if there is none (or it
+ *    could not be created).
+ *
+ * Side effects:
+ *    Starts the flush thread the first time a buffer is created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsWbBuffer *
+HgfsWbGet(HgfsHandle handle,  // IN: Handle of the file
+          const char *path,   // IN: Path of the file, NULL to only look up
+          size_t size)        // IN: Capacity when creating
+{
+   HgfsWbBuffer *wb;
+
+   pthread_mutex_lock(&gHgfsWbLock);
+   list_for_each_entry(wb, &gHgfsWbList, list) {
+      if (wb->handle == handle) {
+         wb->refCount++;
+         goto out;
+      }
+   }
+
+   wb = NULL;
+   if (path != NULL) {
+      wb = calloc(1, sizeof *wb);
+      if (wb != NULL) {
+         wb->path = strdup(path);
+         wb->data = malloc(size);
+         if (wb->path == NULL || wb->data == NULL) {
+            free(wb->path);
+            free(wb->data);
+            free(wb);
+            wb = NULL;
+            goto out;
+         }
+         pthread_mutex_init(&wb->lock, NULL);
+         wb->handle = handle;
+         wb->size = size;
+         /* One reference for the list, one for the caller. */
+         wb->refCount = 2;
+         list_add_tail(&wb->list, &gHgfsWbList);
+         gHgfsWbCount++;
+      }
+
+      if (!gHgfsWbThreadStarted) {
+         pthread_t thread;
+
+         if (pthread_create(&thread, NULL, HgfsWbThread, NULL) == 0) {
+            pthread_detach(thread);
+            gHgfsWbThreadStarted = TRUE;
+         } else {
+            LOG(4, ("Failed to start the write-back flush thread.\n"));
+         }
+      }
+   }
+
+out:
+   pthread_mutex_unlock(&gHgfsWbLock);
+   return wb;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbPut --
+ *
+ *    Drop a reference to a write-back buffer.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The buffer is freed with its last reference.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsWbPut(HgfsWbBuffer *wb)  // IN: Buffer
+{
+   Bool last;
+
+   pthread_mutex_lock(&gHgfsWbLock);
+   last = --wb->refCount == 0;
+   pthread_mutex_unlock(&gHgfsWbLock);
+
+   if (last) {
+      ASSERT(wb->len == 0);
+      pthread_mutex_destroy(&wb->lock);
+      free(wb->path);
+      free(wb->data);
+      free(wb);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbFlushLocked --
+ *
+ *    Write out the data held in a write-back buffer. The caller holds
+ *    wb->lock.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure. The buffer
+ *    is empty either way.
+ *
+ * Side effects:
+ *    The cached attributes of the file are invalidated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsWbFlushLocked(HgfsWbBuffer *wb)  // IN/OUT: Buffer
+{
+   size_t done = 0;
+   int result = 0;
+
+   if (wb->len == 0) {
+      return 0;
+   }
+
+   LOG(4, ("Flush(handle = %u, 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+           wb->handle, wb->len, wb->offset));
+   while (done < wb->len) {
+      result = HgfsDoWrite(wb->handle, wb->data + done, wb->len - done,
+                           wb->offset + done);
+      if (result <= 0) {
+         if (result == 0) {
+            result = -EIO;
+         }
+         LOG(4, ("Error: flushed 0x%"FMTSZ"x bytes DoWrite -> %d\n",
+                 done, result));
+         break;
+      }
+      done += result;
+      result = 0;
+   }
+   wb->len = 0;
+   pthread_mutex_lock(&gHgfsWbLock);
+   wb->dirty = FALSE;
+   HgfsInvalidateAttrCache(wb->path);
+   pthread_mutex_unlock(&gHgfsWbLock);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbFlushMatching --
+ *
+ *    Flush every write-back buffer of path, or if path is NULL every
+ *    buffer that has been dirty for at least HGFS_WB_MAX_AGE seconds.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Flush errors are kept in the buffers for their handles to report.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsWbFlushMatching(const char *path)  // IN: Path or NULL
+{
+   HgfsWbBuffer *wb;
+   time_t now = time(NULL);
+   uint32 passes = 0;
+   Bool found;
+
+   do {
+      found = FALSE;
+      pthread_mutex_lock(&gHgfsWbLock);
+      /* Bound the work should writers keep dirtying the buffers. */
+      if (passes++ <= gHgfsWbCount) {
+         list_for_each_entry(wb, &gHgfsWbList, list) {
+            if (wb->dirty &&
+                (path != NULL ? strcmp(wb->path, path) == 0 :
+                                now - wb->dirtyTime >= HGFS_WB_MAX_AGE)) {
+               wb->refCount++;
+               found = TRUE;
+               break;
+            }
+         }
+      }
+      pthread_mutex_unlock(&gHgfsWbLock);
+
+      if (found) {
+         int result;
+
+         pthread_mutex_lock(&wb->lock);
+         result = HgfsWbFlushLocked(wb);
+         if (result < 0 && wb->error == 0) {
+            wb->error = result;
+         }
+         pthread_mutex_unlock(&wb->lock);
+         HgfsWbPut(wb);
+      }
+   } while (found);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbThread --
+ *
+ *    Flush write-back buffers that have been dirty for too long.
+ *
+ * Results:
+ *    Never returns.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+HgfsWbThread(void *data)  // IN: Unused
+{
+   for (;;) {
+      sleep(HGFS_WB_MAX_AGE);
+      HgfsWbFlushMatching(NULL);
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbFlush --
+ *
+ *    Write out the buffered data of a handle.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure. With report
+ *    set the error of an earlier flush is returned and forgotten, else a
+ *    new error is kept for the handle to report later.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsWbFlush(HgfsHandle handle,  // IN: Handle of the file
+            Bool report)        // IN: Return deferred errors
+{
+   HgfsWbBuffer *wb;
+   int result;
+
+   if (!gState->writeBack) {
+      return 0;
+   }
+
+   wb = HgfsWbGet(handle, NULL, 0);
+   if (wb == NULL) {
+      return 0;
+   }
+
+   pthread_mutex_lock(&wb->lock);
+   result = HgfsWbFlushLocked(wb);
+   if (report) {
+      if (wb->error != 0) {
+         result = wb->error;
+         wb->error = 0;
+      }
+   } else if (result < 0 && wb->error == 0) {
+      wb->error = result;
+   }
+   pthread_mutex_unlock(&wb->lock);
+   HgfsWbPut(wb);
+
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBuffered --
+ *
+ *    Write to a file through its write-back buffer when the writeback
+ *    mount option is set, otherwise straight through HgfsWrite.
+ *
+ * Results:
+ *    Returns the number of bytes written on success, or an error on
+ *    failure. This includes a failed flush of earlier buffered data.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsWriteBuffered(struct fuse_file_info *fi,  // IN: File info structure
+                  const char *path,           // IN: Path of the file
+                  const char *buf,            // IN: Data to write
+                  size_t count,               // IN: Number of bytes to write
+                  loff_t offset)              // IN: Offset at which to write
+{
+   uint32 maxIOSize = HgfsMaxIOSize();
+   HgfsWbBuffer *wb;
+   ssize_t result;
+
+   if (!gState->writeBack) {
+      return HgfsWrite(fi, buf, count, offset);
+   }
+
+   wb = HgfsWbGet(fi->fh, count < maxIOSize ? path : NULL, maxIOSize);
+   if (wb == NULL) {
+      return HgfsWrite(fi, buf, count, offset);
+   }
+
+   pthread_mutex_lock(&wb->lock);
+   if (wb->error != 0) {
+      result = wb->error;
+      wb->error = 0;
+      goto out;
+   }
+
+   if (wb->len != 0 &&
+       (offset != wb->offset + wb->len || count > wb->size - wb->len)) {
+      result = HgfsWbFlushLocked(wb);
+      if (result < 0) {
+         goto out;
+      }
+   }
+
+   if (count >= wb->size) {
+      result = HgfsWrite(fi, buf, count, offset);
+      goto out;
+   }
+
+   if (wb->len == 0) {
+      wb->offset = offset;
+      pthread_mutex_lock(&gHgfsWbLock);
+      wb->dirty = TRUE;
+      wb->dirtyTime = time(NULL);
+      pthread_mutex_unlock(&gHgfsWbLock);
+   }
+   memcpy(wb->data + wb->len, buf, count);
+   wb->len += count;
+   result = count;
+
+   if (wb->len == wb->size) {
+      int res = HgfsWbFlushLocked(wb);
+
+      if (res < 0) {
+         result = res;
+      }
+   }
+
+out:
+   pthread_mutex_unlock(&wb->lock);
+   HgfsWbPut(wb);
+
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackFlush --
+ *
+ *    Write out the buffered data of a handle, as for flush or fsync.
+ *
+ * Results:
+ *    Returns zero on success, or the error of this or an earlier flush.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsWriteBackFlush(HgfsHandle handle)  // IN: Handle of the file
+{
+   return HgfsWbFlush(handle, TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackFlushPath --
+ *
+ *    Write out the buffered data of every handle open on path.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Flush errors are reported later through the handles.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBackFlushPath(const char *path)  // IN: Path of the file
+{
+   if (gState->writeBack) {
+      HgfsWbFlushMatching(path);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWbRename --
+ *
+ *    Move the write-back buffers of a renamed path, and of everything
+ *    beneath it, to the new name, so that they are found and their
+ *    flushes invalidate the right attributes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsWbRename(const char *from,  // IN: Old path
+             const char *to)    // IN: New path
+{
+   HgfsWbBuffer *wb;
+   size_t fromLen = strlen(from);
+   size_t toLen = strlen(to);
+
+   if (!gState->writeBack) {
+      return;
+   }
+
+   pthread_mutex_lock(&gHgfsWbLock);
+   list_for_each_entry(wb, &gHgfsWbList, list) {
+      char *newPath;
+
+      if (strncmp(wb->path, from, fromLen) != 0 ||
+          (wb->path[fromLen] != '\0' && wb->path[fromLen] != '/')) {
+         continue;
+      }
+
+      newPath = malloc(toLen + strlen(wb->path + fromLen) + 1);
+      if (newPath == NULL) {
+         LOG(4, ("Out of memory renaming the buffer of %s\n", wb->path));
+         continue;
+      }
+      memcpy(newPath, to, toLen);
+      strcpy(newPath + toLen, wb->path + fromLen);
+      LOG(4, ("Buffer of handle %u moved to %s\n", wb->handle, newPath));
+      free(wb->path);
+      wb->path = newPath;
+   }
+   pthread_mutex_unlock(&gHgfsWbLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackRelease --
+ *
+ *    Flush and drop the write-back buffer of a handle being closed.
+ *
+ * Results:
+ *    Returns zero on success, or the error of this or an earlier flush.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsWriteBackRelease(HgfsHandle handle)  // IN: Handle of the file
+{
+   HgfsWbBuffer *wb;
+   int result;
+
+   if (!gState->writeBack) {
+      return 0;
+   }
+
+   wb = HgfsWbGet(handle, NULL, 0);
+   if (wb == NULL) {
+      return 0;
+   }
+
+   pthread_mutex_lock(&gHgfsWbLock);
+   list_del_init(&wb->list);
+   gHgfsWbCount--;
+   wb->refCount--;
+   pthread_mutex_unlock(&gHgfsWbLock);
+
+   pthread_mutex_lock(&wb->lock);
+   result = HgfsWbFlushLocked(wb);
+   if (wb->error != 0) {
+      result = wb->error;
+   }
+   pthread_mutex_unlock(&wb->lock);
+   HgfsWbPut(wb);
+
+   return result;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -965,6 +1868,9 @@ HgfsRename(const char* from, const char* to)
    ASSERT(from);
    ASSERT(to);
 
+   HgfsWriteBackFlushPath(from);
+   HgfsWriteBackFlushPath(to);
+
    req = HgfsGetNewRequest();
    if (!req) {
       LOG(4, ("Out of memory while getting new request\n"));
@@ -1129,6 +2035,12 @@ retry:
    }
 
 out:
+   if (result == 0) {
+      HgfsWbRename(from, to);
+   }
+   /* Even a failed request may have moved the file. */
+   HgfsInvalidateNegativeCache(to);
+   HgfsInvalidateNegativeCacheRename(from);
    HgfsFreeRequest(req);
    LOG(6, ("Exit(%d)\n", result));
    return result;
@@ -1393,6 +2305,9 @@ HgfsSetattr(const char* path,       //IN: Path to file
 
    LOG(4, ("Entry(%s)\n", path));
 
+   /* A truncate must not be overtaken by buffered writes. */
+   HgfsWriteBackFlushPath(path);
+
    req = HgfsGetNewRequest();
    if (!req) {
       result = -ENOMEM;
@@ -1452,7 +2367,9 @@ out:
  *    Called when the last user of a file closes it.
  *
  * Results:
- *    Returns zero on success, or an error on failure.
+ *    Returns zero on success, or an error on failure. This includes a
+ *    failed flush of buffered writes, after which the handle is still
+ *    closed.
  *
  * Side effects:
  *    None
@@ -1467,10 +2384,17 @@ HgfsRelease(HgfsHandle handle)  //IN:File handle to close
    HgfsOp opUsed;
    HgfsStatus replyStatus;
    int result;
+   int flushResult;
 
    LOG(6, ("Entry(handle = %u)\n", handle));
 
-   req = HgfsGetNewRequest();
+   /* The handle is closed even if its buffered writes were lost. */
+   flushResult = HgfsWriteBackRelease(handle);
+   if (flushResult < 0) {
+      LOG(4, ("Flushing buffered writes failed. error = %d\n", flushResult));
+   }
+
+   req = HgfsGetNewSmallRequest(0);
    if (!req) {
       LOG(4, ("Out of memory while getting new request\n"));
       result = -ENOMEM;
@@ -1529,6 +2453,9 @@ retry:
    }
 
 out:
+   if (result == 0 && flushResult < 0) {
+      result = flushResult;
+   }
    HgfsFreeRequest(req);
    LOG(6, ("Exit(%d)\n", result));
    return result;
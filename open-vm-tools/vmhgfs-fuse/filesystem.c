@@ -30,6 +30,7 @@
 #include "module.h"
 #include "request.h"
 #include "fsutil.h"
+#include "cache.h"
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 #include "rpcout.h"
@@ -102,6 +103,98 @@ HgfsResetOps(void)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsMountInit --
+ *
+ *    Called once the filesystem is mounted, by either FUSE API. Spawns the
+ *    attribute cache purge thread, creates the HGFS session and starts
+ *    statistics reporting if enabled.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsMountInit(void)
+{
+   pthread_t purgeCacheThread;
+   int dummy;
+   int res;
+
+   /*
+    * dummy argument is required for Solaris and FreeBSD while creating
+    * thread otherwise the program crashes.
+    */
+   res = pthread_create(&purgeCacheThread, NULL,
+                        HgfsPurgeCache, &dummy);
+   if (res < 0) {
+      LOG(4, ("Pthread create fail. error = %d\n", res));
+   }
+
+   res = HgfsCreateSession();
+   if (res < 0) {
+      LOG(4, ("Create session failed. error = %d\n", res));
+   }
+
+   HgfsStatsInit();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsMountExit --
+ *
+ *    Called when the filesystem is unmounted. Destroys the HGFS session
+ *    and releases the transport and global state.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsMountExit(void)
+{
+   HgfsReqStats stats;
+   int res;
+
+   res = HgfsDestroySession();
+   if (res < 0) {
+      LOG(4, ("Destroy session failed. error = %d\n", res));
+   }
+
+   HgfsGetRequestStats(&stats);
+   LOG(4, ("Requests: %"FMT64"u allocated, %"FMT64"u reused, "
+           "%"FMT64"u small, %"FMT64"u grown\n",
+           stats.allocated, stats.reused, stats.small, stats.grown));
+   LOG(4, ("Negative cache saved %"FMT64"u lookups\n",
+           HgfsGetNegativeCacheHits()));
+   HgfsStatsExit();
+
+   HgfsTransportExit();
+
+   free(gState->basePath);
+   free(gState->statsFile);
+
+   if (gState->conf != NULL) {
+      g_key_file_free(gState->conf);
+      gState->conf = NULL;
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
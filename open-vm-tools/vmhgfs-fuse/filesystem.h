@@ -45,6 +45,17 @@ typedef struct HgfsFuseState {
     */
    char *basePath;
    size_t basePathLen;
+   /* Chunk requests one large read or write may keep outstanding. */
+   uint32 maxInflight;
+   /* Transport channels requests may be spread over. */
+   uint32 numChannels;
+   /* Serve the kernel through the inode based FUSE low-level API. */
+   Bool lowLevel;
+   /* Coalesce small sequential writes per handle (see file.c). */
+   Bool writeBack;
+   /* Collect latency statistics, reported to statsFile or stderr. */
+   Bool stats;
+   char *statsFile;
 
    GKeyFile *conf;
 
@@ -52,5 +63,7 @@ typedef struct HgfsFuseState {
 
 /* Public functions (with respect to the entire module). */
 int HgfsStatfs(const char *path, struct statvfs *stat);
+void HgfsMountInit(void);
+void HgfsMountExit(void);
 
 #endif // _HGFS_DRIVER_FILESYSTEM_H_
@@ -167,7 +167,8 @@ HgfsUnpackGetattrReply(HgfsReq *req,        // IN: Reply packet
  *
  * HgfsPackGetattrRequest --
  *
- *    Setup the getattr request
+ *    Setup the getattr request. Without a path the file is named by its
+ *    open handle, which only version 3 requests can carry.
  *
  * Results:
  *    Returns zero on success, or negative error on failure.
@@ -191,10 +192,14 @@ HgfsPackGetattrRequest(HgfsReq *req,            // IN/OUT: Request buffer
    int result = 0;
    ASSERT(attr);
    ASSERT(req);
-   ASSERT(path);
+   ASSERT(path || (handleReuse && handle != HGFS_INVALID_HANDLE));
    attr->requestType = opUsed;
-   (void) handle;
-   (void) handleReuse;
+
+   if (path == NULL && opUsed != HGFS_OP_GETATTR_V3) {
+      LOG(8, ("Getattr by handle needs version 3.\n"));
+      result = -ENOENT;
+      goto out;
+   }
 
    switch (opUsed) {
    case HGFS_OP_GETATTR_V3: {
@@ -210,6 +215,16 @@ HgfsPackGetattrRequest(HgfsReq *req,            // IN/OUT: Request buffer
       reqSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
       reqBufferSize = HGFS_NAME_BUFFER_SIZET(HgfsLargePacketMax(FALSE), reqSize);
 
+      if (path == NULL) {
+         requestV3->hints = HGFS_ATTR_HINT_USE_FILE_DESC;
+         requestV3->fileName.flags = HGFS_FILE_NAME_USE_FILE_DESC;
+         requestV3->fileName.fid = handle;
+         requestV3->fileName.length = 0;
+         requestV3->fileName.name[0] = '\0';
+         result = 0;
+         break;
+      }
+
       /* Convert to CP name. */
       result = CPName_ConvertTo(path,
                                 reqBufferSize,
@@ -429,7 +444,9 @@ HgfsUnpackCommonAttr(void *rawAttr,          // IN: Attr in reply packet
  *
  *    Internal getattr routine. Send a getattr request to the server
  *    for the indicated remote name, and if it succeeds copy the
- *    results of the getattr into the provided HgfsAttrInfo.
+ *    results of the getattr into the provided HgfsAttrInfo. With a NULL
+ *    path the request names the file by handle instead, e.g. for a file
+ *    removed while open.
  *
  *    attr->fileName will be allocated on success if the file is a
  *    symlink; it's the caller's duty to free it.
@@ -457,7 +474,12 @@ HgfsPrivateGetattr(HgfsHandle handle,      // IN: file handle
    ASSERT(attr);
    LOG( 4,("path = %s, handle = %u\n", path, handle));
 
-   req = HgfsGetNewRequest();
+   /* The size and times must include buffered writes. */
+   if (path != NULL) {
+      HgfsWriteBackFlushPath(path);
+   }
+
+   req = HgfsGetNewSmallRequest(path != NULL ? strlen(path) : 0);
    if (!req) {
       LOG(8, ("Out of memory while getting new request\n"));
       result = -ENOMEM;
@@ -699,6 +721,84 @@ HgfsCalcBlockSize(uint64 tsize)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrToStat --
+ *
+ *    Fill in a struct stat from HGFS attributes.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsAttrToStat(const HgfsAttrInfo *attr,  // IN: HGFS attributes
+               struct stat *stbuf)        // OUT: Stat buffer
+{
+   uint32 d_type;
+
+   memset(stbuf, 0, sizeof *stbuf);
+
+   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
+      stbuf->st_mode |= (attr->specialPerms << 9);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
+      stbuf->st_mode |= (attr->ownerPerms << 6);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
+      stbuf->st_mode |= (attr->groupPerms << 3);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
+      stbuf->st_mode |= (attr->otherPerms);
+   }
+
+   /* Mask the access mode. */
+   switch (attr->type) {
+   case HGFS_FILE_TYPE_SYMLINK:
+      d_type = DT_LNK;
+      break;
+
+   case HGFS_FILE_TYPE_REGULAR:
+      d_type = DT_REG;
+      break;
+
+   case HGFS_FILE_TYPE_DIRECTORY:
+      d_type = DT_DIR;
+      break;
+
+   default:
+      d_type = DT_UNKNOWN;
+      break;
+   }
+
+   stbuf->st_mode |= d_type << 12;
+   stbuf->st_blksize = HGFS_BLOCKSIZE;
+   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
+   stbuf->st_size = attr->size;
+   stbuf->st_ino = attr->hostFileId;
+   stbuf->st_nlink = 1;
+   stbuf->st_uid = attr->userId;
+   stbuf->st_gid = attr->groupId;
+   stbuf->st_rdev = 0;
+
+   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
+      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
+      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
+      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -75,6 +75,19 @@ HgfsWrite(struct fuse_file_info *fi,
           size_t count,
           loff_t offset);
 
+ssize_t
+HgfsWriteBuffered(struct fuse_file_info *fi,
+                  const char *path,
+                  const char *buf,
+                  size_t count,
+                  loff_t offset);
+
+int
+HgfsWriteBackFlush(HgfsHandle handle);
+
+void
+HgfsWriteBackFlushPath(const char *path);
+
 int
 HgfsRename(const char* from, const char* to);
 
@@ -90,7 +103,8 @@ HgfsCreate(const char *path,
            struct fuse_file_info *fi);
 
 ssize_t
-HgfsRead(struct fuse_file_info *fi,
+HgfsRead(const char *path,
+         struct fuse_file_info *fi,
          char  *buf,
          size_t count,
          loff_t offset);
@@ -120,10 +134,14 @@ int
 HgfsDirOpen(const char* path, HgfsHandle* handle);
 
 int
-HgfsReaddir(HgfsHandle handle,
+HgfsReaddir(const char *path,
+            HgfsHandle handle,
             void *dirent,
             fuse_fill_dir_t filldir);
 
+int
+HgfsDirClose(HgfsHandle handle);
+
 int
 HgfsMkdir(const char *path,
           int mode);
@@ -142,4 +160,8 @@ HgfsResetOps(void);
 unsigned long
 HgfsCalcBlockSize(uint64 tsize);
 
+void
+HgfsAttrToStat(const HgfsAttrInfo *attr,
+               struct stat *stbuf);
+
 #endif // _HGFS_DRIVER_FSUTIL_H_
@@ -25,6 +25,7 @@
 
 
 #include "module.h"
+#include "cache.h"
 
 
 /*
@@ -215,6 +216,8 @@ HgfsSymlink(const char* source,    // IN: Source name
    }
 
 out:
+   /* Even a failed request may have created the link. */
+   HgfsInvalidateNegativeCache(source);
    HgfsFreeRequest(req);
 
    return result;
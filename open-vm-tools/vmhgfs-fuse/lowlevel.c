@@ -0,0 +1,2345 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * lowlevel.c --
+ *
+ * Inode based entry points for HGFS, used with the "lowlevel" option.
+ *
+ * The high-level FUSE API hands every callback a path, which the driver
+ * turns into an HGFS path and resolves on the host again. Here the kernel
+ * addresses files by node id instead. Each node id maps to an HgfsLlInode
+ * holding the share relative path of the file, the kernel's lookup count
+ * and, while the file is open, the HGFS handles that getattr can use in
+ * place of the name. Because node ids are stable the kernel caches entries
+ * and attributes for HGFS_DEFAULT_TTL seconds, and with FUSE 3 a directory
+ * listing returns the attributes of its entries (READDIRPLUS), so walking
+ * a tree no longer costs a lookup and a getattr per file.
+ */
+
+#include "module.h"
+#include "cache.h"
+#include "filesystem.h"
+#include "file.h"
+#include "lowlevel.h"
+#include <fuse_lowlevel.h>
+
+#define HGFS_LL_HASH_BUCKETS 1024
+
+typedef struct HgfsLlInode {
+   struct list_head idLink;       /* Link in gHgfsLlTable.byId. */
+   struct list_head pathLink;     /* Link in gHgfsLlTable.byPath. */
+   fuse_ino_t ino;
+   uint64 nlookup;                /* Lookups not yet forgotten by the kernel. */
+   char *path;                    /* Relative to the mount, "/" for the root.
+                                     NULL once the file was removed. */
+   HgfsHandle *handles;           /* Open handles on the file, oldest first. */
+   uint32 numHandles;
+   uint32 maxHandles;
+} HgfsLlInode;
+
+typedef struct HgfsLlDirEntry {
+   char *name;
+   struct stat st;                /* Type and inode number only. */
+} HgfsLlDirEntry;
+
+/* An open directory; fuse_file_info.fh points to one. */
+typedef struct HgfsLlDir {
+   pthread_mutex_t lock;
+   HgfsHandle handle;             /* Search handle. */
+   char *path;
+   char *absPath;
+   HgfsLlDirEntry *entries;
+   uint32 numEntries;
+   uint32 maxEntries;
+   Bool filled;                   /* Entries read from the server. */
+} HgfsLlDir;
+
+static struct {
+   pthread_mutex_t lock;
+   fuse_ino_t nextIno;
+   struct list_head byId[HGFS_LL_HASH_BUCKETS];
+   struct list_head byPath[HGFS_LL_HASH_BUCKETS];
+} gHgfsLlTable;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlPathBucket --
+ *
+ *    Hash a relative path (FNV-1a) to its bucket.
+ *
+ * Results:
+ *    The bucket in gHgfsLlTable.byPath.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static struct list_head *
+HgfsLlPathBucket(const char *path)  // IN: Relative path
+{
+   uint32 hash = 2166136261U;
+
+   while (*path != '\0') {
+      hash ^= (unsigned char)*path++;
+      hash *= 16777619U;
+   }
+   return &gHgfsLlTable.byPath[hash % HGFS_LL_HASH_BUCKETS];
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlFindIno --
+ *
+ *    Look up an inode by node id. Called with gHgfsLlTable.lock held.
+ *
+ * Results:
+ *    The inode, or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsLlInode *
+HgfsLlFindIno(fuse_ino_t ino)  // IN: Node id
+{
+   struct list_head *bucket = &gHgfsLlTable.byId[ino % HGFS_LL_HASH_BUCKETS];
+   HgfsLlInode *inode;
+
+   list_for_each_entry(inode, bucket, idLink) {
+      if (inode->ino == ino) {
+         return inode;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlFindPath --
+ *
+ *    Look up an inode by relative path. Called with gHgfsLlTable.lock
+ *    held.
+ *
+ * Results:
+ *    The inode, or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsLlInode *
+HgfsLlFindPath(const char *path)  // IN: Relative path
+{
+   struct list_head *bucket = HgfsLlPathBucket(path);
+   HgfsLlInode *inode;
+
+   list_for_each_entry(inode, bucket, pathLink) {
+      if (strcmp(inode->path, path) == 0) {
+         return inode;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlDetachLocked --
+ *
+ *    Forget the path of an inode whose file is gone, so that later
+ *    requests on it fail instead of reaching whatever takes the name.
+ *    Called with gHgfsLlTable.lock held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlDetachLocked(HgfsLlInode *inode)  // IN: Inode
+{
+   if (inode->path != NULL) {
+      list_del_init(&inode->pathLink);
+      free(inode->path);
+      inode->path = NULL;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlInodeHandle --
+ *
+ *    Get a handle through which getattr can reach the file. Called with
+ *    the table lock held.
+ *
+ * Results:
+ *    The oldest open handle, or HGFS_INVALID_HANDLE if none is open.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsLlInodeHandle(const HgfsLlInode *inode)  // IN: Inode
+{
+   return inode->numHandles > 0 ? inode->handles[0] : HGFS_INVALID_HANDLE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlInitTable --
+ *
+ *    Set up the inode table with the root of the mount.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLlInitTable(void)
+{
+   HgfsLlInode *root;
+   uint32 i;
+
+   pthread_mutex_init(&gHgfsLlTable.lock, NULL);
+   for (i = 0; i < HGFS_LL_HASH_BUCKETS; i++) {
+      INIT_LIST_HEAD(&gHgfsLlTable.byId[i]);
+      INIT_LIST_HEAD(&gHgfsLlTable.byPath[i]);
+   }
+   gHgfsLlTable.nextIno = FUSE_ROOT_ID + 1;
+
+   root = calloc(1, sizeof *root);
+   if (root == NULL || (root->path = strdup("/")) == NULL) {
+      free(root);
+      return -ENOMEM;
+   }
+   root->ino = FUSE_ROOT_ID;
+   root->nlookup = 1;
+   list_add(&root->idLink, &gHgfsLlTable.byId[root->ino % HGFS_LL_HASH_BUCKETS]);
+   list_add(&root->pathLink, HgfsLlPathBucket(root->path));
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlJoinPath --
+ *
+ *    Build the relative path of the entry called name in directory dir.
+ *
+ * Results:
+ *    The allocated path, or NULL if out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+HgfsLlJoinPath(const char *dir,   // IN: Relative path of the directory
+               const char *name)  // IN: Entry name
+{
+   return Str_Asprintf(NULL, "%s/%s", strcmp(dir, "/") == 0 ? "" : dir, name);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlAbsPath --
+ *
+ *    Build the HGFS path of a relative path, as getAbsPath does for the
+ *    high-level API.
+ *
+ * Results:
+ *    The allocated path, or NULL if out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+HgfsLlAbsPath(const char *path)  // IN: Relative path
+{
+   return Str_Asprintf(NULL, "%s%s",
+                       gState->basePath != NULL ? gState->basePath : "", path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlGetPath --
+ *
+ *    Get the paths of an inode, or of the entry called name in the
+ *    directory inode.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure. On success
+ *    the caller frees *path and *absPath.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLlGetPath(fuse_ino_t ino,          // IN: Node id
+              const char *name,        // IN: Entry name or NULL
+              char **path,             // OUT: Path relative to the mount
+              char **absPath,          // OUT: HGFS path
+              HgfsHandle *handle)      // OUT: Open handle, optional
+{
+   HgfsLlInode *inode;
+   int res = 0;
+
+   *path = NULL;
+   *absPath = NULL;
+   if (name != NULL && strlen(name) > NAME_MAX) {
+      return -ENAMETOOLONG;
+   }
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindIno(ino);
+   if (inode == NULL) {
+      res = -ESTALE;
+      goto exit;
+   }
+   if (inode->path == NULL) {
+      res = -ENOENT;
+      goto exit;
+   }
+
+   if (name == NULL) {
+      *path = strdup(inode->path);
+   } else {
+      *path = HgfsLlJoinPath(inode->path, name);
+   }
+   if (handle != NULL) {
+      *handle = HgfsLlInodeHandle(inode);
+   }
+
+exit:
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+   if (res == 0) {
+      if (*path != NULL) {
+         *absPath = HgfsLlAbsPath(*path);
+      }
+      if (*absPath == NULL) {
+         free(*path);
+         *path = NULL;
+         res = -ENOMEM;
+      }
+   }
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlRef --
+ *
+ *    Take a kernel reference on the inode for path, creating it if
+ *    needed. Every reference is dropped by a later forget.
+ *
+ * Results:
+ *    The node id, or 0 if out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static fuse_ino_t
+HgfsLlRef(const char *path)  // IN: Relative path
+{
+   HgfsLlInode *inode;
+   fuse_ino_t ino = 0;
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindPath(path);
+   if (inode == NULL) {
+      inode = calloc(1, sizeof *inode);
+      if (inode == NULL || (inode->path = strdup(path)) == NULL) {
+         free(inode);
+         goto exit;
+      }
+      inode->ino = gHgfsLlTable.nextIno++;
+      list_add(&inode->idLink,
+               &gHgfsLlTable.byId[inode->ino % HGFS_LL_HASH_BUCKETS]);
+      list_add(&inode->pathLink, HgfsLlPathBucket(inode->path));
+   }
+   inode->nlookup++;
+   ino = inode->ino;
+
+exit:
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+   return ino;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlUnref --
+ *
+ *    Drop kernel references on an inode, freeing it with the last one.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlUnref(fuse_ino_t ino,     // IN: Node id
+            uint64 nlookup)     // IN: References to drop
+{
+   HgfsLlInode *inode;
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindIno(ino);
+   if (inode != NULL && ino != FUSE_ROOT_ID) {
+      inode->nlookup -= MIN(nlookup, inode->nlookup);
+      if (inode->nlookup == 0) {
+         HgfsLlDetachLocked(inode);
+         list_del(&inode->idLink);
+         free(inode->handles);
+         free(inode);
+      }
+   }
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlDetach --
+ *
+ *    Called after path was removed on the host.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlDetach(const char *path)  // IN: Relative path
+{
+   HgfsLlInode *inode;
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindPath(path);
+   if (inode != NULL) {
+      HgfsLlDetachLocked(inode);
+   }
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlRename --
+ *
+ *    Called after from was renamed to to on the host. Moves the inode
+ *    of from, and of everything below it, to the new name.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Any inode for the old to is detached.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlRename(const char *from,  // IN: Old relative path
+             const char *to)    // IN: New relative path
+{
+   size_t fromLen = strlen(from);
+   HgfsLlInode *inode;
+   uint32 i;
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindPath(to);
+   if (inode != NULL) {
+      HgfsLlDetachLocked(inode);
+   }
+
+   for (i = 0; i < HGFS_LL_HASH_BUCKETS; i++) {
+      list_for_each_entry(inode, &gHgfsLlTable.byId[i], idLink) {
+         char *newPath;
+
+         if (inode->path == NULL ||
+             strncmp(inode->path, from, fromLen) != 0 ||
+             (inode->path[fromLen] != '\0' && inode->path[fromLen] != '/')) {
+            continue;
+         }
+
+         newPath = Str_Asprintf(NULL, "%s%s", to, inode->path + fromLen);
+         HgfsLlDetachLocked(inode);
+         if (newPath != NULL) {
+            inode->path = newPath;
+            list_add(&inode->pathLink, HgfsLlPathBucket(newPath));
+         }
+      }
+   }
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlSetHandle --
+ *
+ *    Remember an open handle for getattr on the inode, or forget it when
+ *    it is released. Every handle is tracked so that releasing one opener
+ *    leaves the others usable; should the set fail to grow the handle is
+ *    simply not tracked and getattr falls back to the path.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlSetHandle(fuse_ino_t ino,      // IN: Node id
+                HgfsHandle handle,   // IN: Handle
+                Bool open)           // IN: TRUE on open, FALSE on release
+{
+   HgfsLlInode *inode;
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindIno(ino);
+   if (inode == NULL) {
+      goto exit;
+   }
+
+   if (open) {
+      if (inode->numHandles == inode->maxHandles) {
+         uint32 maxHandles = MAX(2 * inode->maxHandles, 2);
+         HgfsHandle *handles;
+
+         handles = realloc(inode->handles, maxHandles * sizeof *handles);
+         if (handles == NULL) {
+            goto exit;
+         }
+         inode->handles = handles;
+         inode->maxHandles = maxHandles;
+      }
+      inode->handles[inode->numHandles++] = handle;
+   } else {
+      uint32 i;
+
+      for (i = 0; i < inode->numHandles; i++) {
+         if (inode->handles[i] == handle) {
+            inode->numHandles--;
+            memmove(&inode->handles[i], &inode->handles[i + 1],
+                    (inode->numHandles - i) * sizeof inode->handles[0]);
+            break;
+         }
+      }
+   }
+
+exit:
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlGetDetachedHandle --
+ *
+ *    Get the open handle of an inode whose file was removed, through
+ *    which its attributes can still be read.
+ *
+ * Results:
+ *    The handle, or HGFS_INVALID_HANDLE if the inode still has a path or
+ *    is not open.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsLlGetDetachedHandle(fuse_ino_t ino)  // IN: Node id
+{
+   HgfsLlInode *inode;
+   HgfsHandle handle = HGFS_INVALID_HANDLE;
+
+   pthread_mutex_lock(&gHgfsLlTable.lock);
+   inode = HgfsLlFindIno(ino);
+   if (inode != NULL && inode->path == NULL) {
+      handle = HgfsLlInodeHandle(inode);
+   }
+   pthread_mutex_unlock(&gHgfsLlTable.lock);
+   return handle;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlGetattr --
+ *
+ *    Get the attributes of a file from the attribute cache or the server.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    The attribute cache is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLlGetattr(const char *absPath,   // IN: HGFS path
+              HgfsHandle handle,     // IN: Open handle or HGFS_INVALID_HANDLE
+              HgfsAttrInfo *attr)    // OUT: Attributes
+{
+   uint64 start = HgfsStatsStart();
+   uint32 negGen;
+   int res;
+
+   memset(attr, 0, sizeof *attr);
+   res = HgfsGetAttrCache(absPath, attr);
+   if (res == 0 || res == -ENOENT) {
+      goto exit;
+   }
+
+   negGen = HgfsGetNegativeCacheGen(absPath);
+   res = HgfsPrivateGetattr(handle, absPath, attr);
+   if (res == -EBADF && handle != HGFS_INVALID_HANDLE) {
+      /* The handle was closed under us. */
+      res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, absPath, attr);
+   }
+   free(attr->fileName);
+   attr->fileName = NULL;
+   if (res == 0) {
+      HgfsSetAttrCache(absPath, attr);
+   } else if (res == -ENOENT) {
+      HgfsSetNegativeCache(absPath, negGen);
+   }
+
+exit:
+   HgfsStatsEnd(HGFS_STAT_GETATTR, start, res);
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlFillEntry --
+ *
+ *    Fill in the entry for path and take a kernel reference on its inode.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLlFillEntry(const char *path,                // IN: Relative path
+                const char *absPath,             // IN: HGFS path
+                struct fuse_entry_param *entry)  // OUT: Entry
+{
+   HgfsAttrInfo attr;
+   int res;
+
+   memset(entry, 0, sizeof *entry);
+   res = HgfsLlGetattr(absPath, HGFS_INVALID_HANDLE, &attr);
+   if (res < 0) {
+      return res;
+   }
+
+   entry->ino = HgfsLlRef(path);
+   if (entry->ino == 0) {
+      return -ENOMEM;
+   }
+   entry->generation = 1;
+   HgfsAttrToStat(&attr, &entry->attr);
+   if ((attr.mask & HGFS_ATTR_VALID_FILEID) == 0) {
+      entry->attr.st_ino = entry->ino;
+   }
+   entry->attr_timeout = HGFS_DEFAULT_TTL;
+   entry->entry_timeout = HGFS_DEFAULT_TTL;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlReplyEntry --
+ *
+ *    Reply to a request creating or looking up the entry called name in
+ *    directory parent.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlReplyEntry(fuse_req_t req,      // IN: Request
+                 const char *path,    // IN: Relative path
+                 const char *absPath) // IN: HGFS path
+{
+   struct fuse_entry_param entry;
+   int res;
+
+   res = HgfsLlFillEntry(path, absPath, &entry);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else if (fuse_reply_entry(req, &entry) != 0) {
+      /* The request was interrupted, the kernel did not take the reference. */
+      HgfsLlUnref(entry.ino, 1);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_init
+ *
+ *    Initialization routine.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_init(void *userdata,              // IN: unused
+             struct fuse_conn_info *conn) // IN/OUT: Connection info
+{
+   LOG(4, ("Entry()\n"));
+#if FUSE_MAJOR_VERSION == 3
+   if (conn->capable & FUSE_CAP_READDIRPLUS) {
+      conn->want |= FUSE_CAP_READDIRPLUS;
+   }
+#endif
+   HgfsMountInit();
+   LOG(4, ("Exit()\n"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_destroy
+ *
+ *    Cleanup routine.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_destroy(void *userdata) // IN: unused
+{
+   LOG(4, ("Entry()\n"));
+   HgfsMountExit();
+   LOG(4, ("Exit()\n"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_lookup
+ *
+ *    Look up the entry called name in directory parent.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_lookup(fuse_req_t req,     // IN: Request
+               fuse_ino_t parent,  // IN: Directory
+               const char *name)   // IN: Entry name
+{
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(parent = %lu, name = %s)\n", (unsigned long)parent, name));
+   res = HgfsLlGetPath(parent, name, &path, &absPath, NULL);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      goto exit;
+   }
+
+   HgfsLlReplyEntry(req, path, absPath);
+
+exit:
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_forget
+ *
+ *    Drop kernel references on an inode.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+#if FUSE_MAJOR_VERSION == 3
+static void
+hgfs_ll_forget(fuse_req_t req,      // IN: Request
+               fuse_ino_t ino,      // IN: Inode
+               uint64_t nlookup)    // IN: References to drop
+#else
+static void
+hgfs_ll_forget(fuse_req_t req,        // IN: Request
+               fuse_ino_t ino,        // IN: Inode
+               unsigned long nlookup) // IN: References to drop
+#endif
+{
+   HgfsLlUnref(ino, nlookup);
+   fuse_reply_none(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_getattr
+ *
+ *    Get the attributes of an inode.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_getattr(fuse_req_t req,             // IN: Request
+                fuse_ino_t ino,             // IN: Inode
+                struct fuse_file_info *fi)  // IN: unused
+{
+   HgfsHandle handle;
+   HgfsAttrInfo attr;
+   struct stat st;
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu)\n", (unsigned long)ino));
+   res = HgfsLlGetPath(ino, NULL, &path, &absPath, &handle);
+   if (res == -ENOENT) {
+      /* Removed while open, as after an unlink of an open file. */
+      handle = HgfsLlGetDetachedHandle(ino);
+      if (handle != HGFS_INVALID_HANDLE) {
+         memset(&attr, 0, sizeof attr);
+         res = HgfsPrivateGetattr(handle, NULL, &attr);
+         free(attr.fileName);
+      }
+   } else if (res == 0) {
+      res = HgfsLlGetattr(absPath, handle, &attr);
+   }
+   if (res < 0) {
+      goto exit;
+   }
+
+   HgfsAttrToStat(&attr, &st);
+   if ((attr.mask & HGFS_ATTR_VALID_FILEID) == 0) {
+      st.st_ino = ino;
+   }
+   fuse_reply_attr(req, &st, HGFS_DEFAULT_TTL);
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   }
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_setattr
+ *
+ *    Change the attributes of an inode. All the changes the kernel asks
+ *    for are sent to the server in a single setattr request.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_setattr(fuse_req_t req,             // IN: Request
+                fuse_ino_t ino,             // IN: Inode
+                struct stat *stbuf,         // IN: New attributes
+                int toSet,                  // IN: FUSE_SET_ATTR_* mask
+                struct fuse_file_info *fi)  // IN: unused
+{
+   HgfsHandle handle;
+   HgfsAttrInfo attr;
+   struct stat st;
+   char *path;
+   char *absPath;
+   uint64 now = HGFS_GET_TIME(time(NULL));
+   int res;
+
+   LOG(4, ("Entry(ino = %lu, toSet = %#x)\n", (unsigned long)ino, toSet));
+   res = HgfsLlGetPath(ino, NULL, &path, &absPath, &handle);
+   if (res < 0) {
+      goto exit;
+   }
+
+   memset(&attr, 0, sizeof attr);
+   if (toSet & FUSE_SET_ATTR_MODE) {
+      attr.mask |= (HGFS_ATTR_VALID_SPECIAL_PERMS |
+                    HGFS_ATTR_VALID_OWNER_PERMS |
+                    HGFS_ATTR_VALID_GROUP_PERMS |
+                    HGFS_ATTR_VALID_OTHER_PERMS);
+      attr.specialPerms = (stbuf->st_mode & (S_ISUID | S_ISGID | S_ISVTX)) >> 9;
+      attr.ownerPerms = (stbuf->st_mode & S_IRWXU) >> 6;
+      attr.groupPerms = (stbuf->st_mode & S_IRWXG) >> 3;
+      attr.otherPerms = stbuf->st_mode & S_IRWXO;
+   }
+   if (toSet & FUSE_SET_ATTR_UID) {
+      attr.mask |= HGFS_ATTR_VALID_USERID;
+      attr.userId = stbuf->st_uid;
+   }
+   if (toSet & FUSE_SET_ATTR_GID) {
+      attr.mask |= HGFS_ATTR_VALID_GROUPID;
+      attr.groupId = stbuf->st_gid;
+   }
+   if (toSet & FUSE_SET_ATTR_SIZE) {
+      attr.mask |= HGFS_ATTR_VALID_SIZE;
+      attr.size = stbuf->st_size;
+   }
+   if (toSet & FUSE_SET_ATTR_ATIME_NOW) {
+      attr.mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+      attr.accessTime = now;
+   } else if (toSet & FUSE_SET_ATTR_ATIME) {
+      attr.mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+#if defined(__linux__)
+      attr.accessTime = HgfsConvertToNtTime(stbuf->st_atim.tv_sec,
+                                            stbuf->st_atim.tv_nsec);
+#else
+      attr.accessTime = HGFS_GET_TIME(stbuf->st_atime);
+#endif
+   }
+   if (toSet & FUSE_SET_ATTR_MTIME_NOW) {
+      attr.mask |= HGFS_ATTR_VALID_WRITE_TIME;
+      attr.writeTime = now;
+   } else if (toSet & FUSE_SET_ATTR_MTIME) {
+      attr.mask |= HGFS_ATTR_VALID_WRITE_TIME;
+#if defined(__linux__)
+      attr.writeTime = HgfsConvertToNtTime(stbuf->st_mtim.tv_sec,
+                                           stbuf->st_mtim.tv_nsec);
+#else
+      attr.writeTime = HGFS_GET_TIME(stbuf->st_mtime);
+#endif
+   }
+
+   if (attr.mask & (HGFS_ATTR_VALID_ACCESS_TIME | HGFS_ATTR_VALID_WRITE_TIME)) {
+      HgfsAttrInfo current;
+
+      /* As with hgfs_utimens, times are not set on symlinks. */
+      if (HgfsLlGetattr(absPath, handle, &current) == 0 &&
+          current.type == HGFS_FILE_TYPE_SYMLINK) {
+         attr.mask &= ~(HGFS_ATTR_VALID_ACCESS_TIME |
+                        HGFS_ATTR_VALID_WRITE_TIME);
+      }
+   }
+
+   if (attr.mask != 0) {
+      res = HgfsSetattr(absPath, &attr);
+      HgfsInvalidateAttrCache(absPath);
+      if (res < 0) {
+         LOG(4, ("path = %s , HgfsSetattr failed. res = %d\n", absPath, res));
+         goto exit;
+      }
+   }
+
+   /* Retrieve new complete attribute settings and update the cache. */
+   res = HgfsLlGetattr(absPath, handle, &attr);
+   if (res < 0) {
+      goto exit;
+   }
+
+   HgfsAttrToStat(&attr, &st);
+   if ((attr.mask & HGFS_ATTR_VALID_FILEID) == 0) {
+      st.st_ino = ino;
+   }
+   fuse_reply_attr(req, &st, HGFS_DEFAULT_TTL);
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   }
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_readlink
+ *
+ *    Read the target of a symbolic link.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_readlink(fuse_req_t req,  // IN: Request
+                 fuse_ino_t ino)  // IN: Inode
+{
+   HgfsAttrInfo attr = {0};
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu)\n", (unsigned long)ino));
+   res = HgfsLlGetPath(ino, NULL, &path, &absPath, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+
+   /* The attributes fileName field will hold the symlink target name. */
+   res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, absPath, &attr);
+   if (res < 0) {
+      goto exit;
+   }
+   if (attr.fileName == NULL) {
+      res = -EINVAL;
+      goto exit;
+   }
+   fuse_reply_readlink(req, attr.fileName);
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   }
+   LOG(4, ("Exit(%d)\n", res));
+   free(attr.fileName);
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_mkdir
+ *
+ *    Create a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_mkdir(fuse_req_t req,     // IN: Request
+              fuse_ino_t parent,  // IN: Parent directory
+              const char *name,   // IN: Directory name
+              mode_t mode)        // IN: Mode of the directory
+{
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(parent = %lu, name = %s, mode = %#o)\n",
+           (unsigned long)parent, name, mode));
+   res = HgfsLlGetPath(parent, name, &path, &absPath, NULL);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      goto exit;
+   }
+
+   res = HgfsMkdir(absPath, mode);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      goto exit;
+   }
+   HgfsInvalidateAttrCache(absPath);
+   HgfsLlReplyEntry(req, path, absPath);
+
+exit:
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_remove
+ *
+ *    Delete a file or directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_remove(fuse_req_t req,     // IN: Request
+               fuse_ino_t parent,  // IN: Parent directory
+               const char *name,   // IN: Entry name
+               HgfsOp op)          // IN: Delete file or directory
+{
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(parent = %lu, name = %s)\n", (unsigned long)parent, name));
+   res = HgfsLlGetPath(parent, name, &path, &absPath, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsDelete(absPath, op);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(absPath);
+      HgfsLlDetach(path);
+   }
+
+exit:
+   fuse_reply_err(req, -res);
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+static void
+hgfs_ll_unlink(fuse_req_t req,     // IN: Request
+               fuse_ino_t parent,  // IN: Parent directory
+               const char *name)   // IN: File name
+{
+   hgfs_ll_remove(req, parent, name, HGFS_OP_DELETE_FILE);
+}
+
+
+static void
+hgfs_ll_rmdir(fuse_req_t req,     // IN: Request
+              fuse_ino_t parent,  // IN: Parent directory
+              const char *name)   // IN: Directory name
+{
+   hgfs_ll_remove(req, parent, name, HGFS_OP_DELETE_DIR);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_symlink
+ *
+ *    Create a symbolic link.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_symlink(fuse_req_t req,      // IN: Request
+                const char *link,    // IN: Link target
+                fuse_ino_t parent,   // IN: Parent directory
+                const char *name)    // IN: Link name
+{
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(link = %s, parent = %lu, name = %s)\n",
+           link, (unsigned long)parent, name));
+   res = HgfsLlGetPath(parent, name, &path, &absPath, NULL);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      goto exit;
+   }
+
+   res = HgfsSymlink(absPath, link);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      goto exit;
+   }
+   HgfsInvalidateAttrCache(absPath);
+   HgfsLlReplyEntry(req, path, absPath);
+
+exit:
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_rename
+ *
+ *    Rename a file or directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+#if FUSE_MAJOR_VERSION == 3
+static void
+hgfs_ll_rename(fuse_req_t req,         // IN: Request
+               fuse_ino_t parent,      // IN: Old parent directory
+               const char *name,       // IN: Old name
+               fuse_ino_t newParent,   // IN: New parent directory
+               const char *newName,    // IN: New name
+               unsigned int flags)     // IN: RENAME_* flags
+#else
+static void
+hgfs_ll_rename(fuse_req_t req,         // IN: Request
+               fuse_ino_t parent,      // IN: Old parent directory
+               const char *name,       // IN: Old name
+               fuse_ino_t newParent,   // IN: New parent directory
+               const char *newName)    // IN: New name
+#endif
+{
+   char *from = NULL;
+   char *absFrom = NULL;
+   char *to = NULL;
+   char *absTo = NULL;
+   int res;
+
+   LOG(4, ("Entry(from = %s, to = %s)\n", name, newName));
+#if FUSE_MAJOR_VERSION == 3
+   if (flags != 0) {
+      res = -EINVAL;
+      goto exit;
+   }
+#endif
+   res = HgfsLlGetPath(parent, name, &from, &absFrom, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+   res = HgfsLlGetPath(newParent, newName, &to, &absTo, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsRename(absFrom, absTo);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(absFrom);
+      HgfsInvalidateAttrCache(absTo);
+      HgfsLlRename(from, to);
+   }
+
+exit:
+   fuse_reply_err(req, -res);
+   LOG(4, ("Exit(%d)\n", res));
+   free(from);
+   free(absFrom);
+   free(to);
+   free(absTo);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_open
+ *
+ *    Open a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_open(fuse_req_t req,             // IN: Request
+             fuse_ino_t ino,             // IN: Inode
+             struct fuse_file_info *fi)  // IN/OUT: File info
+{
+   char *path;
+   char *absPath;
+   uint64 start = HgfsStatsStart();
+   int res;
+
+   LOG(4, ("Entry(ino = %lu)\n", (unsigned long)ino));
+   res = HgfsLlGetPath(ino, NULL, &path, &absPath, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsOpen(absPath, fi);
+   if (res < 0) {
+      goto exit;
+   }
+   HgfsLlSetHandle(ino, fi->fh, TRUE);
+   if (fuse_reply_open(req, fi) != 0) {
+      HgfsLlSetHandle(ino, fi->fh, FALSE);
+      HgfsRelease(fi->fh);
+   }
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   }
+   HgfsStatsEnd(HGFS_STAT_OPEN, start, res);
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_create
+ *
+ *    Create and open a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_create(fuse_req_t req,             // IN: Request
+               fuse_ino_t parent,          // IN: Parent directory
+               const char *name,           // IN: File name
+               mode_t mode,                // IN: File mode
+               struct fuse_file_info *fi)  // IN/OUT: File info
+{
+   struct fuse_entry_param entry;
+   char *path;
+   char *absPath;
+   uint64 start = HgfsStatsStart();
+   int res;
+
+   LOG(4, ("Entry(parent = %lu, name = %s, mode = %#o)\n",
+           (unsigned long)parent, name, mode));
+   res = HgfsLlGetPath(parent, name, &path, &absPath, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsCreate(absPath, mode, fi);
+   if (res < 0) {
+      goto exit;
+   }
+   HgfsInvalidateAttrCache(absPath);
+
+   res = HgfsLlFillEntry(path, absPath, &entry);
+   if (res < 0) {
+      HgfsRelease(fi->fh);
+      goto exit;
+   }
+   HgfsLlSetHandle(entry.ino, fi->fh, TRUE);
+   if (fuse_reply_create(req, &entry, fi) != 0) {
+      HgfsLlSetHandle(entry.ino, fi->fh, FALSE);
+      HgfsRelease(fi->fh);
+      HgfsLlUnref(entry.ino, 1);
+   }
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   }
+   HgfsStatsEnd(HGFS_STAT_OPEN, start, res);
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_read
+ *
+ *    Read from an open file. Unlike hgfs_read there is always a handle.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_read(fuse_req_t req,             // IN: Request
+             fuse_ino_t ino,             // IN: Inode
+             size_t size,                // IN: Bytes to read
+             off_t offset,               // IN: Offset to read at
+             struct fuse_file_info *fi)  // IN: File info
+{
+   char *buf;
+   char *path = NULL;
+   char *absPath = NULL;
+   uint64 start = HgfsStatsStart();
+   ssize_t res;
+
+   LOG(4, ("Entry(fi->fh = %#"FMT64"x, %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
+           fi->fh, size, offset));
+   buf = malloc(size);
+   if (buf == NULL) {
+      res = -ENOMEM;
+      fuse_reply_err(req, ENOMEM);
+      goto exit;
+   }
+
+   /* Without a path the read still flushes its own handle's writes. */
+   (void)HgfsLlGetPath(ino, NULL, &path, &absPath, NULL);
+   res = HgfsRead(absPath, fi, buf, size, offset);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_buf(req, buf, res);
+   }
+   free(buf);
+
+exit:
+   HgfsStatsEnd(HGFS_STAT_READ, start, res);
+   LOG(4, ("Exit(%"FMTSZ"d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_write
+ *
+ *    Write to an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_write(fuse_req_t req,             // IN: Request
+              fuse_ino_t ino,             // IN: Inode
+              const char *buf,            // IN: Data to write
+              size_t size,                // IN: Bytes to write
+              off_t offset,               // IN: Offset to write at
+              struct fuse_file_info *fi)  // IN: File info
+{
+   char *path;
+   char *absPath;
+   uint64 start = HgfsStatsStart();
+   ssize_t res;
+
+   LOG(4, ("Entry(fi->fh = %#"FMT64"x, write %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
+           fi->fh, size, offset));
+   if (HgfsLlGetPath(ino, NULL, &path, &absPath, NULL) != 0) {
+      /* Detached inode: nothing to buffer against, write through. */
+      res = HgfsWrite(fi, buf, size, offset);
+      path = NULL;
+      absPath = NULL;
+   } else {
+      res = HgfsWriteBuffered(fi, absPath, buf, size, offset);
+   }
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_write(req, res);
+   }
+
+   /* Even a failed write may have changed the size or times. */
+   if (absPath != NULL) {
+      HgfsInvalidateAttrCache(absPath);
+      free(path);
+      free(absPath);
+   }
+   HgfsStatsEnd(HGFS_STAT_WRITE, start, res);
+   LOG(4, ("Exit(%"FMTSZ"d)\n", res));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_release
+ *
+ *    Release an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_release(fuse_req_t req,             // IN: Request
+                fuse_ino_t ino,             // IN: Inode
+                struct fuse_file_info *fi)  // IN: File info
+{
+   int res;
+
+   LOG(4, ("Entry(fi->fh = %#"FMT64"x)\n", fi->fh));
+   HgfsLlSetHandle(ino, fi->fh, FALSE);
+   res = HgfsRelease(fi->fh);
+   fuse_reply_err(req, -res);
+   LOG(4, ("Exit(%d)\n", res));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_flush
+ *
+ *    Called on each close of a file descriptor. Writes out buffered data.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_flush(fuse_req_t req,             // IN: Request
+              fuse_ino_t ino,             // IN: Inode
+              struct fuse_file_info *fi)  // IN: File info
+{
+   int res;
+
+   LOG(4, ("Entry(fi->fh = %#"FMT64"x)\n", fi->fh));
+   res = HgfsWriteBackFlush(fi->fh);
+   fuse_reply_err(req, -res);
+   LOG(4, ("Exit(%d)\n", res));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_fsync
+ *
+ *    Synchronize an open file by writing out its buffered data.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_fsync(fuse_req_t req,             // IN: Request
+              fuse_ino_t ino,             // IN: Inode
+              int datasync,               // IN: Only sync data
+              struct fuse_file_info *fi)  // IN: File info
+{
+   int res;
+
+   LOG(4, ("Entry(fi->fh = %#"FMT64"x)\n", fi->fh));
+   res = HgfsWriteBackFlush(fi->fh);
+   fuse_reply_err(req, -res);
+   LOG(4, ("Exit(%d)\n", res));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlDirFill --
+ *
+ *    Filler passed to HgfsReaddir; appends one entry to an HgfsLlDir.
+ *
+ * Results:
+ *    Zero on success, 1 if out of memory (stops the listing).
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+#if FUSE_MAJOR_VERSION == 3
+static int
+HgfsLlDirFill(void *buf,                        // IN: HgfsLlDir
+              const char *name,                 // IN: Entry name
+              const struct stat *stbuf,         // IN: Entry type and inode
+              off_t off,                        // IN: unused
+              enum fuse_fill_dir_flags flags)   // IN: unused
+#else
+static int
+HgfsLlDirFill(void *buf,                        // IN: HgfsLlDir
+              const char *name,                 // IN: Entry name
+              const struct stat *stbuf,         // IN: Entry type and inode
+              off_t off)                        // IN: unused
+#endif
+{
+   HgfsLlDir *dir = buf;
+   HgfsLlDirEntry *entry;
+
+   if (dir->numEntries == dir->maxEntries) {
+      uint32 maxEntries = MAX(2 * dir->maxEntries, 64);
+      HgfsLlDirEntry *entries;
+
+      entries = realloc(dir->entries, maxEntries * sizeof *entries);
+      if (entries == NULL) {
+         return 1;
+      }
+      dir->entries = entries;
+      dir->maxEntries = maxEntries;
+   }
+
+   entry = &dir->entries[dir->numEntries];
+   entry->name = strdup(name);
+   if (entry->name == NULL) {
+      return 1;
+   }
+   entry->st = *stbuf;
+   dir->numEntries++;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlDirFree --
+ *
+ *    Free the entries read into an HgfsLlDir.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlDirFree(HgfsLlDir *dir)  // IN/OUT: Directory
+{
+   uint32 i;
+
+   for (i = 0; i < dir->numEntries; i++) {
+      free(dir->entries[i].name);
+   }
+   free(dir->entries);
+   dir->entries = NULL;
+   dir->numEntries = 0;
+   dir->maxEntries = 0;
+   dir->filled = FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlDirRead --
+ *
+ *    Make sure the entries of an open directory have been read. A read
+ *    from offset zero after the first (rewinddir) starts a new search so
+ *    that it sees the current contents.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    Entries with V3 attributes are added to the attribute cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLlDirRead(HgfsLlDir *dir,  // IN/OUT: Directory
+              off_t offset)    // IN: Offset of the read
+{
+   int res;
+
+   if (dir->filled && offset == 0) {
+      HgfsHandle handle;
+
+      res = HgfsDirOpen(dir->absPath, &handle);
+      if (res < 0) {
+         return res;
+      }
+      HgfsDirClose(dir->handle);
+      dir->handle = handle;
+      HgfsLlDirFree(dir);
+   }
+   if (dir->filled) {
+      return 0;
+   }
+
+   res = HgfsReaddir(dir->absPath, dir->handle, dir, HgfsLlDirFill);
+   if (res < 0) {
+      HgfsLlDirFree(dir);
+      return res;
+   }
+   dir->filled = TRUE;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_opendir
+ *
+ *    Open a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_opendir(fuse_req_t req,             // IN: Request
+                fuse_ino_t ino,             // IN: Inode
+                struct fuse_file_info *fi)  // IN/OUT: File info
+{
+   HgfsLlDir *dir;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu)\n", (unsigned long)ino));
+   dir = calloc(1, sizeof *dir);
+   if (dir == NULL) {
+      res = -ENOMEM;
+      goto exit;
+   }
+
+   res = HgfsLlGetPath(ino, NULL, &dir->path, &dir->absPath, NULL);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsDirOpen(dir->absPath, &dir->handle);
+   if (res < 0) {
+      goto exit;
+   }
+
+   pthread_mutex_init(&dir->lock, NULL);
+   fi->fh = (uintptr_t)dir;
+   if (fuse_reply_open(req, fi) != 0) {
+      HgfsDirClose(dir->handle);
+      pthread_mutex_destroy(&dir->lock);
+      res = -EINTR;
+      goto exit;
+   }
+   LOG(4, ("Exit(0)\n"));
+   return;
+
+exit:
+   if (res != -EINTR) {
+      fuse_reply_err(req, -res);
+   }
+   if (dir != NULL) {
+      free(dir->path);
+      free(dir->absPath);
+      free(dir);
+   }
+   LOG(4, ("Exit(%d)\n", res));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLlReaddirInt --
+ *
+ *    Reply to a readdir or readdirplus request from the entries read
+ *    into the directory. The offset of an entry is its index plus one.
+ *
+ *    For readdirplus, entries whose attributes are in the attribute cache
+ *    are returned with them and a kernel reference on their inode, so the
+ *    kernel need not look them up. The others are returned like a plain
+ *    readdir would. Should the reply not reach the kernel, those
+ *    references are dropped again.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLlReaddirInt(fuse_req_t req,             // IN: Request
+                 size_t size,                // IN: Reply buffer size
+                 off_t offset,               // IN: First entry
+                 struct fuse_file_info *fi,  // IN: File info
+                 Bool plus)                  // IN: Readdirplus
+{
+   HgfsLlDir *dir = (HgfsLlDir *)(uintptr_t)fi->fh;
+   char *buf;
+   size_t used = 0;
+   off_t i;
+   fuse_ino_t *refs = NULL;     /* Inodes referenced by readdirplus. */
+   uint32 numRefs = 0;
+   uint64 start = HgfsStatsStart();
+   int res;
+
+   LOG(4, ("Entry(%s @ %#"FMT64"x)\n", dir->path, offset));
+   buf = malloc(size);
+   if (buf == NULL) {
+      fuse_reply_err(req, ENOMEM);
+      return;
+   }
+
+   pthread_mutex_lock(&dir->lock);
+   res = HgfsLlDirRead(dir, offset);
+   if (res < 0) {
+      goto exit;
+   }
+
+   if (plus && MAX(offset, 0) < dir->numEntries) {
+      refs = malloc((dir->numEntries - MAX(offset, 0)) * sizeof *refs);
+      if (refs == NULL) {
+         res = -ENOMEM;
+         goto exit;
+      }
+   }
+
+   for (i = MAX(offset, 0); i < dir->numEntries; i++) {
+      HgfsLlDirEntry *entry = &dir->entries[i];
+      size_t entrySize;
+
+#if FUSE_MAJOR_VERSION == 3
+      if (plus) {
+         struct fuse_entry_param param;
+         Bool isDot = strcmp(entry->name, ".") == 0 ||
+                      strcmp(entry->name, "..") == 0;
+
+         entrySize = fuse_add_direntry_plus(req, NULL, 0, entry->name, NULL, 0);
+         if (used + entrySize > size) {
+            break;
+         }
+
+         memset(&param, 0, sizeof param);
+         param.attr = entry->st;
+         if (!isDot) {
+            HgfsAttrInfo attr;
+            char *path;
+            char *absPath;
+
+            path = HgfsLlJoinPath(dir->path, entry->name);
+            absPath = path != NULL ? HgfsLlAbsPath(path) : NULL;
+            if (absPath != NULL &&
+                HgfsGetAttrCache(absPath, &attr) == 0) {
+               param.ino = HgfsLlRef(path);
+            }
+            if (param.ino != 0) {
+               refs[numRefs++] = param.ino;
+               param.generation = 1;
+               HgfsAttrToStat(&attr, &param.attr);
+               if ((attr.mask & HGFS_ATTR_VALID_FILEID) == 0) {
+                  param.attr.st_ino = param.ino;
+               }
+               param.attr_timeout = HGFS_DEFAULT_TTL;
+               param.entry_timeout = HGFS_DEFAULT_TTL;
+            }
+            free(path);
+            free(absPath);
+         }
+         fuse_add_direntry_plus(req, buf + used, size - used, entry->name,
+                                &param, i + 1);
+      } else
+#endif
+      {
+         entrySize = fuse_add_direntry(req, NULL, 0, entry->name, NULL, 0);
+         if (used + entrySize > size) {
+            break;
+         }
+         fuse_add_direntry(req, buf + used, size - used, entry->name,
+                           &entry->st, i + 1);
+      }
+      used += entrySize;
+   }
+
+exit:
+   pthread_mutex_unlock(&dir->lock);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else if (fuse_reply_buf(req, buf, used) != 0) {
+      /* The kernel never saw the entries, so it will not forget them. */
+      while (numRefs > 0) {
+         HgfsLlUnref(refs[--numRefs], 1);
+      }
+   }
+   free(refs);
+   free(buf);
+   HgfsStatsEnd(HGFS_STAT_READDIR, start, res);
+   LOG(4, ("Exit(%d)\n", res));
+}
+
+
+static void
+hgfs_ll_readdir(fuse_req_t req,             // IN: Request
+                fuse_ino_t ino,             // IN: Inode
+                size_t size,                // IN: Reply buffer size
+                off_t offset,               // IN: First entry
+                struct fuse_file_info *fi)  // IN: File info
+{
+   HgfsLlReaddirInt(req, size, offset, fi, FALSE);
+}
+
+
+#if FUSE_MAJOR_VERSION == 3
+static void
+hgfs_ll_readdirplus(fuse_req_t req,             // IN: Request
+                    fuse_ino_t ino,             // IN: Inode
+                    size_t size,                // IN: Reply buffer size
+                    off_t offset,               // IN: First entry
+                    struct fuse_file_info *fi)  // IN: File info
+{
+   HgfsLlReaddirInt(req, size, offset, fi, TRUE);
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_releasedir
+ *
+ *    Release an open directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_releasedir(fuse_req_t req,             // IN: Request
+                   fuse_ino_t ino,             // IN: Inode
+                   struct fuse_file_info *fi)  // IN: File info
+{
+   HgfsLlDir *dir = (HgfsLlDir *)(uintptr_t)fi->fh;
+
+   LOG(4, ("Entry(%s)\n", dir->path));
+   HgfsDirClose(dir->handle);
+   HgfsLlDirFree(dir);
+   pthread_mutex_destroy(&dir->lock);
+   free(dir->path);
+   free(dir->absPath);
+   free(dir);
+   fuse_reply_err(req, 0);
+   LOG(4, ("Exit(0)\n"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_statfs
+ *
+ *    Get filesystem statistics.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_statfs(fuse_req_t req,  // IN: Request
+               fuse_ino_t ino)  // IN: Inode
+{
+   struct statvfs stbuf;
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu)\n", (unsigned long)ino));
+   res = HgfsLlGetPath(ino, NULL, &path, &absPath, NULL);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+      goto exit;
+   }
+
+   memset(&stbuf, 0, sizeof stbuf);
+   res = HgfsStatfs(absPath, &stbuf);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_statfs(req, &stbuf);
+   }
+
+exit:
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_ll_access
+ *
+ *    Check access permissions, as hgfs_access does.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+hgfs_ll_access(fuse_req_t req,  // IN: Request
+               fuse_ino_t ino,  // IN: Inode
+               int mask)        // IN: Mask
+{
+   HgfsHandle handle;
+   HgfsAttrInfo attr;
+   uint32 effectivePermissions;
+   char *path;
+   char *absPath;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu, mask = %#o)\n", (unsigned long)ino, mask));
+   res = HgfsLlGetPath(ino, NULL, &path, &absPath, &handle);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsLlGetattr(absPath, handle, &attr);
+   if (res < 0 || mask == F_OK) {
+      goto exit;
+   }
+
+   if (attr.mask & HGFS_ATTR_VALID_EFFECTIVE_PERMS) {
+      effectivePermissions = attr.effectivePerms;
+   } else {
+      /* Be optimistic, the host enforces the real permissions. */
+      effectivePermissions = (attr.ownerPerms |
+                              attr.groupPerms |
+                              attr.otherPerms);
+   }
+   if ((effectivePermissions & mask) != mask) {
+      res = -EACCES;
+   }
+
+exit:
+   fuse_reply_err(req, -res);
+   LOG(4, ("Exit(%d)\n", res));
+   free(path);
+   free(absPath);
+}
+
+
+/*--------------------------------------------------------------------------- */
+static struct fuse_lowlevel_ops vmhgfs_ll_operations = {
+   .init        = hgfs_ll_init,
+   .destroy     = hgfs_ll_destroy,
+   .lookup      = hgfs_ll_lookup,
+   .forget      = hgfs_ll_forget,
+   .getattr     = hgfs_ll_getattr,
+   .setattr     = hgfs_ll_setattr,
+   .readlink    = hgfs_ll_readlink,
+   .mkdir       = hgfs_ll_mkdir,
+   .unlink      = hgfs_ll_unlink,
+   .rmdir       = hgfs_ll_rmdir,
+   .symlink     = hgfs_ll_symlink,
+   .rename      = hgfs_ll_rename,
+   .open        = hgfs_ll_open,
+   .read        = hgfs_ll_read,
+   .write       = hgfs_ll_write,
+   .release     = hgfs_ll_release,
+   .flush       = hgfs_ll_flush,
+   .fsync       = hgfs_ll_fsync,
+   .opendir     = hgfs_ll_opendir,
+   .readdir     = hgfs_ll_readdir,
+#if FUSE_MAJOR_VERSION == 3
+   .readdirplus = hgfs_ll_readdirplus,
+#endif
+   .releasedir  = hgfs_ll_releasedir,
+   .statfs      = hgfs_ll_statfs,
+   .access      = hgfs_ll_access,
+   .create      = hgfs_ll_create,
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelMain --
+ *
+ *    Mount and serve the filesystem with the FUSE low-level API until it
+ *    is unmounted.
+ *
+ * Results:
+ *    Returns zero on success, or nonzero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsLowLevelMain(struct fuse_args *args)  // IN/OUT: Arguments
+{
+   struct fuse_session *se;
+   int res = 1;
+#if FUSE_MAJOR_VERSION == 3
+   struct fuse_cmdline_opts opts;
+   struct fuse_loop_config config;
+
+   if (HgfsLlInitTable() != 0 || fuse_parse_cmdline(args, &opts) != 0) {
+      return 1;
+   }
+   if (opts.mountpoint == NULL) {
+      fprintf(stderr, "No mountpoint specified!\n");
+      goto exit;
+   }
+
+   se = fuse_session_new(args, &vmhgfs_ll_operations,
+                         sizeof vmhgfs_ll_operations, NULL);
+   if (se == NULL) {
+      goto exit;
+   }
+   if (fuse_set_signal_handlers(se) != 0) {
+      goto destroy;
+   }
+   if (fuse_session_mount(se, opts.mountpoint) != 0) {
+      goto signals;
+   }
+
+   fuse_daemonize(opts.foreground);
+   if (opts.singlethread) {
+      res = fuse_session_loop(se);
+   } else {
+      config.clone_fd = opts.clone_fd;
+      config.max_idle_threads = opts.max_idle_threads;
+      res = fuse_session_loop_mt(se, &config);
+   }
+
+   fuse_session_unmount(se);
+signals:
+   fuse_remove_signal_handlers(se);
+destroy:
+   fuse_session_destroy(se);
+exit:
+   free(opts.mountpoint);
+#else
+   struct fuse_chan *ch;
+   char *mountpoint;
+   int multithreaded;
+   int foreground;
+
+   if (HgfsLlInitTable() != 0 ||
+       fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) != 0) {
+      return 1;
+   }
+   if (mountpoint == NULL) {
+      fprintf(stderr, "No mountpoint specified!\n");
+      return 1;
+   }
+
+   ch = fuse_mount(mountpoint, args);
+   if (ch == NULL) {
+      goto exit;
+   }
+   se = fuse_lowlevel_new(args, &vmhgfs_ll_operations,
+                          sizeof vmhgfs_ll_operations, NULL);
+   if (se == NULL) {
+      goto unmount;
+   }
+   if (fuse_set_signal_handlers(se) != 0) {
+      goto destroy;
+   }
+
+   fuse_session_add_chan(se, ch);
+   fuse_daemonize(foreground);
+   res = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+   fuse_remove_signal_handlers(se);
+   fuse_session_remove_chan(ch);
+destroy:
+   fuse_session_destroy(se);
+unmount:
+   fuse_unmount(mountpoint, ch);
+exit:
+   free(mountpoint);
+#endif
+   fuse_opt_free_args(args);
+   return res != 0 ? 1 : 0;
+}
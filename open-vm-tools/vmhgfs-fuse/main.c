@@ -26,6 +26,7 @@
 #include "cache.h"
 #include "filesystem.h"
 #include "file.h"
+#include "lowlevel.h"
 
 /*
  *----------------------------------------------------------------------
@@ -129,8 +130,8 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
-   uint32 d_type;
    char *abspath = NULL;
+   uint64 start = HgfsStatsStart();
    int res;
 
    LOG(4, ("Entry(path = %s)\n", path));
@@ -141,12 +142,16 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
+      uint32 negGen = HgfsGetNegativeCacheGen(abspath);
+
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(abspath, negGen);
       }
    }
 
@@ -156,61 +161,10 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
 
    LOG(4, ("fill stat for %s\n", abspath));
 
-   memset(stbuf, 0, sizeof *stbuf);
-
-   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
-      stbuf->st_mode |= (attr->specialPerms << 9);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
-      stbuf->st_mode |= (attr->ownerPerms << 6);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
-      stbuf->st_mode |= (attr->groupPerms << 3);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
-      stbuf->st_mode |= (attr->otherPerms);
-   }
-
-   /* Mask the access mode. */
-   switch (attr->type) {
-   case HGFS_FILE_TYPE_SYMLINK:
-      d_type = DT_LNK;
-      break;
-
-   case HGFS_FILE_TYPE_REGULAR:
-      d_type = DT_REG;
-      break;
-
-   case HGFS_FILE_TYPE_DIRECTORY:
-      d_type = DT_DIR;
-      break;
-
-   default:
-      d_type = DT_UNKNOWN;
-      break;
-   }
-
-   stbuf->st_mode |= d_type << 12;
-   stbuf->st_blksize = HGFS_BLOCKSIZE;
-   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
-   stbuf->st_size = attr->size;
-   stbuf->st_ino = attr->hostFileId;
-   stbuf->st_nlink = 1;
-   stbuf->st_uid = attr->userId;
-   stbuf->st_gid = attr->groupId;
-   stbuf->st_rdev = 0;
-
-   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
-      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
-      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
-      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
-   }
+   HgfsAttrToStat(attr, stbuf);
 
 exit:
+   HgfsStatsEnd(HGFS_STAT_GETATTR, start, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -250,14 +204,18 @@ hgfs_access(const char *path,  //IN: Path to a file.
       goto exit;
    }
 
-   res = HgfsGetAttrCache(path, attr);
+   res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
+      uint32 negGen = HgfsGetNegativeCacheGen(abspath);
+
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(abspath, negGen);
       }
    }
 
@@ -388,6 +346,7 @@ hgfs_readdir(const char *path,          //IN: path to a directory
    char *abspath = NULL;
    int res = 0;
    HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
+   uint64 start = HgfsStatsStart();
 
    LOG(4, ("Entry(path = %s, @ %#"FMT64"x)\n", path, offset));
    res = getAbsPath(path, &abspath);
@@ -401,9 +360,10 @@ hgfs_readdir(const char *path,          //IN: path to a directory
    }
 
    fi->fh = fileHandle;
-   res = HgfsReaddir(fileHandle, buf, filler);
+   res = HgfsReaddir(abspath, fileHandle, buf, filler);
 
 exit:
+   HgfsStatsEnd(HGFS_STAT_READDIR, start, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -952,12 +912,16 @@ hgfs_utimens(const char *path,              //IN: path to a file
 
    res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
+   if (res != 0 && res != -ENOENT) {
+      uint32 negGen = HgfsGetNegativeCacheGen(abspath);
+
       /* Retrieve new complete attribute settings and update the cache. */
       res = HgfsPrivateGetattr(fileHandle, abspath, attr);
       LOG(4, ("Retrieve attr from server. result = %d \n", res));
       if (res == 0 ) {
          HgfsSetAttrCache(abspath, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeCache(abspath, negGen);
       }
    }
 
@@ -1028,6 +992,7 @@ hgfs_open(const char *path,          //IN: path to a file
           struct fuse_file_info *fi) //IN: file info structure
 {
    char *abspath = NULL;
+   uint64 start = HgfsStatsStart();
    int res;
 
    LOG(4, ("Entry(path = %s)\n", path));
@@ -1039,6 +1004,7 @@ hgfs_open(const char *path,          //IN: path to a file
    res = HgfsOpen(abspath, fi);
 
 exit:
+   HgfsStatsEnd(HGFS_STAT_OPEN, start, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1067,6 +1033,7 @@ hgfs_create(const char *path,          //IN: path to a file
             struct fuse_file_info *fi) //IN: file info structure
 {
    char *abspath = NULL;
+   uint64 start = HgfsStatsStart();
    int res;
 
    LOG(4, ("Entry(path = %s, mode = %#o)\n", path, mode));
@@ -1078,6 +1045,7 @@ hgfs_create(const char *path,          //IN: path to a file
    res = HgfsCreate(abspath, mode, fi);
 
 exit:
+   HgfsStatsEnd(HGFS_STAT_OPEN, start, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1109,6 +1077,7 @@ hgfs_read(const char *path,          //IN: path to a file
           struct fuse_file_info *fi) //IN: file info structure
 {
    char *abspath = NULL;
+   uint64 start = HgfsStatsStart();
    int res;
 
    LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x, %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
@@ -1124,9 +1093,10 @@ hgfs_read(const char *path,          //IN: path to a file
          goto exit;
       }
    }
-   res = HgfsRead(fi, buf, size, offset);
+   res = HgfsRead(abspath, fi, buf, size, offset);
 
 exit:
+   HgfsStatsEnd(HGFS_STAT_READ, start, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1158,6 +1128,7 @@ hgfs_write(const char *path,          //IN: path to a file
            struct fuse_file_info *fi) //IN: file info structure
 {
    char *abspath = NULL;
+   uint64 start = HgfsStatsStart();
    int res;
 
    LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x, write %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
@@ -1174,7 +1145,7 @@ hgfs_write(const char *path,          //IN: path to a file
       }
    }
 
-   res = HgfsWrite(fi, buf, size, offset);
+   res = HgfsWriteBuffered(fi, abspath, buf, size, offset);
    if (res >= 0) {
       /*
        * Positive result indicates the number of bytes written.
@@ -1185,6 +1156,7 @@ hgfs_write(const char *path,          //IN: path to a file
    }
 
 exit:
+   HgfsStatsEnd(HGFS_STAT_WRITE, start, res);
    LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
    return res;
@@ -1236,7 +1208,8 @@ exit:
  *    Release a file.
  *
  * Results:
- *    Returns zero.
+ *    Returns zero on success, or a negative error if buffered writes
+ *    could not be flushed or the handle could not be closed.
  *
  * Side effects:
  *    None
@@ -1263,9 +1236,69 @@ hgfs_release(const char *path,                //IN: path to a file
    }
 
 exit:
-   LOG(4, ("Exit(0)\n"));
+   LOG(4, ("Exit(%d)\n", res));
    freeAbsPath(abspath);
-   return 0;
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_flush
+ *
+ *    Called on each close of a file descriptor. Writes out buffered data.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_flush(const char *path,                //IN: path to a file
+           struct fuse_file_info *fi)       //IN: file info structure
+{
+   int res;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+   res = HgfsWriteBackFlush(fi->fh);
+   LOG(4, ("Exit(%d)\n", res));
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_fsync
+ *
+ *    Synchronize a file. Only the write-back buffer needs writing out,
+ *    the host does not expose a sync of its own.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_fsync(const char *path,                //IN: path to a file
+           int datasync,                    //IN: only sync data
+           struct fuse_file_info *fi)       //IN: file info structure
+{
+   int res;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+   res = HgfsWriteBackFlush(fi->fh);
+   LOG(4, ("Exit(%d)\n", res));
+   return res;
 }
 
 
@@ -1294,27 +1327,8 @@ static void*
 hgfs_init(struct fuse_conn_info *conn) // IN: unused
 #endif
 {
-   pthread_t purgeCacheThread;
-   int dummy;
-   int res;
-
    LOG(4, ("Entry()\n"));
-
-   /*
-    * dummy argument is required for Solaris and FreeBSD while creating
-    * thread otherwise the program crashes.
-    */
-   res = pthread_create(&purgeCacheThread, NULL,
-                        HgfsPurgeCache, &dummy);
-   if (res < 0) {
-      LOG(4, ("Pthread create fail. error = %d\n", res));
-   }
-
-   res = HgfsCreateSession();
-   if (res < 0) {
-      LOG(4, ("Create session failed. error = %d\n", res));
-   }
-
+   HgfsMountInit();
    LOG(4, ("Exit(NULL)\n"));
    return NULL;
 }
@@ -1339,24 +1353,8 @@ hgfs_init(struct fuse_conn_info *conn) // IN: unused
 static void
 hgfs_destroy(void *data) // IN: unused
 {
-   int res;
-
    LOG(4, ("Entry()\n"));
-
-   res = HgfsDestroySession();
-   if (res < 0) {
-      LOG(4, ("Destroy session failed. error = %d\n", res));
-   }
-
-   HgfsTransportExit();
-
-   free(gState->basePath);
-
-   if (gState->conf != NULL) {
-      g_key_file_free(gState->conf);
-      gState->conf = NULL;
-   }
-
+   HgfsMountExit();
    LOG(4, ("Exit()\n"));
 }
 
@@ -1383,6 +1381,8 @@ static struct fuse_operations vmhgfs_operations = {
    .write       = hgfs_write,
    .statfs      = hgfs_statfs,
    .release     = hgfs_release,
+   .flush       = hgfs_flush,
+   .fsync       = hgfs_fsync,
    .create      = hgfs_create,
    .init        = hgfs_init,
    .destroy     = hgfs_destroy,
@@ -1428,6 +1428,9 @@ main(int argc,       //IN: Argument count
    }
    HgfsInitCache();
 
+   if (gState->lowLevel) {
+      return HgfsLowLevelMain(&args);
+   }
    return fuse_main(args.argc, args.argv, &vmhgfs_operations, NULL);
 }
 
@@ -70,6 +70,7 @@
 #include "transport.h"
 #include "session.h"
 #include "config.h"
+#include "stats.h"
 
 #if defined(__SOLARIS__) || defined(__APPLE__)
 #define DT_UNKNOWN      0
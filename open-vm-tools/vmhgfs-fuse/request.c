@@ -29,51 +29,276 @@
 #include "transport.h"
 #include "fsutil.h"
 #include "vm_assert.h"
+#include "vm_atomic.h"
 
-static HgfsHandle hgfsIdCounter;
-pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Requests are recycled through small per-thread caches instead of going
+ * back to malloc for every getattr or read. The caches need no locking;
+ * whatever a FUSE worker thread still holds when it exits is freed by the
+ * key destructor. Large requests carry a whole HGFS_LARGE_PACKET_MAX
+ * buffer so fewer of them are kept around.
+ */
+#define HGFS_REQ_CACHE_SMALL  8
+#define HGFS_REQ_CACHE_LARGE  2
+
+#define HGFS_REQ_SMALL_PAYLOAD_MAX  HGFS_PACKET_MAX
+#define HGFS_REQ_LARGE_PAYLOAD_MAX  HGFS_LARGE_PACKET_MAX
+
+typedef struct HgfsReqCache {
+   HgfsReq *small[HGFS_REQ_CACHE_SMALL];
+   HgfsReq *large[HGFS_REQ_CACHE_LARGE];
+   unsigned int numSmall;
+   unsigned int numLarge;
+} HgfsReqCache;
+
+static Atomic_uint32 hgfsIdCounter;
+
+static pthread_once_t hgfsReqCacheOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t hgfsReqCacheKey;
+static Bool hgfsReqCacheKeyValid;
+
+static Atomic_uint64 hgfsReqAllocated;
+static Atomic_uint64 hgfsReqReused;
+static Atomic_uint64 hgfsReqSmall;
+static Atomic_uint64 hgfsReqGrown;
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetNewRequest --
+ * HgfsReqCacheDestroy --
  *
- *    Get a new request structure off the free list and initialize it.
+ *    Thread exit destructor for the per-thread request cache.
  *
  * Results:
- *    On success the new struct is returned with all fields
- *    initialized. Returns NULL on failure.
+ *    None
  *
  * Side effects:
+ *    Frees every cached request.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqCacheDestroy(void *data)  // IN: HgfsReqCache of the exiting thread
+{
+   HgfsReqCache *cache = data;
+   unsigned int i;
+
+   for (i = 0; i < cache->numSmall; i++) {
+      free(cache->small[i]);
+   }
+   for (i = 0; i < cache->numLarge; i++) {
+      free(cache->large[i]);
+   }
+   free(cache);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqCacheInit --
+ *
+ *    Create the thread specific key for the request caches. Called once.
+ *
+ * Results:
  *    None
  *
+ * Side effects:
+ *    Without the key every request goes straight to malloc and free.
+ *
  *----------------------------------------------------------------------
  */
 
-HgfsReq *
-HgfsGetNewRequest(void)
+static void
+HgfsReqCacheInit(void)
 {
-   HgfsReq *req = (HgfsReq*) malloc(sizeof(HgfsReq));
-   if (req == NULL) {
-      LOG(4, ("Can't allocate memory.\n"));
+   hgfsReqCacheKeyValid =
+      pthread_key_create(&hgfsReqCacheKey, HgfsReqCacheDestroy) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqCacheGet --
+ *
+ *    Return the request cache of the calling thread, creating it if needed.
+ *
+ * Results:
+ *    The cache, or NULL if it could not be set up.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReqCache *
+HgfsReqCacheGet(void)
+{
+   HgfsReqCache *cache;
+
+   pthread_once(&hgfsReqCacheOnce, HgfsReqCacheInit);
+   if (!hgfsReqCacheKeyValid) {
       return NULL;
    }
+
+   cache = pthread_getspecific(hgfsReqCacheKey);
+   if (cache == NULL) {
+      cache = calloc(1, sizeof *cache);
+      if (cache != NULL &&
+          pthread_setspecific(hgfsReqCacheKey, cache) != 0) {
+         free(cache);
+         cache = NULL;
+      }
+   }
+   return cache;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAllocRequest --
+ *
+ *    Get a request with a small or large packet, from the calling thread's
+ *    cache if it has one, otherwise from malloc, and initialize it.
+ *
+ * Results:
+ *    The request, or NULL on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReq *
+HgfsAllocRequest(Bool small)  // IN: Small packet wanted
+{
+   HgfsReqCache *cache = HgfsReqCacheGet();
+   size_t payloadMax = small ? HGFS_REQ_SMALL_PAYLOAD_MAX :
+                               HGFS_REQ_LARGE_PAYLOAD_MAX;
+   HgfsReq *req = NULL;
+
+   if (cache != NULL) {
+      if (small && cache->numSmall > 0) {
+         req = cache->small[--cache->numSmall];
+      } else if (!small && cache->numLarge > 0) {
+         req = cache->large[--cache->numLarge];
+      }
+   }
+
+   if (req != NULL) {
+      Atomic_Inc64(&hgfsReqReused);
+   } else {
+      req = malloc(sizeof *req + HGFS_CLIENT_CMD_LEN + payloadMax);
+      if (req == NULL) {
+         LOG(4, ("Can't allocate memory.\n"));
+         return NULL;
+      }
+      Atomic_Inc64(&hgfsReqAllocated);
+   }
+   if (small) {
+      Atomic_Inc64(&hgfsReqSmall);
+   }
+
    INIT_LIST_HEAD(&req->list);
    req->payloadSize = 0;
+   req->payloadMax = payloadMax;
+   req->small = small;
+   req->packet = (char *)(req + 1);
    req->state = HGFS_REQ_STATE_ALLOCATED;
    /* Setup the packet prefix. */
    memcpy(req->packet, HGFS_SYNC_REQREP_CLIENT_CMD,
           HGFS_SYNC_REQREP_CLIENT_CMD_LEN);
-   pthread_mutex_lock(&hgfsIdLock);
-   req->id = hgfsIdCounter;
-   hgfsIdCounter++;
-   pthread_mutex_unlock(&hgfsIdLock);
+   req->id = Atomic_ReadInc32(&hgfsIdCounter);
 
    return req;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetNewRequest --
+ *
+ *    Get a new request structure off the free list and initialize it.
+ *    The packet has room for HGFS_LARGE_PACKET_MAX bytes of payload.
+ *
+ * Results:
+ *    On success the new struct is returned with all fields
+ *    initialized. Returns NULL on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsReq *
+HgfsGetNewRequest(void)
+{
+   return HgfsAllocRequest(FALSE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetNewSmallRequest --
+ *
+ *    Get a new request for a metadata operation whose request carries at
+ *    most a name of nameLen bytes. Such requests get a packet of
+ *    HGFS_PACKET_MAX bytes rather than a large one; a reply that does not
+ *    fit is moved to a large packet by HgfsCompleteReq.
+ *
+ * Results:
+ *    On success the new struct is returned with all fields
+ *    initialized. Returns NULL on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsReq *
+HgfsGetNewSmallRequest(size_t nameLen)  // IN: Longest name in the request
+{
+   return HgfsAllocRequest(nameLen <= HGFS_REQ_SMALL_NAME_MAX);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetRequestStats --
+ *
+ *    Report how many requests were allocated and how many were served
+ *    from the per-thread caches instead.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetRequestStats(HgfsReqStats *stats)  // OUT: Counters
+{
+   stats->allocated = Atomic_Read64(&hgfsReqAllocated);
+   stats->reused = Atomic_Read64(&hgfsReqReused);
+   stats->small = Atomic_Read64(&hgfsReqSmall);
+   stats->grown = Atomic_Read64(&hgfsReqGrown);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -310,6 +535,7 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 
    ASSERT(req);
    ASSERT(req->payloadSize <= HgfsLargePacketMax(FALSE));
+   ASSERT(req->payloadSize <= req->payloadMax);
 
    req->state = HGFS_REQ_STATE_UNSENT;
 
@@ -329,7 +555,8 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
  *
  * HgfsFreeRequest --
  *
- *    Free an HGFS request.
+ *    Free an HGFS request, or keep it in the calling thread's cache for
+ *    reuse.
  *
  * Results:
  *    None
@@ -343,6 +570,29 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 void
 HgfsFreeRequest(HgfsReq *req) // IN: Request to free
 {
+   HgfsReqCache *cache;
+
+   if (req == NULL) {
+      return;
+   }
+
+   if (req->packet != (char *)(req + 1)) {
+      /* The reply outgrew the small packet. */
+      free(req->packet);
+      req->packet = (char *)(req + 1);
+   }
+
+   cache = HgfsReqCacheGet();
+   if (cache != NULL) {
+      if (req->small && cache->numSmall < HGFS_REQ_CACHE_SMALL) {
+         cache->small[cache->numSmall++] = req;
+         return;
+      }
+      if (!req->small && cache->numLarge < HGFS_REQ_CACHE_LARGE) {
+         cache->large[cache->numLarge++] = req;
+         return;
+      }
+   }
    free(req);
 }
 
@@ -417,7 +667,9 @@ out:
  * HgfsCompleteReq --
  *
  *    Copies the reply packet into the request structure and wakes up
- *    the associated client.
+ *    the associated client. A small request is given a large packet if
+ *    the reply does not fit. Taking the request off the pending table is
+ *    left to the transport.
  *
  * Results:
  *    None
@@ -437,10 +689,25 @@ HgfsCompleteReq(HgfsReq *req,       // IN: Request
    ASSERT(reply);
    ASSERT(replySize <= HgfsLargePacketMax(FALSE));
 
+   if (replySize > req->payloadMax) {
+      char *packet = malloc(HGFS_CLIENT_CMD_LEN + HGFS_REQ_LARGE_PAYLOAD_MAX);
+
+      if (packet == NULL) {
+         /* Looks like a malformed reply to the caller. */
+         LOG(4, ("Can't allocate memory for a %"FMTSZ"u byte reply.\n",
+                 replySize));
+         replySize = 0;
+      } else {
+         LOG(4, ("Reply of %"FMTSZ"u bytes moved to a large packet.\n",
+                 replySize));
+         memcpy(packet, req->packet, HGFS_CLIENT_CMD_LEN);
+         req->packet = packet;
+         req->payloadMax = HGFS_REQ_LARGE_PAYLOAD_MAX;
+         Atomic_Inc64(&hgfsReqGrown);
+      }
+   }
+
    memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
    req->payloadSize = replySize;
    req->state = HGFS_REQ_STATE_COMPLETED;
-   if (!list_empty(&req->list)) {
-      list_del_init(&req->list);
-   }
 }
@@ -103,15 +103,39 @@ typedef struct HgfsReq {
    /* Total size of the payload.*/
    size_t payloadSize;
 
+   /* Room in the packet for the payload, excluding the command prefix. */
+   size_t payloadMax;
+
+   /* Which pool the request came from and goes back to. */
+   Bool small;
+
    /*
     * Packet of data, for both incoming and outgoing messages.
-    * Include room for the command.
+    * Include room for the command. Points at the buffer allocated right
+    * after the request, unless a reply outgrew a small request.
     */
-   char packet[HGFS_LARGE_PACKET_MAX + HGFS_CLIENT_CMD_LEN];
+   char *packet;
 } HgfsReq;
 
+/*
+ * Small requests only carry HGFS_PACKET_MAX bytes of payload, which is
+ * plenty for the metadata operations that use them. A request whose
+ * name is longer than HGFS_REQ_SMALL_NAME_MAX gets a large packet.
+ */
+#define HGFS_REQ_SMALL_NAME_MAX (HGFS_PACKET_MAX - 512)
+
+/* Request pool counters. */
+typedef struct HgfsReqStats {
+   uint64 allocated;     /* Requests malloc'ed. */
+   uint64 reused;        /* Requests taken from a pool instead. */
+   uint64 small;         /* Requests handed out with a small packet. */
+   uint64 grown;         /* Small requests whose reply needed a large one. */
+} HgfsReqStats;
+
 /* Public functions (with respect to the entire module). */
 HgfsReq *HgfsGetNewRequest(void);
+HgfsReq *HgfsGetNewSmallRequest(size_t nameLen);
+void HgfsGetRequestStats(HgfsReqStats *stats);
 HgfsStatus HgfsPackHeader(HgfsReq *req, HgfsOp opUsed);
 HgfsStatus HgfsUnpackHeader(void *serverReply,
 			    size_t replySize,
@@ -0,0 +1,507 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * stats.c --
+ *
+ * Per-operation counters and latency histograms for the vmhgfs driver.
+ *
+ * Collection is off unless the filesystem is mounted with "-o stats". The
+ * FUSE operations are timed from entry to return, and each request sent to
+ * the host is timed twice more: once for the wait to get a transport
+ * channel and once for the round trip itself. Comparing an operation with
+ * the host time behind it tells host latency apart from client overhead.
+ *
+ * A report is written whenever the process receives SIGUSR1 and again at
+ * unmount, to the file named by "-o stats_file=PATH" or to stderr.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <time.h>
+#include "module.h"
+#include "stats.h"
+#include "vm_atomic.h"
+#include "vm_basic_asm.h"
+
+typedef struct HgfsStatOpData {
+   Atomic_uint64 count;
+   Atomic_uint64 errors;
+   Atomic_uint64 totalUs;
+   Atomic_uint64 maxUs;
+   Atomic_uint64 buckets[HGFS_STAT_BUCKETS];
+} HgfsStatOpData;
+
+static const char *hgfsStatOpNames[HGFS_STAT_OP_MAX] = {
+   "open",
+   "getattr",
+   "readdir",
+   "read",
+   "write",
+   "channel wait",
+   "host",
+};
+
+static const char *hgfsStatCounterNames[HGFS_STAT_COUNTER_MAX] = {
+   "attr cache hit",
+   "attr cache miss",
+   "negative cache hit",
+};
+
+static HgfsStatOpData hgfsStatOps[HGFS_STAT_OP_MAX];
+static Atomic_uint64 hgfsStatCounters[HGFS_STAT_COUNTER_MAX];
+static uint64 hgfsStatsStartTime;
+
+/* Wakes the report thread, posted from the SIGUSR1 handler. */
+static sem_t hgfsStatsSem;
+static pthread_t hgfsStatsThread;
+static Bool hgfsStatsThreadRunning = FALSE;
+static Atomic_uint32 hgfsStatsExiting;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsNow --
+ *
+ *    Read the monotonic clock.
+ *
+ * Results:
+ *    Current time in nanoseconds, never zero.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint64
+HgfsStatsNow(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * CONST64U(1000000000) + ts.tv_nsec + 1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsStart --
+ *
+ *    Take the start time of an operation to be passed to HgfsStatsEnd.
+ *
+ * Results:
+ *    Start time, or zero if statistics are not being collected.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+uint64
+HgfsStatsStart(void)
+{
+   return gState->stats ? HgfsStatsNow() : 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsEnd --
+ *
+ *    Account one completed operation in its counters and histogram.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsEnd(HgfsStatOp op,   // IN: Operation that completed
+             uint64 start,    // IN: Value returned by HgfsStatsStart
+             int result)      // IN: Operation result, negative on error
+{
+   HgfsStatOpData *data;
+   uint64 elapsedUs;
+   uint64 maxUs;
+   int bucket;
+
+   if (start == 0) {
+      return;
+   }
+
+   ASSERT(op < HGFS_STAT_OP_MAX);
+   data = &hgfsStatOps[op];
+   elapsedUs = (HgfsStatsNow() - start) / 1000;
+
+   bucket = mssb64_0(elapsedUs);
+   if (bucket < 0) {
+      bucket = 0;
+   } else if (bucket >= HGFS_STAT_BUCKETS) {
+      bucket = HGFS_STAT_BUCKETS - 1;
+   }
+
+   Atomic_Inc64(&data->count);
+   if (result < 0) {
+      Atomic_Inc64(&data->errors);
+   }
+   Atomic_Add64(&data->totalUs, elapsedUs);
+   Atomic_Inc64(&data->buckets[bucket]);
+
+   maxUs = Atomic_Read64(&data->maxUs);
+   while (elapsedUs > maxUs) {
+      uint64 prev = Atomic_ReadIfEqualWrite64(&data->maxUs, maxUs, elapsedUs);
+
+      if (prev == maxUs) {
+         break;
+      }
+      maxUs = prev;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsCount --
+ *
+ *    Bump an event counter.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsCount(HgfsStatCounter counter) // IN: Counter to bump
+{
+   ASSERT(counter < HGFS_STAT_COUNTER_MAX);
+   if (gState->stats) {
+      Atomic_Inc64(&hgfsStatCounters[counter]);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsPercentile --
+ *
+ *    Estimate a latency percentile from a histogram snapshot.
+ *
+ * Results:
+ *    Upper bound in microseconds of the bucket holding the percentile.
+ *    For the last bucket, which has no bound, the maximum seen.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint64
+HgfsStatsPercentile(const uint64 *buckets,  // IN: Histogram snapshot
+                    uint64 count,           // IN: Sum of the buckets
+                    uint32 percent,         // IN: Percentile wanted
+                    uint64 maxUs)           // IN: Largest sample
+{
+   uint64 want = (count * percent + 99) / 100;
+   uint64 seen = 0;
+   int i;
+
+   for (i = 0; i < HGFS_STAT_BUCKETS - 1; i++) {
+      seen += buckets[i];
+      if (seen >= want) {
+         return MIN(CONST64U(1) << (i + 1), maxUs);
+      }
+   }
+   return maxUs;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsDump --
+ *
+ *    Write a report of everything collected so far. Counters are read
+ *    one at a time while operations keep running, so the figures of a
+ *    busy mount can be off from each other by a few operations.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsDump(FILE *out)   // IN: Stream to write to
+{
+   int op;
+   int i;
+
+   fprintf(out, "vmhgfs-fuse statistics after %"FMT64"u seconds "
+           "(latencies in microseconds)\n",
+           (HgfsStatsNow() - hgfsStatsStartTime) / CONST64U(1000000000));
+   fprintf(out, "%-14s %10s %8s %8s %8s %8s %8s %10s\n",
+           "operation", "count", "errors", "avg", "p50", "p90", "p99", "max");
+
+   for (op = 0; op < HGFS_STAT_OP_MAX; op++) {
+      HgfsStatOpData *data = &hgfsStatOps[op];
+      uint64 buckets[HGFS_STAT_BUCKETS];
+      uint64 count = 0;
+      uint64 maxUs = Atomic_Read64(&data->maxUs);
+
+      for (i = 0; i < HGFS_STAT_BUCKETS; i++) {
+         buckets[i] = Atomic_Read64(&data->buckets[i]);
+         count += buckets[i];
+      }
+      if (count == 0) {
+         continue;
+      }
+
+      fprintf(out, "%-14s %10"FMT64"u %8"FMT64"u %8"FMT64"u %8"FMT64"u "
+              "%8"FMT64"u %8"FMT64"u %10"FMT64"u\n",
+              hgfsStatOpNames[op], count, Atomic_Read64(&data->errors),
+              Atomic_Read64(&data->totalUs) / count,
+              HgfsStatsPercentile(buckets, count, 50, maxUs),
+              HgfsStatsPercentile(buckets, count, 90, maxUs),
+              HgfsStatsPercentile(buckets, count, 99, maxUs),
+              maxUs);
+
+      fprintf(out, "%14s", "");
+      for (i = 0; i < HGFS_STAT_BUCKETS; i++) {
+         if (buckets[i] != 0) {
+            fprintf(out, " %s%"FMT64"u:%"FMT64"u",
+                    i == HGFS_STAT_BUCKETS - 1 ? ">=" : "<",
+                    CONST64U(1) << (i == HGFS_STAT_BUCKETS - 1 ? i : i + 1),
+                    buckets[i]);
+         }
+      }
+      fprintf(out, "\n");
+   }
+
+   for (i = 0; i < HGFS_STAT_COUNTER_MAX; i++) {
+      fprintf(out, "%-20s %10"FMT64"u\n", hgfsStatCounterNames[i],
+              Atomic_Read64(&hgfsStatCounters[i]));
+   }
+   fflush(out);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsReport --
+ *
+ *    Append a report to the configured statistics file, or stderr.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsStatsReport(void)
+{
+   FILE *out = stderr;
+
+   if (gState->statsFile != NULL) {
+      out = fopen(gState->statsFile, "a");
+      if (out == NULL) {
+         LOG(4, ("Cannot open %s, error = %d\n", gState->statsFile, errno));
+         return;
+      }
+   }
+
+   HgfsStatsDump(out);
+
+   if (out != stderr) {
+      fclose(out);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsSignal --
+ *
+ *    SIGUSR1 handler. Only wakes the report thread, as formatting the
+ *    report is not safe in signal context.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsStatsSignal(int sig)   // IN: Unused
+{
+   int savedErrno = errno;
+
+   sem_post(&hgfsStatsSem);
+   errno = savedErrno;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsThread --
+ *
+ *    Write a report each time SIGUSR1 is received, until HgfsStatsExit.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+HgfsStatsThread(void *unused)   // IN: Thread argument
+{
+   while (1) {
+      if (sem_wait(&hgfsStatsSem) != 0) {
+         continue;
+      }
+      if (Atomic_Read32(&hgfsStatsExiting)) {
+         break;
+      }
+      HgfsStatsReport();
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsInit --
+ *
+ *    Start collecting statistics if enabled, and install the SIGUSR1
+ *    handler that reports them. Called at mount time, after FUSE has
+ *    daemonized.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Starts the report thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsInit(void)
+{
+   struct sigaction sa;
+   int res;
+
+   if (!gState->stats) {
+      return;
+   }
+
+   hgfsStatsStartTime = HgfsStatsNow();
+   Atomic_Write32(&hgfsStatsExiting, FALSE);
+
+   if (sem_init(&hgfsStatsSem, 0, 0) != 0) {
+      LOG(4, ("Semaphore init fail. error = %d\n", errno));
+      return;
+   }
+
+   res = pthread_create(&hgfsStatsThread, NULL, HgfsStatsThread, NULL);
+   if (res != 0) {
+      LOG(4, ("Pthread create fail. error = %d\n", res));
+      sem_destroy(&hgfsStatsSem);
+      return;
+   }
+   hgfsStatsThreadRunning = TRUE;
+
+   memset(&sa, 0, sizeof sa);
+   sa.sa_handler = HgfsStatsSignal;
+   sa.sa_flags = SA_RESTART;
+   sigemptyset(&sa.sa_mask);
+   if (sigaction(SIGUSR1, &sa, NULL) != 0) {
+      LOG(4, ("Cannot install SIGUSR1 handler. error = %d\n", errno));
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsStatsExit --
+ *
+ *    Write the final report and stop the report thread.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    SIGUSR1 is ignored from now on.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsStatsExit(void)
+{
+   if (!gState->stats) {
+      return;
+   }
+
+   if (hgfsStatsThreadRunning) {
+      signal(SIGUSR1, SIG_IGN);
+      Atomic_Write32(&hgfsStatsExiting, TRUE);
+      sem_post(&hgfsStatsSem);
+      pthread_join(hgfsStatsThread, NULL);
+      sem_destroy(&hgfsStatsSem);
+      hgfsStatsThreadRunning = FALSE;
+   }
+
+   HgfsStatsReport();
+}
@@ -0,0 +1,65 @@
+/*********************************************************
+ * Copyright (C) 2021 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * stats.h --
+ *
+ * Per-operation counters and latency histograms for the vmhgfs driver.
+ */
+
+#ifndef _HGFS_DRIVER_STATS_H_
+#define _HGFS_DRIVER_STATS_H_
+
+#include <stdio.h>
+#include "vm_basic_types.h"
+
+/* Timed operations. Keep in sync with hgfsStatOpNames in stats.c. */
+typedef enum {
+   HGFS_STAT_OPEN,
+   HGFS_STAT_GETATTR,
+   HGFS_STAT_READDIR,
+   HGFS_STAT_READ,
+   HGFS_STAT_WRITE,
+   HGFS_STAT_CHANNEL_WAIT,   /* Waiting for a free transport channel. */
+   HGFS_STAT_HOST,           /* Request sent until its reply arrived. */
+   HGFS_STAT_OP_MAX
+} HgfsStatOp;
+
+/* Plain event counters. Keep in sync with hgfsStatCounterNames. */
+typedef enum {
+   HGFS_STAT_CACHE_HIT,
+   HGFS_STAT_CACHE_MISS,
+   HGFS_STAT_CACHE_NEGATIVE_HIT,
+   HGFS_STAT_COUNTER_MAX
+} HgfsStatCounter;
+
+/*
+ * Histogram bucket i counts operations that took [2^i, 2^(i+1))
+ * microseconds, except the first also takes anything faster and the
+ * last anything slower.
+ */
+#define HGFS_STAT_BUCKETS 24
+
+void HgfsStatsInit(void);
+void HgfsStatsExit(void);
+uint64 HgfsStatsStart(void);
+void HgfsStatsEnd(HgfsStatOp op, uint64 start, int result);
+void HgfsStatsCount(HgfsStatCounter counter);
+void HgfsStatsDump(FILE *out);
+
+#endif // _HGFS_DRIVER_STATS_H_
@@ -24,9 +24,17 @@
  * actual transport channels (backdoor, tcp, vsock, ...).
  *
  * The sends happen in the process context, where as a thread
- * handles the asynchronous replies. A queue of pending replies is
- * maintained and is protected by a lock. The channel opens and close
- * is protected by a mutex.
+ * handles the asynchronous replies. A table of pending replies, hashed
+ * by request id, is maintained and each of its buckets is protected by
+ * a lock.
+ *
+ * Up to gState->numChannels channels are used side by side, each with a
+ * mutex protecting its open, close and sends. A request goes out on the
+ * first idle channel, starting the search at a different channel each
+ * time, so that a getattr is not queued behind a large read on another
+ * FUSE thread. Only the first channel is opened up front, the others
+ * when there is contention for them. A channel that cannot be opened is
+ * not tried again and its requests use the first channel instead.
  */
 
 
@@ -37,17 +45,32 @@
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
+#include "vm_atomic.h"
 
-static HgfsTransportChannel *gHgfsActiveChannel;     /* Current active channel. */
-static pthread_mutex_t gHgfsActiveChannelLock;       /* Current active channel lock. */
-static Bool gHgfsActiveChannelLockInited;
+#define HGFS_PENDING_BUCKETS 64
 
-static struct list_head gHgfsPendingRequests;        /* Pending requests queue. */
-static pthread_mutex_t gHgfsPendingRequestsLock;     /* Pending requests queue lock. */
-static Bool gHgfsPendingRequestsLockInited;
+typedef struct HgfsTransportSlot {
+   HgfsTransportChannel *channel;    /* NULL until opened. */
+   pthread_mutex_t lock;             /* Protects this slot and its sends. */
+   Bool failed;                      /* The channel could not be opened. */
+} HgfsTransportSlot;
+
+typedef struct HgfsPendingBucket {
+   pthread_mutex_t lock;
+   struct list_head requests;
+} HgfsPendingBucket;
+
+static HgfsTransportSlot gHgfsChannels[HGFS_CHANNELS_LIMIT];
+static uint32 gHgfsNumChannels;                      /* Slots initialized. */
+static Atomic_uint32 gHgfsNextChannel;               /* Round-robin start. */
+
+static HgfsPendingBucket gHgfsPendingRequests[HGFS_PENDING_BUCKETS];
+static uint32 gHgfsPendingBucketsInited;
 
 
 #define HgfsRequestId(req) ((HgfsRequest *)req)->id
+#define HgfsPendingBucketOf(id) \
+   (&gHgfsPendingRequests[(id) & (HGFS_PENDING_BUCKETS - 1)])
 
 static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
 
@@ -84,6 +107,8 @@ HgfsTransportChannelOpen(HgfsTransportChannel **channel) // IN: active channel
          result = -ENOTCONN;
          *channel = NULL;
       }
+   } else {
+      result = -ENOTCONN;
    }
 
    return result;
@@ -158,7 +183,7 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
  *
  * HgfsTransportEnqueueRequest --
  *
- *     Add the request to the gHgfsPendingRequests queue.
+ *     Add the request to the gHgfsPendingRequests table.
  *
  *
  * Side effects:
@@ -170,11 +195,14 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
 static void
 HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
 {
+   HgfsPendingBucket *bucket;
+
    ASSERT(req);
 
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_add_tail(&req->list, &gHgfsPendingRequests);
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   bucket = HgfsPendingBucketOf(req->id);
+   pthread_mutex_lock(&bucket->lock);
+   list_add_tail(&req->list, &bucket->requests);
+   pthread_mutex_unlock(&bucket->lock);
 }
 
 
@@ -183,7 +211,7 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
  *
  * HgfsTransportDequeueRequest --
  *
- *     Removes the request from the gHgfsPendingRequests queue.
+ *     Removes the request from the gHgfsPendingRequests table.
  *
  * Results:
  *     None
@@ -197,13 +225,61 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
 static void
 HgfsTransportDequeueRequest(HgfsReq *req)   // IN: Request to dequeue
 {
+   HgfsPendingBucket *bucket;
+
    ASSERT(req);
 
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
+   bucket = HgfsPendingBucketOf(req->id);
+   pthread_mutex_lock(&bucket->lock);
    if (!list_empty(&req->list)) {
       list_del_init(&req->list);
    }
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   pthread_mutex_unlock(&bucket->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportLockSlot --
+ *
+ *     Pick a channel slot for a request and lock it. Idle slots are
+ *     preferred; when all are busy the caller waits for one.
+ *
+ * Results:
+ *     The locked slot.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsTransportSlot *
+HgfsTransportLockSlot(void)
+{
+   uint32 start = Atomic_ReadInc32(&gHgfsNextChannel) % gHgfsNumChannels;
+   HgfsTransportSlot *slot;
+   uint32 i;
+
+   for (i = 0; i < gHgfsNumChannels; i++) {
+      slot = &gHgfsChannels[(start + i) % gHgfsNumChannels];
+      if (pthread_mutex_trylock(&slot->lock) == 0) {
+         if (!slot->failed) {
+            return slot;
+         }
+         pthread_mutex_unlock(&slot->lock);
+      }
+   }
+
+   slot = &gHgfsChannels[start];
+   pthread_mutex_lock(&slot->lock);
+   if (slot->failed) {
+      pthread_mutex_unlock(&slot->lock);
+      slot = &gHgfsChannels[0];
+      pthread_mutex_lock(&slot->lock);
+   }
+   return slot;
 }
 
 
@@ -233,6 +309,7 @@ HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
                            size_t receivedSize)     //IN: packet size
 {
    struct list_head *cur, *next;
+   HgfsPendingBucket *bucket;
    HgfsHandle id;
    Bool found = FALSE;
 
@@ -243,21 +320,23 @@ HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
    LOG(8, ("Entered.\n"));
    LOG(6, ("Req id: %d\n", id));
    /*
-    * Search through gHgfsPendingRequests queue for the matching id and wake up
-    * the associated waiting process. Delete the req from the queue.
+    * Search through gHgfsPendingRequests table for the matching id and wake
+    * up the associated waiting process. Delete the req from the table.
     */
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_for_each_safe(cur, next, &gHgfsPendingRequests) {
+   bucket = HgfsPendingBucketOf(id);
+   pthread_mutex_lock(&bucket->lock);
+   list_for_each_safe(cur, next, &bucket->requests) {
       HgfsReq *req;
       req = list_entry(cur, HgfsReq, list);
       if (req->id == id) {
          ASSERT(req->state == HGFS_REQ_STATE_SUBMITTED);
+         list_del_init(&req->list);
          HgfsCompleteReq(req, receivedPacket, receivedSize);
          found = TRUE;
          break;
       }
    }
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+   pthread_mutex_unlock(&bucket->lock);
 
    if (!found) {
       LOG(4, ("No matching id, dropping reply.\n"));
@@ -287,18 +366,24 @@ void
 HgfsTransportBeforeExitingRecvThread(void)
 {
    struct list_head *cur, *next;
+   uint32 i;
 
-   /* Walk through gHgfsPendingRequests queue and reply them with error. */
-   pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_for_each_safe(cur, next, &gHgfsPendingRequests) {
-      HgfsReq *req;
-      HgfsReply reply;
+   /* Walk through gHgfsPendingRequests table and reply them with error. */
+   for (i = 0; i < HGFS_PENDING_BUCKETS; i++) {
+      HgfsPendingBucket *bucket = &gHgfsPendingRequests[i];
 
-      req = list_entry(cur, HgfsReq, list);
-      LOG(6, ("Injecting error reply to req id: %d\n", req->id));
-      HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      pthread_mutex_lock(&bucket->lock);
+      list_for_each_safe(cur, next, &bucket->requests) {
+         HgfsReq *req;
+         HgfsReply reply;
+
+         req = list_entry(cur, HgfsReq, list);
+         LOG(6, ("Injecting error reply to req id: %d\n", req->id));
+         list_del_init(&req->list);
+         HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      }
+      pthread_mutex_unlock(&bucket->lock);
    }
-   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
 }
 
 
@@ -321,42 +406,57 @@ HgfsTransportBeforeExitingRecvThread(void)
 int
 HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
 {
+   HgfsTransportSlot *slot;
+   uint64 start = HgfsStatsStart();
    int ret;
    ASSERT(req);
    ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
    ASSERT(req->payloadSize <= HgfsLargePacketMax(FALSE));
 
-   pthread_mutex_lock(&gHgfsActiveChannelLock);
+   slot = HgfsTransportLockSlot();
+   HgfsStatsEnd(HGFS_STAT_CHANNEL_WAIT, start, 0);
 
    /* Try opening the channel. */
-   if (NULL == gHgfsActiveChannel) {
-      ret = HgfsTransportChannelOpen(&gHgfsActiveChannel);
+   if (NULL == slot->channel) {
+      ret = HgfsTransportChannelOpen(&slot->channel);
+      if (ret != 0 && slot != &gHgfsChannels[0]) {
+         LOG(4, ("Cannot open channel %u, using the first one.\n",
+                 (uint32)(slot - gHgfsChannels)));
+         slot->failed = TRUE;
+         pthread_mutex_unlock(&slot->lock);
+         slot = &gHgfsChannels[0];
+         pthread_mutex_lock(&slot->lock);
+         ret = slot->channel == NULL ?
+               HgfsTransportChannelOpen(&slot->channel) : 0;
+      }
       if (ret != 0) {
          goto exit;
       }
    }
 
-   ASSERT(gHgfsActiveChannel->ops.send);
+   ASSERT(slot->channel->ops.send);
 
    HgfsTransportEnqueueRequest(req);
 
-   ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
+   start = HgfsStatsStart();
+   ret = slot->channel->ops.send(slot->channel, req);
    if (ret < 0) {
       LOG(4, ("Send failed, status = %d. Try reopening the channel ...\n",
               ret));
-      if (HgfsTransportChannelReset(&gHgfsActiveChannel)) {
-         ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
+      if (HgfsTransportChannelReset(&slot->channel)) {
+         ret = slot->channel->ops.send(slot->channel, req);
       }
    }
+   HgfsStatsEnd(HGFS_STAT_HOST, start, ret);
 
 exit:
    ASSERT(req->state == HGFS_REQ_STATE_COMPLETED ||
           req->state == HGFS_REQ_STATE_SUBMITTED ||
           req->state == HGFS_REQ_STATE_UNSENT);
 
-   pthread_mutex_unlock(&gHgfsActiveChannelLock);
+   pthread_mutex_unlock(&slot->lock);
 
-   if (ret < 0) {
+   if (ret < 0 || req->state == HGFS_REQ_STATE_COMPLETED) {
       HgfsTransportDequeueRequest(req);
    }
 
@@ -386,28 +486,46 @@ exit:
 int
 HgfsTransportInit(void)
 {
-   int res;
+   uint32 numChannels = gState->numChannels;
+   int res = 0;
 
-   gHgfsActiveChannel = NULL;
-   gHgfsPendingRequestsLockInited = FALSE;
-   gHgfsActiveChannelLockInited = FALSE;
-   INIT_LIST_HEAD(&gHgfsPendingRequests);
+   if (numChannels == 0) {
+      numChannels = 1;
+   } else if (numChannels > HGFS_CHANNELS_LIMIT) {
+      numChannels = HGFS_CHANNELS_LIMIT;
+   }
 
-   res = pthread_mutex_init(&gHgfsPendingRequestsLock, NULL);
-   if (res != 0) {
-      res = -res;
-      goto exit;
+   gHgfsNumChannels = 0;
+   gHgfsPendingBucketsInited = 0;
+   Atomic_Write32(&gHgfsNextChannel, 0);
+
+   while (gHgfsPendingBucketsInited < HGFS_PENDING_BUCKETS) {
+      HgfsPendingBucket *bucket =
+         &gHgfsPendingRequests[gHgfsPendingBucketsInited];
+
+      INIT_LIST_HEAD(&bucket->requests);
+      res = pthread_mutex_init(&bucket->lock, NULL);
+      if (res != 0) {
+         res = -res;
+         goto exit;
+      }
+      gHgfsPendingBucketsInited++;
    }
-   gHgfsPendingRequestsLockInited = TRUE;
 
-   res = pthread_mutex_init(&gHgfsActiveChannelLock, NULL);
-   if (res != 0) {
-      res = -res;
-      goto exit;
+   while (gHgfsNumChannels < numChannels) {
+      HgfsTransportSlot *slot = &gHgfsChannels[gHgfsNumChannels];
+
+      slot->channel = NULL;
+      slot->failed = FALSE;
+      res = pthread_mutex_init(&slot->lock, NULL);
+      if (res != 0) {
+         res = -res;
+         goto exit;
+      }
+      gHgfsNumChannels++;
    }
-   gHgfsActiveChannelLockInited = TRUE;
 
-   res = HgfsTransportChannelOpen(&gHgfsActiveChannel);
+   res = HgfsTransportChannelOpen(&gHgfsChannels[0].channel);
 
 exit:
    if (res != 0) {
@@ -436,22 +554,25 @@ exit:
 void
 HgfsTransportExit(void)
 {
+   uint32 i;
+
    LOG(8, ("Entered.\n"));
 
-   if (gHgfsActiveChannelLockInited) {
-      pthread_mutex_lock(&gHgfsActiveChannelLock);
-      HgfsTransportChannelClose(&gHgfsActiveChannel);
-      pthread_mutex_unlock(&gHgfsActiveChannelLock);
+   for (i = 0; i < gHgfsNumChannels; i++) {
+      HgfsTransportSlot *slot = &gHgfsChannels[i];
 
-      pthread_mutex_destroy(&gHgfsActiveChannelLock);
-      gHgfsActiveChannelLockInited = FALSE;
-   }
+      pthread_mutex_lock(&slot->lock);
+      HgfsTransportChannelClose(&slot->channel);
+      pthread_mutex_unlock(&slot->lock);
 
-   ASSERT(list_empty(&gHgfsPendingRequests));
+      pthread_mutex_destroy(&slot->lock);
+   }
+   gHgfsNumChannels = 0;
 
-   if (gHgfsPendingRequestsLockInited) {
-      pthread_mutex_destroy(&gHgfsPendingRequestsLock);
-      gHgfsPendingRequestsLockInited = FALSE;
+   for (i = 0; i < gHgfsPendingBucketsInited; i++) {
+      ASSERT(list_empty(&gHgfsPendingRequests[i].requests));
+      pthread_mutex_destroy(&gHgfsPendingRequests[i].lock);
    }
+   gHgfsPendingBucketsInited = 0;
    LOG(8, ("Exited.\n"));
 }